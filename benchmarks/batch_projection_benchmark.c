@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "orbits.h"
+#include "point_sources.h"
+#include "projection_kernels.h"
+#include "projections.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+static double center_position[3] = {0.9, 0.8, 0.01};
+static double center_velocity[3] = {-0.05, 0.05, 0.00001};
+
+#define TIME 1.0
+#define N_POINTS 100000
+#define N_ORBITS 256
+#define N_RUNS 5
+
+static const size_t thread_counts[] = {1, 2, 4, 8, 16, 32, 64};
+
+double rand_double(void) {
+  // Generate a random double in the range [0, 1).
+  return (double)rand() / RAND_MAX;
+}
+
+double rand_near(double x) {
+  // Generate a random double in the range [x - 0.1, x + 0.1).
+  return x + (rand_double() - 0.5) / 5.0;
+}
+
+void generate_point_sources(struct CartesianPointSources *cartesian, size_t n) {
+  cartesian_point_sources_new(cartesian, n);
+  for (size_t i = 0; i < n; i++) {
+    cartesian_point_sources_push(cartesian, rand_near(center_position[0]), rand_near(center_position[1]),
+                                 rand_near(center_position[2]), TIME);
+  }
+}
+
+void generate_orbits(struct CartesianOrbits *orbits, size_t n) {
+  cartesian_orbits_new(orbits, n);
+  for (size_t i = 0; i < n; i++) {
+    double pos[3] = {rand_near(center_position[0]), rand_near(center_position[1]), rand_near(center_position[2])};
+    cartesian_orbits_push(orbits, pos, center_velocity, TIME);
+  }
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Times one batch projection into gnomonic, whose N_ORBITS outputs are
+// reused across runs so that only the projection itself is measured.
+double run(struct CartesianPointSources *cartesian, struct CartesianOrbits *orbits,
+           struct GnomonicPointSources *gnomonic, struct ThreadPool *pool) {
+  double start = now();
+  cartesian_to_gnomonic_batch(cartesian, orbits, gnomonic, pool);
+  return now() - start;
+}
+
+static const size_t group_sizes[] = {1, 2, 4, 8, 16, 32, N_ORBITS};
+
+// Times the kernels alone on one thread: one pass over the detections
+// per orbit, against the multi-orbit kernel given K orbits per call,
+// so that each call reads the detections from memory once per K
+// orbits.
+void compare_kernels(struct CartesianPointSources *cartesian, struct CartesianOrbits *orbits) {
+  double(*rotations)[3][3] = malloc(N_ORBITS * sizeof(double[3][3]));
+  gnomonic_rotation_matrices(orbits->x.data, orbits->y.data, orbits->z.data, orbits->vx.data, orbits->vy.data,
+                             orbits->vz.data, N_ORBITS, rotations);
+  double **gnomonic_x = malloc(N_ORBITS * sizeof(double *));
+  double **gnomonic_y = malloc(N_ORBITS * sizeof(double *));
+  for (size_t i = 0; i < N_ORBITS; i++) {
+    gnomonic_x[i] = malloc(N_POINTS * sizeof(double));
+    gnomonic_y[i] = malloc(N_POINTS * sizeof(double));
+  }
+
+  projection_kernel_fn single = projection_kernel_best();
+  projection_multi_kernel_fn multi = projection_multi_kernel_best();
+  double best_single = -1.0;
+  for (size_t r = 0; r < N_RUNS; r++) {
+    double start = now();
+    for (size_t i = 0; i < N_ORBITS; i++) {
+      single(rotations[i], cartesian->x.data, cartesian->y.data, cartesian->z.data, gnomonic_x[i], gnomonic_y[i],
+             N_POINTS);
+    }
+    double seconds = now() - start;
+    best_single = best_single < 0 || seconds < best_single ? seconds : best_single;
+  }
+  double work = (double)N_POINTS * N_ORBITS;
+  printf("%-14s %9.3fms  %8.1f Mpoints*orbits/s\n", "per-orbit", best_single * 1000.0, work / best_single / 1e6);
+
+  printf("multi-orbit kernel, %zu frames per pass\n", projection_multi_kernel_width(simd_level_detect()));
+  for (size_t g = 0; g < sizeof(group_sizes) / sizeof(group_sizes[0]); g++) {
+    size_t k = group_sizes[g];
+    double best = -1.0;
+    for (size_t r = 0; r < N_RUNS; r++) {
+      double start = now();
+      for (size_t first = 0; first < N_ORBITS; first += k) {
+        size_t n_orbits = N_ORBITS - first < k ? N_ORBITS - first : k;
+        multi(&rotations[first], n_orbits, cartesian->x.data, cartesian->y.data, cartesian->z.data,
+              &gnomonic_x[first], &gnomonic_y[first], N_POINTS);
+      }
+      double seconds = now() - start;
+      best = best < 0 || seconds < best ? seconds : best;
+    }
+    printf("  K = %3zu     %9.3fms  %8.1f Mpoints*orbits/s  Speedup: %5.2fx\n", k, best * 1000.0,
+           work / best / 1e6, best_single / best);
+  }
+
+  for (size_t i = 0; i < N_ORBITS; i++) {
+    free(gnomonic_x[i]);
+    free(gnomonic_y[i]);
+  }
+  free(gnomonic_x);
+  free(gnomonic_y);
+  free(rotations);
+}
+
+int main(void) {
+  struct CartesianPointSources cartesian = CARTESIAN_POINT_SOURCES_ZERO;
+  struct CartesianOrbits orbits = CARTESIAN_ORBITS_ZERO;
+  generate_point_sources(&cartesian, N_POINTS);
+  generate_orbits(&orbits, N_ORBITS);
+
+  printf("%zu detections x %d orbits, kernels only\n", (size_t)N_POINTS, N_ORBITS);
+  compare_kernels(&cartesian, &orbits);
+
+  struct GnomonicPointSources *gnomonic = malloc(N_ORBITS * sizeof(struct GnomonicPointSources));
+  for (size_t i = 0; i < N_ORBITS; i++) {
+    gnomonic_point_sources_new(&gnomonic[i], N_POINTS);
+  }
+
+  printf("%zu detections x %d orbits\n", (size_t)N_POINTS, N_ORBITS);
+  double single_thread = 0.0;
+  for (size_t k = 0; k < sizeof(thread_counts) / sizeof(thread_counts[0]); k++) {
+    struct ThreadPool pool;
+    thread_pool_new(&pool, thread_counts[k]);
+    double best = -1.0;
+    for (size_t i = 0; i < N_RUNS; i++) {
+      double seconds = run(&cartesian, &orbits, gnomonic, &pool);
+      if (best < 0 || seconds < best) {
+        best = seconds;
+      }
+    }
+    thread_pool_free(&pool);
+    if (k == 0) {
+      single_thread = best;
+    }
+    double points_per_second = (double)N_POINTS * N_ORBITS / best;
+    printf("%3zu threads: %9.3fms  %8.1f Mpoints/s  Speedup: %5.2fx\n", thread_counts[k], best * 1000.0,
+           points_per_second / 1e6, single_thread / best);
+  }
+
+  for (size_t i = 0; i < N_ORBITS; i++) {
+    gnomonic_point_sources_free(&gnomonic[i]);
+  }
+  free(gnomonic);
+  cartesian_orbits_free(&orbits);
+  cartesian_point_sources_free(&cartesian);
+}
@@ -0,0 +1,570 @@
+// A parameterized benchmark suite for the projection paths.
+//
+// Every case is swept over problem sizes from 1e3 up to --max-size
+// detections, every kernel variant the CPU supports, and (for the
+// batch case) thread counts up to --max-threads. Each measurement
+// warms up first, then repeats until --min-time seconds have passed,
+// and reports the median and 99th percentile time per run, throughput
+// in points/s and GB/s, and heap allocations per run.
+//
+// Usage:
+//
+//   bench_suite [--max-size N] [--max-threads N] [--min-time S]
+//               [--filter NAME] [--json PATH]
+//               [--compare BASELINE] [--threshold F]
+//
+// --json writes the results to PATH. --compare reads a file written
+// by --json and flags every case whose median is more than threshold
+// (default 0.10, i.e. 10%) slower than in the baseline, or which
+// allocates more; the exit status is 1 if any case regressed.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "instrument.h"
+#include "point_sources.h"
+#include "projection_kernels.h"
+#include "projections.h"
+#include "simd.h"
+#include "thread_pool.h"
+#include "vectors.h"
+
+static double center_position[3] = {0.9, 0.8, 0.01};
+static double center_velocity[3] = {-0.05, 0.05, 0.00001};
+
+#define TIME 1.0
+#define MIN_SIZE 1000
+#define WARMUP_TIME 0.05
+#define MIN_RUNS 5
+#define MAX_RUNS 100000
+#define BATCH_ORBITS 16
+#define WITHIN_RADIUS 1.0
+
+// Bytes read and written per point by each case: x, y, z and t in;
+// x, y and t out. The filtered case only writes the few points it
+// keeps, so it is counted as reading alone.
+#define PROJECT_BYTES (4 * sizeof(double) + 3 * sizeof(double))
+#define PROJECT_F32_BYTES (4 * sizeof(double) + 2 * sizeof(float) + sizeof(double))
+#define READ_BYTES (3 * sizeof(double))
+
+// Heap allocations are counted by standing in for the allocator
+// entry points and forwarding to glibc's own.
+#ifdef __GLIBC__
+#define HAVE_ALLOCATION_COUNTS 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static size_t allocation_count;
+static size_t allocation_bytes;
+
+static void count_allocation(size_t size) {
+  __atomic_add_fetch(&allocation_count, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&allocation_bytes, size, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size) {
+  count_allocation(size);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  count_allocation(count * size);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  count_allocation(size);
+  return __libc_realloc(ptr, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  count_allocation(size);
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+  count_allocation(size);
+  void *result = __libc_memalign(alignment, size);
+  if (result == NULL) {
+    return 12;  // ENOMEM
+  }
+  *ptr = result;
+  return 0;
+}
+#endif
+
+struct Options {
+  size_t max_size;
+  size_t max_threads;
+  double min_time;
+  const char *filter;
+  const char *json_path;
+  const char *compare_path;
+  double threshold;
+};
+
+struct Result {
+  char name[32];
+  char variant[16];
+  size_t size;
+  size_t threads;
+  size_t runs;
+  double p50_ns;
+  double p99_ns;
+  double points_per_second;
+  double gb_per_second;
+  double allocations;
+  double bytes_allocated;
+};
+
+struct Results {
+  size_t length;
+  size_t capacity;
+  struct Result *data;
+};
+
+// A measured operation: run does the work, and reset, if not NULL,
+// restores the state between runs, outside the timed region.
+typedef void (*bench_fn)(void *state);
+
+struct Measurement {
+  size_t runs;
+  double p50;
+  double p99;
+  double allocations;
+  double bytes_allocated;
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static int measure(bench_fn run, bench_fn reset, void *state, double min_time, struct Measurement *m) {
+  double warmup_end = now() + WARMUP_TIME;
+  do {
+    if (reset != NULL) {
+      reset(state);
+    }
+    run(state);
+  } while (now() < warmup_end);
+
+  size_t capacity = 64;
+  double *samples = malloc(capacity * sizeof(double));
+  if (samples == NULL) {
+    return -1;
+  }
+  size_t runs = 0;
+  double total = 0.0;
+  size_t allocations = 0, bytes_allocated = 0;
+  while ((runs < MIN_RUNS || total < min_time) && runs < MAX_RUNS) {
+    if (runs == capacity) {
+      capacity *= 2;
+      double *grown = realloc(samples, capacity * sizeof(double));
+      if (grown == NULL) {
+        free(samples);
+        return -1;
+      }
+      samples = grown;
+    }
+    if (reset != NULL) {
+      reset(state);
+    }
+#ifdef HAVE_ALLOCATION_COUNTS
+    size_t count_before = allocation_count, bytes_before = allocation_bytes;
+#endif
+    double start = now();
+    run(state);
+    double seconds = now() - start;
+#ifdef HAVE_ALLOCATION_COUNTS
+    allocations += allocation_count - count_before;
+    bytes_allocated += allocation_bytes - bytes_before;
+#endif
+    samples[runs++] = seconds;
+    total += seconds;
+  }
+
+  qsort(samples, runs, sizeof(double), compare_doubles);
+  m->runs = runs;
+  m->p50 = samples[runs / 2];
+  m->p99 = samples[(size_t)ceil(0.99 * runs) - 1];
+  m->allocations = (double)allocations / runs;
+  m->bytes_allocated = (double)bytes_allocated / runs;
+  free(samples);
+  return 0;
+}
+
+static int results_push(struct Results *results, struct Result *result) {
+  if (results->length == results->capacity) {
+    size_t capacity = results->capacity > 0 ? results->capacity * 2 : 64;
+    struct Result *data = realloc(results->data, capacity * sizeof(struct Result));
+    if (data == NULL) {
+      return -1;
+    }
+    results->data = data;
+    results->capacity = capacity;
+  }
+  results->data[results->length++] = *result;
+  return 0;
+}
+
+static void record(struct Results *results, const char *name, const char *variant, size_t size, size_t threads,
+                   size_t points, size_t bytes, struct Measurement *m) {
+  struct Result result = {.size = size,
+                          .threads = threads,
+                          .runs = m->runs,
+                          .p50_ns = m->p50 * 1e9,
+                          .p99_ns = m->p99 * 1e9,
+                          .points_per_second = points / m->p50,
+                          .gb_per_second = bytes / m->p50 * 1e-9,
+                          .allocations = m->allocations,
+                          .bytes_allocated = m->bytes_allocated};
+  snprintf(result.name, sizeof(result.name), "%s", name);
+  snprintf(result.variant, sizeof(result.variant), "%s", variant);
+  printf("%-16s %-8s %10zu %3zu  p50 %12.0fns  p99 %12.0fns  %10.3g pts/s  %7.2f GB/s  %6.1f allocs\n", name,
+         variant, size, threads, result.p50_ns, result.p99_ns, result.points_per_second, result.gb_per_second,
+         result.allocations);
+  fflush(stdout);
+  if (results_push(results, &result) != 0) {
+    fprintf(stderr, "out of memory recording results\n");
+  }
+}
+
+struct ProjectState {
+  struct CartesianPointSources *cartesian;
+  struct GnomonicPointSources gnomonic;
+  struct GnomonicPointSourcesF32 gnomonic_f32;
+  struct VecU32 rows;
+  struct CartesianOrbits orbits;
+  struct GnomonicPointSources batch[BATCH_ORBITS];
+  struct ThreadPool *pool;
+  enum SimdLevel level;
+  double checksum;
+};
+
+static void reset_outputs(void *arg) {
+  struct ProjectState *state = arg;
+  state->gnomonic.x.length = state->gnomonic.y.length = state->gnomonic.t.length = 0;
+  state->gnomonic_f32.x.length = state->gnomonic_f32.y.length = state->gnomonic_f32.t.length = 0;
+  state->rows.length = 0;
+  for (size_t i = 0; i < BATCH_ORBITS; i++) {
+    state->batch[i].x.length = state->batch[i].y.length = state->batch[i].t.length = 0;
+  }
+}
+
+static void run_project(void *arg) {
+  struct ProjectState *state = arg;
+  cartesian_to_gnomonic_with_kernel(state->cartesian, center_position, center_velocity, &state->gnomonic,
+                                    state->level);
+}
+
+static void run_project_f32(void *arg) {
+  struct ProjectState *state = arg;
+  cartesian_to_gnomonic_f32(state->cartesian, center_position, center_velocity, &state->gnomonic_f32);
+}
+
+static void run_project_within(void *arg) {
+  struct ProjectState *state = arg;
+  cartesian_to_gnomonic_within(state->cartesian, center_position, center_velocity, WITHIN_RADIUS, &state->gnomonic,
+                               &state->rows);
+}
+
+static int sum_block(struct GnomonicPointSources *block, size_t offset, void *context) {
+  (void)offset;
+  struct ProjectState *state = context;
+  for (size_t i = 0; i < block->x.length; i++) {
+    state->checksum += block->x.data[i];
+  }
+  return 0;
+}
+
+static void run_project_stream(void *arg) {
+  struct ProjectState *state = arg;
+  cartesian_to_gnomonic_stream(state->cartesian, center_position, center_velocity, 0, sum_block, state);
+}
+
+static void run_project_batch(void *arg) {
+  struct ProjectState *state = arg;
+  cartesian_to_gnomonic_batch(state->cartesian, &state->orbits, state->batch, state->pool);
+}
+
+static int selected(struct Options *options, const char *name) {
+  return options->filter == NULL || strstr(name, options->filter) != NULL;
+}
+
+static double rand_near(double x) {
+  // A random double in the range [x - 0.1, x + 0.1).
+  return x + ((double)rand() / RAND_MAX - 0.5) / 5.0;
+}
+
+static int run_suite(struct Options *options, struct Results *results) {
+  struct CartesianPointSources all = CARTESIAN_POINT_SOURCES_ZERO;
+  if (cartesian_point_sources_new(&all, options->max_size) != 0) {
+    return -1;
+  }
+  srand(42);
+  for (size_t i = 0; i < options->max_size; i++) {
+    cartesian_point_sources_push(&all, rand_near(center_position[0]), rand_near(center_position[1]),
+                                 rand_near(center_position[2]), TIME);
+  }
+
+  struct ProjectState state = {.gnomonic = GNOMONIC_POINT_SOURCES_ZERO,
+                               .gnomonic_f32 = GNOMONIC_POINT_SOURCES_F32_ZERO,
+                               .rows = VECU32_ZERO,
+                               .orbits = CARTESIAN_ORBITS_ZERO};
+  gnomonic_point_sources_new(&state.gnomonic, 1);
+  gnomonic_point_sources_f32_new(&state.gnomonic_f32, 1);
+  vec_u32_new(&state.rows, 1);
+  cartesian_orbits_new(&state.orbits, BATCH_ORBITS);
+  for (size_t i = 0; i < BATCH_ORBITS; i++) {
+    double position[3] = {rand_near(center_position[0]), rand_near(center_position[1]),
+                          rand_near(center_position[2])};
+    cartesian_orbits_push(&state.orbits, position, center_velocity, TIME);
+    gnomonic_point_sources_new(&state.batch[i], 1);
+  }
+
+  for (size_t size = MIN_SIZE; size <= options->max_size; size *= 10) {
+    // Each size is a view of the first size detections.
+    struct CartesianPointSources cartesian = CARTESIAN_POINT_SOURCES_ZERO;
+    vec_f64_view(&cartesian.x, all.x.data, size);
+    vec_f64_view(&cartesian.y, all.y.data, size);
+    vec_f64_view(&cartesian.z, all.z.data, size);
+    vec_f64_view(&cartesian.t, all.t.data, size);
+    state.cartesian = &cartesian;
+    struct Measurement m;
+
+    if (selected(options, "project")) {
+      for (int level = SIMD_LEVEL_SCALAR; level < SIMD_LEVEL_COUNT; level++) {
+        if (!simd_level_supported(level)) {
+          continue;
+        }
+        state.level = level;
+        if (measure(run_project, reset_outputs, &state, options->min_time, &m) == 0) {
+          record(results, "project", simd_level_name(level), size, 1, size, size * PROJECT_BYTES, &m);
+        }
+      }
+    }
+    const char *best = simd_level_name(simd_level_detect());
+    if (selected(options, "project_f32") &&
+        measure(run_project_f32, reset_outputs, &state, options->min_time, &m) == 0) {
+      record(results, "project_f32", best, size, 1, size, size * PROJECT_F32_BYTES, &m);
+    }
+    if (selected(options, "project_within") &&
+        measure(run_project_within, reset_outputs, &state, options->min_time, &m) == 0) {
+      record(results, "project_within", best, size, 1, size, size * READ_BYTES, &m);
+    }
+    if (selected(options, "project_stream") &&
+        measure(run_project_stream, NULL, &state, options->min_time, &m) == 0) {
+      record(results, "project_stream", best, size, 1, size, size * READ_BYTES, &m);
+    }
+
+    // The batch output grows with size times the number of orbits, so
+    // it is held to the same limit as a single projection.
+    if (selected(options, "project_batch") && size * BATCH_ORBITS <= options->max_size) {
+      for (size_t threads = 1; threads <= options->max_threads; threads *= 2) {
+        struct ThreadPool pool;
+        if (thread_pool_new(&pool, threads) != 0) {
+          break;
+        }
+        state.pool = &pool;
+        if (measure(run_project_batch, reset_outputs, &state, options->min_time, &m) == 0) {
+          record(results, "project_batch", best, size, threads, size * BATCH_ORBITS,
+                 size * BATCH_ORBITS * PROJECT_BYTES, &m);
+        }
+        thread_pool_free(&pool);
+        state.pool = NULL;
+      }
+    }
+  }
+
+  gnomonic_point_sources_free(&state.gnomonic);
+  gnomonic_point_sources_f32_free(&state.gnomonic_f32);
+  vec_u32_free(&state.rows);
+  for (size_t i = 0; i < BATCH_ORBITS; i++) {
+    gnomonic_point_sources_free(&state.batch[i]);
+  }
+  cartesian_orbits_free(&state.orbits);
+  cartesian_point_sources_free(&all);
+  return 0;
+}
+
+// The JSON files are written one result per line, which is all
+// read_results needs to parse them back.
+#define RESULT_FORMAT                                                                                         \
+  "    {\"name\": \"%s\", \"variant\": \"%s\", \"size\": %zu, \"threads\": %zu, \"runs\": %zu, \"p50_ns\": %.1f, " \
+  "\"p99_ns\": %.1f, \"points_per_second\": %.6g, \"gb_per_second\": %.6g, \"allocations\": %.1f, "               \
+  "\"bytes_allocated\": %.1f}"
+#define RESULT_SCAN_FORMAT                                                                                    \
+  " {\"name\": \"%31[^\"]\", \"variant\": \"%15[^\"]\", \"size\": %zu, \"threads\": %zu, \"runs\": %zu, "          \
+  "\"p50_ns\": %lf, \"p99_ns\": %lf, \"points_per_second\": %lf, \"gb_per_second\": %lf, \"allocations\": %lf, " \
+  "\"bytes_allocated\": %lf}"
+
+static int write_results(const char *path, struct Results *results) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    return -1;
+  }
+  fprintf(file, "{\n  \"simd\": \"%s\",\n  \"results\": [\n", simd_level_name(simd_level_detect()));
+  for (size_t i = 0; i < results->length; i++) {
+    struct Result *r = &results->data[i];
+    fprintf(file, RESULT_FORMAT "%s\n", r->name, r->variant, r->size, r->threads, r->runs, r->p50_ns, r->p99_ns,
+            r->points_per_second, r->gb_per_second, r->allocations, r->bytes_allocated,
+            i + 1 < results->length ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+  return fclose(file) == 0 ? 0 : -1;
+}
+
+static int read_results(const char *path, struct Results *results) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+  char line[1024];
+  int status = 0;
+  while (status == 0 && fgets(line, sizeof(line), file) != NULL) {
+    struct Result r;
+    if (sscanf(line, RESULT_SCAN_FORMAT, r.name, r.variant, &r.size, &r.threads, &r.runs, &r.p50_ns, &r.p99_ns,
+               &r.points_per_second, &r.gb_per_second, &r.allocations, &r.bytes_allocated) == 11) {
+      status = results_push(results, &r);
+    }
+  }
+  fclose(file);
+  return status;
+}
+
+// Prints how each result compares with the same case in baseline, and
+// returns the number of regressions.
+static size_t compare_results(struct Results *results, struct Results *baseline, double threshold) {
+  size_t regressions = 0;
+  printf("\nCompared with baseline (threshold %.0f%%):\n", threshold * 100.0);
+  for (size_t i = 0; i < results->length; i++) {
+    struct Result *r = &results->data[i];
+    struct Result *base = NULL;
+    for (size_t j = 0; j < baseline->length && base == NULL; j++) {
+      struct Result *b = &baseline->data[j];
+      if (strcmp(b->name, r->name) == 0 && strcmp(b->variant, r->variant) == 0 && b->size == r->size &&
+          b->threads == r->threads) {
+        base = b;
+      }
+    }
+    if (base == NULL) {
+      printf("  %-16s %-8s %10zu %3zu  new\n", r->name, r->variant, r->size, r->threads);
+      continue;
+    }
+    double change = r->p50_ns / base->p50_ns - 1.0;
+    const char *verdict = "ok";
+    if (change > threshold) {
+      verdict = "REGRESSION";
+    } else if (r->allocations > base->allocations) {
+      verdict = "REGRESSION (allocations)";
+    } else if (change < -threshold) {
+      verdict = "faster";
+    }
+    regressions += verdict[0] == 'R';
+    printf("  %-16s %-8s %10zu %3zu  %+6.1f%%  %s\n", r->name, r->variant, r->size, r->threads, change * 100.0,
+           verdict);
+  }
+  return regressions;
+}
+
+static int parse_options(int argc, char **argv, struct Options *options) {
+  for (int i = 1; i < argc; i++) {
+    const char *flag = argv[i];
+    if (i + 1 >= argc) {
+      fprintf(stderr, "missing value for %s\n", flag);
+      return -1;
+    }
+    const char *value = argv[++i];
+    if (strcmp(flag, "--max-size") == 0) {
+      options->max_size = (size_t)strtod(value, NULL);
+    } else if (strcmp(flag, "--max-threads") == 0) {
+      options->max_threads = (size_t)strtoul(value, NULL, 10);
+    } else if (strcmp(flag, "--min-time") == 0) {
+      options->min_time = strtod(value, NULL);
+    } else if (strcmp(flag, "--filter") == 0) {
+      options->filter = value;
+    } else if (strcmp(flag, "--json") == 0) {
+      options->json_path = value;
+    } else if (strcmp(flag, "--compare") == 0) {
+      options->compare_path = value;
+    } else if (strcmp(flag, "--threshold") == 0) {
+      options->threshold = strtod(value, NULL);
+    } else {
+      fprintf(stderr, "unknown option %s\n", flag);
+      return -1;
+    }
+  }
+  if (options->max_size < MIN_SIZE || options->max_threads == 0) {
+    fprintf(stderr, "--max-size must be at least %d and --max-threads at least 1\n", MIN_SIZE);
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  struct Options options = {.max_size = 10000000,
+                            .max_threads = cpus > 0 ? (size_t)cpus : 1,
+                            .min_time = 0.5,
+                            .filter = NULL,
+                            .json_path = NULL,
+                            .compare_path = NULL,
+                            .threshold = 0.10};
+  if (parse_options(argc, argv, &options) != 0) {
+    return 2;
+  }
+
+  struct Results results = {0, 0, NULL};
+  if (run_suite(&options, &results) != 0) {
+    fprintf(stderr, "out of memory generating detections\n");
+    return 2;
+  }
+
+  // With an instrumented build (make INSTRUMENT=1), show where the time
+  // went inside the library.
+  struct InstrumentStats stats;
+  instrument_snapshot(&stats);
+  if (stats.enabled) {
+    printf("\nInstrumentation totals:\n");
+    for (int p = 0; p < INSTRUMENT_PROBE_COUNT; p++) {
+      struct InstrumentProbeStats *probe = &stats.probes[p];
+      printf("  %-18s %10llu calls  %10.3fs  %14llu items\n", instrument_probe_name(p),
+             (unsigned long long)probe->calls, probe->ticks / stats.ticks_per_second,
+             (unsigned long long)probe->items);
+    }
+  }
+
+  int status = 0;
+  if (options.json_path != NULL && write_results(options.json_path, &results) != 0) {
+    fprintf(stderr, "could not write %s\n", options.json_path);
+    status = 2;
+  }
+  if (options.compare_path != NULL) {
+    struct Results baseline = {0, 0, NULL};
+    if (read_results(options.compare_path, &baseline) != 0) {
+      fprintf(stderr, "could not read %s\n", options.compare_path);
+      status = 2;
+    } else if (compare_results(&results, &baseline, options.threshold) > 0) {
+      status = status != 0 ? status : 1;
+    }
+    free(baseline.data);
+  }
+  free(results.data);
+  return status;
+}
@@ -0,0 +1,67 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "clustering.h"
+#include "point_sources.h"
+
+// Points are spread over a FIELD_SIZE x FIELD_SIZE degree field, with
+// the clustering radius chosen so that each point has
+// MEAN_NEIGHBOURS neighbours on average regardless of n.
+#define FIELD_SIZE 10.0
+#define MEAN_NEIGHBOURS 2.0
+#define MIN_SAMPLES 5
+#define N_RUNS 3
+
+// By default the sweep stops at 1e7 points; pass a larger maximum (for
+// example 1e8) as the first argument on machines with enough memory.
+#define DEFAULT_MAX_POINTS 10000000
+
+double rand_double(void) {
+  // Generate a random double in the range [0, 1).
+  return (double)rand() / RAND_MAX;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void generate_point_sources(struct GnomonicPointSources *gnomonic, size_t n) {
+  gnomonic_point_sources_new(gnomonic, n);
+  for (size_t i = 0; i < n; i++) {
+    gnomonic_point_sources_push(gnomonic, rand_double() * FIELD_SIZE, rand_double() * FIELD_SIZE, 0.0);
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t max_points = DEFAULT_MAX_POINTS;
+  if (argc > 1) {
+    max_points = (size_t)strtod(argv[1], NULL);
+  }
+
+  for (size_t n = 100000; n <= max_points; n *= 10) {
+    struct GnomonicPointSources gnomonic = GNOMONIC_POINT_SOURCES_ZERO;
+    generate_point_sources(&gnomonic, n);
+    double radius = sqrt(FIELD_SIZE * FIELD_SIZE * MEAN_NEIGHBOURS / (M_PI * n));
+
+    double best = -1.0;
+    size_t n_clusters = 0;
+    for (size_t i = 0; i < N_RUNS; i++) {
+      struct Clusters clusters = CLUSTERS_ZERO;
+      double start = now();
+      cluster_gnomonic(&gnomonic, radius, MIN_SAMPLES, &clusters);
+      double seconds = now() - start;
+      n_clusters = clusters.n_clusters;
+      clusters_free(&clusters);
+      if (best < 0 || seconds < best) {
+        best = seconds;
+      }
+    }
+    printf("%10zu points: %10.3fms  %8.2f Mpoints/s  (%zu clusters)\n", n, best * 1000.0, n / best / 1e6,
+           n_clusters);
+    gnomonic_point_sources_free(&gnomonic);
+  }
+}
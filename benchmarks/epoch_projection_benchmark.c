@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "orbits.h"
+#include "point_sources.h"
+#include "projections.h"
+#include "propagation.h"
+
+#define N_EXPOSURES 1000
+#define POINTS_PER_EXPOSURE 1000
+#define N_RUNS 5
+
+double rand_double(void) {
+  // Generate a random double in the range [0, 1).
+  return (double)rand() / RAND_MAX;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+  struct CartesianOrbits orbit;
+  cartesian_orbits_new(&orbit, 1);
+  double pos[3] = {0.9, 0.8, 0.01};
+  double vel[3] = {-0.01, 0.01, 0.00001};
+  cartesian_orbits_push(&orbit, pos, vel, 59000.0);
+  double epochs[N_EXPOSURES];
+  for (size_t e = 0; e < N_EXPOSURES; e++) {
+    epochs[e] = 59000.0 + 0.02 * e;
+  }
+  struct CartesianOrbits centers;
+  cartesian_orbits_new(&centers, N_EXPOSURES);
+  propagate_orbits(&orbit, epochs, N_EXPOSURES, PROPAGATION_MU_SUN, NULL, &centers);
+
+  size_t n = (size_t)N_EXPOSURES * POINTS_PER_EXPOSURE;
+  struct CartesianPointSources cartesian;
+  cartesian_point_sources_new(&cartesian, n);
+  for (size_t i = 0; i < n; i++) {
+    size_t e = i / POINTS_PER_EXPOSURE;
+    cartesian_point_sources_push(&cartesian, centers.x.data[e] + 0.1 * (rand_double() - 0.5),
+                                 centers.y.data[e] + 0.1 * (rand_double() - 0.5), centers.z.data[e], epochs[e]);
+  }
+
+  double best = -1.0;
+  for (size_t run = 0; run < N_RUNS; run++) {
+    struct GnomonicPointSources gnomonic;
+    gnomonic_point_sources_new(&gnomonic, n);
+    double start = now();
+    cartesian_to_gnomonic_epochs(&cartesian, &centers, &gnomonic);
+    double seconds = now() - start;
+    gnomonic_point_sources_free(&gnomonic);
+    if (best < 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+
+  printf("%d exposures x %d detections\n", N_EXPOSURES, POINTS_PER_EXPOSURE);
+  printf("epoch projection: %9.3fms  %8.1f Mpoints/s\n", best * 1000.0, (double)n / best / 1e6);
+
+  cartesian_point_sources_free(&cartesian);
+  cartesian_orbits_free(&centers);
+  cartesian_orbits_free(&orbit);
+}
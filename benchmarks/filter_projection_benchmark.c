@@ -0,0 +1,90 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "point_sources.h"
+#include "projections.h"
+#include "vectors.h"
+
+static double center_position[3] = {0.9, 0.8, 0.01};
+static double center_velocity[3] = {-0.05, 0.05, 0.00001};
+
+#define TIME 1.0
+#define N_POINTS 4000000
+#define N_RUNS 5
+
+// Detections are spread over a wide patch of sky, so only a few percent
+// of them land within RADIUS degrees of the center.
+#define RADIUS 1.0
+
+double rand_double(void) {
+  // Generate a random double in the range [0, 1).
+  return (double)rand() / RAND_MAX;
+}
+
+double rand_near(double x) {
+  // Generate a random double in the range [x - 0.1, x + 0.1).
+  return x + (rand_double() - 0.5) / 5.0;
+}
+
+void generate_point_sources(struct CartesianPointSources *cartesian, size_t n) {
+  cartesian_point_sources_new(cartesian, n);
+  for (size_t i = 0; i < n; i++) {
+    cartesian_point_sources_push(cartesian, rand_near(center_position[0]), rand_near(center_position[1]),
+                                 rand_near(center_position[2]), TIME);
+  }
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+  struct CartesianPointSources cartesian = CARTESIAN_POINT_SOURCES_ZERO;
+  generate_point_sources(&cartesian, N_POINTS);
+
+  // Project everything, then pick out the points within the radius, as
+  // a caller had to before.
+  double best = INFINITY;
+  size_t kept = 0;
+  for (size_t r = 0; r < N_RUNS; r++) {
+    struct GnomonicPointSources gnomonic = GNOMONIC_POINT_SOURCES_ZERO;
+    gnomonic_point_sources_new(&gnomonic, N_POINTS);
+    struct VecU32 rows = VECU32_ZERO;
+    vec_u32_new(&rows, 1);
+    double start = now();
+    cartesian_to_gnomonic(&cartesian, center_position, center_velocity, &gnomonic);
+    for (size_t i = 0; i < gnomonic.x.length; i++) {
+      if (gnomonic.x.data[i] * gnomonic.x.data[i] + gnomonic.y.data[i] * gnomonic.y.data[i] <= RADIUS * RADIUS) {
+        vec_u32_push(&rows, (uint32_t)i);
+      }
+    }
+    double seconds = now() - start;
+    best = seconds < best ? seconds : best;
+    kept = rows.length;
+    gnomonic_point_sources_free(&gnomonic);
+    vec_u32_free(&rows);
+  }
+  printf("%-12s Best: %.3fms  Kept: %zu of %d\n", "full", best * 1000.0, kept, N_POINTS);
+
+  best = INFINITY;
+  for (size_t r = 0; r < N_RUNS; r++) {
+    struct GnomonicPointSources gnomonic = GNOMONIC_POINT_SOURCES_ZERO;
+    gnomonic_point_sources_new(&gnomonic, 1);
+    struct VecU32 rows = VECU32_ZERO;
+    vec_u32_new(&rows, 1);
+    double start = now();
+    cartesian_to_gnomonic_within(&cartesian, center_position, center_velocity, RADIUS, &gnomonic, &rows);
+    double seconds = now() - start;
+    best = seconds < best ? seconds : best;
+    kept = rows.length;
+    gnomonic_point_sources_free(&gnomonic);
+    vec_u32_free(&rows);
+  }
+  printf("%-12s Best: %.3fms  Kept: %zu of %d\n", "fused", best * 1000.0, kept, N_POINTS);
+
+  cartesian_point_sources_free(&cartesian);
+}
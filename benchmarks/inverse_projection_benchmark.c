@@ -0,0 +1,72 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "matrixmath.h"
+#include "point_sources.h"
+#include "projections.h"
+
+static double center_position[3] = {0.9, 0.8, 0.01};
+static double center_velocity[3] = {-0.05, 0.05, 0.00001};
+
+#define N_POINTS 4000000
+#define N_RUNS 5
+
+double rand_double(void) {
+  // Generate a random double in the range [0, 1).
+  return (double)rand() / RAND_MAX;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+  struct GnomonicPointSources gnomonic = GNOMONIC_POINT_SOURCES_ZERO;
+  gnomonic_point_sources_reserve(&gnomonic, N_POINTS);
+  for (size_t i = 0; i < N_POINTS; i++) {
+    gnomonic_point_sources_push(&gnomonic, (rand_double() - 0.5) * 10, (rand_double() - 0.5) * 10, 1.0);
+  }
+  double rotation[1][3][3];
+  gnomonic_rotation_matrices(&center_position[0], &center_position[1], &center_position[2], &center_velocity[0],
+                             &center_velocity[1], &center_velocity[2], 1, rotation);
+
+  // One point at a time through matinv_3x3 and matmul_3x3_3x1, as
+  // callers had to before.
+  double best = INFINITY;
+  for (size_t r = 0; r < N_RUNS; r++) {
+    struct CartesianPointSources cartesian = CARTESIAN_POINT_SOURCES_ZERO;
+    cartesian_point_sources_reserve(&cartesian, N_POINTS);
+    double start = now();
+    double inverse[3][3];
+    matinv_3x3(rotation[0], inverse);
+    for (size_t i = 0; i < N_POINTS; i++) {
+      double d[3] = {1.0, gnomonic.x.data[i] * M_PI / 180.0, gnomonic.y.data[i] * M_PI / 180.0};
+      normalize(d);
+      double p[3];
+      matmul_3x3_3x1(inverse, d, p);
+      cartesian_point_sources_push(&cartesian, p[0], p[1], p[2], gnomonic.t.data[i]);
+    }
+    double seconds = now() - start;
+    best = seconds < best ? seconds : best;
+    cartesian_point_sources_free(&cartesian);
+  }
+  printf("%-12s Best: %.3fms\n", "per-point", best * 1000.0);
+
+  best = INFINITY;
+  for (size_t r = 0; r < N_RUNS; r++) {
+    struct CartesianPointSources cartesian = CARTESIAN_POINT_SOURCES_ZERO;
+    cartesian_point_sources_reserve(&cartesian, N_POINTS);
+    double start = now();
+    gnomonic_to_cartesian_rotated(&gnomonic, rotation[0], &cartesian);
+    double seconds = now() - start;
+    best = seconds < best ? seconds : best;
+    cartesian_point_sources_free(&cartesian);
+  }
+  printf("%-12s Best: %.3fms\n", "batch", best * 1000.0);
+
+  gnomonic_point_sources_free(&gnomonic);
+}
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "arena.h"
+#include "numa.h"
+#include "orbits.h"
+#include "point_sources.h"
+#include "projections.h"
+#include "thread_pool.h"
+
+static double center_position[3] = {0.9, 0.8, 0.01};
+static double center_velocity[3] = {-0.05, 0.05, 0.00001};
+
+#define TIME 1.0
+#define N_POINTS 400000
+#define N_ORBITS 64
+#define N_RUNS 5
+
+double rand_double(void) {
+  // Generate a random double in the range [0, 1).
+  return (double)rand() / RAND_MAX;
+}
+
+double rand_near(double x) {
+  // Generate a random double in the range [x - 0.1, x + 0.1).
+  return x + (rand_double() - 0.5) / 5.0;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Returns the best of N_RUNS batch projections of cartesian on pool,
+// after one untimed run that first touches the outputs, as a sweep
+// that reuses its outputs would.
+static double run(struct CartesianPointSources *cartesian, struct CartesianOrbits *orbits, struct ThreadPool *pool) {
+  struct GnomonicPointSources *gnomonic = malloc(N_ORBITS * sizeof(struct GnomonicPointSources));
+  for (size_t i = 0; i < N_ORBITS; i++) {
+    gnomonic[i] = (struct GnomonicPointSources)GNOMONIC_POINT_SOURCES_ZERO;
+  }
+  cartesian_to_gnomonic_batch(cartesian, orbits, gnomonic, pool);
+  double best = -1.0;
+  for (size_t r = 0; r < N_RUNS; r++) {
+    double start = now();
+    cartesian_to_gnomonic_batch(cartesian, orbits, gnomonic, pool);
+    double seconds = now() - start;
+    if (best < 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+  for (size_t i = 0; i < N_ORBITS; i++) {
+    gnomonic_point_sources_free(&gnomonic[i]);
+  }
+  free(gnomonic);
+  return best;
+}
+
+int main(void) {
+  struct NumaTopology topology;
+  numa_topology_new(&topology);
+  printf("%zu NUMA nodes, %zu CPUs, %d detections, %d orbits\n", topology.n_nodes, topology.n_cpus, N_POINTS,
+         N_ORBITS);
+  if (topology.n_nodes == 1) {
+    printf("single node: the NUMA mode only adds thread pinning here\n");
+  }
+
+  // The detections are loaded by the main thread, so on a multi-node
+  // machine they all live on its node.
+  struct CartesianPointSources cartesian;
+  cartesian_point_sources_new(&cartesian, N_POINTS);
+  for (size_t i = 0; i < N_POINTS; i++) {
+    cartesian_point_sources_push(&cartesian, rand_near(center_position[0]), rand_near(center_position[1]),
+                                 rand_near(center_position[2]), TIME);
+  }
+  struct CartesianOrbits orbits;
+  cartesian_orbits_new(&orbits, N_ORBITS);
+  for (size_t i = 0; i < N_ORBITS; i++) {
+    double pos[3] = {rand_near(center_position[0]), rand_near(center_position[1]), rand_near(center_position[2])};
+    cartesian_orbits_push(&orbits, pos, center_velocity, TIME);
+  }
+  double points = (double)N_POINTS * N_ORBITS;
+
+  struct ThreadPool pool;
+  thread_pool_new(&pool, topology.n_cpus);
+  double plain = run(&cartesian, &orbits, &pool);
+  thread_pool_free(&pool);
+  printf("%-10s %9.3fms  %8.2f Mpoints/s\n", "default", plain * 1000.0, points / plain / 1e6);
+
+  // Pinned workers, with the detections partitioned across the nodes
+  // and each chunk's tasks run where its detections are.
+  thread_pool_new_pinned(&pool, 0, &topology);
+  struct Arena arena;
+  arena_new(&arena, 4 * (N_POINTS * sizeof(double) + ARENA_ALIGNMENT), ARENA_DEFAULT);
+  struct CartesianPointSources placed;
+  double start = now();
+  cartesian_to_gnomonic_batch_place(&cartesian, &pool, &arena, &placed);
+  double place = now() - start;
+  double numa = run(&placed, &orbits, &pool);
+  thread_pool_free(&pool);
+  printf("%-10s %9.3fms  %8.2f Mpoints/s  Speedup: %5.2fx  (placement %.3fms)\n", "numa", numa * 1000.0,
+         points / numa / 1e6, plain / numa, place * 1000.0);
+
+  arena_free(&arena);
+  cartesian_orbits_free(&orbits);
+  cartesian_point_sources_free(&cartesian);
+  numa_topology_free(&topology);
+}
@@ -0,0 +1,163 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "orbit_determination.h"
+#include "orbits.h"
+#include "propagation.h"
+#include "thread_pool.h"
+
+#define N_CANDIDATES 20000
+#define N_RUNS 3
+
+static const size_t thread_counts[] = {1, 2, 4, 8, 16};
+static double epochs[3] = {59000.0, 59004.0, 59009.0};
+
+double rand_double(void) {
+  // Generate a random double in the range [0, 1).
+  return (double)rand() / RAND_MAX;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void observer_position(double t, double pos[3]) {
+  double angle = sqrt(PROPAGATION_MU_SUN) * (t - epochs[0]);
+  pos[0] = cos(angle);
+  pos[1] = sin(angle);
+  pos[2] = 0.0;
+}
+
+int main(void) {
+  // Main-belt-like objects, each seen on three nights by an observer on
+  // a circular orbit at 1 AU.
+  struct CartesianOrbits truth;
+  cartesian_orbits_new(&truth, N_CANDIDATES);
+  for (size_t i = 0; i < N_CANDIDATES; i++) {
+    double r = 2.0 + rand_double();
+    double angle = 2.0 * M_PI * rand_double();
+    double speed = sqrt(PROPAGATION_MU_SUN / r) * (0.9 + 0.2 * rand_double());
+    double pos[3] = {r * cos(angle), r * sin(angle), 0.1 * (rand_double() - 0.5)};
+    double vel[3] = {-speed * sin(angle), speed * cos(angle), 0.002 * (rand_double() - 0.5)};
+    cartesian_orbits_push(&truth, pos, vel, epochs[1]);
+  }
+  struct CartesianOrbits states;
+  cartesian_orbits_new(&states, 3 * N_CANDIDATES);
+  propagate_orbits(&truth, epochs, 3, PROPAGATION_MU_SUN, NULL, &states);
+
+  struct String obscode = string_create("500");
+  struct ObservatoryTable table;
+  observatory_table_new(&table);
+  for (size_t k = 0; k < 3; k++) {
+    double observer[3];
+    observer_position(epochs[k], observer);
+    observatory_table_add(&table, &obscode, epochs[k], observer);
+  }
+  string_free(&obscode);
+  struct String *owned_obscode = malloc(sizeof(struct String));
+  *owned_obscode = string_create("500");
+  struct TopocentricPointSources detections;
+  topocentric_point_sources_new(&detections, 3 * N_CANDIDATES, owned_obscode);
+  uint32_t *triplets = malloc(3 * N_CANDIDATES * sizeof(uint32_t));
+  for (size_t row = 0; row < 3 * N_CANDIDATES; row++) {
+    double observer[3];
+    observer_position(epochs[row % 3], observer);
+    double d[3] = {states.x.data[row] - observer[0], states.y.data[row] - observer[1],
+                   states.z.data[row] - observer[2]};
+    double rho = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    topocentric_point_sources_push(&detections, atan2(d[1], d[0]) * 180.0 / M_PI, asin(d[2] / rho) * 180.0 / M_PI,
+                                   epochs[row % 3]);
+    triplets[row] = (uint32_t)row;
+  }
+
+  printf("%d candidates\n", N_CANDIDATES);
+  double single_thread = 0.0;
+  for (size_t k = 0; k < sizeof(thread_counts) / sizeof(thread_counts[0]); k++) {
+    struct ThreadPool pool;
+    thread_pool_new(&pool, thread_counts[k]);
+    double best = -1.0;
+    size_t n_orbits = 0;
+    for (size_t run = 0; run < N_RUNS; run++) {
+      struct CartesianOrbits orbits = CARTESIAN_ORBITS_ZERO;
+      struct VecU32 candidates = VECU32_ZERO;
+      double start = now();
+      gauss_iod(&detections, &table, triplets, N_CANDIDATES, PROPAGATION_MU_SUN, &pool, &orbits, &candidates);
+      double seconds = now() - start;
+      n_orbits = candidates.length;
+      cartesian_orbits_free(&orbits);
+      vec_u32_free(&candidates);
+      if (best < 0 || seconds < best) {
+        best = seconds;
+      }
+    }
+    thread_pool_free(&pool);
+    if (k == 0) {
+      single_thread = best;
+    }
+    printf("%3zu threads: %9.3fms  %8.2f Mcandidates/s  %zu orbits  Speedup: %5.2fx\n", thread_counts[k],
+           best * 1000.0, (double)N_CANDIDATES / best / 1e6, n_orbits, single_thread / best);
+  }
+
+  // Refine every Gauss orbit against its own triplet.
+  struct CartesianOrbits initial = CARTESIAN_ORBITS_ZERO;
+  struct VecU32 candidates = VECU32_ZERO;
+  gauss_iod(&detections, &table, triplets, N_CANDIDATES, PROPAGATION_MU_SUN, NULL, &initial, &candidates);
+  size_t n_fits = candidates.length;
+  size_t *offsets = malloc((n_fits + 1) * sizeof(size_t));
+  uint32_t *indices = malloc(3 * n_fits * sizeof(uint32_t));
+  for (size_t o = 0; o <= n_fits; o++) {
+    offsets[o] = 3 * o;
+  }
+  for (size_t o = 0; o < n_fits; o++) {
+    for (size_t k = 0; k < 3; k++) {
+      indices[3 * o + k] = triplets[3 * candidates.data[o] + k];
+    }
+  }
+
+  printf("%zu fits\n", n_fits);
+  single_thread = 0.0;
+  for (size_t k = 0; k < sizeof(thread_counts) / sizeof(thread_counts[0]); k++) {
+    struct ThreadPool pool;
+    thread_pool_new(&pool, thread_counts[k]);
+    double best = -1.0;
+    size_t n_converged = 0;
+    for (size_t run = 0; run < N_RUNS; run++) {
+      struct CartesianOrbits fitted = CARTESIAN_ORBITS_ZERO;
+      struct VecF64 rms = VECF64_ZERO;
+      double start = now();
+      differential_correction(&initial, &detections, &table, offsets, indices, PROPAGATION_MU_SUN, &pool, &fitted,
+                              &rms);
+      double seconds = now() - start;
+      n_converged = 0;
+      for (size_t o = 0; o < n_fits; o++) {
+        n_converged += !isnan(rms.data[o]);
+      }
+      cartesian_orbits_free(&fitted);
+      vec_f64_free(&rms);
+      if (best < 0 || seconds < best) {
+        best = seconds;
+      }
+    }
+    thread_pool_free(&pool);
+    if (k == 0) {
+      single_thread = best;
+    }
+    printf("%3zu threads: %9.3fms  %8.2f Mfits/s  %zu converged  Speedup: %5.2fx\n", thread_counts[k],
+           best * 1000.0, (double)n_fits / best / 1e6, n_converged, single_thread / best);
+  }
+
+  free(offsets);
+  free(indices);
+  cartesian_orbits_free(&initial);
+  vec_u32_free(&candidates);
+  free(triplets);
+  topocentric_point_sources_free(&detections);
+  free(owned_obscode);
+  observatory_table_free(&table);
+  cartesian_orbits_free(&states);
+  cartesian_orbits_free(&truth);
+}
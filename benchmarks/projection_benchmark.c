@@ -3,8 +3,10 @@
 #include <stdlib.h>
 #include <time.h>
 
+#include "arena.h"
 #include "point_sources.h"
 #include "projections.h"
+#include "simd.h"
 
 static double center_position[3] = {0.9, 0.8, 0.01};
 static double center_velocity[3] = {-0.05, 0.05, 0.00001};
@@ -33,9 +35,9 @@ void generate_point_sources(struct CartesianPointSources *cartesian, size_t n) {
   }
 }
 
-double run(struct CartesianPointSources *cartesian, struct GnomonicPointSources *gnomonic) {
+double run(struct CartesianPointSources *cartesian, struct GnomonicPointSources *gnomonic, enum SimdLevel level) {
   clock_t start = clock();
-  cartesian_to_gnomonic(cartesian, center_position, center_velocity, gnomonic);
+  cartesian_to_gnomonic_with_kernel(cartesian, center_position, center_velocity, gnomonic, level);
   clock_t end = clock();
   return (double)(end - start) / CLOCKS_PER_SEC;
 }
@@ -74,19 +76,51 @@ double median(double *xs, size_t n) {
 int main(void) {
   struct CartesianPointSources cartesian = CARTESIAN_POINT_SOURCES_ZERO;
   struct GnomonicPointSources gnomonic = GNOMONIC_POINT_SOURCES_ZERO;
-  gnomonic_point_sources_new(&gnomonic, N_POINTS);
   generate_point_sources(&cartesian, N_POINTS);
 
+  // The output lives in an arena that is reset between runs, so the
+  // timings do not include allocator churn.
+  struct Arena arena;
+  arena_new(&arena, 3 * N_POINTS * sizeof(double) + 3 * ARENA_ALIGNMENT, ARENA_HUGE_PAGES);
+
+  double scalar_median = 0.0;
+  for (int level = SIMD_LEVEL_SCALAR; level < SIMD_LEVEL_COUNT; level++) {
+    if (!simd_level_supported(level)) {
+      printf("%-8s not supported on this CPU\n", simd_level_name(level));
+      continue;
+    }
+    double runs[N_RUNS];
+    for (size_t i = 0; i < N_RUNS; i++) {
+      arena_reset(&arena);
+      gnomonic_point_sources_new_in(&gnomonic, N_POINTS, &arena);
+      double seconds = run(&cartesian, &gnomonic, level);
+      double milliseconds = seconds * 1000.0;
+      runs[i] = milliseconds;
+    }
+    double median_ms = median(runs, N_RUNS);
+    if (level == SIMD_LEVEL_SCALAR) {
+      scalar_median = median_ms;
+    }
+    printf("%-8s Mean: %.6fms  Median: %.6fms  Speedup: %.2fx\n", simd_level_name(level), mean(runs, N_RUNS),
+           median_ms, scalar_median / median_ms);
+  }
+
+  // Single-precision output, with the best kernel. One output is
+  // reused, and each run overwrites it, like the arena above.
+  struct GnomonicPointSourcesF32 gnomonic_f32 = GNOMONIC_POINT_SOURCES_F32_ZERO;
+  gnomonic_point_sources_f32_new(&gnomonic_f32, N_POINTS);
   double runs[N_RUNS];
   for (size_t i = 0; i < N_RUNS; i++) {
-    double seconds = run(&cartesian, &gnomonic);
-    double milliseconds = seconds * 1000.0;
-    runs[i] = milliseconds;
-    gnomonic_point_sources_free(&gnomonic);
-    gnomonic_point_sources_new(&gnomonic, N_POINTS);
+    clock_t start = clock();
+    cartesian_to_gnomonic_f32(&cartesian, center_position, center_velocity, &gnomonic_f32);
+    clock_t end = clock();
+    runs[i] = (double)(end - start) / CLOCKS_PER_SEC * 1000.0;
   }
+  gnomonic_point_sources_f32_free(&gnomonic_f32);
+  double median_ms = median(runs, N_RUNS);
+  printf("%-8s Mean: %.6fms  Median: %.6fms  Speedup: %.2fx\n", "f32", mean(runs, N_RUNS), median_ms,
+         scalar_median / median_ms);
+
   cartesian_point_sources_free(&cartesian);
-  gnomonic_point_sources_free(&gnomonic);
-  printf("Mean: %.6fms\n", mean(runs, N_RUNS));
-  printf("Median: %.6fms\n", median(runs, N_RUNS));
+  arena_free(&arena);
 }
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "orbits.h"
+#include "propagation.h"
+#include "thread_pool.h"
+
+#define N_ORBITS 10000
+#define N_EPOCHS 100
+#define N_RUNS 3
+
+static const size_t thread_counts[] = {1, 2, 4, 8, 16};
+
+double rand_double(void) {
+  // Generate a random double in the range [0, 1).
+  return (double)rand() / RAND_MAX;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+  // Main-belt-like test orbits, propagated over a month of exposures.
+  struct CartesianOrbits orbits;
+  cartesian_orbits_new(&orbits, N_ORBITS);
+  for (size_t i = 0; i < N_ORBITS; i++) {
+    double r = 2.0 + rand_double();
+    double pos[3] = {r, 0.0, 0.1 * (rand_double() - 0.5)};
+    double vel[3] = {0.002 * (rand_double() - 0.5), 0.0172 / 1.5 * (0.9 + 0.2 * rand_double()), 0.0};
+    cartesian_orbits_push(&orbits, pos, vel, 59000.0);
+  }
+  double epochs[N_EPOCHS];
+  for (size_t e = 0; e < N_EPOCHS; e++) {
+    epochs[e] = 59000.0 + 0.3 * e;
+  }
+
+  printf("%d orbits x %d epochs\n", N_ORBITS, N_EPOCHS);
+  double single_thread = 0.0;
+  for (size_t k = 0; k < sizeof(thread_counts) / sizeof(thread_counts[0]); k++) {
+    struct ThreadPool pool;
+    thread_pool_new(&pool, thread_counts[k]);
+    double best = -1.0;
+    for (size_t run = 0; run < N_RUNS; run++) {
+      struct CartesianOrbits out;
+      cartesian_orbits_new(&out, (size_t)N_ORBITS * N_EPOCHS);
+      double start = now();
+      propagate_orbits(&orbits, epochs, N_EPOCHS, PROPAGATION_MU_SUN, &pool, &out);
+      double seconds = now() - start;
+      cartesian_orbits_free(&out);
+      if (best < 0 || seconds < best) {
+        best = seconds;
+      }
+    }
+    thread_pool_free(&pool);
+    if (k == 0) {
+      single_thread = best;
+    }
+    printf("%3zu threads: %9.3fms  %8.2f Mstates/s  Speedup: %5.2fx\n", thread_counts[k], best * 1000.0,
+           (double)N_ORBITS * N_EPOCHS / best / 1e6, single_thread / best);
+  }
+
+  cartesian_orbits_free(&orbits);
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "projections.h"
+
+#define N_FRAMES (100000 * 30)
+#define N_RUNS 5
+
+double rand_double(void) {
+  // Generate a random double in the range [0, 1).
+  return (double)rand() / RAND_MAX;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+  // 1e5 test orbits at 30 epochs each.
+  double *columns[6];
+  for (int c = 0; c < 6; c++) {
+    columns[c] = malloc(N_FRAMES * sizeof(double));
+    for (size_t i = 0; i < N_FRAMES; i++) {
+      columns[c][i] = c < 3 ? 4.0 * rand_double() - 2.0 : 0.04 * rand_double() - 0.02;
+    }
+  }
+  double(*rotations)[3][3] = malloc(N_FRAMES * sizeof(double[3][3]));
+
+  double batch = -1.0, single = -1.0;
+  for (int run = 0; run < N_RUNS; run++) {
+    double start = now();
+    gnomonic_rotation_matrices(columns[0], columns[1], columns[2], columns[3], columns[4], columns[5], N_FRAMES,
+                               rotations);
+    double seconds = now() - start;
+    batch = batch < 0 || seconds < batch ? seconds : batch;
+
+    // One call per frame, as building frames one orbit at a time does.
+    start = now();
+    for (size_t i = 0; i < N_FRAMES; i++) {
+      gnomonic_rotation_matrices(columns[0] + i, columns[1] + i, columns[2] + i, columns[3] + i, columns[4] + i,
+                                 columns[5] + i, 1, rotations + i);
+    }
+    seconds = now() - start;
+    single = single < 0 || seconds < single ? seconds : single;
+  }
+
+  printf("%d frames\n", N_FRAMES);
+  printf("one at a time: %9.3fms  %8.1f Mframes/s\n", single * 1000.0, N_FRAMES / single / 1e6);
+  printf("batched:       %9.3fms  %8.1f Mframes/s  Speedup: %5.2fx\n", batch * 1000.0, N_FRAMES / batch / 1e6,
+         single / batch);
+
+  free(rotations);
+  for (int c = 0; c < 6; c++) {
+    free(columns[c]);
+  }
+}
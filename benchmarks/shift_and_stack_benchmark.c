@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "point_sources.h"
+#include "shift_and_stack.h"
+#include "thread_pool.h"
+
+#define N_POINTS 100000
+#define N_V 41
+#define N_RUNS 3
+
+static const size_t thread_counts[] = {1, 2, 4, 8, 16, 32, 64};
+
+double rand_double(void) {
+  // Generate a random double in the range [0, 1).
+  return (double)rand() / RAND_MAX;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+  struct GnomonicPointSources gnomonic = GNOMONIC_POINT_SOURCES_ZERO;
+  gnomonic_point_sources_new(&gnomonic, N_POINTS);
+  for (size_t i = 0; i < N_POINTS; i++) {
+    gnomonic_point_sources_push(&gnomonic, rand_double() * 4 - 2, rand_double() * 4 - 2, 59000.0 + rand() % 10);
+  }
+
+  double vx[N_V * N_V], vy[N_V * N_V];
+  for (size_t i = 0; i < N_V; i++) {
+    for (size_t j = 0; j < N_V; j++) {
+      vx[i * N_V + j] = -0.2 + 0.01 * i;
+      vy[i * N_V + j] = -0.2 + 0.01 * j;
+    }
+  }
+  struct ShiftStackParams params = {
+      .t0 = 59005.0, .bin_size = 0.005, .x_min = -2.0, .x_max = 2.0, .y_min = -2.0, .y_max = 2.0, .min_count = 4};
+
+  printf("%d points x %d velocities\n", N_POINTS, N_V * N_V);
+  double single_thread = 0.0;
+  for (size_t k = 0; k < sizeof(thread_counts) / sizeof(thread_counts[0]); k++) {
+    struct ThreadPool pool;
+    thread_pool_new(&pool, thread_counts[k]);
+    double best = -1.0;
+    for (size_t i = 0; i < N_RUNS; i++) {
+      struct ShiftStackHits hits = SHIFT_STACK_HITS_ZERO;
+      double start = now();
+      shift_and_stack(&gnomonic, vx, vy, N_V * N_V, &params, &pool, &hits);
+      double seconds = now() - start;
+      shift_stack_hits_free(&hits);
+      if (best < 0 || seconds < best) {
+        best = seconds;
+      }
+    }
+    thread_pool_free(&pool);
+    if (k == 0) {
+      single_thread = best;
+    }
+    double shifts = (double)N_POINTS * N_V * N_V;
+    // Per shifted point: read x, y and dt, write a bin index, then read
+    // it back twice for counting and thresholding.
+    double bytes = shifts * (3 * sizeof(double) + 3 * sizeof(uint32_t));
+    printf("%3zu threads: %9.3fms  %8.1f Mshifts/s  %6.2f GB/s  Speedup: %5.2fx\n", thread_counts[k],
+           best * 1000.0, shifts / best / 1e6, bytes / best / 1e9, single_thread / best);
+  }
+
+  gnomonic_point_sources_free(&gnomonic);
+}
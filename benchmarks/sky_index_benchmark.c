@@ -0,0 +1,80 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "point_sources.h"
+#include "projections.h"
+#include "sky_index.h"
+
+#define N_POINTS 1000000
+#define N_EPOCHS 20
+#define N_ORBITS 64
+#define RADIUS 2.0
+
+double rand_double(void) {
+  // Generate a random double in the range [0, 1).
+  return (double)rand() / RAND_MAX;
+}
+
+void random_direction(double out[3]) {
+  double z = 2.0 * rand_double() - 1.0;
+  double phi = 2.0 * M_PI * rand_double();
+  out[0] = sqrt(1.0 - z * z) * cos(phi);
+  out[1] = sqrt(1.0 - z * z) * sin(phi);
+  out[2] = z;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+  // A full-sky catalogue, as in a survey's worth of exposures.
+  struct CartesianPointSources cartesian;
+  cartesian_point_sources_new(&cartesian, N_POINTS);
+  for (size_t i = 0; i < N_POINTS; i++) {
+    double d[3];
+    random_direction(d);
+    double r = 2.0 + rand_double();
+    cartesian_point_sources_push(&cartesian, r * d[0], r * d[1], r * d[2], 59000.0 + (double)(i % N_EPOCHS));
+  }
+  double centers[N_ORBITS][3];
+  double velocity[3] = {0.0, 0.0, 0.01};
+  for (size_t i = 0; i < N_ORBITS; i++) {
+    random_direction(centers[i]);
+  }
+
+  double start = now();
+  struct SkyIndex index;
+  sky_index_new(&index, &cartesian, SKY_INDEX_DEFAULT_RESOLUTION);
+  double build = now() - start;
+
+  // Each loop reuses one output for every orbit, as a search would.
+  struct GnomonicPointSources gnomonic;
+  gnomonic_point_sources_new(&gnomonic, N_POINTS);
+  start = now();
+  for (size_t i = 0; i < N_ORBITS; i++) {
+    cartesian_to_gnomonic(&cartesian, centers[i], velocity, &gnomonic);
+  }
+  double full = now() - start;
+
+  size_t projected = 0;
+  start = now();
+  for (size_t i = 0; i < N_ORBITS; i++) {
+    cartesian_to_gnomonic_indexed(&index, 0, index.n_epochs, centers[i], velocity, RADIUS, &gnomonic, NULL);
+    projected += gnomonic.x.length;
+  }
+  double culled = now() - start;
+  gnomonic_point_sources_free(&gnomonic);
+
+  printf("%d detections, %d epochs, %d orbits, %.1f degree cone\n", N_POINTS, N_EPOCHS, N_ORBITS, RADIUS);
+  printf("index build: %9.3fms\n", build * 1000.0);
+  printf("full:        %9.3fms  (%d projections)\n", full * 1000.0, N_POINTS * N_ORBITS);
+  printf("indexed:     %9.3fms  (%zu projections)  Speedup: %5.1fx\n", culled * 1000.0, projected, full / culled);
+
+  sky_index_free(&index);
+  cartesian_point_sources_free(&cartesian);
+}
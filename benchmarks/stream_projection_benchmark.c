@@ -0,0 +1,103 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "point_sources.h"
+#include "projections.h"
+
+static double center_position[3] = {0.9, 0.8, 0.01};
+static double center_velocity[3] = {-0.05, 0.05, 0.00001};
+
+#define TIME 1.0
+#define N_POINTS 4000000
+#define N_RUNS 5
+
+// A grid-binning pass, standing in for the first step of clustering:
+// counts the points in each GRID_CELL-degree cell of a square GRID_SIZE
+// cells across, centered on the origin.
+#define GRID_SIZE 512
+#define GRID_CELL 0.05
+
+static const size_t block_sizes[] = {1024, 4096, 16384, 65536};
+
+double rand_double(void) {
+  // Generate a random double in the range [0, 1).
+  return (double)rand() / RAND_MAX;
+}
+
+double rand_near(double x) {
+  // Generate a random double in the range [x - 0.1, x + 0.1).
+  return x + (rand_double() - 0.5) / 5.0;
+}
+
+void generate_point_sources(struct CartesianPointSources *cartesian, size_t n) {
+  cartesian_point_sources_new(cartesian, n);
+  for (size_t i = 0; i < n; i++) {
+    cartesian_point_sources_push(cartesian, rand_near(center_position[0]), rand_near(center_position[1]),
+                                 rand_near(center_position[2]), TIME);
+  }
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bin(const double *x, const double *y, size_t n, unsigned *grid) {
+  for (size_t i = 0; i < n; i++) {
+    double col = floor(x[i] / GRID_CELL) + GRID_SIZE / 2;
+    double row = floor(y[i] / GRID_CELL) + GRID_SIZE / 2;
+    if (col >= 0 && col < GRID_SIZE && row >= 0 && row < GRID_SIZE) {
+      grid[(size_t)row * GRID_SIZE + (size_t)col]++;
+    }
+  }
+}
+
+static int bin_block(struct GnomonicPointSources *block, size_t offset, void *context) {
+  (void)offset;
+  bin(block->x.data, block->y.data, block->x.length, context);
+  return 0;
+}
+
+int main(void) {
+  struct CartesianPointSources cartesian = CARTESIAN_POINT_SOURCES_ZERO;
+  generate_point_sources(&cartesian, N_POINTS);
+  unsigned *grid = malloc(GRID_SIZE * GRID_SIZE * sizeof(unsigned));
+
+  // Materialize the whole projection, then bin it.
+  double best = INFINITY;
+  for (size_t r = 0; r < N_RUNS; r++) {
+    memset(grid, 0, GRID_SIZE * GRID_SIZE * sizeof(unsigned));
+    struct GnomonicPointSources gnomonic = GNOMONIC_POINT_SOURCES_ZERO;
+    gnomonic_point_sources_new(&gnomonic, N_POINTS);
+    double start = now();
+    cartesian_to_gnomonic(&cartesian, center_position, center_velocity, &gnomonic);
+    bin(gnomonic.x.data, gnomonic.y.data, gnomonic.x.length, grid);
+    double seconds = now() - start;
+    best = seconds < best ? seconds : best;
+    gnomonic_point_sources_free(&gnomonic);
+  }
+  printf("%-16s Best: %.3fms  Output memory: %zu KiB\n", "materialized", best * 1000.0,
+         3 * N_POINTS * sizeof(double) / 1024);
+
+  for (size_t b = 0; b < sizeof(block_sizes) / sizeof(block_sizes[0]); b++) {
+    best = INFINITY;
+    for (size_t r = 0; r < N_RUNS; r++) {
+      memset(grid, 0, GRID_SIZE * GRID_SIZE * sizeof(unsigned));
+      double start = now();
+      cartesian_to_gnomonic_stream(&cartesian, center_position, center_velocity, block_sizes[b], bin_block, grid);
+      double seconds = now() - start;
+      best = seconds < best ? seconds : best;
+    }
+    char label[32];
+    snprintf(label, sizeof(label), "stream %zu", block_sizes[b]);
+    printf("%-16s Best: %.3fms  Output memory: %zu KiB\n", label, best * 1000.0,
+           2 * block_sizes[b] * sizeof(double) / 1024);
+  }
+
+  free(grid);
+  cartesian_point_sources_free(&cartesian);
+}
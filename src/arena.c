@@ -0,0 +1,52 @@
+#include "arena.h"
+
+#include <stddef.h>
+#include <sys/mman.h>
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+int arena_new(struct Arena *arena, size_t size, int flags) {
+  *arena = (struct Arena)ARENA_ZERO;
+  if (size < 1) {
+    return -1;
+  }
+  if (flags & ARENA_HUGE_PAGES) {
+    // Whole huge pages only, so none of the arena falls back to small
+    // pages at the edges.
+    size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  }
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    return -1;
+  }
+#ifdef MADV_HUGEPAGE
+  if (flags & ARENA_HUGE_PAGES) {
+    // Only advice: the arena still works if the kernel says no.
+    madvise(base, size, MADV_HUGEPAGE);
+  }
+#endif
+  arena->base = base;
+  arena->size = size;
+  arena->used = 0;
+  arena->flags = flags;
+  return 0;
+}
+
+void arena_free(struct Arena *arena) {
+  if (arena->base != NULL) {
+    munmap(arena->base, arena->size);
+  }
+  *arena = (struct Arena)ARENA_ZERO;
+}
+
+void *arena_alloc(struct Arena *arena, size_t size) {
+  // The base is page aligned, so aligning offsets aligns addresses.
+  size_t start = (arena->used + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+  if (start > arena->size || size > arena->size - start) {
+    return NULL;
+  }
+  arena->used = start + size;
+  return arena->base + start;
+}
+
+void arena_reset(struct Arena *arena) { arena->used = 0; }
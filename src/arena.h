@@ -0,0 +1,40 @@
+#ifndef arena_h
+#define arena_h
+
+#include <stddef.h>
+
+#define ARENA_ALIGNMENT 64
+
+enum ArenaFlags {
+  ARENA_DEFAULT = 0,
+  /// Ask the kernel to back the arena with transparent huge pages.
+  ARENA_HUGE_PAGES = 1,
+};
+
+struct Arena {
+  /// A bump allocator over one large mapping. Allocations are
+  /// cache-line aligned and are released all at once by arena_reset,
+  /// so the memory can be reused (for example, once per test orbit)
+  /// without going back to the system allocator.
+  char *base;
+  size_t size;
+  size_t used;
+  int flags;
+};
+
+#define ARENA_ZERO {.base = NULL, .size = 0, .used = 0, .flags = 0}
+
+/// Reserves size bytes for the arena. flags is a combination of
+/// ArenaFlags. Returns 0 on success, -1 on failure.
+int arena_new(struct Arena *arena, size_t size, int flags);
+void arena_free(struct Arena *arena);
+
+/// Returns size bytes aligned to ARENA_ALIGNMENT, or NULL if the arena
+/// does not have that much space left.
+void *arena_alloc(struct Arena *arena, size_t size);
+
+/// Releases every allocation at once. Memory handed out before the
+/// reset must no longer be used.
+void arena_reset(struct Arena *arena);
+
+#endif
@@ -0,0 +1,301 @@
+#include "clustering.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "instrument.h"
+#include "point_sources.h"
+
+#define NO_CLUSTER UINT32_MAX
+
+struct HashGrid {
+  /// Points bucketed by grid cell. Cells are hashed into a power of two
+  /// number of buckets; points are stored sorted by bucket, so the
+  /// points of one bucket are contiguous. An extra final bucket holds
+  /// points with non-finite coordinates, and is never queried.
+  double inv_cell_size;
+  uint64_t mask;
+  uint32_t *bucket_start;  // mask + 3 entries.
+  uint32_t *order;         // Sorted position -> input index.
+  double *x;               // Coordinates in sorted order.
+  double *y;
+};
+
+static uint64_t hash_cell(int64_t cx, int64_t cy) {
+  uint64_t h = (uint64_t)cx * 0x9E3779B97F4A7C15ULL + (uint64_t)cy * 0xC2B2AE3D27D4EB4FULL;
+  return h ^ (h >> 29);
+}
+
+static int cell_of(struct HashGrid *grid, double x, double y, int64_t *cx, int64_t *cy) {
+  double fx = floor(x * grid->inv_cell_size);
+  double fy = floor(y * grid->inv_cell_size);
+  // Also rejects cells too far out to index, which only happens for
+  // absurd radius / coordinate combinations.
+  if (!(fabs(fx) < 4e18 && fabs(fy) < 4e18)) {
+    return -1;
+  }
+  *cx = (int64_t)fx;
+  *cy = (int64_t)fy;
+  return 0;
+}
+
+static void hash_grid_free(struct HashGrid *grid) {
+  free(grid->bucket_start);
+  free(grid->order);
+  free(grid->x);
+  free(grid->y);
+}
+
+static int hash_grid_build(struct HashGrid *grid, const double *x, const double *y, uint32_t n, double cell_size) {
+  uint64_t n_buckets = 16;
+  while (n_buckets < n) {
+    n_buckets *= 2;
+  }
+  grid->inv_cell_size = 1.0 / cell_size;
+  grid->mask = n_buckets - 1;
+  grid->bucket_start = calloc(n_buckets + 2, sizeof(uint32_t));
+  grid->order = malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+  grid->x = malloc((n > 0 ? n : 1) * sizeof(double));
+  grid->y = malloc((n > 0 ? n : 1) * sizeof(double));
+  uint32_t *bucket_of = malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+  if (grid->bucket_start == NULL || grid->order == NULL || grid->x == NULL || grid->y == NULL ||
+      bucket_of == NULL) {
+    free(bucket_of);
+    hash_grid_free(grid);
+    return -1;
+  }
+
+  // Counting sort by bucket.
+  for (uint32_t i = 0; i < n; i++) {
+    int64_t cx, cy;
+    uint32_t bucket = (uint32_t)n_buckets;
+    if (cell_of(grid, x[i], y[i], &cx, &cy) == 0) {
+      bucket = (uint32_t)(hash_cell(cx, cy) & grid->mask);
+    }
+    bucket_of[i] = bucket;
+    grid->bucket_start[bucket + 1]++;
+  }
+  for (uint64_t b = 0; b <= n_buckets; b++) {
+    grid->bucket_start[b + 1] += grid->bucket_start[b];
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t k = grid->bucket_start[bucket_of[i]]++;
+    grid->order[k] = i;
+    grid->x[k] = x[i];
+    grid->y[k] = y[i];
+  }
+  // The scatter advanced each start to the next bucket's start; shift
+  // them back.
+  memmove(grid->bucket_start + 1, grid->bucket_start, (n_buckets + 1) * sizeof(uint32_t));
+  grid->bucket_start[0] = 0;
+
+  free(bucket_of);
+  return 0;
+}
+
+// Finds the distinct buckets covering the 3x3 block of cells around a
+// point. Returns how many there are, or 0 for a non-finite point.
+static size_t neighbour_buckets(struct HashGrid *grid, double x, double y, uint32_t buckets[9]) {
+  int64_t cx, cy;
+  if (cell_of(grid, x, y, &cx, &cy) != 0) {
+    return 0;
+  }
+  size_t n = 0;
+  for (int64_t dx = -1; dx <= 1; dx++) {
+    for (int64_t dy = -1; dy <= 1; dy++) {
+      uint32_t bucket = (uint32_t)(hash_cell(cx + dx, cy + dy) & grid->mask);
+      int seen = 0;
+      for (size_t i = 0; i < n; i++) {
+        seen |= buckets[i] == bucket;
+      }
+      if (!seen) {
+        buckets[n++] = bucket;
+      }
+    }
+  }
+  return n;
+}
+
+static uint32_t find_root(uint32_t *parent, uint32_t i) {
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+static void join(uint32_t *parent, uint32_t a, uint32_t b) {
+  a = find_root(parent, a);
+  b = find_root(parent, b);
+  // Keep the smaller index as the root, so the result does not depend
+  // on visiting order.
+  if (a < b) {
+    parent[b] = a;
+  } else if (b < a) {
+    parent[a] = b;
+  }
+}
+
+void clusters_free(struct Clusters *clusters) {
+  free(clusters->offsets);
+  free(clusters->indices);
+  clusters->offsets = NULL;
+  clusters->indices = NULL;
+  clusters->n_clusters = 0;
+}
+
+enum ClusteringError cluster_gnomonic(struct GnomonicPointSources *gnomonic, double radius, size_t min_samples,
+                                     struct Clusters *clusters) {
+  INSTRUMENT_SCOPE(INSTRUMENT_CLUSTERING, gnomonic->x.length);
+  *clusters = (struct Clusters)CLUSTERS_ZERO;
+  if (!(radius > 0) || min_samples < 1) {
+    return CLUSTERING_ERROR_INVALID_ARGUMENT;
+  }
+  if (gnomonic->x.length >= UINT32_MAX) {
+    return CLUSTERING_ERROR_TOO_MANY_POINTS;
+  }
+  uint32_t n = (uint32_t)gnomonic->x.length;
+
+  struct HashGrid grid;
+  if (hash_grid_build(&grid, gnomonic->x.data, gnomonic->y.data, n, radius) != 0) {
+    return CLUSTERING_ERROR_OUT_OF_MEMORY;
+  }
+
+  // Everything below works in sorted (bucket) order, so that the
+  // points of a query are contiguous in memory.
+  uint8_t *is_core = calloc(n > 0 ? n : 1, sizeof(uint8_t));
+  uint32_t *parent = malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+  uint32_t *cluster_of = malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+  if (is_core == NULL || parent == NULL || cluster_of == NULL) {
+    free(is_core);
+    free(parent);
+    free(cluster_of);
+    hash_grid_free(&grid);
+    return CLUSTERING_ERROR_OUT_OF_MEMORY;
+  }
+
+  double r_squared = radius * radius;
+  uint32_t buckets[9];
+
+  // Pass 1: find core points.
+  for (uint32_t k = 0; k < n; k++) {
+    double px = grid.x[k], py = grid.y[k];
+    size_t n_buckets = neighbour_buckets(&grid, px, py, buckets);
+    size_t count = 0;
+    for (size_t b = 0; b < n_buckets && count < min_samples; b++) {
+      for (uint32_t j = grid.bucket_start[buckets[b]]; j < grid.bucket_start[buckets[b] + 1]; j++) {
+        double dx = grid.x[j] - px, dy = grid.y[j] - py;
+        count += dx * dx + dy * dy <= r_squared;
+      }
+    }
+    is_core[k] = count >= min_samples;
+    parent[k] = k;
+  }
+
+  // Pass 2: join core points that are neighbours, and attach border
+  // points to the first core neighbour found.
+  for (uint32_t k = 0; k < n; k++) {
+    cluster_of[k] = NO_CLUSTER;
+    double px = grid.x[k], py = grid.y[k];
+    size_t n_buckets = neighbour_buckets(&grid, px, py, buckets);
+    for (size_t b = 0; b < n_buckets; b++) {
+      for (uint32_t j = grid.bucket_start[buckets[b]]; j < grid.bucket_start[buckets[b] + 1]; j++) {
+        if (!is_core[j]) {
+          continue;
+        }
+        double dx = grid.x[j] - px, dy = grid.y[j] - py;
+        if (dx * dx + dy * dy > r_squared) {
+          continue;
+        }
+        if (is_core[k]) {
+          if (j > k) {
+            join(parent, k, j);
+          }
+        } else if (cluster_of[k] == NO_CLUSTER) {
+          // Remember the core point; its root is resolved below, once
+          // all joins are done.
+          cluster_of[k] = j;
+        }
+      }
+    }
+  }
+
+  // Resolve every clustered point to a root, in input order, and number
+  // the roots by first appearance.
+  uint32_t *label = malloc((n > 0 ? n : 1) * sizeof(uint32_t));    // Input index -> cluster, or NO_CLUSTER.
+  uint32_t *number = malloc((n > 0 ? n : 1) * sizeof(uint32_t));   // Root -> cluster, or NO_CLUSTER.
+  if (label == NULL || number == NULL) {
+    free(label);
+    free(number);
+    free(is_core);
+    free(parent);
+    free(cluster_of);
+    hash_grid_free(&grid);
+    return CLUSTERING_ERROR_OUT_OF_MEMORY;
+  }
+  for (uint32_t k = 0; k < n; k++) {
+    number[k] = NO_CLUSTER;
+  }
+  for (uint32_t k = 0; k < n; k++) {
+    uint32_t root = NO_CLUSTER;
+    if (is_core[k]) {
+      root = find_root(parent, k);
+    } else if (cluster_of[k] != NO_CLUSTER) {
+      root = find_root(parent, cluster_of[k]);
+    }
+    // Temporarily store roots; they are renumbered below.
+    label[grid.order[k]] = root;
+  }
+
+  size_t n_clusters = 0;
+  size_t n_members = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t root = label[i];
+    if (root == NO_CLUSTER) {
+      continue;
+    }
+    if (number[root] == NO_CLUSTER) {
+      number[root] = (uint32_t)n_clusters++;
+    }
+    label[i] = number[root];
+    n_members++;
+  }
+
+  enum ClusteringError status = CLUSTERING_ERROR_NONE;
+  clusters->offsets = calloc(n_clusters + 1, sizeof(size_t));
+  clusters->indices = malloc((n_members > 0 ? n_members : 1) * sizeof(uint32_t));
+  if (clusters->offsets == NULL || clusters->indices == NULL) {
+    clusters_free(clusters);
+    status = CLUSTERING_ERROR_OUT_OF_MEMORY;
+    goto done;
+  }
+  clusters->n_clusters = n_clusters;
+  for (uint32_t i = 0; i < n; i++) {
+    if (label[i] != NO_CLUSTER) {
+      clusters->offsets[label[i] + 1]++;
+    }
+  }
+  for (size_t c = 0; c < n_clusters; c++) {
+    clusters->offsets[c + 1] += clusters->offsets[c];
+  }
+  // Fill using the cluster numbering scratch space as write cursors.
+  for (size_t c = 0; c < n_clusters; c++) {
+    number[c] = (uint32_t)clusters->offsets[c];
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    if (label[i] != NO_CLUSTER) {
+      clusters->indices[number[label[i]]++] = i;
+    }
+  }
+
+done:
+  free(label);
+  free(number);
+  free(is_core);
+  free(parent);
+  free(cluster_of);
+  hash_grid_free(&grid);
+  return status;
+}
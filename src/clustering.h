@@ -0,0 +1,49 @@
+#ifndef clustering_h
+#define clustering_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "point_sources.h"
+
+enum ClusteringError {
+  CLUSTERING_ERROR_NONE = 0,
+  CLUSTERING_ERROR_INVALID_ARGUMENT = -1,
+  CLUSTERING_ERROR_OUT_OF_MEMORY = -2,
+  CLUSTERING_ERROR_TOO_MANY_POINTS = -3,
+};
+
+struct Clusters {
+  /// Cluster membership in compressed form. The detections in cluster
+  /// i are indices[offsets[i]] through indices[offsets[i + 1] - 1], in
+  /// increasing order. Clusters are numbered in order of their lowest
+  /// detection index.
+  size_t n_clusters;
+  size_t *offsets;
+  uint32_t *indices;
+};
+
+#define CLUSTERS_ZERO {.n_clusters = 0, .offsets = NULL, .indices = NULL}
+
+void clusters_free(struct Clusters *clusters);
+
+/// Finds density-connected clusters (DBSCAN) among gnomonic points,
+/// using the x and y columns.
+///
+/// A point is a core point if at least min_samples points (counting
+/// itself) lie within radius of it. Core points within radius of each
+/// other share a cluster; other points join the cluster of a core
+/// point within radius, if any, and are otherwise noise. Noise is left
+/// out of the result.
+///
+/// Points are binned into a flat hash grid of radius-sized cells, so
+/// each neighbour query only visits the 3x3 block of cells around a
+/// point.
+///
+/// clusters must be zeroed or freed; it is overwritten.
+///
+/// Returns 0 on success, or an error code on failure.
+enum ClusteringError cluster_gnomonic(struct GnomonicPointSources *gnomonic, double radius, size_t min_samples,
+                                     struct Clusters *clusters);
+
+#endif
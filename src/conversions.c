@@ -0,0 +1,169 @@
+#include "conversions.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "observatories.h"
+#include "point_sources.h"
+#include "simd.h"
+#include "vectors.h"
+
+#define DEG_TO_RAD (M_PI / 180.0)
+
+// Number of observer positions topocentric_to_cartesian remembers. A
+// power of two, comfortably more than the sites of one night's
+// exposures that interleave in a batch.
+#define POSITION_CACHE_SIZE 64
+
+struct CachedPosition {
+  /// The observer position of one (obscode id, exposure time) pair. An
+  /// empty slot has a NaN t, which matches no exposure.
+  double t;
+  uint16_t obscode_id;
+  double position[3];
+};
+
+static size_t position_slot(uint16_t obscode_id, double t) {
+  uint64_t bits;
+  memcpy(&bits, &t, sizeof(bits));
+  uint64_t h = (bits ^ ((uint64_t)obscode_id << 48)) * 0x9E3779B97F4A7C15ull;
+  return (size_t)(h >> 58) & (POSITION_CACHE_SIZE - 1);
+}
+
+// Adding and then subtracting 1.5 * 2^52 rounds a double of magnitude
+// below 2^51 to the nearest integer, without a call the vectorizer
+// would have to keep scalar.
+#define ROUNDING_SHIFTER 0x1.8p52
+
+// Minimax coefficients for sin and cos on [-pi/4, pi/4], from fdlibm's
+// __kernel_sin and __kernel_cos.
+#define S1 -1.66666666666666324348e-01
+#define S2 8.33333333332248946124e-03
+#define S3 -1.98412698298579493134e-04
+#define S4 2.75573137070700676789e-06
+#define S5 -2.50507602534068634195e-08
+#define S6 1.58969099521155010221e-10
+#define C1 4.16666666666666019037e-02
+#define C2 -1.38888888888741095749e-03
+#define C3 2.48015872894767294178e-05
+#define C4 -2.75573143513906633035e-07
+#define C5 2.08757232129817482790e-09
+#define C6 -1.13596475577881948265e-11
+
+// Computes the sine and cosine of an angle in degrees, to within about
+// an ulp of libm's, with no branches or calls, so that a loop over it
+// vectorizes. The angle is reduced by the nearest multiple of 90
+// degrees, which is exact in degrees, and the polynomials' results are
+// swapped and negated for the quadrant by weights of 0 or 1 and of 1 or
+// -1: gcc will not if-convert a choice between two computed doubles.
+static inline void sincos_degrees(double degrees, double *sine, double *cosine) {
+  double k = (degrees * (1.0 / 90.0) + ROUNDING_SHIFTER) - ROUNDING_SHIFTER;
+  double x = (degrees - k * 90.0) * DEG_TO_RAD;
+  // The quadrant, k mod 4, from 0 to 3.
+  double q = k - 4.0 * ((k * 0.25 + ROUNDING_SHIFTER) - ROUNDING_SHIFTER);
+  q += q < 0.0 ? 4.0 : 0.0;
+
+  double z = x * x;
+  double w = z * z;
+  double r = S2 + z * (S3 + z * S4) + z * w * (S5 + z * S6);
+  double s = x + z * x * (S1 + z * r);
+  r = z * (C1 + z * (C2 + z * C3)) + w * w * (C4 + z * (C5 + z * C6));
+  double hz = 0.5 * z;
+  double one_minus_hz = 1.0 - hz;
+  double c = one_minus_hz + (((1.0 - one_minus_hz) - hz) + z * r);
+
+  // Quadrants 1 and 3 swap sine and cosine; 2 and 3 negate the sine,
+  // and 1 and 2 the cosine.
+  double odd = fabs(q - 2.0) == 1.0 ? 1.0 : 0.0;
+  double sine_sign = q > 1.5 ? -1.0 : 1.0;
+  double cosine_sign = fabs(q - 1.5) < 1.0 ? -1.0 : 1.0;
+  *sine = sine_sign * (odd * c + (1.0 - odd) * s);
+  *cosine = cosine_sign * (odd * s + (1.0 - odd) * c);
+}
+
+// Converts one run of detections that share an observer position.
+SIMD_TARGET_CLONES
+static void convert_run(const double *ra, const double *dec, size_t n, double observer[3], double r_squared,
+                        double *x, double *y, double *z) {
+  double ox = observer[0], oy = observer[1], oz = observer[2];
+  double c = ox * ox + oy * oy + oz * oz - r_squared;
+  for (size_t i = 0; i < n; i++) {
+    double sin_ra, cos_ra, sin_dec, cos_dec;
+    sincos_degrees(ra[i], &sin_ra, &cos_ra);
+    sincos_degrees(dec[i], &sin_dec, &cos_dec);
+    double ux = cos_dec * cos_ra;
+    double uy = cos_dec * sin_ra;
+    double uz = sin_dec;
+
+    // Solve |observer + rho * u| = r for the far root rho. sqrt of a
+    // negative discriminant yields NaN, which is what we report for
+    // lines of sight that miss the sphere.
+    double b = ox * ux + oy * uy + oz * uz;
+    double rho = -b + sqrt(b * b - c);
+
+    x[i] = ox + rho * ux;
+    y[i] = oy + rho * uy;
+    z[i] = oz + rho * uz;
+  }
+}
+
+enum ConversionError topocentric_to_cartesian(struct TopocentricPointSources *topocentric,
+                                              struct ObservatoryTable *observatories, double heliocentric_distance,
+                                              struct CartesianPointSources *cartesian) {
+  size_t n = topocentric->ra.length;
+  if (n == 0) {
+    return CONVERSION_ERROR_NONE;
+  }
+  // Growing geometrically keeps repeated appends to one output linear.
+  size_t offset = cartesian->x.length;
+  size_t capacity = vec_grown_capacity(cartesian->x.capacity, offset + n);
+  if (vec_f64_reserve(&cartesian->x, capacity) != 0 || vec_f64_reserve(&cartesian->y, capacity) != 0 ||
+      vec_f64_reserve(&cartesian->z, capacity) != 0 || vec_f64_reserve(&cartesian->t, capacity) != 0) {
+    return CONVERSION_ERROR_OUT_OF_MEMORY;
+  }
+
+  const double *t = topocentric->t.data;
+  const uint16_t *obscode_id = topocentric->obscode_id.data;
+  double r_squared = heliocentric_distance * heliocentric_distance;
+  struct CachedPosition cache[POSITION_CACHE_SIZE];
+  for (size_t i = 0; i < POSITION_CACHE_SIZE; i++) {
+    cache[i].t = NAN;
+  }
+  size_t start = 0;
+  while (start < n) {
+    size_t end = start + 1;
+    while (end < n && t[end] == t[start] && obscode_id[end] == obscode_id[start]) {
+      end++;
+    }
+
+    // Rows of one exposure are usually adjacent, but several sites'
+    // exposures may interleave, so positions are cached by (obscode
+    // id, time) rather than only reused for the next run.
+    struct CachedPosition *cached = &cache[position_slot(obscode_id[start], t[start])];
+    if (cached->t != t[start] || cached->obscode_id != obscode_id[start]) {
+      struct ObservatoryEphemeris *ephemeris = observatory_table_find_id(observatories, obscode_id[start]);
+      if (ephemeris == NULL) {
+        return CONVERSION_ERROR_UNKNOWN_OBSERVATORY;
+      }
+      if (observatory_ephemeris_position(ephemeris, t[start], cached->position) != OBSERVATORY_ERROR_NONE) {
+        cached->t = NAN;
+        return CONVERSION_ERROR_OUT_OF_RANGE;
+      }
+      cached->t = t[start];
+      cached->obscode_id = obscode_id[start];
+    }
+    convert_run(topocentric->ra.data + start, topocentric->dec.data + start, end - start, cached->position, r_squared,
+                cartesian->x.data + offset + start, cartesian->y.data + offset + start,
+                cartesian->z.data + offset + start);
+    start = end;
+  }
+
+  memcpy(cartesian->t.data + offset, t, n * sizeof(double));
+  cartesian->x.length = offset + n;
+  cartesian->y.length = offset + n;
+  cartesian->z.length = offset + n;
+  cartesian->t.length = offset + n;
+  return CONVERSION_ERROR_NONE;
+}
@@ -0,0 +1,41 @@
+#ifndef conversions_h
+#define conversions_h
+
+#include "observatories.h"
+#include "point_sources.h"
+
+enum ConversionError {
+  CONVERSION_ERROR_NONE = 0,
+  CONVERSION_ERROR_UNKNOWN_OBSERVATORY = -1,
+  CONVERSION_ERROR_OUT_OF_RANGE = -2,
+  CONVERSION_ERROR_OUT_OF_MEMORY = -3,
+};
+
+/// Converts topocentric detections into heliocentric Cartesian point
+/// sources, assuming every detection lies at the given heliocentric
+/// distance (in AU), as THOR does for a test orbit.
+///
+/// ra and dec are in degrees, in the equatorial (ICRF) frame, and the
+/// observatory table must use the same frame. Each detection is placed
+/// where its line of sight from the observatory crosses the sphere of
+/// radius heliocentric_distance around the sun. Detections whose line
+/// of sight never reaches that sphere get NaN coordinates.
+///
+/// Each row's observatory is given by its obscode_id. Rows are
+/// processed in runs of adjacent rows that share an observatory and
+/// exposure time, and observer positions are cached by (observatory,
+/// exposure time), so each exposure's position is normally looked up
+/// once even when several sites' exposures interleave. The rows are not
+/// reordered: input whose exposures are scattered across many more
+/// distinct (observatory, time) pairs than the cache's 64 slots costs
+/// up to one lookup per row, and is best sorted by exposure first.
+///
+/// The result is appended to cartesian, which must be initialized by
+/// the caller. Row i of the output corresponds to row i of the input.
+///
+/// Returns 0 on success, or an error code on failure.
+enum ConversionError topocentric_to_cartesian(struct TopocentricPointSources *topocentric,
+                                              struct ObservatoryTable *observatories, double heliocentric_distance,
+                                              struct CartesianPointSources *cartesian);
+
+#endif
@@ -0,0 +1,132 @@
+#include "instrument.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#define CACHE_LINE 64
+
+struct InstrumentBuffer {
+  /// One thread's counters. Only the owning thread writes them, so
+  /// updates need no atomic read-modify-write; the relaxed loads and
+  /// stores just keep snapshots from other threads well defined.
+  struct InstrumentProbeStats probes[INSTRUMENT_PROBE_COUNT];
+  struct InstrumentBuffer *next;
+};
+
+static const char *probe_names[INSTRUMENT_PROBE_COUNT] = {
+    "rotation_matrices", "projection", "projection_batch", "vec_growth", "propagation", "clustering",
+    "orbit_determination", "differential_correction",
+};
+
+// Every buffer ever handed out, newest first. Buffers outlive their
+// threads so that their counts stay in the totals.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct InstrumentBuffer *buffers = NULL;
+static _Thread_local struct InstrumentBuffer *local = NULL;
+
+// A reference point for estimating the tick rate.
+static uint64_t first_ticks = 0;
+static double first_seconds = 0.0;
+
+static double seconds_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+const char *instrument_probe_name(enum InstrumentProbe probe) {
+  if ((int)probe < 0 || probe >= INSTRUMENT_PROBE_COUNT) {
+    return "unknown";
+  }
+  return probe_names[probe];
+}
+
+uint64_t instrument_ticks(void) {
+#ifdef HAVE_TSC
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static struct InstrumentBuffer *local_buffer(void) {
+  if (local != NULL) {
+    return local;
+  }
+  // Each buffer gets cache lines of its own, so that threads recording
+  // at the same time do not contend for them.
+  size_t size = (sizeof(struct InstrumentBuffer) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+  struct InstrumentBuffer *buffer = aligned_alloc(CACHE_LINE, size);
+  if (buffer == NULL) {
+    return NULL;
+  }
+  memset(buffer, 0, size);
+  pthread_mutex_lock(&lock);
+  if (buffers == NULL) {
+    first_ticks = instrument_ticks();
+    first_seconds = seconds_now();
+  }
+  buffer->next = buffers;
+  buffers = buffer;
+  pthread_mutex_unlock(&lock);
+  local = buffer;
+  return buffer;
+}
+
+static void add(uint64_t *counter, uint64_t value) {
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+void instrument_record(enum InstrumentProbe probe, uint64_t ticks, uint64_t items) {
+  struct InstrumentBuffer *buffer = local_buffer();
+  if (buffer == NULL || (int)probe < 0 || probe >= INSTRUMENT_PROBE_COUNT) {
+    return;
+  }
+  struct InstrumentProbeStats *stats = &buffer->probes[probe];
+  add(&stats->calls, 1);
+  add(&stats->ticks, ticks);
+  add(&stats->items, items);
+}
+
+void instrument_snapshot(struct InstrumentStats *stats) {
+  memset(stats, 0, sizeof(*stats));
+#ifdef CTHOR_INSTRUMENT
+  stats->enabled = 1;
+#endif
+  pthread_mutex_lock(&lock);
+  for (struct InstrumentBuffer *buffer = buffers; buffer != NULL; buffer = buffer->next) {
+    for (size_t p = 0; p < INSTRUMENT_PROBE_COUNT; p++) {
+      stats->probes[p].calls += __atomic_load_n(&buffer->probes[p].calls, __ATOMIC_RELAXED);
+      stats->probes[p].ticks += __atomic_load_n(&buffer->probes[p].ticks, __ATOMIC_RELAXED);
+      stats->probes[p].items += __atomic_load_n(&buffer->probes[p].items, __ATOMIC_RELAXED);
+    }
+  }
+  if (buffers != NULL) {
+    double seconds = seconds_now() - first_seconds;
+    if (seconds > 0.0) {
+      stats->ticks_per_second = (double)(instrument_ticks() - first_ticks) / seconds;
+    }
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+void instrument_reset(void) {
+  pthread_mutex_lock(&lock);
+  for (struct InstrumentBuffer *buffer = buffers; buffer != NULL; buffer = buffer->next) {
+    for (size_t p = 0; p < INSTRUMENT_PROBE_COUNT; p++) {
+      __atomic_store_n(&buffer->probes[p].calls, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&buffer->probes[p].ticks, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&buffer->probes[p].items, 0, __ATOMIC_RELAXED);
+    }
+  }
+  pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,106 @@
+#ifndef instrument_h
+#define instrument_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Optional counters and timers around the library's hot paths.
+///
+/// Probes are compiled in only when the library is built with
+/// CTHOR_INSTRUMENT defined (make INSTRUMENT=1). Otherwise
+/// INSTRUMENT_SCOPE expands to nothing and instrumented functions are
+/// unchanged; the functions below still exist, and snapshots are all
+/// zero.
+///
+/// Each thread records into its own buffer, so probes never contend;
+/// instrument_snapshot sums the buffers of every thread that has
+/// recorded anything, including threads that have since exited.
+
+enum InstrumentProbe {
+  /// gnomonic_rotation_matrices; items are frames built.
+  INSTRUMENT_ROTATION_MATRICES = 0,
+  /// cartesian_to_gnomonic and cartesian_to_gnomonic_with_kernel;
+  /// items are detections.
+  INSTRUMENT_PROJECTION,
+  /// cartesian_to_gnomonic_batch; items are detections times orbits.
+  INSTRUMENT_PROJECTION_BATCH,
+  /// Vector reallocations (growth through push or reserve); items are
+  /// bytes allocated.
+  INSTRUMENT_VEC_GROWTH,
+  /// propagate_orbits; items are states computed.
+  INSTRUMENT_PROPAGATION,
+  /// cluster_gnomonic; items are points.
+  INSTRUMENT_CLUSTERING,
+  /// gauss_iod; items are candidates.
+  INSTRUMENT_ORBIT_DETERMINATION,
+  /// differential_correction; items are fits.
+  INSTRUMENT_DIFFERENTIAL_CORRECTION,
+};
+
+#define INSTRUMENT_PROBE_COUNT 8
+
+struct InstrumentProbeStats {
+  /// Number of times the probe was entered.
+  uint64_t calls;
+  /// Time spent inside the probe, in ticks of the cycle counter (see
+  /// InstrumentStats.ticks_per_second).
+  uint64_t ticks;
+  /// A probe-specific measure of the work done; see InstrumentProbe.
+  uint64_t items;
+};
+
+struct InstrumentStats {
+  /// 1 if the library was built with instrumentation, 0 otherwise.
+  int enabled;
+  /// Estimated rate of the tick counter, for converting ticks to
+  /// seconds. 0 until something has been recorded.
+  double ticks_per_second;
+  struct InstrumentProbeStats probes[INSTRUMENT_PROBE_COUNT];
+};
+
+/// Returns a short name for a probe, e.g. "projection".
+const char *instrument_probe_name(enum InstrumentProbe probe);
+
+/// Returns the current value of the tick counter: the CPU's time stamp
+/// counter on x86-64, or a nanosecond clock elsewhere.
+uint64_t instrument_ticks(void);
+
+/// Adds one call, taking ticks and covering items, to a probe in the
+/// calling thread's buffer.
+void instrument_record(enum InstrumentProbe probe, uint64_t ticks, uint64_t items);
+
+/// Fills stats with the totals over all threads.
+void instrument_snapshot(struct InstrumentStats *stats);
+
+/// Zeros every thread's counters. Calls recorded concurrently with a
+/// reset may be partly kept.
+void instrument_reset(void);
+
+struct InstrumentScope {
+  enum InstrumentProbe probe;
+  uint64_t start;
+  uint64_t items;
+};
+
+static inline struct InstrumentScope instrument_scope_begin(enum InstrumentProbe probe, uint64_t items) {
+  struct InstrumentScope scope = {.probe = probe, .start = instrument_ticks(), .items = items};
+  return scope;
+}
+
+static inline void instrument_scope_end(struct InstrumentScope *scope) {
+  instrument_record(scope->probe, instrument_ticks() - scope->start, scope->items);
+}
+
+/// Times the rest of the enclosing block as one call to probe covering
+/// items, however the block is left.
+#ifdef CTHOR_INSTRUMENT
+#define INSTRUMENT_SCOPE(probe, items)                                                               \
+  struct InstrumentScope instrument_scope __attribute__((cleanup(instrument_scope_end), unused)) = \
+      instrument_scope_begin((probe), (items))
+#else
+#define INSTRUMENT_SCOPE(probe, items) \
+  do {                                 \
+  } while (0)
+#endif
+
+#endif
@@ -0,0 +1,144 @@
+// For sched_getaffinity and the CPU_* macros.
+#define _GNU_SOURCE
+
+#include "numa.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define SYSFS_NODES "/sys/devices/system/node"
+
+// Longest node or CPU list read from sysfs. The lists are made of
+// ranges, so even machines with thousands of CPUs fit.
+#define LIST_LENGTH 4096
+
+int numa_parse_cpu_list(const char *list, int *cpus, size_t max_cpus, size_t *n_cpus) {
+  size_t n = 0;
+  const char *p = list;
+  while (*p != '\0' && *p != '\n') {
+    char *end;
+    long first = strtol(p, &end, 10);
+    if (end == p || first < 0 || first >= CPU_SETSIZE) {
+      return -1;
+    }
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      p++;
+      last = strtol(p, &end, 10);
+      if (end == p || last < first || last >= CPU_SETSIZE) {
+        return -1;
+      }
+      p = end;
+    }
+    for (long cpu = first; cpu <= last; cpu++) {
+      if (n == max_cpus) {
+        return -1;
+      }
+      cpus[n++] = (int)cpu;
+    }
+    if (*p == ',') {
+      p++;
+      if (*p == '\0' || *p == '\n') {
+        return -1;
+      }
+    } else if (*p != '\0' && *p != '\n') {
+      return -1;
+    }
+  }
+  *n_cpus = n;
+  return 0;
+}
+
+// Reads the first line of a sysfs file into buffer. Returns 0 on
+// success, -1 if the file cannot be read.
+static int read_list(const char *path, char buffer[LIST_LENGTH]) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+  char *line = fgets(buffer, LIST_LENGTH, file);
+  fclose(file);
+  return line != NULL ? 0 : -1;
+}
+
+int numa_topology_new(struct NumaTopology *topology) {
+  *topology = (struct NumaTopology)NUMA_TOPOLOGY_ZERO;
+
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    CPU_ZERO(&allowed);
+    for (long cpu = 0; cpu < (online > 0 ? online : 1) && cpu < CPU_SETSIZE; cpu++) {
+      CPU_SET(cpu, &allowed);
+    }
+  }
+  size_t n_allowed = (size_t)CPU_COUNT(&allowed);
+
+  int status = 0;
+  int *nodes = malloc(CPU_SETSIZE * sizeof(int));
+  int *listed = malloc(CPU_SETSIZE * sizeof(int));
+  topology->cpus = malloc(n_allowed * sizeof(int));
+  topology->node_offsets = malloc((CPU_SETSIZE + 1) * sizeof(size_t));
+  if (nodes == NULL || listed == NULL || topology->cpus == NULL || topology->node_offsets == NULL) {
+    status = -1;
+    goto done;
+  }
+  topology->node_offsets[0] = 0;
+
+  // Each online node contributes the allowed CPUs from its cpulist. A
+  // CPU belongs to one node, but is only ever taken once regardless.
+  char buffer[LIST_LENGTH];
+  size_t n_nodes = 0;
+  if (read_list(SYSFS_NODES "/online", buffer) == 0 &&
+      numa_parse_cpu_list(buffer, nodes, CPU_SETSIZE, &n_nodes) != 0) {
+    n_nodes = 0;
+  }
+  cpu_set_t taken;
+  CPU_ZERO(&taken);
+  for (size_t k = 0; k < n_nodes; k++) {
+    char path[64];
+    size_t n_listed;
+    snprintf(path, sizeof(path), SYSFS_NODES "/node%d/cpulist", nodes[k]);
+    if (read_list(path, buffer) != 0 || numa_parse_cpu_list(buffer, listed, CPU_SETSIZE, &n_listed) != 0) {
+      continue;
+    }
+    size_t start = topology->n_cpus;
+    for (size_t i = 0; i < n_listed; i++) {
+      if (CPU_ISSET(listed[i], &allowed) && !CPU_ISSET(listed[i], &taken)) {
+        CPU_SET(listed[i], &taken);
+        topology->cpus[topology->n_cpus++] = listed[i];
+      }
+    }
+    if (topology->n_cpus > start) {
+      topology->node_offsets[++topology->n_nodes] = topology->n_cpus;
+    }
+  }
+
+  // Without a usable description, everything is one node.
+  if (topology->n_nodes == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE && topology->n_cpus < n_allowed; cpu++) {
+      if (CPU_ISSET(cpu, &allowed)) {
+        topology->cpus[topology->n_cpus++] = cpu;
+      }
+    }
+    topology->n_nodes = 1;
+    topology->node_offsets[1] = topology->n_cpus;
+  }
+
+done:
+  free(nodes);
+  free(listed);
+  if (status != 0) {
+    numa_topology_free(topology);
+  }
+  return status;
+}
+
+void numa_topology_free(struct NumaTopology *topology) {
+  free(topology->cpus);
+  free(topology->node_offsets);
+  *topology = (struct NumaTopology)NUMA_TOPOLOGY_ZERO;
+}
@@ -0,0 +1,36 @@
+#ifndef numa_h
+#define numa_h
+
+#include <stddef.h>
+
+struct NumaTopology {
+  /// The NUMA nodes of the machine and the CPUs on each that this
+  /// process may run on. Nodes with no such CPUs, like memory-only
+  /// nodes or ones excluded by the process's affinity mask, are left
+  /// out, so every node has at least one CPU.
+  size_t n_nodes;
+  size_t n_cpus;
+  int *cpus;             // The usable CPUs, grouped by node.
+  size_t *node_offsets;  // Node k's CPUs are cpus[node_offsets[k]] through cpus[node_offsets[k + 1] - 1].
+};
+
+#define NUMA_TOPOLOGY_ZERO {.n_nodes = 0, .n_cpus = 0, .cpus = NULL, .node_offsets = NULL}
+
+/// Reads the topology from /sys/devices/system/node. Where that is not
+/// available, as on other systems or in some containers, every usable
+/// CPU is put on a single node, which is how the rest of the library
+/// falls back to its ordinary behavior.
+///
+/// Returns 0 on success, -1 on allocation failure.
+int numa_topology_new(struct NumaTopology *topology);
+void numa_topology_free(struct NumaTopology *topology);
+
+/// Parses a Linux CPU list, such as "0-3,8,10-11", into cpus, which
+/// has room for max_cpus entries, and sets n_cpus to the number found.
+/// A trailing newline is allowed.
+///
+/// Returns 0 on success, or -1 if the list is malformed or has more
+/// than max_cpus CPUs.
+int numa_parse_cpu_list(const char *list, int *cpus, size_t max_cpus, size_t *n_cpus);
+
+#endif
@@ -0,0 +1,74 @@
+#include "obscodes.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "str.h"
+
+// Open addressing hash from obscode to id, with twice as many slots as
+// the table can hold ids so that probes stay short.
+#define N_SLOTS (1u << 17)
+#define EMPTY_SLOT OBSCODE_NONE
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct String strings[OBSCODE_MAX_COUNT];
+static uint16_t slots[N_SLOTS];
+static size_t count = 0;
+static int initialized = 0;
+
+static uint32_t hash(const struct String *s) {
+  // FNV-1a.
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < s->length; i++) {
+    h ^= (unsigned char)s->data[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+uint16_t obscode_intern(const struct String *obscode) {
+  pthread_mutex_lock(&lock);
+  if (!initialized) {
+    memset(slots, 0xff, sizeof(slots));
+    initialized = 1;
+  }
+
+  uint16_t id = OBSCODE_NONE;
+  uint32_t slot = hash(obscode) & (N_SLOTS - 1);
+  while (slots[slot] != EMPTY_SLOT) {
+    if (string_equal(&strings[slots[slot]], obscode)) {
+      id = slots[slot];
+      goto done;
+    }
+    slot = (slot + 1) & (N_SLOTS - 1);
+  }
+
+  if (count == OBSCODE_MAX_COUNT || obscode->length < 1) {
+    goto done;
+  }
+  struct String *copy = &strings[count];
+  if (string_new(copy, obscode->length) != 0) {
+    goto done;
+  }
+  memcpy(copy->data, obscode->data, obscode->length);
+  id = (uint16_t)count;
+  slots[slot] = id;
+  // Publish the string before the count, so that lock-free lookups
+  // never see an id whose string is not yet written.
+  __atomic_store_n(&count, count + 1, __ATOMIC_RELEASE);
+
+done:
+  pthread_mutex_unlock(&lock);
+  return id;
+}
+
+const struct String *obscode_lookup(uint16_t id) {
+  if (id >= __atomic_load_n(&count, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  return &strings[id];
+}
+
+size_t obscode_count(void) { return __atomic_load_n(&count, __ATOMIC_ACQUIRE); }
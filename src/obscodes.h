@@ -0,0 +1,35 @@
+#ifndef obscodes_h
+#define obscodes_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "str.h"
+
+/// Observatory codes are interned into a table shared by the whole
+/// process, so that point source containers can store a compact
+/// per-row id instead of a string. Ids are assigned densely from 0 in
+/// order of first interning, and stay valid for the life of the
+/// process.
+
+/// Marks a row with no known observatory. Also returned when interning
+/// fails.
+#define OBSCODE_NONE UINT16_MAX
+
+/// The number of distinct obscodes the table can hold.
+#define OBSCODE_MAX_COUNT (OBSCODE_NONE)
+
+/// Returns the id of obscode, interning a copy of it on first use.
+/// Safe to call from several threads.
+///
+/// Returns OBSCODE_NONE if the table is full or memory runs out.
+uint16_t obscode_intern(const struct String *obscode);
+
+/// Returns the obscode for an id, or NULL if no obscode has that id.
+/// The result is owned by the table and must not be freed.
+const struct String *obscode_lookup(uint16_t id);
+
+/// Returns how many obscodes have been interned.
+size_t obscode_count(void);
+
+#endif
@@ -0,0 +1,203 @@
+#include "observatories.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "obscodes.h"
+#include "str.h"
+#include "vectors.h"
+
+#define INITIAL_CAPACITY 4
+#define INITIAL_SAMPLES 64
+#define MAX_LINE 256
+
+int observatory_table_new(struct ObservatoryTable *table) {
+  table->length = 0;
+  table->capacity = INITIAL_CAPACITY;
+  table->observatories = malloc(table->capacity * sizeof(struct ObservatoryEphemeris));
+  if (table->observatories == NULL) {
+    return -1;
+  }
+  return 0;
+}
+
+static void ephemeris_free(struct ObservatoryEphemeris *ephemeris) {
+  string_free(&ephemeris->obscode);
+  vec_f64_free(&ephemeris->t);
+  vec_f64_free(&ephemeris->x);
+  vec_f64_free(&ephemeris->y);
+  vec_f64_free(&ephemeris->z);
+}
+
+void observatory_table_free(struct ObservatoryTable *table) {
+  for (size_t i = 0; i < table->length; i++) {
+    ephemeris_free(&table->observatories[i]);
+  }
+  free(table->observatories);
+  table->observatories = NULL;
+  table->length = 0;
+  table->capacity = 0;
+}
+
+struct ObservatoryEphemeris *observatory_table_find(struct ObservatoryTable *table, const struct String *obscode) {
+  // Tables hold at most a few hundred sites, so a linear scan is fine.
+  for (size_t i = 0; i < table->length; i++) {
+    if (string_equal(&table->observatories[i].obscode, obscode)) {
+      return &table->observatories[i];
+    }
+  }
+  return NULL;
+}
+
+struct ObservatoryEphemeris *observatory_table_find_id(struct ObservatoryTable *table, uint16_t obscode_id) {
+  for (size_t i = 0; i < table->length; i++) {
+    if (table->observatories[i].obscode_id == obscode_id) {
+      return &table->observatories[i];
+    }
+  }
+  return NULL;
+}
+
+static struct ObservatoryEphemeris *table_insert(struct ObservatoryTable *table, const struct String *obscode) {
+  uint16_t obscode_id = obscode_intern(obscode);
+  if (obscode_id == OBSCODE_NONE) {
+    return NULL;
+  }
+  if (table->length == table->capacity) {
+    size_t capacity = table->capacity * 2;
+    struct ObservatoryEphemeris *observatories =
+        realloc(table->observatories, capacity * sizeof(struct ObservatoryEphemeris));
+    if (observatories == NULL) {
+      return NULL;
+    }
+    table->observatories = observatories;
+    table->capacity = capacity;
+  }
+
+  struct ObservatoryEphemeris *ephemeris = &table->observatories[table->length];
+  *ephemeris = (struct ObservatoryEphemeris){
+      .obscode = {.length = 0, .data = NULL}, .t = VECF64_ZERO, .x = VECF64_ZERO, .y = VECF64_ZERO, .z = VECF64_ZERO};
+  if (string_new(&ephemeris->obscode, obscode->length) != 0) {
+    return NULL;
+  }
+  memcpy(ephemeris->obscode.data, obscode->data, obscode->length);
+  ephemeris->obscode_id = obscode_id;
+  if (vec_f64_new(&ephemeris->t, INITIAL_SAMPLES) != 0 || vec_f64_new(&ephemeris->x, INITIAL_SAMPLES) != 0 ||
+      vec_f64_new(&ephemeris->y, INITIAL_SAMPLES) != 0 || vec_f64_new(&ephemeris->z, INITIAL_SAMPLES) != 0) {
+    ephemeris_free(ephemeris);
+    return NULL;
+  }
+  table->length++;
+  return ephemeris;
+}
+
+// Returns the number of samples with time strictly less than t.
+static size_t lower_bound(struct VecF64 *times, double t) {
+  size_t lo = 0, hi = times->length;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (times->data[mid] < t) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Inserts value before the item at index. The vector must already have
+// room for it.
+static void insert_at(struct VecF64 *vec, size_t index, double value) {
+  memmove(vec->data + index + 1, vec->data + index, (vec->length - index) * sizeof(double));
+  vec->data[index] = value;
+  vec->length++;
+}
+
+enum ObservatoryError observatory_table_add(struct ObservatoryTable *table, const struct String *obscode, double t,
+                                            double pos[3]) {
+  // A NaN time would not sort, and would break the binary searches.
+  if (!isfinite(t)) {
+    return OBSERVATORY_ERROR_OUT_OF_RANGE;
+  }
+  struct ObservatoryEphemeris *ephemeris = observatory_table_find(table, obscode);
+  if (ephemeris == NULL) {
+    ephemeris = table_insert(table, obscode);
+    if (ephemeris == NULL) {
+      return OBSERVATORY_ERROR_OUT_OF_MEMORY;
+    }
+  }
+
+  // Samples almost always arrive in time order, which makes this an
+  // append.
+  size_t index = ephemeris->t.length;
+  if (index > 0 && ephemeris->t.data[index - 1] >= t) {
+    index = lower_bound(&ephemeris->t, t);
+  }
+  // Room is made in every column before any of them changes, so that
+  // running out of memory leaves the samples as they were.
+  size_t capacity = vec_grown_capacity(ephemeris->t.capacity, ephemeris->t.length + 1);
+  if (vec_f64_reserve(&ephemeris->t, capacity) != 0 || vec_f64_reserve(&ephemeris->x, capacity) != 0 ||
+      vec_f64_reserve(&ephemeris->y, capacity) != 0 || vec_f64_reserve(&ephemeris->z, capacity) != 0) {
+    return OBSERVATORY_ERROR_OUT_OF_MEMORY;
+  }
+  insert_at(&ephemeris->t, index, t);
+  insert_at(&ephemeris->x, index, pos[0]);
+  insert_at(&ephemeris->y, index, pos[1]);
+  insert_at(&ephemeris->z, index, pos[2]);
+  return OBSERVATORY_ERROR_NONE;
+}
+
+enum ObservatoryError observatory_table_load(struct ObservatoryTable *table, const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return OBSERVATORY_ERROR_IO;
+  }
+
+  enum ObservatoryError status = OBSERVATORY_ERROR_NONE;
+  char line[MAX_LINE];
+  char code[MAX_LINE];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char *start = line + strspn(line, " \t");
+    if (*start == '#' || *start == '\n' || *start == '\0') {
+      continue;
+    }
+    double t, pos[3];
+    if (sscanf(start, "%255s %lf %lf %lf %lf", code, &t, &pos[0], &pos[1], &pos[2]) != 5) {
+      status = OBSERVATORY_ERROR_IO;
+      break;
+    }
+    struct String obscode = {.length = strlen(code), .data = code};
+    status = observatory_table_add(table, &obscode, t, pos);
+    if (status != OBSERVATORY_ERROR_NONE) {
+      break;
+    }
+  }
+
+  fclose(file);
+  return status;
+}
+
+enum ObservatoryError observatory_ephemeris_position(struct ObservatoryEphemeris *ephemeris, double t, double pos[3]) {
+  size_t n = ephemeris->t.length;
+  // Every comparison with a NaN is false, so it is rejected explicitly.
+  if (n == 0 || !isfinite(t) || t < ephemeris->t.data[0] || t > ephemeris->t.data[n - 1]) {
+    return OBSERVATORY_ERROR_OUT_OF_RANGE;
+  }
+
+  size_t hi = lower_bound(&ephemeris->t, t);
+  if (ephemeris->t.data[hi] == t) {
+    pos[0] = ephemeris->x.data[hi];
+    pos[1] = ephemeris->y.data[hi];
+    pos[2] = ephemeris->z.data[hi];
+    return OBSERVATORY_ERROR_NONE;
+  }
+
+  size_t lo = hi - 1;
+  double f = (t - ephemeris->t.data[lo]) / (ephemeris->t.data[hi] - ephemeris->t.data[lo]);
+  pos[0] = ephemeris->x.data[lo] + f * (ephemeris->x.data[hi] - ephemeris->x.data[lo]);
+  pos[1] = ephemeris->y.data[lo] + f * (ephemeris->y.data[hi] - ephemeris->y.data[lo]);
+  pos[2] = ephemeris->z.data[lo] + f * (ephemeris->z.data[hi] - ephemeris->z.data[lo]);
+  return OBSERVATORY_ERROR_NONE;
+}
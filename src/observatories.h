@@ -0,0 +1,70 @@
+#ifndef observatories_h
+#define observatories_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "str.h"
+#include "vectors.h"
+
+enum ObservatoryError {
+  OBSERVATORY_ERROR_NONE = 0,
+  OBSERVATORY_ERROR_UNKNOWN = -1,
+  OBSERVATORY_ERROR_OUT_OF_RANGE = -2,
+  OBSERVATORY_ERROR_OUT_OF_MEMORY = -3,
+  OBSERVATORY_ERROR_IO = -4,
+};
+
+struct ObservatoryEphemeris {
+  /// Heliocentric positions of one observatory, sampled at increasing
+  /// times. Positions are in AU, in the equatorial (ICRF) frame.
+  struct String obscode;
+  uint16_t obscode_id;  // Interned id of obscode.
+  struct VecF64 t;  // MJD
+  struct VecF64 x;
+  struct VecF64 y;
+  struct VecF64 z;
+};
+
+struct ObservatoryTable {
+  /// An in-memory cache of observatory ephemerides, keyed by obscode.
+  size_t length;
+  size_t capacity;
+  struct ObservatoryEphemeris *observatories;
+};
+
+#define OBSERVATORY_TABLE_ZERO {.length = 0, .capacity = 0, .observatories = NULL}
+
+int observatory_table_new(struct ObservatoryTable *table);
+void observatory_table_free(struct ObservatoryTable *table);
+
+/// Adds one sample of an observatory's heliocentric position. Samples
+/// may be added in any order.
+///
+/// Returns OBSERVATORY_ERROR_OUT_OF_RANGE if t is not finite, and
+/// OBSERVATORY_ERROR_OUT_OF_MEMORY, leaving the observatory's samples
+/// unchanged, if there is no room for the sample.
+enum ObservatoryError observatory_table_add(struct ObservatoryTable *table, const struct String *obscode, double t,
+                                            double pos[3]);
+
+/// Loads samples from a whitespace-separated text file into the table.
+/// Each line holds "obscode mjd x y z"; blank lines and lines starting
+/// with '#' are ignored. Stops at the first sample that cannot be
+/// added, and returns observatory_table_add's error for it.
+enum ObservatoryError observatory_table_load(struct ObservatoryTable *table, const char *path);
+
+/// Finds the ephemeris for an obscode, or returns NULL if the table
+/// has none.
+struct ObservatoryEphemeris *observatory_table_find(struct ObservatoryTable *table, const struct String *obscode);
+
+/// Like observatory_table_find, by interned obscode id.
+struct ObservatoryEphemeris *observatory_table_find_id(struct ObservatoryTable *table, uint16_t obscode_id);
+
+/// Computes an observatory's heliocentric position at time t by
+/// linear interpolation between the neighbouring samples.
+///
+/// Returns OBSERVATORY_ERROR_OUT_OF_RANGE if t is NaN or lies outside
+/// the sampled times.
+enum ObservatoryError observatory_ephemeris_position(struct ObservatoryEphemeris *ephemeris, double t, double pos[3]);
+
+#endif
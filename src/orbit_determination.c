@@ -0,0 +1,797 @@
+#include "orbit_determination.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "instrument.h"
+#include "observatories.h"
+#include "orbits.h"
+#include "propagation.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#define L ORBIT_DETERMINATION_LANES
+#define R GAUSS_MAX_ROOTS
+
+#define DEG_TO_RAD (M_PI / 180.0)
+#define RAD_TO_DEG (180.0 / M_PI)
+
+// Partial derivatives for differential correction are taken by
+// perturbing each element of the state by this fraction of the
+// magnitude of its position or velocity.
+#define FINITE_DIFFERENCE_STEP 1e-7
+
+// Roots are bracketed by sampling the polynomial at this many
+// logarithmically spaced distances, then each bracket is bisected a
+// fixed number of times. A bracket spans about 5% in distance, and
+// 48 halvings take that below double precision.
+#define GRID_POINTS 256
+#define BISECTIONS 48
+
+struct Block {
+  /// Inputs and outputs for one lockstep group of candidates, one lane
+  /// each. Observations are indexed 0 to 2.
+  double rho_hat[3][3][L];
+  double observer[3][3][L];
+  double t[3][L];
+  double r[R][3][L];
+  double v[R][3][L];
+  int valid[R][L];
+};
+
+static inline double polynomial(double x, double a, double b, double c) {
+  double x3 = x * x * x;
+  double x6 = x3 * x3;
+  return x6 * x * x + a * x6 + b * x3 + c;
+}
+
+// Solves Gauss's problem for every lane of a block. The notation
+// follows Curtis, "Orbital Mechanics for Engineering Students",
+// algorithm 5.5: D[i][j] is observer i dotted with p[j].
+SIMD_TARGET_CLONES
+static void solve_block(struct Block *block, double mu, const double *grid) {
+  double A[L], B[L], a[L], b[L], c[L], D0[L], D[3][3][L], tau1[L], tau3[L];
+  int usable[L];
+  for (int l = 0; l < L; l++) {
+    double (*q)[3][L] = block->rho_hat;
+    double p[3][3];
+    // p[0] = q1 x q2, p[1] = q0 x q2, p[2] = q0 x q1.
+    int pairs[3][2] = {{1, 2}, {0, 2}, {0, 1}};
+    for (int j = 0; j < 3; j++) {
+      int m = pairs[j][0], n = pairs[j][1];
+      p[j][0] = q[m][1][l] * q[n][2][l] - q[m][2][l] * q[n][1][l];
+      p[j][1] = q[m][2][l] * q[n][0][l] - q[m][0][l] * q[n][2][l];
+      p[j][2] = q[m][0][l] * q[n][1][l] - q[m][1][l] * q[n][0][l];
+    }
+    D0[l] = q[0][0][l] * p[0][0] + q[0][1][l] * p[0][1] + q[0][2][l] * p[0][2];
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        D[i][j][l] = block->observer[i][0][l] * p[j][0] + block->observer[i][1][l] * p[j][1] +
+                     block->observer[i][2][l] * p[j][2];
+      }
+    }
+
+    tau1[l] = block->t[0][l] - block->t[1][l];
+    tau3[l] = block->t[2][l] - block->t[1][l];
+    double tau = tau3[l] - tau1[l];
+    A[l] = (-D[0][1][l] * tau3[l] / tau + D[1][1][l] + D[2][1][l] * tau1[l] / tau) / D0[l];
+    B[l] = (D[0][1][l] * (tau3[l] * tau3[l] - tau * tau) * tau3[l] / tau +
+            D[2][1][l] * (tau * tau - tau1[l] * tau1[l]) * tau1[l] / tau) /
+           (6.0 * D0[l]);
+    double E = block->observer[1][0][l] * q[1][0][l] + block->observer[1][1][l] * q[1][1][l] +
+               block->observer[1][2][l] * q[1][2][l];
+    double R2 = block->observer[1][0][l] * block->observer[1][0][l] +
+                block->observer[1][1][l] * block->observer[1][1][l] +
+                block->observer[1][2][l] * block->observer[1][2][l];
+    a[l] = -(A[l] * A[l] + 2.0 * A[l] * E + R2);
+    b[l] = -2.0 * mu * B[l] * (A[l] + E);
+    c[l] = -mu * mu * B[l] * B[l];
+    usable[l] = (tau1[l] < 0.0) & (tau3[l] > 0.0) & (isfinite(a[l]) != 0) & (isfinite(b[l]) != 0) &
+                (isfinite(c[l]) != 0);
+  }
+
+  // Bracket up to R sign changes per lane on the shared grid. Every
+  // lane evaluates every grid point, and brackets are recorded with
+  // weights of exactly 0 or 1 rather than selects, which leaves the
+  // finite values they blend unchanged, so the loops have no
+  // data-dependent branches. Signs, flags and counts are all doubles,
+  // and the loop over brackets runs outside the loop over lanes.
+  double lo[R][L], hi[R][L], lo_negative[R][L], negative[L], count[L];
+  for (int l = 0; l < L; l++) {
+    negative[l] = polynomial(grid[0], a[l], b[l], c[l]) < 0.0 ? 1.0 : 0.0;
+    count[l] = 0.0;
+    for (int j = 0; j < R; j++) {
+      lo[j][l] = hi[j][l] = grid[0];
+      lo_negative[j][l] = 0.0;
+    }
+  }
+  for (int k = 1; k < GRID_POINTS; k++) {
+    double lower = grid[k - 1], upper = grid[k];
+    // slot is the bracket a sign change in this lane fills, or -1.
+    // Changes past the Rth fill none, but are still counted.
+    double slot[L];
+    for (int l = 0; l < L; l++) {
+      double now_negative = polynomial(upper, a[l], b[l], c[l]) < 0.0 ? 1.0 : 0.0;
+      double change = fabs(now_negative - negative[l]);
+      slot[l] = change * count[l] + (change - 1.0);
+      count[l] += change;
+      negative[l] = now_negative;
+    }
+    for (int j = 0; j < R; j++) {
+      for (int l = 0; l < L; l++) {
+        // The sign changed, so the value at lower had the other sign.
+        double take = slot[l] == j ? 1.0 : 0.0;
+        lo[j][l] = take * lower + (1.0 - take) * lo[j][l];
+        hi[j][l] = take * upper + (1.0 - take) * hi[j][l];
+        lo_negative[j][l] = take * (1.0 - negative[l]) + (1.0 - take) * lo_negative[j][l];
+      }
+    }
+  }
+
+  for (int j = 0; j < R; j++) {
+    for (int iteration = 0; iteration < BISECTIONS; iteration++) {
+      for (int l = 0; l < L; l++) {
+        double mid = 0.5 * (lo[j][l] + hi[j][l]);
+        int mid_negative = polynomial(mid, a[l], b[l], c[l]) < 0.0;
+        int keep_hi = mid_negative == (lo_negative[j][l] == 1.0);
+        lo[j][l] = keep_hi ? mid : lo[j][l];
+        hi[j][l] = keep_hi ? hi[j][l] : mid;
+      }
+    }
+
+    for (int l = 0; l < L; l++) {
+      double r2 = 0.5 * (lo[j][l] + hi[j][l]);
+      double u = mu / (r2 * r2 * r2);
+      double tau = tau3[l] - tau1[l];
+
+      // With the Lagrange coefficients truncated after their first
+      // terms, r2 = c1 r1 + c3 r3 gives each slant range.
+      double c1 = tau3[l] / tau * (1.0 + u * (tau * tau - tau3[l] * tau3[l]) / 6.0);
+      double c3 = -tau1[l] / tau * (1.0 + u * (tau * tau - tau1[l] * tau1[l]) / 6.0);
+      double rho[3];
+      rho[0] = (-D[0][0][l] + D[1][0][l] / c1 - c3 / c1 * D[2][0][l]) / D0[l];
+      rho[1] = A[l] + mu * B[l] / (r2 * r2 * r2);
+      rho[2] = (-c1 / c3 * D[0][2][l] + D[1][2][l] / c3 - D[2][2][l]) / D0[l];
+
+      double f1 = 1.0 - 0.5 * u * tau1[l] * tau1[l];
+      double f3 = 1.0 - 0.5 * u * tau3[l] * tau3[l];
+      double g1 = tau1[l] - u * tau1[l] * tau1[l] * tau1[l] / 6.0;
+      double g3 = tau3[l] - u * tau3[l] * tau3[l] * tau3[l] / 6.0;
+      double denominator = f1 * g3 - f3 * g1;
+
+      int valid = (j < count[l]) & usable[l] & (rho[0] > 0.0) & (rho[1] > 0.0) & (rho[2] > 0.0);
+      for (int d = 0; d < 3; d++) {
+        double r1 = block->observer[0][d][l] + rho[0] * block->rho_hat[0][d][l];
+        double r3 = block->observer[2][d][l] + rho[2] * block->rho_hat[2][d][l];
+        block->r[j][d][l] = block->observer[1][d][l] + rho[1] * block->rho_hat[1][d][l];
+        block->v[j][d][l] = (f1 * r3 - f3 * r1) / denominator;
+        valid &= (isfinite(block->r[j][d][l]) != 0) & (isfinite(block->v[j][d][l]) != 0);
+      }
+      block->valid[j][l] = valid;
+    }
+  }
+}
+
+struct GaussTask {
+  /// A run of candidates, solved a block at a time. Results go to
+  /// slots R * candidate through R * candidate + R - 1 of the scratch
+  /// columns.
+  struct TopocentricPointSources *detections;
+  const uint32_t *triplets;
+  const double (*observers)[3];
+  const double *grid;
+  double mu;
+  double *state[6];
+  unsigned char *valid;
+  size_t start;
+  size_t length;
+};
+
+static void run_gauss_task(void *arg) {
+  struct GaussTask *task = arg;
+  const double *ra = task->detections->ra.data, *dec = task->detections->dec.data, *t = task->detections->t.data;
+
+  struct Block block;
+  size_t end = task->start + task->length;
+  for (size_t first = task->start; first < end; first += L) {
+    size_t n = end - first < L ? end - first : L;
+    // Short blocks repeat their last candidate in the spare lanes.
+    for (int l = 0; l < L; l++) {
+      size_t i = first + ((size_t)l < n ? (size_t)l : n - 1);
+      for (int k = 0; k < 3; k++) {
+        size_t row = task->triplets[3 * i + k];
+        double cos_dec = cos(dec[row] * DEG_TO_RAD);
+        block.rho_hat[k][0][l] = cos_dec * cos(ra[row] * DEG_TO_RAD);
+        block.rho_hat[k][1][l] = cos_dec * sin(ra[row] * DEG_TO_RAD);
+        block.rho_hat[k][2][l] = sin(dec[row] * DEG_TO_RAD);
+        for (int d = 0; d < 3; d++) {
+          block.observer[k][d][l] = task->observers[3 * i + k][d];
+        }
+        block.t[k][l] = t[row];
+      }
+    }
+    solve_block(&block, task->mu, task->grid);
+    for (size_t l = 0; l < n; l++) {
+      for (int j = 0; j < R; j++) {
+        size_t slot = R * (first + l) + j;
+        for (int d = 0; d < 3; d++) {
+          task->state[d][slot] = block.r[j][d][l];
+          task->state[d + 3][slot] = block.v[j][d][l];
+        }
+        task->valid[slot] = (unsigned char)block.valid[j][l];
+      }
+    }
+  }
+}
+
+// Looks up the observer position of the detection at each of n rows.
+static enum OrbitDeterminationError find_observers(struct TopocentricPointSources *detections,
+                                                   struct ObservatoryTable *observatories, const uint32_t *rows,
+                                                   size_t n, double (*observers)[3]) {
+  struct ObservatoryEphemeris *ephemeris = NULL;
+  for (size_t i = 0; i < n; i++) {
+    uint32_t row = rows[i];
+    uint16_t obscode_id = detections->obscode_id.data[row];
+    if (ephemeris == NULL || ephemeris->obscode_id != obscode_id) {
+      ephemeris = observatory_table_find_id(observatories, obscode_id);
+      if (ephemeris == NULL) {
+        return ORBIT_DETERMINATION_ERROR_UNKNOWN_OBSERVATORY;
+      }
+    }
+    if (observatory_ephemeris_position(ephemeris, detections->t.data[row], observers[i]) != OBSERVATORY_ERROR_NONE) {
+      return ORBIT_DETERMINATION_ERROR_OUT_OF_RANGE;
+    }
+  }
+  return ORBIT_DETERMINATION_ERROR_NONE;
+}
+
+enum OrbitDeterminationError gauss_iod(struct TopocentricPointSources *detections,
+                                       struct ObservatoryTable *observatories, const uint32_t *triplets,
+                                       size_t n_candidates, double mu, struct ThreadPool *pool,
+                                       struct CartesianOrbits *orbits, struct VecU32 *candidates) {
+  INSTRUMENT_SCOPE(INSTRUMENT_ORBIT_DETERMINATION, n_candidates);
+  cartesian_orbits_clear(orbits);
+  vec_u32_clear(candidates);
+  if (!(mu > 0.0) || !isfinite(mu) || n_candidates > UINT32_MAX) {
+    return ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT;
+  }
+  if (n_candidates == 0) {
+    return ORBIT_DETERMINATION_ERROR_NONE;
+  }
+  for (size_t i = 0; i < 3 * n_candidates; i++) {
+    if (triplets[i] >= detections->ra.length) {
+      return ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT;
+    }
+  }
+
+  size_t n_slots = R * n_candidates;
+  size_t n_tasks = (n_candidates + ORBIT_DETERMINATION_TASK_CANDIDATES - 1) / ORBIT_DETERMINATION_TASK_CANDIDATES;
+  double(*observers)[3] = malloc(3 * n_candidates * sizeof(double[3]));
+  double *scratch = malloc(6 * n_slots * sizeof(double));
+  unsigned char *valid = malloc(n_slots);
+  struct GaussTask *tasks = malloc(n_tasks * sizeof(struct GaussTask));
+  enum OrbitDeterminationError status = ORBIT_DETERMINATION_ERROR_NONE;
+  if (observers == NULL || scratch == NULL || valid == NULL || tasks == NULL) {
+    status = ORBIT_DETERMINATION_ERROR_OUT_OF_MEMORY;
+    goto done;
+  }
+  status = find_observers(detections, observatories, triplets, 3 * n_candidates, observers);
+  if (status != ORBIT_DETERMINATION_ERROR_NONE) {
+    goto done;
+  }
+
+  double grid[GRID_POINTS];
+  for (int k = 0; k < GRID_POINTS; k++) {
+    grid[k] = GAUSS_MIN_DISTANCE * pow(GAUSS_MAX_DISTANCE / GAUSS_MIN_DISTANCE, (double)k / (GRID_POINTS - 1));
+  }
+
+  for (size_t k = 0; k < n_tasks; k++) {
+    size_t start = k * ORBIT_DETERMINATION_TASK_CANDIDATES;
+    size_t length = n_candidates - start < ORBIT_DETERMINATION_TASK_CANDIDATES ? n_candidates - start
+                                                                                : ORBIT_DETERMINATION_TASK_CANDIDATES;
+    tasks[k] = (struct GaussTask){.detections = detections,
+                                  .triplets = triplets,
+                                  .observers = (const double(*)[3])observers,
+                                  .grid = grid,
+                                  .mu = mu,
+                                  .valid = valid,
+                                  .start = start,
+                                  .length = length};
+    for (int d = 0; d < 6; d++) {
+      tasks[k].state[d] = scratch + d * n_slots;
+    }
+  }
+
+  if (pool == NULL) {
+    for (size_t k = 0; k < n_tasks; k++) {
+      run_gauss_task(&tasks[k]);
+    }
+  } else {
+    for (size_t k = 0; k < n_tasks; k++) {
+      if (thread_pool_submit(pool, run_gauss_task, &tasks[k]) != 0) {
+        // Whatever was not queued runs here instead.
+        run_gauss_task(&tasks[k]);
+      }
+    }
+    thread_pool_wait(pool);
+  }
+
+  // Compact the valid slots into the outputs, in slot order.
+  size_t n_orbits = 0;
+  for (size_t s = 0; s < n_slots; s++) {
+    n_orbits += valid[s];
+  }
+  struct VecF64 *columns[7] = {&orbits->x, &orbits->y, &orbits->z, &orbits->vx, &orbits->vy, &orbits->vz, &orbits->t};
+  for (int d = 0; d < 7; d++) {
+    if (vec_f64_reserve(columns[d], n_orbits) != 0) {
+      status = ORBIT_DETERMINATION_ERROR_OUT_OF_MEMORY;
+      goto done;
+    }
+  }
+  if (vec_u32_reserve(candidates, n_orbits) != 0) {
+    status = ORBIT_DETERMINATION_ERROR_OUT_OF_MEMORY;
+    goto done;
+  }
+  size_t o = 0;
+  for (size_t s = 0; s < n_slots; s++) {
+    if (!valid[s]) {
+      continue;
+    }
+    size_t candidate = s / R;
+    for (int d = 0; d < 6; d++) {
+      columns[d]->data[o] = scratch[d * n_slots + s];
+    }
+    orbits->t.data[o] = detections->t.data[triplets[3 * candidate + 1]];
+    candidates->data[o] = (uint32_t)candidate;
+    o++;
+  }
+  for (int d = 0; d < 7; d++) {
+    columns[d]->length = n_orbits;
+  }
+  candidates->length = n_orbits;
+
+done:
+  free(tasks);
+  free(valid);
+  free(scratch);
+  free(observers);
+  return status;
+}
+
+struct FitBlock {
+  /// One lockstep group of fits, one lane each. Lane l fits the
+  /// detections at indices[begin[l]] through
+  /// indices[begin[l] + count[l] - 1].
+  double state[6][L];
+  double epoch[L];
+  size_t begin[L];
+  size_t count[L];
+  double rms[L];
+  int converged[L];
+};
+
+struct FitTask {
+  /// A run of fits, solved a block at a time. basis[j] holds the
+  /// observed direction and the east and north unit vectors of the
+  /// tangent plane there for the detection at indices[j]; each task
+  /// fills in its own.
+  struct CartesianOrbits *orbits;
+  struct TopocentricPointSources *detections;
+  const size_t *offsets;
+  const uint32_t *indices;
+  const double (*observers)[3];
+  double (*basis)[3][3];
+  double mu;
+  struct CartesianOrbits *fitted;
+  double *rms;
+  size_t start;
+  size_t length;
+};
+
+// Adds one detection per lane to the normal equations: the two rows of
+// partials and residuals, scaled by weight (0 for lanes that have run
+// out of detections). Only the lower triangle of normal is kept.
+SIMD_TARGET_CLONES
+static void accumulate_normal_equations(double normal[6][6][L], double rhs[6][L], double chi2[L],
+                                        const double partials[2][6][L], const double residual[2][L],
+                                        const double weight[L]) {
+  for (int i = 0; i < 6; i++) {
+    for (int j = 0; j <= i; j++) {
+      for (int l = 0; l < L; l++) {
+        normal[i][j][l] +=
+            weight[l] * (partials[0][i][l] * partials[0][j][l] + partials[1][i][l] * partials[1][j][l]);
+      }
+    }
+    for (int l = 0; l < L; l++) {
+      rhs[i][l] += weight[l] * (partials[0][i][l] * residual[0][l] + partials[1][i][l] * residual[1][l]);
+    }
+  }
+  for (int l = 0; l < L; l++) {
+    chi2[l] += weight[l] * (residual[0][l] * residual[0][l] + residual[1][l] * residual[1][l]);
+  }
+}
+
+// Solves normal x = rhs in every lane by Cholesky factorization,
+// overwriting normal. Position and velocity elements differ in scale
+// by orders of magnitude, so the system is first scaled to a unit
+// diagonal. ok[l] is cleared in lanes whose matrix is not positive
+// definite.
+SIMD_TARGET_CLONES
+static void cholesky_solve_6x6(double normal[6][6][L], const double rhs[6][L], double x[6][L], int ok[L]) {
+  double scale[6][L], y[6][L];
+  for (int i = 0; i < 6; i++) {
+    for (int l = 0; l < L; l++) {
+      ok[l] &= normal[i][i][l] > 0.0;
+      scale[i][l] = normal[i][i][l] > 0.0 ? 1.0 / sqrt(normal[i][i][l]) : 1.0;
+    }
+  }
+  for (int i = 0; i < 6; i++) {
+    for (int j = 0; j <= i; j++) {
+      for (int l = 0; l < L; l++) {
+        normal[i][j][l] *= scale[i][l] * scale[j][l];
+      }
+    }
+  }
+
+  // normal = G G^T, with G stored in the lower triangle. Each sum runs
+  // over k outside the lanes, so that the innermost loop is always the
+  // one across fits.
+  double sum[L];
+  for (int j = 0; j < 6; j++) {
+    for (int l = 0; l < L; l++) {
+      sum[l] = normal[j][j][l];
+    }
+    for (int k = 0; k < j; k++) {
+      for (int l = 0; l < L; l++) {
+        sum[l] -= normal[j][k][l] * normal[j][k][l];
+      }
+    }
+    for (int l = 0; l < L; l++) {
+      ok[l] &= sum[l] > 0.0;
+      normal[j][j][l] = sum[l] > 0.0 ? sqrt(sum[l]) : 1.0;
+    }
+    for (int i = j + 1; i < 6; i++) {
+      for (int l = 0; l < L; l++) {
+        sum[l] = normal[i][j][l];
+      }
+      for (int k = 0; k < j; k++) {
+        for (int l = 0; l < L; l++) {
+          sum[l] -= normal[i][k][l] * normal[j][k][l];
+        }
+      }
+      for (int l = 0; l < L; l++) {
+        normal[i][j][l] = sum[l] / normal[j][j][l];
+      }
+    }
+  }
+
+  for (int i = 0; i < 6; i++) {
+    for (int l = 0; l < L; l++) {
+      sum[l] = rhs[i][l] * scale[i][l];
+    }
+    for (int k = 0; k < i; k++) {
+      for (int l = 0; l < L; l++) {
+        sum[l] -= normal[i][k][l] * y[k][l];
+      }
+    }
+    for (int l = 0; l < L; l++) {
+      y[i][l] = sum[l] / normal[i][i][l];
+    }
+  }
+  for (int i = 5; i >= 0; i--) {
+    for (int l = 0; l < L; l++) {
+      sum[l] = y[i][l];
+    }
+    for (int k = i + 1; k < 6; k++) {
+      for (int l = 0; l < L; l++) {
+        sum[l] -= normal[k][i][l] * x[k][l];
+      }
+    }
+    for (int l = 0; l < L; l++) {
+      x[i][l] = sum[l] / normal[i][i][l];
+    }
+  }
+  for (int i = 0; i < 6; i++) {
+    for (int l = 0; l < L; l++) {
+      x[i][l] *= scale[i][l];
+    }
+  }
+}
+
+// Projects the propagated positions onto the tangent plane at each
+// lane's observed direction, as seen from observer.
+static void tangent_plane(const struct PropagationBlock *propagation, const double observer[3][L],
+                          const double basis[3][3][L], double xi[L], double eta[L]) {
+  for (int l = 0; l < L; l++) {
+    double d[3];
+    for (int k = 0; k < 3; k++) {
+      d[k] = propagation->r[k][l] - observer[k][l];
+    }
+    double along = d[0] * basis[0][0][l] + d[1] * basis[0][1][l] + d[2] * basis[0][2][l];
+    xi[l] = (d[0] * basis[1][0][l] + d[1] * basis[1][1][l] + d[2] * basis[1][2][l]) / along;
+    eta[l] = (d[0] * basis[2][0][l] + d[1] * basis[2][1][l] + d[2] * basis[2][2][l]) / along;
+  }
+}
+
+// Runs Gauss-Newton iterations on every lane of a block until each
+// lane has converged or failed.
+static void fit_block(struct FitBlock *fit, const struct FitTask *task) {
+  const double *t = task->detections->t.data;
+  struct PropagationBlock propagation;
+  double normal[6][6][L], rhs[6][L], delta[6][L], step[6][L], chi2[L];
+  double partials[2][6][L], residual[2][L], weight[L], xi[L], eta[L];
+  double observer[3][L], basis[3][3][L];
+  int active[L], ok[L];
+
+  size_t max_count = 0;
+  for (int l = 0; l < L; l++) {
+    int finite = 1;
+    for (int d = 0; d < 6; d++) {
+      finite &= isfinite(fit->state[d][l]) != 0;
+    }
+    active[l] = finite & (fit->count[l] >= 3);
+    fit->converged[l] = 0;
+    fit->rms[l] = NAN;
+    max_count = fit->count[l] > max_count ? fit->count[l] : max_count;
+  }
+
+  for (int iteration = 0; iteration < DIFFERENTIAL_CORRECTION_MAX_ITERATIONS; iteration++) {
+    int n_active = 0;
+    for (int l = 0; l < L; l++) {
+      n_active += active[l];
+    }
+    if (n_active == 0) {
+      break;
+    }
+
+    for (int l = 0; l < L; l++) {
+      double r = sqrt(fit->state[0][l] * fit->state[0][l] + fit->state[1][l] * fit->state[1][l] +
+                      fit->state[2][l] * fit->state[2][l]);
+      double v = sqrt(fit->state[3][l] * fit->state[3][l] + fit->state[4][l] * fit->state[4][l] +
+                      fit->state[5][l] * fit->state[5][l]);
+      for (int d = 0; d < 6; d++) {
+        step[d][l] = FINITE_DIFFERENCE_STEP * (d < 3 ? r : v);
+        rhs[d][l] = 0.0;
+        for (int e = 0; e < 6; e++) {
+          normal[d][e][l] = 0.0;
+        }
+      }
+      chi2[l] = 0.0;
+    }
+
+    // Lanes with fewer detections repeat their last one with zero
+    // weight. Lanes with none are inactive, and only see a placeholder.
+    for (size_t k = 0; k < max_count; k++) {
+      for (int l = 0; l < L; l++) {
+        if (fit->count[l] == 0) {
+          weight[l] = 0.0;
+          propagation.dt[l] = 0.0;
+          for (int d = 0; d < 3; d++) {
+            observer[d][l] = 0.0;
+            for (int b = 0; b < 3; b++) {
+              basis[b][d][l] = b == d ? 1.0 : 0.0;
+            }
+          }
+          continue;
+        }
+        size_t j = fit->begin[l] + (k < fit->count[l] ? k : fit->count[l] - 1);
+        weight[l] = k < fit->count[l] ? 1.0 : 0.0;
+        propagation.dt[l] = t[task->indices[j]] - fit->epoch[l];
+        for (int d = 0; d < 3; d++) {
+          observer[d][l] = task->observers[j][d];
+          for (int b = 0; b < 3; b++) {
+            basis[b][d][l] = task->basis[j][b][d];
+          }
+        }
+      }
+
+      // The nominal state, then each element perturbed in turn.
+      for (int p = -1; p < 6; p++) {
+        for (int d = 0; d < 3; d++) {
+          for (int l = 0; l < L; l++) {
+            propagation.r0[d][l] = fit->state[d][l] + (p == d ? step[d][l] : 0.0);
+            propagation.v0[d][l] = fit->state[d + 3][l] + (p == d + 3 ? step[d + 3][l] : 0.0);
+          }
+        }
+        propagate_block(&propagation, task->mu);
+        if (p < 0) {
+          tangent_plane(&propagation, observer, basis, residual[0], residual[1]);
+          continue;
+        }
+        tangent_plane(&propagation, observer, basis, xi, eta);
+        for (int l = 0; l < L; l++) {
+          partials[0][p][l] = (xi[l] - residual[0][l]) / step[p][l];
+          partials[1][p][l] = (eta[l] - residual[1][l]) / step[p][l];
+        }
+      }
+      // The observation sits at the origin of its tangent plane, so the
+      // residual is minus the prediction.
+      for (int l = 0; l < L; l++) {
+        residual[0][l] = -residual[0][l];
+        residual[1][l] = -residual[1][l];
+      }
+      accumulate_normal_equations(normal, rhs, chi2, (const double(*)[6][L])partials,
+                                  (const double(*)[L])residual, weight);
+    }
+
+    for (int l = 0; l < L; l++) {
+      ok[l] = 1;
+    }
+    cholesky_solve_6x6(normal, (const double(*)[L])rhs, delta, ok);
+
+    // A lane stops when the correction or the change in residuals is
+    // negligible. Either way it keeps the state its residuals were
+    // measured at, so rms always matches the state.
+    for (int l = 0; l < L; l++) {
+      double r2 = 0.0, v2 = 0.0, dr2 = 0.0, dv2 = 0.0;
+      int finite = isfinite(chi2[l]) != 0;
+      for (int d = 0; d < 3; d++) {
+        r2 += fit->state[d][l] * fit->state[d][l];
+        v2 += fit->state[d + 3][l] * fit->state[d + 3][l];
+        dr2 += delta[d][l] * delta[d][l];
+        dv2 += delta[d + 3][l] * delta[d + 3][l];
+      }
+      for (int d = 0; d < 6; d++) {
+        finite &= isfinite(delta[d][l]) != 0;
+      }
+      double rms = sqrt(chi2[l] / (2.0 * (double)fit->count[l])) * RAD_TO_DEG;
+      double tolerance = DIFFERENTIAL_CORRECTION_TOLERANCE * DIFFERENTIAL_CORRECTION_TOLERANCE;
+      int small_step = (dr2 <= tolerance * r2) & (dv2 <= tolerance * v2);
+      int settled = iteration > 0 && fabs(rms - fit->rms[l]) <= DIFFERENTIAL_CORRECTION_RMS_TOLERANCE * fit->rms[l];
+      int usable = active[l] & ok[l] & finite;
+      int converged = usable & (small_step | settled);
+      int update = usable & !converged;
+      for (int d = 0; d < 6; d++) {
+        fit->state[d][l] += update ? delta[d][l] : 0.0;
+      }
+      fit->rms[l] = active[l] ? rms : fit->rms[l];
+      fit->converged[l] |= converged;
+      active[l] = update;
+    }
+  }
+}
+
+static void run_fit_task(void *arg) {
+  struct FitTask *task = arg;
+  const double *ra = task->detections->ra.data, *dec = task->detections->dec.data;
+  size_t end = task->start + task->length;
+  for (size_t j = task->offsets[task->start]; j < task->offsets[end]; j++) {
+    size_t row = task->indices[j];
+    double sin_ra = sin(ra[row] * DEG_TO_RAD), cos_ra = cos(ra[row] * DEG_TO_RAD);
+    double sin_dec = sin(dec[row] * DEG_TO_RAD), cos_dec = cos(dec[row] * DEG_TO_RAD);
+    double basis[3][3] = {{cos_dec * cos_ra, cos_dec * sin_ra, sin_dec},
+                          {-sin_ra, cos_ra, 0.0},
+                          {-sin_dec * cos_ra, -sin_dec * sin_ra, cos_dec}};
+    for (int b = 0; b < 3; b++) {
+      for (int d = 0; d < 3; d++) {
+        task->basis[j][b][d] = basis[b][d];
+      }
+    }
+  }
+
+  struct CartesianOrbits *orbits = task->orbits, *fitted = task->fitted;
+  double *in_columns[6] = {orbits->x.data, orbits->y.data, orbits->z.data,
+                           orbits->vx.data, orbits->vy.data, orbits->vz.data};
+  double *out_columns[6] = {fitted->x.data,  fitted->y.data,  fitted->z.data,
+                            fitted->vx.data, fitted->vy.data, fitted->vz.data};
+  struct FitBlock fit;
+  for (size_t first = task->start; first < end; first += L) {
+    size_t n = end - first < L ? end - first : L;
+    // Short blocks repeat their last fit in the spare lanes.
+    for (int l = 0; l < L; l++) {
+      size_t i = first + ((size_t)l < n ? (size_t)l : n - 1);
+      for (int d = 0; d < 6; d++) {
+        fit.state[d][l] = in_columns[d][i];
+      }
+      fit.epoch[l] = orbits->t.data[i];
+      fit.begin[l] = task->offsets[i];
+      fit.count[l] = task->offsets[i + 1] - task->offsets[i];
+    }
+    fit_block(&fit, task);
+    for (size_t l = 0; l < n; l++) {
+      for (int d = 0; d < 6; d++) {
+        out_columns[d][first + l] = fit.converged[l] ? fit.state[d][l] : NAN;
+      }
+      fitted->t.data[first + l] = fit.epoch[l];
+      task->rms[first + l] = fit.converged[l] ? fit.rms[l] : NAN;
+    }
+  }
+}
+
+enum OrbitDeterminationError differential_correction(struct CartesianOrbits *orbits,
+                                                     struct TopocentricPointSources *detections,
+                                                     struct ObservatoryTable *observatories, const size_t *offsets,
+                                                     const uint32_t *indices, double mu, struct ThreadPool *pool,
+                                                     struct CartesianOrbits *fitted, struct VecF64 *rms) {
+  size_t n_fits = orbits->x.length;
+  INSTRUMENT_SCOPE(INSTRUMENT_DIFFERENTIAL_CORRECTION, n_fits);
+  cartesian_orbits_clear(fitted);
+  vec_f64_clear(rms);
+  if (!(mu > 0.0) || !isfinite(mu)) {
+    return ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT;
+  }
+  if (n_fits == 0) {
+    return ORBIT_DETERMINATION_ERROR_NONE;
+  }
+  for (size_t i = 0; i < n_fits; i++) {
+    if (offsets[i + 1] < offsets[i]) {
+      return ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT;
+    }
+  }
+  for (size_t j = offsets[0]; j < offsets[n_fits]; j++) {
+    if (indices[j] >= detections->ra.length) {
+      return ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT;
+    }
+  }
+
+  struct VecF64 *columns[7] = {&fitted->x, &fitted->y, &fitted->z, &fitted->vx, &fitted->vy, &fitted->vz, &fitted->t};
+  for (int d = 0; d < 7; d++) {
+    if (vec_f64_reserve(columns[d], n_fits) != 0) {
+      return ORBIT_DETERMINATION_ERROR_OUT_OF_MEMORY;
+    }
+  }
+  if (vec_f64_reserve(rms, n_fits) != 0) {
+    return ORBIT_DETERMINATION_ERROR_OUT_OF_MEMORY;
+  }
+
+  // Scratch is indexed like indices, so only entries from offsets[0]
+  // on are used.
+  size_t n_indices = offsets[n_fits];
+  size_t n_tasks = (n_fits + DIFFERENTIAL_CORRECTION_TASK_FITS - 1) / DIFFERENTIAL_CORRECTION_TASK_FITS;
+  double(*observers)[3] = malloc((n_indices > 0 ? n_indices : 1) * sizeof(double[3]));
+  double(*basis)[3][3] = malloc((n_indices > 0 ? n_indices : 1) * sizeof(double[3][3]));
+  struct FitTask *tasks = malloc(n_tasks * sizeof(struct FitTask));
+  enum OrbitDeterminationError status = ORBIT_DETERMINATION_ERROR_NONE;
+  if (observers == NULL || basis == NULL || tasks == NULL) {
+    status = ORBIT_DETERMINATION_ERROR_OUT_OF_MEMORY;
+    goto done;
+  }
+  status = find_observers(detections, observatories, indices + offsets[0], n_indices - offsets[0],
+                          observers + offsets[0]);
+  if (status != ORBIT_DETERMINATION_ERROR_NONE) {
+    goto done;
+  }
+
+  for (size_t k = 0; k < n_tasks; k++) {
+    size_t start = k * DIFFERENTIAL_CORRECTION_TASK_FITS;
+    size_t length =
+        n_fits - start < DIFFERENTIAL_CORRECTION_TASK_FITS ? n_fits - start : DIFFERENTIAL_CORRECTION_TASK_FITS;
+    tasks[k] = (struct FitTask){.orbits = orbits,
+                                .detections = detections,
+                                .offsets = offsets,
+                                .indices = indices,
+                                .observers = (const double(*)[3])observers,
+                                .basis = basis,
+                                .mu = mu,
+                                .fitted = fitted,
+                                .rms = rms->data,
+                                .start = start,
+                                .length = length};
+  }
+
+  if (pool == NULL) {
+    for (size_t k = 0; k < n_tasks; k++) {
+      run_fit_task(&tasks[k]);
+    }
+  } else {
+    for (size_t k = 0; k < n_tasks; k++) {
+      if (thread_pool_submit(pool, run_fit_task, &tasks[k]) != 0) {
+        // Whatever was not queued runs here instead.
+        run_fit_task(&tasks[k]);
+      }
+    }
+    thread_pool_wait(pool);
+  }
+
+  for (int d = 0; d < 7; d++) {
+    columns[d]->length = n_fits;
+  }
+  rms->length = n_fits;
+
+done:
+  free(tasks);
+  free(basis);
+  free(observers);
+  return status;
+}
@@ -0,0 +1,132 @@
+#ifndef orbit_determination_h
+#define orbit_determination_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "observatories.h"
+#include "orbits.h"
+#include "point_sources.h"
+#include "propagation.h"
+#include "thread_pool.h"
+#include "vectors.h"
+
+/// Number of candidates whose Gauss polynomials, or fits, are solved in
+/// lockstep. As in propagation, the solvers' loops run across this many
+/// lanes so the compiler can keep one candidate per vector lane; fits
+/// hand their lanes straight to propagate_block, so the two must match.
+#define ORBIT_DETERMINATION_LANES PROPAGATION_LANES
+
+/// Number of candidates per task in gauss_iod.
+#define ORBIT_DETERMINATION_TASK_CANDIDATES 256
+
+/// Gauss's eighth-order polynomial has at most three positive roots,
+/// so each candidate yields at most this many orbits.
+#define GAUSS_MAX_ROOTS 3
+
+/// Range of heliocentric distances at the middle observation, in AU,
+/// searched for roots of the polynomial.
+#define GAUSS_MIN_DISTANCE 0.01
+#define GAUSS_MAX_DISTANCE 1000.0
+
+/// Number of fits per task in differential_correction.
+#define DIFFERENTIAL_CORRECTION_TASK_FITS 32
+
+/// A fit stops once a correction would change its position and
+/// velocity by less than DIFFERENTIAL_CORRECTION_TOLERANCE of their
+/// magnitudes, or an iteration changed its RMS residual by less than
+/// DIFFERENTIAL_CORRECTION_RMS_TOLERANCE of it. It fails if neither
+/// has happened after DIFFERENTIAL_CORRECTION_MAX_ITERATIONS.
+#define DIFFERENTIAL_CORRECTION_TOLERANCE 1e-10
+#define DIFFERENTIAL_CORRECTION_RMS_TOLERANCE 1e-6
+#define DIFFERENTIAL_CORRECTION_MAX_ITERATIONS 12
+
+enum OrbitDeterminationError {
+  ORBIT_DETERMINATION_ERROR_NONE = 0,
+  ORBIT_DETERMINATION_ERROR_OUT_OF_MEMORY = -1,
+  ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT = -2,
+  ORBIT_DETERMINATION_ERROR_UNKNOWN_OBSERVATORY = -3,
+  ORBIT_DETERMINATION_ERROR_OUT_OF_RANGE = -4,
+};
+
+/// Computes preliminary orbits for many candidates at once with Gauss's
+/// method, under two-body motion about a central body with
+/// gravitational parameter mu (PROPAGATION_MU_SUN for heliocentric
+/// orbits).
+///
+/// Candidate i is the three detections at rows triplets[3 * i],
+/// triplets[3 * i + 1] and triplets[3 * i + 2] of detections, in
+/// increasing time order, such as three members of one cluster. Each
+/// detection's observer position comes from observatories, which, like
+/// the detections' ra and dec, must be in the frame the orbits are
+/// wanted in.
+///
+/// Every positive root of the Gauss polynomial between
+/// GAUSS_MIN_DISTANCE and GAUSS_MAX_DISTANCE that puts the object in
+/// front of the observer at all three times gives one orbit: its
+/// position and velocity at the middle detection's time. Roots closer
+/// together than about 5% of their distance may be missed. The f and g
+/// series are truncated after the first term, and no light-time
+/// correction is made, so the orbits are starting points for
+/// differential correction rather than final solutions.
+///
+/// The orbits are written to orbits, in candidate order and then by
+/// increasing distance, and candidates receives the candidate index
+/// of each. Both must be initialized by the caller; whatever they held
+/// before is overwritten and their storage reused, as with
+/// propagate_orbits. On failure both are left empty. Candidates with no valid root (including ones whose times are not
+/// increasing, or whose lines of sight are coplanar) produce no rows.
+///
+/// Candidates are solved ORBIT_DETERMINATION_LANES at a time, and
+/// groups of ORBIT_DETERMINATION_TASK_CANDIDATES run as tasks on pool;
+/// if pool is NULL, everything runs on the calling thread.
+///
+/// Returns 0 on success, ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT if
+/// a row is out of range or there are more candidates than fit in a
+/// uint32_t, ORBIT_DETERMINATION_ERROR_UNKNOWN_OBSERVATORY or
+/// ORBIT_DETERMINATION_ERROR_OUT_OF_RANGE if an observer position is
+/// not in the table, or another error code on failure.
+enum OrbitDeterminationError gauss_iod(struct TopocentricPointSources *detections,
+                                       struct ObservatoryTable *observatories, const uint32_t *triplets,
+                                       size_t n_candidates, double mu, struct ThreadPool *pool,
+                                       struct CartesianOrbits *orbits, struct VecU32 *candidates);
+
+/// Refines preliminary orbits, such as those from gauss_iod, by
+/// differential correction: a Gauss-Newton least-squares fit of each
+/// orbit's six-element state to its detections, under two-body motion
+/// about a central body with gravitational parameter mu.
+///
+/// Fit i starts from row i of orbits and uses the detections at rows
+/// indices[offsets[i]] through indices[offsets[i + 1] - 1], which is
+/// the layout of struct Clusters. Each detection's observer position
+/// comes from observatories, as in gauss_iod. Residuals are measured in
+/// the tangent plane at each observed direction, with equal weights,
+/// and no light-time correction is made.
+///
+/// The fits are solved ORBIT_DETERMINATION_LANES at a time: the normal
+/// equations are accumulated and solved by Cholesky factorization
+/// across lanes, with partial derivatives from finite differences of
+/// propagate_block. Groups of DIFFERENTIAL_CORRECTION_TASK_FITS fits
+/// run as tasks on pool; if pool is NULL, everything runs on the
+/// calling thread.
+///
+/// Row i of fitted receives fit i's state at the epoch of orbits' row
+/// i, and row i of rms its root-mean-square residual in degrees. Both
+/// must be initialized by the caller; whatever they held before is
+/// overwritten and their storage reused, as with propagate_orbits. On
+/// failure both are left empty. Fits with fewer than
+/// three detections, singular normal equations, or that do not
+/// converge produce NaN rows.
+///
+/// Returns 0 on success, ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT if
+/// offsets decrease or an index is out of range,
+/// ORBIT_DETERMINATION_ERROR_UNKNOWN_OBSERVATORY or
+/// ORBIT_DETERMINATION_ERROR_OUT_OF_RANGE if an observer position is
+/// not in the table, or another error code on failure.
+enum OrbitDeterminationError differential_correction(struct CartesianOrbits *orbits,
+                                                     struct TopocentricPointSources *detections,
+                                                     struct ObservatoryTable *observatories, const size_t *offsets,
+                                                     const uint32_t *indices, double mu, struct ThreadPool *pool,
+                                                     struct CartesianOrbits *fitted, struct VecF64 *rms);
+
+#endif
@@ -0,0 +1,91 @@
+#include "orbits.h"
+
+#include <stddef.h>
+
+#include "vectors.h"
+
+int cartesian_orbits_new(struct CartesianOrbits *orbits, size_t capacity) {
+  if (vec_f64_new(&orbits->x, capacity) != 0) {
+    goto fail;
+  }
+  if (vec_f64_new(&orbits->y, capacity) != 0) {
+    goto fail;
+  }
+  if (vec_f64_new(&orbits->z, capacity) != 0) {
+    goto fail;
+  }
+  if (vec_f64_new(&orbits->vx, capacity) != 0) {
+    goto fail;
+  }
+  if (vec_f64_new(&orbits->vy, capacity) != 0) {
+    goto fail;
+  }
+  if (vec_f64_new(&orbits->vz, capacity) != 0) {
+    goto fail;
+  }
+  if (vec_f64_new(&orbits->t, capacity) != 0) {
+    goto fail;
+  }
+  return 0;
+
+fail:
+  cartesian_orbits_free(orbits);
+  return -1;
+}
+
+void cartesian_orbits_free(struct CartesianOrbits *orbits) {
+  vec_f64_free(&orbits->x);
+  vec_f64_free(&orbits->y);
+  vec_f64_free(&orbits->z);
+  vec_f64_free(&orbits->vx);
+  vec_f64_free(&orbits->vy);
+  vec_f64_free(&orbits->vz);
+  vec_f64_free(&orbits->t);
+}
+
+void cartesian_orbits_clear(struct CartesianOrbits *orbits) {
+  vec_f64_clear(&orbits->x);
+  vec_f64_clear(&orbits->y);
+  vec_f64_clear(&orbits->z);
+  vec_f64_clear(&orbits->vx);
+  vec_f64_clear(&orbits->vy);
+  vec_f64_clear(&orbits->vz);
+  vec_f64_clear(&orbits->t);
+}
+
+void cartesian_orbits_push(struct CartesianOrbits *orbits, double pos[3], double vel[3], double t) {
+  vec_f64_push(&orbits->x, pos[0]);
+  vec_f64_push(&orbits->y, pos[1]);
+  vec_f64_push(&orbits->z, pos[2]);
+  vec_f64_push(&orbits->vx, vel[0]);
+  vec_f64_push(&orbits->vy, vel[1]);
+  vec_f64_push(&orbits->vz, vel[2]);
+  vec_f64_push(&orbits->t, t);
+}
+
+int cartesian_orbits_get(struct CartesianOrbits *orbits, size_t i, double pos[3], double vel[3]) {
+  if (i >= orbits->x.length) {
+    return -1;
+  }
+  pos[0] = orbits->x.data[i];
+  pos[1] = orbits->y.data[i];
+  pos[2] = orbits->z.data[i];
+  vel[0] = orbits->vx.data[i];
+  vel[1] = orbits->vy.data[i];
+  vel[2] = orbits->vz.data[i];
+  return 0;
+}
+
+int cartesian_orbits_view(struct CartesianOrbits *orbits, size_t start, size_t length, struct CartesianOrbits *view) {
+  if (start > orbits->x.length || length > orbits->x.length - start) {
+    return -1;
+  }
+  vec_f64_view(&view->x, orbits->x.data + start, length);
+  vec_f64_view(&view->y, orbits->y.data + start, length);
+  vec_f64_view(&view->z, orbits->z.data + start, length);
+  vec_f64_view(&view->vx, orbits->vx.data + start, length);
+  vec_f64_view(&view->vy, orbits->vy.data + start, length);
+  vec_f64_view(&view->vz, orbits->vz.data + start, length);
+  vec_f64_view(&view->t, orbits->t.data + start, length);
+  return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef orbits_h
+#define orbits_h
+
+#include <stddef.h>
+
+#include "vectors.h"
+
+struct CartesianOrbits {
+  /// Represents a collection of orbital states, relative to the
+  /// sun. Positions are in AU, velocities in AU per day. Uses a struct
+  /// of arrays representation.
+  struct VecF64 x;
+  struct VecF64 y;
+  struct VecF64 z;
+  struct VecF64 vx;
+  struct VecF64 vy;
+  struct VecF64 vz;
+  struct VecF64 t;  // MJD
+};
+
+#define CARTESIAN_ORBITS_ZERO                                                                             \
+  {.x = VECF64_ZERO, .y = VECF64_ZERO, .z = VECF64_ZERO, .vx = VECF64_ZERO, .vy = VECF64_ZERO, .vz = VECF64_ZERO, \
+   .t = VECF64_ZERO}
+
+int cartesian_orbits_new(struct CartesianOrbits *orbits, size_t capacity);
+void cartesian_orbits_free(struct CartesianOrbits *orbits);
+/// Empties orbits, keeping its storage for reuse.
+void cartesian_orbits_clear(struct CartesianOrbits *orbits);
+void cartesian_orbits_push(struct CartesianOrbits *orbits, double pos[3], double vel[3], double t);
+
+/// Copies the position and velocity of the i-th orbit into pos and vel.
+/// Returns 0 on success, -1 if i is out of range.
+int cartesian_orbits_get(struct CartesianOrbits *orbits, size_t i, double pos[3], double vel[3]);
+
+/// Makes view a borrowed view of rows start through start + length - 1
+/// of orbits, without copying; see vec_f64_view. Useful for passing
+/// one orbit's block of propagate_orbits output on as a per-epoch
+/// table. Returns 0 on success, -1 if the rows are out of range.
+int cartesian_orbits_view(struct CartesianOrbits *orbits, size_t start, size_t length, struct CartesianOrbits *view);
+
+#endif
@@ -0,0 +1,365 @@
+#include "point_source_file.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "obscodes.h"
+#include "point_sources.h"
+#include "str.h"
+#include "vectors.h"
+
+#define MAX_COLUMNS 8
+#define COLUMNS_OFFSET 128
+
+_Static_assert(sizeof(struct PointSourceFileHeader) == 64, "point source file header must be 64 bytes");
+
+static uint64_t align_up(uint64_t offset) {
+  return (offset + POINT_SOURCE_FILE_ALIGNMENT - 1) / POINT_SOURCE_FILE_ALIGNMENT * POINT_SOURCE_FILE_ALIGNMENT;
+}
+
+static int write_padding(FILE *f, uint64_t from, uint64_t to) {
+  static const char zeros[POINT_SOURCE_FILE_ALIGNMENT] = {0};
+  while (from < to) {
+    size_t n = to - from < sizeof(zeros) ? to - from : sizeof(zeros);
+    if (fwrite(zeros, 1, n, f) != n) {
+      return -1;
+    }
+    from += n;
+  }
+  return 0;
+}
+
+struct Column {
+  const void *data;
+  size_t item_size;
+};
+
+static enum PointSourceFileError write_file(const char *path, enum PointSourceFileKind kind, struct Column *columns,
+                                            uint32_t n_columns, uint64_t n_rows, const struct String **obscodes,
+                                            uint32_t n_obscodes) {
+  struct PointSourceFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, POINT_SOURCE_FILE_MAGIC, sizeof(POINT_SOURCE_FILE_MAGIC));
+  header.version = POINT_SOURCE_FILE_VERSION;
+  header.byte_order = POINT_SOURCE_FILE_BYTE_ORDER;
+  header.kind = kind;
+  header.n_columns = n_columns;
+  header.n_rows = n_rows;
+  header.n_obscodes = n_obscodes;
+
+  uint64_t column_offsets[MAX_COLUMNS] = {0};
+  uint64_t offset = COLUMNS_OFFSET;
+  for (uint32_t c = 0; c < n_columns; c++) {
+    column_offsets[c] = offset;
+    offset = align_up(offset + n_rows * columns[c].item_size);
+  }
+  header.dictionary_offset = offset;
+  header.dictionary_size = 0;
+  for (uint32_t i = 0; i < n_obscodes; i++) {
+    header.dictionary_size += sizeof(uint32_t) + obscodes[i]->length;
+  }
+
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    return POINT_SOURCE_FILE_ERROR_IO;
+  }
+  int failed = fwrite(&header, sizeof(header), 1, f) != 1;
+  failed = failed || fwrite(column_offsets, sizeof(column_offsets), 1, f) != 1;
+  offset = COLUMNS_OFFSET;
+  for (uint32_t c = 0; c < n_columns && !failed; c++) {
+    failed = write_padding(f, offset, column_offsets[c]) != 0;
+    failed = failed || (n_rows > 0 && fwrite(columns[c].data, columns[c].item_size, n_rows, f) != n_rows);
+    offset = column_offsets[c] + n_rows * columns[c].item_size;
+  }
+  failed = failed || write_padding(f, offset, header.dictionary_offset) != 0;
+  for (uint32_t i = 0; i < n_obscodes && !failed; i++) {
+    uint32_t length = (uint32_t)obscodes[i]->length;
+    failed = fwrite(&length, sizeof(length), 1, f) != 1;
+    failed = failed || (length > 0 && fwrite(obscodes[i]->data, 1, length, f) != length);
+  }
+  failed = fclose(f) != 0 || failed;
+  return failed ? POINT_SOURCE_FILE_ERROR_IO : POINT_SOURCE_FILE_ERROR_NONE;
+}
+
+enum PointSourceFileError point_source_file_write_topocentric(const char *path,
+                                                              struct TopocentricPointSources *topocentric) {
+  // The file gets its own dense ids, numbering the observatories it
+  // uses in order of their process-wide ids.
+  size_t n = topocentric->ra.length;
+  const uint16_t *ids = topocentric->obscode_id.data;
+  uint16_t *file_id = malloc((size_t)OBSCODE_MAX_COUNT * sizeof(uint16_t));
+  const struct String **obscodes = malloc((size_t)OBSCODE_MAX_COUNT * sizeof(struct String *));
+  uint16_t *file_ids = malloc((n > 0 ? n : 1) * sizeof(uint16_t));
+  enum PointSourceFileError status = POINT_SOURCE_FILE_ERROR_OUT_OF_MEMORY;
+  if (file_id == NULL || obscodes == NULL || file_ids == NULL) {
+    goto done;
+  }
+
+  memset(file_id, 0xff, (size_t)OBSCODE_MAX_COUNT * sizeof(uint16_t));
+  for (size_t i = 0; i < n; i++) {
+    if (ids[i] != OBSCODE_NONE) {
+      file_id[ids[i]] = 0;
+    }
+  }
+  uint32_t n_obscodes = 0;
+  for (size_t id = 0; id < OBSCODE_MAX_COUNT; id++) {
+    if (file_id[id] == 0) {
+      file_id[id] = (uint16_t)n_obscodes;
+      obscodes[n_obscodes++] = obscode_lookup((uint16_t)id);
+    }
+  }
+  for (size_t i = 0; i < n; i++) {
+    file_ids[i] = ids[i] == OBSCODE_NONE ? OBSCODE_NONE : file_id[ids[i]];
+  }
+
+  struct Column columns[4] = {{topocentric->ra.data, sizeof(double)},
+                              {topocentric->dec.data, sizeof(double)},
+                              {topocentric->t.data, sizeof(double)},
+                              {file_ids, sizeof(uint16_t)}};
+  status = write_file(path, POINT_SOURCE_FILE_TOPOCENTRIC, columns, 4, n, obscodes, n_obscodes);
+
+done:
+  free(file_id);
+  free(obscodes);
+  free(file_ids);
+  return status;
+}
+
+enum PointSourceFileError point_source_file_write_cartesian(const char *path,
+                                                            struct CartesianPointSources *cartesian) {
+  struct Column columns[4] = {{cartesian->x.data, sizeof(double)},
+                              {cartesian->y.data, sizeof(double)},
+                              {cartesian->z.data, sizeof(double)},
+                              {cartesian->t.data, sizeof(double)}};
+  return write_file(path, POINT_SOURCE_FILE_CARTESIAN, columns, 4, cartesian->x.length, NULL, 0);
+}
+
+// Returns how many columns a file of the header's kind and version
+// holds, or 0 for an unknown kind.
+static uint32_t expected_columns(const struct PointSourceFileHeader *header) {
+  if (header->kind == POINT_SOURCE_FILE_TOPOCENTRIC) {
+    return header->version >= 2 ? 4 : 3;
+  }
+  if (header->kind == POINT_SOURCE_FILE_CARTESIAN) {
+    return 4;
+  }
+  return 0;
+}
+
+// Returns the size of one value of column c, which must be one of the
+// file's expected columns.
+static size_t item_size(const struct PointSourceFileHeader *header, uint32_t c) {
+  return header->kind == POINT_SOURCE_FILE_TOPOCENTRIC && c == 3 ? sizeof(uint16_t) : sizeof(double);
+}
+
+static enum PointSourceFileError validate(struct PointSourceFile *file) {
+  if (file->size < COLUMNS_OFFSET) {
+    return POINT_SOURCE_FILE_ERROR_FORMAT;
+  }
+  const struct PointSourceFileHeader *header = file->header;
+  if (memcmp(header->magic, POINT_SOURCE_FILE_MAGIC, sizeof(POINT_SOURCE_FILE_MAGIC)) != 0 ||
+      header->version < 1 || header->version > POINT_SOURCE_FILE_VERSION ||
+      header->byte_order != POINT_SOURCE_FILE_BYTE_ORDER ||
+      header->n_columns == 0 || header->n_columns != expected_columns(header)) {
+    return POINT_SOURCE_FILE_ERROR_FORMAT;
+  }
+  if (header->n_rows > file->size / sizeof(double)) {
+    return POINT_SOURCE_FILE_ERROR_FORMAT;
+  }
+  const uint64_t *column_offsets = (const uint64_t *)((const char *)file->mapping + sizeof(*header));
+  for (uint32_t c = 0; c < header->n_columns; c++) {
+    uint64_t offset = column_offsets[c];
+    size_t size = item_size(header, c);
+    if (offset % POINT_SOURCE_FILE_ALIGNMENT != 0 || offset < COLUMNS_OFFSET || offset > file->size ||
+        header->n_rows * size > file->size - offset) {
+      return POINT_SOURCE_FILE_ERROR_FORMAT;
+    }
+  }
+  if (header->dictionary_offset > file->size || header->dictionary_size > file->size - header->dictionary_offset) {
+    return POINT_SOURCE_FILE_ERROR_FORMAT;
+  }
+  return POINT_SOURCE_FILE_ERROR_NONE;
+}
+
+static enum PointSourceFileError read_obscodes(struct PointSourceFile *file) {
+  const struct PointSourceFileHeader *header = file->header;
+  if (header->n_obscodes == 0) {
+    return POINT_SOURCE_FILE_ERROR_NONE;
+  }
+  if (header->n_obscodes > OBSCODE_MAX_COUNT) {
+    return POINT_SOURCE_FILE_ERROR_FORMAT;
+  }
+  file->obscode_ids = malloc(header->n_obscodes * sizeof(uint16_t));
+  if (file->obscode_ids == NULL) {
+    return POINT_SOURCE_FILE_ERROR_OUT_OF_MEMORY;
+  }
+
+  const char *entry = (const char *)file->mapping + header->dictionary_offset;
+  uint64_t remaining = header->dictionary_size;
+  for (uint32_t i = 0; i < header->n_obscodes; i++) {
+    uint32_t length;
+    if (remaining < sizeof(length)) {
+      return POINT_SOURCE_FILE_ERROR_FORMAT;
+    }
+    memcpy(&length, entry, sizeof(length));
+    if (length == 0 || length > remaining - sizeof(length)) {
+      return POINT_SOURCE_FILE_ERROR_FORMAT;
+    }
+    struct String obscode = {.length = length, .data = (char *)entry + sizeof(length)};
+    file->obscode_ids[i] = obscode_intern(&obscode);
+    if (file->obscode_ids[i] == OBSCODE_NONE) {
+      return POINT_SOURCE_FILE_ERROR_OUT_OF_MEMORY;
+    }
+    entry += sizeof(length) + length;
+    remaining -= sizeof(length) + length;
+  }
+  return POINT_SOURCE_FILE_ERROR_NONE;
+}
+
+static const uint16_t *mapped_ids(struct PointSourceFile *file);
+
+// Decides whether the obscode_id column can be used as mapped, and
+// translates it into process-wide ids if not.
+static enum PointSourceFileError translate_ids(struct PointSourceFile *file) {
+  const struct PointSourceFileHeader *header = file->header;
+  if (header->kind != POINT_SOURCE_FILE_TOPOCENTRIC) {
+    return POINT_SOURCE_FILE_ERROR_NONE;
+  }
+  size_t n = header->n_rows;
+
+  if (header->version < 2) {
+    // Every row belongs to the one observatory in the dictionary.
+    uint16_t id = header->n_obscodes > 0 ? file->obscode_ids[0] : OBSCODE_NONE;
+    file->translated_ids = malloc((n > 0 ? n : 1) * sizeof(uint16_t));
+    if (file->translated_ids == NULL) {
+      return POINT_SOURCE_FILE_ERROR_OUT_OF_MEMORY;
+    }
+    for (size_t i = 0; i < n; i++) {
+      file->translated_ids[i] = id;
+    }
+    return POINT_SOURCE_FILE_ERROR_NONE;
+  }
+
+  // Even ids that need no translation are checked, so that a corrupt
+  // id cannot name some other observatory of the process.
+  const uint16_t *ids = mapped_ids(file);
+  int identity = 1;
+  for (uint32_t i = 0; i < header->n_obscodes; i++) {
+    identity &= file->obscode_ids[i] == i;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (ids[i] != OBSCODE_NONE && ids[i] >= header->n_obscodes) {
+      return POINT_SOURCE_FILE_ERROR_FORMAT;
+    }
+  }
+  if (identity) {
+    return POINT_SOURCE_FILE_ERROR_NONE;
+  }
+
+  file->translated_ids = malloc((n > 0 ? n : 1) * sizeof(uint16_t));
+  if (file->translated_ids == NULL) {
+    return POINT_SOURCE_FILE_ERROR_OUT_OF_MEMORY;
+  }
+  for (size_t i = 0; i < n; i++) {
+    file->translated_ids[i] = ids[i] == OBSCODE_NONE ? OBSCODE_NONE : file->obscode_ids[ids[i]];
+  }
+  return POINT_SOURCE_FILE_ERROR_NONE;
+}
+
+enum PointSourceFileError point_source_file_open(struct PointSourceFile *file, const char *path) {
+  file->mapping = NULL;
+  file->size = 0;
+  file->header = NULL;
+  file->obscode_ids = NULL;
+  file->translated_ids = NULL;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return POINT_SOURCE_FILE_ERROR_IO;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return POINT_SOURCE_FILE_ERROR_IO;
+  }
+  if ((size_t)st.st_size < COLUMNS_OFFSET) {
+    close(fd);
+    return POINT_SOURCE_FILE_ERROR_FORMAT;
+  }
+  void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping keeps its own reference to the file.
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return POINT_SOURCE_FILE_ERROR_IO;
+  }
+  file->mapping = mapping;
+  file->size = st.st_size;
+  file->header = mapping;
+
+  enum PointSourceFileError status = validate(file);
+  if (status == POINT_SOURCE_FILE_ERROR_NONE) {
+    status = read_obscodes(file);
+  }
+  if (status == POINT_SOURCE_FILE_ERROR_NONE) {
+    status = translate_ids(file);
+  }
+  if (status != POINT_SOURCE_FILE_ERROR_NONE) {
+    point_source_file_close(file);
+  }
+  return status;
+}
+
+void point_source_file_close(struct PointSourceFile *file) {
+  if (file->mapping != NULL) {
+    munmap(file->mapping, file->size);
+    file->mapping = NULL;
+  }
+  file->header = NULL;
+  free(file->obscode_ids);
+  free(file->translated_ids);
+  file->obscode_ids = NULL;
+  file->translated_ids = NULL;
+}
+
+static void *column(struct PointSourceFile *file, uint32_t c) {
+  const uint64_t *column_offsets = (const uint64_t *)((const char *)file->mapping + sizeof(*file->header));
+  return (char *)file->mapping + column_offsets[c];
+}
+
+static const uint16_t *mapped_ids(struct PointSourceFile *file) { return column(file, 3); }
+
+enum PointSourceFileError point_source_file_topocentric(struct PointSourceFile *file,
+                                                        struct TopocentricPointSources *topocentric) {
+  const struct PointSourceFileHeader *header = file->header;
+  if (header->kind != POINT_SOURCE_FILE_TOPOCENTRIC) {
+    return POINT_SOURCE_FILE_ERROR_WRONG_KIND;
+  }
+  size_t n = header->n_rows;
+  vec_f64_view(&topocentric->ra, column(file, 0), n);
+  vec_f64_view(&topocentric->dec, column(file, 1), n);
+  vec_f64_view(&topocentric->t, column(file, 2), n);
+  uint16_t *ids = file->translated_ids != NULL ? file->translated_ids : column(file, 3);
+  vec_u16_view(&topocentric->obscode_id, ids, n);
+  topocentric->obscode = NULL;
+  topocentric->default_obscode_id = header->n_obscodes == 1 ? file->obscode_ids[0] : OBSCODE_NONE;
+  return POINT_SOURCE_FILE_ERROR_NONE;
+}
+
+enum PointSourceFileError point_source_file_cartesian(struct PointSourceFile *file,
+                                                      struct CartesianPointSources *cartesian) {
+  if (file->header->kind != POINT_SOURCE_FILE_CARTESIAN) {
+    return POINT_SOURCE_FILE_ERROR_WRONG_KIND;
+  }
+  size_t n = file->header->n_rows;
+  vec_f64_view(&cartesian->x, column(file, 0), n);
+  vec_f64_view(&cartesian->y, column(file, 1), n);
+  vec_f64_view(&cartesian->z, column(file, 2), n);
+  vec_f64_view(&cartesian->t, column(file, 3), n);
+  return POINT_SOURCE_FILE_ERROR_NONE;
+}
@@ -0,0 +1,103 @@
+#ifndef point_source_file_h
+#define point_source_file_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "point_sources.h"
+#include "str.h"
+
+/// A point source file stores the columns of one point source container
+/// in a versioned binary layout designed to be memory-mapped:
+///
+///   offset 0    header (64 bytes, struct PointSourceFileHeader)
+///   offset 64   column offsets (8 bytes each, at most 8 columns)
+///   offset 128  columns, each n_rows values, each starting on a
+///               64-byte boundary
+///   ...         obscode dictionary: for each entry, a uint32 length
+///               followed by that many bytes
+///
+/// Numbers are stored in host byte order; the header records which.
+/// Topocentric files hold ra, dec and t columns of doubles, and (from
+/// version 2) an obscode_id column of uint16 indices into the file's
+/// dictionary. Cartesian files hold x, y, z and t columns of doubles.
+///
+/// Version 1 files, whose dictionary names the single observatory of
+/// every row, can still be read.
+
+#define POINT_SOURCE_FILE_MAGIC "CTHORPS"
+#define POINT_SOURCE_FILE_VERSION 2
+#define POINT_SOURCE_FILE_ALIGNMENT 64
+#define POINT_SOURCE_FILE_BYTE_ORDER 0x01020304u
+
+enum PointSourceFileError {
+  POINT_SOURCE_FILE_ERROR_NONE = 0,
+  POINT_SOURCE_FILE_ERROR_IO = -1,
+  POINT_SOURCE_FILE_ERROR_FORMAT = -2,
+  POINT_SOURCE_FILE_ERROR_WRONG_KIND = -3,
+  POINT_SOURCE_FILE_ERROR_OUT_OF_MEMORY = -4,
+};
+
+enum PointSourceFileKind {
+  POINT_SOURCE_FILE_TOPOCENTRIC = 1,
+  POINT_SOURCE_FILE_CARTESIAN = 2,
+};
+
+struct PointSourceFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t kind;
+  uint32_t n_columns;
+  uint64_t n_rows;
+  uint64_t dictionary_offset;
+  uint64_t dictionary_size;
+  uint32_t n_obscodes;
+  uint8_t reserved[12];
+};
+
+struct PointSourceFile {
+  /// An open, memory-mapped point source file.
+  void *mapping;
+  size_t size;
+  const struct PointSourceFileHeader *header;
+  /// Process-wide obscode id of each dictionary entry.
+  uint16_t *obscode_ids;
+  /// The obscode_id column translated to process-wide ids, when the
+  /// file's ids differ from the process's; otherwise NULL and views use
+  /// the mapped column directly.
+  uint16_t *translated_ids;
+};
+
+enum PointSourceFileError point_source_file_write_topocentric(const char *path,
+                                                              struct TopocentricPointSources *topocentric);
+enum PointSourceFileError point_source_file_write_cartesian(const char *path, struct CartesianPointSources *cartesian);
+
+/// Maps a point source file read-only and validates its layout,
+/// including that it has exactly the columns of its kind and version.
+/// The only column data read is a topocentric file's obscode_id column,
+/// whose ids are checked against its dictionary; other pages are
+/// faulted in as they are used, and other processes mapping the same
+/// file share the page cache.
+enum PointSourceFileError point_source_file_open(struct PointSourceFile *file, const char *path);
+void point_source_file_close(struct PointSourceFile *file);
+
+/// Fills topocentric with zero-copy, read-only views of the file's
+/// columns (see vec_f64_view). The views stay valid until the file is
+/// closed and must not be freed with topocentric_point_sources_free.
+/// Writing through the views faults; pushing to them copies the column
+/// out first.
+///
+/// The file's obscodes are interned on open. The obscode_id column is
+/// only copied if the file's ids do not already match the process's,
+/// which they do when the file is the first thing a process reads. The
+/// view's obscode is NULL; its default_obscode_id is set if the file
+/// holds a single observatory.
+enum PointSourceFileError point_source_file_topocentric(struct PointSourceFile *file,
+                                                        struct TopocentricPointSources *topocentric);
+
+/// Like point_source_file_topocentric, for Cartesian files.
+enum PointSourceFileError point_source_file_cartesian(struct PointSourceFile *file,
+                                                      struct CartesianPointSources *cartesian);
+
+#endif
@@ -1,15 +1,60 @@
 #include "point_sources.h"
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "arena.h"
+#include "obscodes.h"
 #include "str.h"
 #include "vectors.h"
 
+// Rounds a size in bytes up to a whole number of cache lines. bytes
+// must be at most SIZE_MAX - (ARENA_ALIGNMENT - 1).
+static size_t cache_lines(size_t bytes) {
+  return (bytes + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+}
+
+// Carves n_columns empty columns of the given capacity out of one
+// arena block, each starting on its own cache line. If tail is not
+// NULL, tail_size more bytes follow on a cache line of their own, for a
+// column of another type, and *tail is set to them. Fails if the block
+// would be larger than a size_t can hold.
+static int columns_from_arena(struct Arena *arena, size_t capacity, struct VecF64 **columns, size_t n_columns,
+                              size_t tail_size, void **tail) {
+  if (capacity < 1 || capacity > (SIZE_MAX - (ARENA_ALIGNMENT - 1)) / sizeof(double) ||
+      tail_size > SIZE_MAX - (ARENA_ALIGNMENT - 1)) {
+    return -1;
+  }
+  size_t stride = cache_lines(capacity * sizeof(double));
+  size_t tail_stride = cache_lines(tail_size);
+  if (stride > (SIZE_MAX - tail_stride) / n_columns) {
+    return -1;
+  }
+  char *block = arena_alloc(arena, stride * n_columns + tail_stride);
+  if (block == NULL) {
+    return -1;
+  }
+  for (size_t i = 0; i < n_columns; i++) {
+    vec_f64_from_buffer(columns[i], (double *)(block + i * stride), capacity);
+  }
+  if (tail != NULL) {
+    *tail = block + n_columns * stride;
+  }
+  return 0;
+}
+
+static void set_obscode(struct TopocentricPointSources *topocentric, struct String *obscode) {
+  topocentric->obscode = obscode;
+  topocentric->default_obscode_id = obscode != NULL ? obscode_intern(obscode) : OBSCODE_NONE;
+}
+
 int topocentric_point_sources_new(struct TopocentricPointSources *topocentric, size_t capacity,
                                   struct String *obscode) {
   /// Create a new TopocentricPointSources object with the given
   /// capacity. Takes ownership of obscode.
+  topocentric->obscode = NULL;
   if (vec_f64_new(&topocentric->ra, capacity) != 0) {
     goto fail;
   }
@@ -19,7 +64,10 @@ int topocentric_point_sources_new(struct TopocentricPointSources *topocentric, s
   if (vec_f64_new(&topocentric->t, capacity) != 0) {
     goto fail;
   }
-  topocentric->obscode = obscode;
+  if (vec_u16_new(&topocentric->obscode_id, capacity) != 0) {
+    goto fail;
+  }
+  set_obscode(topocentric, obscode);
   return 0;
 
 fail:
@@ -27,17 +75,96 @@ fail:
   return -1;
 }
 
+int topocentric_point_sources_new_in(struct TopocentricPointSources *topocentric, size_t capacity,
+                                     struct String *obscode, struct Arena *arena) {
+  struct VecF64 *columns[3] = {&topocentric->ra, &topocentric->dec, &topocentric->t};
+  void *ids;
+  // A capacity too large for the ids' size to be computed is rejected
+  // anyway, as too large for the double columns.
+  if (columns_from_arena(arena, capacity, columns, 3, capacity * sizeof(uint16_t), &ids) != 0) {
+    return -1;
+  }
+  vec_u16_from_buffer(&topocentric->obscode_id, ids, capacity);
+  set_obscode(topocentric, obscode);
+  return 0;
+}
+
 void topocentric_point_sources_free(struct TopocentricPointSources *topocentric) {
   vec_f64_free(&topocentric->ra);
   vec_f64_free(&topocentric->dec);
   vec_f64_free(&topocentric->t);
-  string_free(topocentric->obscode);
+  vec_u16_free(&topocentric->obscode_id);
+  if (topocentric->obscode != NULL) {
+    string_free(topocentric->obscode);
+  }
+}
+
+int topocentric_point_sources_push(struct TopocentricPointSources *topocentric, double ra, double dec, double t) {
+  return topocentric_point_sources_push_obscode(topocentric, ra, dec, t, topocentric->default_obscode_id);
 }
 
-void topocentric_point_sources_push(struct TopocentricPointSources *topocentric, double ra, double dec, double t) {
-  vec_f64_push(&topocentric->ra, ra);
-  vec_f64_push(&topocentric->dec, dec);
-  vec_f64_push(&topocentric->t, t);
+int topocentric_point_sources_push_obscode(struct TopocentricPointSources *topocentric, double ra, double dec,
+                                           double t, uint16_t obscode_id) {
+  // Every column is grown before any is written, so a failure leaves
+  // them all the same length.
+  size_t length = topocentric->ra.length;
+  if (topocentric_point_sources_reserve(topocentric, vec_grown_capacity(topocentric->ra.capacity, length + 1)) !=
+      0) {
+    return -1;
+  }
+  topocentric->ra.data[length] = ra;
+  topocentric->dec.data[length] = dec;
+  topocentric->t.data[length] = t;
+  topocentric->obscode_id.data[length] = obscode_id;
+  topocentric_point_sources_resize(topocentric, length + 1);
+  return 0;
+}
+
+int topocentric_point_sources_reserve(struct TopocentricPointSources *topocentric, size_t capacity) {
+  if (vec_f64_reserve(&topocentric->ra, capacity) != 0 || vec_f64_reserve(&topocentric->dec, capacity) != 0 ||
+      vec_f64_reserve(&topocentric->t, capacity) != 0 || vec_u16_reserve(&topocentric->obscode_id, capacity) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+int topocentric_point_sources_resize(struct TopocentricPointSources *topocentric, size_t length) {
+  if (topocentric_point_sources_reserve(topocentric, length) != 0) {
+    return -1;
+  }
+  topocentric->ra.length = length;
+  topocentric->dec.length = length;
+  topocentric->t.length = length;
+  topocentric->obscode_id.length = length;
+  return 0;
+}
+
+void topocentric_point_sources_clear(struct TopocentricPointSources *topocentric) {
+  topocentric_point_sources_resize(topocentric, 0);
+}
+
+int topocentric_point_sources_append(struct TopocentricPointSources *topocentric, const double *ra,
+                                     const double *dec, const double *t, const uint16_t *obscode_id, size_t n) {
+  size_t length = topocentric->ra.length;
+  if (n > SIZE_MAX - length ||
+      topocentric_point_sources_reserve(topocentric, vec_grown_capacity(topocentric->ra.capacity, length + n)) != 0) {
+    return -1;
+  }
+  if (n == 0) {
+    return 0;
+  }
+  memcpy(topocentric->ra.data + length, ra, n * sizeof(double));
+  memcpy(topocentric->dec.data + length, dec, n * sizeof(double));
+  memcpy(topocentric->t.data + length, t, n * sizeof(double));
+  if (obscode_id != NULL) {
+    memcpy(topocentric->obscode_id.data + length, obscode_id, n * sizeof(uint16_t));
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      topocentric->obscode_id.data[length + i] = topocentric->default_obscode_id;
+    }
+  }
+  topocentric_point_sources_resize(topocentric, length + n);
+  return 0;
 }
 
 int cartesian_point_sources_new(struct CartesianPointSources *cartesian, size_t capacity) {
@@ -61,6 +188,11 @@ fail:
   return -1;
 }
 
+int cartesian_point_sources_new_in(struct CartesianPointSources *cartesian, size_t capacity, struct Arena *arena) {
+  struct VecF64 *columns[4] = {&cartesian->x, &cartesian->y, &cartesian->z, &cartesian->t};
+  return columns_from_arena(arena, capacity, columns, 4, 0, NULL);
+}
+
 void cartesian_point_sources_free(struct CartesianPointSources *cartesian) {
   vec_f64_free(&cartesian->x);
   vec_f64_free(&cartesian->y);
@@ -68,11 +200,58 @@ void cartesian_point_sources_free(struct CartesianPointSources *cartesian) {
   vec_f64_free(&cartesian->t);
 }
 
-void cartesian_point_sources_push(struct CartesianPointSources *cartesian, double x, double y, double z, double t) {
-  vec_f64_push(&cartesian->x, x);
-  vec_f64_push(&cartesian->y, y);
-  vec_f64_push(&cartesian->z, z);
-  vec_f64_push(&cartesian->t, t);
+int cartesian_point_sources_push(struct CartesianPointSources *cartesian, double x, double y, double z, double t) {
+  size_t length = cartesian->x.length;
+  if (cartesian_point_sources_reserve(cartesian, vec_grown_capacity(cartesian->x.capacity, length + 1)) != 0) {
+    return -1;
+  }
+  cartesian->x.data[length] = x;
+  cartesian->y.data[length] = y;
+  cartesian->z.data[length] = z;
+  cartesian->t.data[length] = t;
+  cartesian_point_sources_resize(cartesian, length + 1);
+  return 0;
+}
+
+int cartesian_point_sources_reserve(struct CartesianPointSources *cartesian, size_t capacity) {
+  if (vec_f64_reserve(&cartesian->x, capacity) != 0 || vec_f64_reserve(&cartesian->y, capacity) != 0 ||
+      vec_f64_reserve(&cartesian->z, capacity) != 0 || vec_f64_reserve(&cartesian->t, capacity) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+int cartesian_point_sources_resize(struct CartesianPointSources *cartesian, size_t length) {
+  if (cartesian_point_sources_reserve(cartesian, length) != 0) {
+    return -1;
+  }
+  cartesian->x.length = length;
+  cartesian->y.length = length;
+  cartesian->z.length = length;
+  cartesian->t.length = length;
+  return 0;
+}
+
+void cartesian_point_sources_clear(struct CartesianPointSources *cartesian) {
+  cartesian_point_sources_resize(cartesian, 0);
+}
+
+int cartesian_point_sources_append(struct CartesianPointSources *cartesian, const double *x, const double *y,
+                                   const double *z, const double *t, size_t n) {
+  size_t length = cartesian->x.length;
+  if (n > SIZE_MAX - length ||
+      cartesian_point_sources_reserve(cartesian, vec_grown_capacity(cartesian->x.capacity, length + n)) != 0) {
+    return -1;
+  }
+  if (n == 0) {
+    return 0;
+  }
+  memcpy(cartesian->x.data + length, x, n * sizeof(double));
+  memcpy(cartesian->y.data + length, y, n * sizeof(double));
+  memcpy(cartesian->z.data + length, z, n * sizeof(double));
+  memcpy(cartesian->t.data + length, t, n * sizeof(double));
+  cartesian_point_sources_resize(cartesian, length + n);
+  return 0;
 }
 
 int gnomonic_point_sources_new(struct GnomonicPointSources *gnomonic, size_t capacity) {
@@ -93,14 +272,137 @@ fail:
   return -1;
 }
 
+int gnomonic_point_sources_new_in(struct GnomonicPointSources *gnomonic, size_t capacity, struct Arena *arena) {
+  struct VecF64 *columns[3] = {&gnomonic->x, &gnomonic->y, &gnomonic->t};
+  return columns_from_arena(arena, capacity, columns, 3, 0, NULL);
+}
+
 void gnomonic_point_sources_free(struct GnomonicPointSources *gnomonic) {
   vec_f64_free(&gnomonic->x);
   vec_f64_free(&gnomonic->y);
   vec_f64_free(&gnomonic->t);
 }
 
-void gnomonic_point_sources_push(struct GnomonicPointSources *gnomonic, double x, double y, double t) {
-  vec_f64_push(&gnomonic->x, x);
-  vec_f64_push(&gnomonic->y, y);
-  vec_f64_push(&gnomonic->t, t);
+int gnomonic_point_sources_push(struct GnomonicPointSources *gnomonic, double x, double y, double t) {
+  size_t length = gnomonic->x.length;
+  if (gnomonic_point_sources_reserve(gnomonic, vec_grown_capacity(gnomonic->x.capacity, length + 1)) != 0) {
+    return -1;
+  }
+  gnomonic->x.data[length] = x;
+  gnomonic->y.data[length] = y;
+  gnomonic->t.data[length] = t;
+  gnomonic_point_sources_resize(gnomonic, length + 1);
+  return 0;
+}
+
+int gnomonic_point_sources_reserve(struct GnomonicPointSources *gnomonic, size_t capacity) {
+  if (vec_f64_reserve(&gnomonic->x, capacity) != 0 || vec_f64_reserve(&gnomonic->y, capacity) != 0 ||
+      vec_f64_reserve(&gnomonic->t, capacity) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+int gnomonic_point_sources_resize(struct GnomonicPointSources *gnomonic, size_t length) {
+  if (gnomonic_point_sources_reserve(gnomonic, length) != 0) {
+    return -1;
+  }
+  gnomonic->x.length = length;
+  gnomonic->y.length = length;
+  gnomonic->t.length = length;
+  return 0;
+}
+
+void gnomonic_point_sources_clear(struct GnomonicPointSources *gnomonic) { gnomonic_point_sources_resize(gnomonic, 0); }
+
+int gnomonic_point_sources_append(struct GnomonicPointSources *gnomonic, const double *x, const double *y,
+                                  const double *t, size_t n) {
+  size_t length = gnomonic->x.length;
+  if (n > SIZE_MAX - length ||
+      gnomonic_point_sources_reserve(gnomonic, vec_grown_capacity(gnomonic->x.capacity, length + n)) != 0) {
+    return -1;
+  }
+  if (n == 0) {
+    return 0;
+  }
+  memcpy(gnomonic->x.data + length, x, n * sizeof(double));
+  memcpy(gnomonic->y.data + length, y, n * sizeof(double));
+  memcpy(gnomonic->t.data + length, t, n * sizeof(double));
+  gnomonic_point_sources_resize(gnomonic, length + n);
+  return 0;
+}
+
+int gnomonic_point_sources_f32_new(struct GnomonicPointSourcesF32 *gnomonic, size_t capacity) {
+  if (vec_f32_new(&gnomonic->x, capacity) != 0) {
+    goto fail;
+  }
+  if (vec_f32_new(&gnomonic->y, capacity) != 0) {
+    goto fail;
+  }
+  if (vec_f64_new(&gnomonic->t, capacity) != 0) {
+    goto fail;
+  }
+
+  return 0;
+
+fail:
+  gnomonic_point_sources_f32_free(gnomonic);
+  return -1;
+}
+
+void gnomonic_point_sources_f32_free(struct GnomonicPointSourcesF32 *gnomonic) {
+  vec_f32_free(&gnomonic->x);
+  vec_f32_free(&gnomonic->y);
+  vec_f64_free(&gnomonic->t);
+}
+
+int gnomonic_point_sources_f32_push(struct GnomonicPointSourcesF32 *gnomonic, float x, float y, double t) {
+  size_t length = gnomonic->x.length;
+  if (gnomonic_point_sources_f32_reserve(gnomonic, vec_grown_capacity(gnomonic->x.capacity, length + 1)) != 0) {
+    return -1;
+  }
+  gnomonic->x.data[length] = x;
+  gnomonic->y.data[length] = y;
+  gnomonic->t.data[length] = t;
+  gnomonic_point_sources_f32_resize(gnomonic, length + 1);
+  return 0;
+}
+
+int gnomonic_point_sources_f32_reserve(struct GnomonicPointSourcesF32 *gnomonic, size_t capacity) {
+  if (vec_f32_reserve(&gnomonic->x, capacity) != 0 || vec_f32_reserve(&gnomonic->y, capacity) != 0 ||
+      vec_f64_reserve(&gnomonic->t, capacity) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+int gnomonic_point_sources_f32_resize(struct GnomonicPointSourcesF32 *gnomonic, size_t length) {
+  if (gnomonic_point_sources_f32_reserve(gnomonic, length) != 0) {
+    return -1;
+  }
+  gnomonic->x.length = length;
+  gnomonic->y.length = length;
+  gnomonic->t.length = length;
+  return 0;
+}
+
+void gnomonic_point_sources_f32_clear(struct GnomonicPointSourcesF32 *gnomonic) {
+  gnomonic_point_sources_f32_resize(gnomonic, 0);
+}
+
+int gnomonic_point_sources_f32_append(struct GnomonicPointSourcesF32 *gnomonic, const float *x, const float *y,
+                                      const double *t, size_t n) {
+  size_t length = gnomonic->x.length;
+  if (n > SIZE_MAX - length ||
+      gnomonic_point_sources_f32_reserve(gnomonic, vec_grown_capacity(gnomonic->x.capacity, length + n)) != 0) {
+    return -1;
+  }
+  if (n == 0) {
+    return 0;
+  }
+  memcpy(gnomonic->x.data + length, x, n * sizeof(float));
+  memcpy(gnomonic->y.data + length, y, n * sizeof(float));
+  memcpy(gnomonic->t.data + length, t, n * sizeof(double));
+  gnomonic_point_sources_f32_resize(gnomonic, length + n);
+  return 0;
 }
@@ -2,23 +2,64 @@
 #define point_sources_h
 
 #include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+#include "obscodes.h"
 #include "vectors.h"
 #include "str.h"
 
 struct TopocentricPointSources {
   /// Represents a collection of point sources in the sky, relative to
-  /// a given observatory. Uses a struct of arrays representation.
+  /// the observatories that saw them. Uses a struct of arrays
+  /// representation. One container can hold detections from any number
+  /// of observatories; obscode_id refers to the process-wide table in
+  /// obscodes.h.
   struct VecF64 ra;
   struct VecF64 dec;
   struct VecF64 t; // MJD
+  struct VecU16 obscode_id;
+  /// Observatory of rows added with topocentric_point_sources_push, or
+  /// NULL. Owned by the container.
   struct String *obscode;
+  /// Interned id of obscode, or OBSCODE_NONE.
+  uint16_t default_obscode_id;
 };
 
-#define TOPOCENTRIC_POINT_SOURCES_ZERO {.ra = VECF64_ZERO, .dec = VECF64_ZERO, .t = VECF64_ZERO, .obscode = NULL}
+#define TOPOCENTRIC_POINT_SOURCES_ZERO                                                                    \
+  {.ra = VECF64_ZERO, .dec = VECF64_ZERO, .t = VECF64_ZERO, .obscode_id = VECU16_ZERO, .obscode = NULL, \
+   .default_obscode_id = OBSCODE_NONE}
 
+/// Creates an empty container. Takes ownership of obscode, which may be
+/// NULL for containers that only hold rows added with
+/// topocentric_point_sources_push_obscode.
 int topocentric_point_sources_new(struct TopocentricPointSources *topocentric, size_t capacity, struct String *obscode);
+/// Like topocentric_point_sources_new, but carves all columns out of a
+/// single cache-aligned block of the arena. The columns are borrowed
+/// from the arena and are released by arena_reset; growing past
+/// capacity moves a column to the heap.
+int topocentric_point_sources_new_in(struct TopocentricPointSources *topocentric, size_t capacity,
+                                     struct String *obscode, struct Arena *arena);
 void topocentric_point_sources_free(struct TopocentricPointSources *topocentric);
-void topocentric_point_sources_push(struct TopocentricPointSources *topocentric, double ra, double dec, double t);
+/// Adds a row seen by the container's own obscode.
+///
+/// Like every function below that adds rows, returns 0 on success, or
+/// -1 on allocation failure, in which case no column has changed.
+int topocentric_point_sources_push(struct TopocentricPointSources *topocentric, double ra, double dec, double t);
+/// Adds a row seen by the observatory with the given interned id.
+int topocentric_point_sources_push_obscode(struct TopocentricPointSources *topocentric, double ra, double dec,
+                                           double t, uint16_t obscode_id);
+/// Ensures every column can hold capacity rows without reallocating.
+int topocentric_point_sources_reserve(struct TopocentricPointSources *topocentric, size_t capacity);
+/// Sets the number of rows, growing the columns if needed. New rows
+/// are uninitialized, for the caller to fill column by column.
+int topocentric_point_sources_resize(struct TopocentricPointSources *topocentric, size_t length);
+/// Removes every row, keeping the columns' storage for reuse.
+void topocentric_point_sources_clear(struct TopocentricPointSources *topocentric);
+/// Copies n rows onto the end of the container, one column at a time.
+/// If obscode_id is NULL, the rows are seen by the container's own
+/// obscode.
+int topocentric_point_sources_append(struct TopocentricPointSources *topocentric, const double *ra,
+                                     const double *dec, const double *t, const uint16_t *obscode_id, size_t n);
 
 struct CartesianPointSources {
   /// Represents a collection of point sources in the sky, relative to
@@ -32,8 +73,18 @@ struct CartesianPointSources {
 #define CARTESIAN_POINT_SOURCES_ZERO {.x = VECF64_ZERO, .y = VECF64_ZERO, .z = VECF64_ZERO, .t = VECF64_ZERO}
 
 int cartesian_point_sources_new(struct CartesianPointSources *cartesian, size_t capacity);
+/// Like cartesian_point_sources_new, with all columns in one arena
+/// block. See topocentric_point_sources_new_in.
+int cartesian_point_sources_new_in(struct CartesianPointSources *cartesian, size_t capacity, struct Arena *arena);
 void cartesian_point_sources_free(struct CartesianPointSources *cartesian);
-void cartesian_point_sources_push(struct CartesianPointSources *cartesian, double x, double y, double z, double t);
+int cartesian_point_sources_push(struct CartesianPointSources *cartesian, double x, double y, double z, double t);
+/// Bulk versions of push; see the topocentric_point_sources functions
+/// of the same names.
+int cartesian_point_sources_reserve(struct CartesianPointSources *cartesian, size_t capacity);
+int cartesian_point_sources_resize(struct CartesianPointSources *cartesian, size_t length);
+void cartesian_point_sources_clear(struct CartesianPointSources *cartesian);
+int cartesian_point_sources_append(struct CartesianPointSources *cartesian, const double *x, const double *y,
+                                   const double *z, const double *t, size_t n);
 
 struct GnomonicPointSources {
   /// Represents a collection of point sources, placed on a gnomonic
@@ -46,8 +97,37 @@ struct GnomonicPointSources {
 #define GNOMONIC_POINT_SOURCES_ZERO {.x = VECF64_ZERO, .y = VECF64_ZERO, .t = VECF64_ZERO}
 
 int gnomonic_point_sources_new(struct GnomonicPointSources *gnomonic, size_t capacity);
+/// Like gnomonic_point_sources_new, with all columns in one arena
+/// block. See topocentric_point_sources_new_in.
+int gnomonic_point_sources_new_in(struct GnomonicPointSources *gnomonic, size_t capacity, struct Arena *arena);
 void gnomonic_point_sources_free(struct GnomonicPointSources *gnomonic);
-void gnomonic_point_sources_push(struct GnomonicPointSources *gnomonic, double x, double y, double t);
+int gnomonic_point_sources_push(struct GnomonicPointSources *gnomonic, double x, double y, double t);
+int gnomonic_point_sources_reserve(struct GnomonicPointSources *gnomonic, size_t capacity);
+int gnomonic_point_sources_resize(struct GnomonicPointSources *gnomonic, size_t length);
+void gnomonic_point_sources_clear(struct GnomonicPointSources *gnomonic);
+int gnomonic_point_sources_append(struct GnomonicPointSources *gnomonic, const double *x, const double *y,
+                                  const double *t, size_t n);
+
+struct GnomonicPointSourcesF32 {
+  /// Like GnomonicPointSources, with x and y in single precision. t
+  /// stays double: a float cannot hold an MJD to better than a few
+  /// minutes. See cartesian_to_gnomonic_f32 for the accuracy of x and
+  /// y.
+  struct VecF32 x;
+  struct VecF32 y;
+  struct VecF64 t;
+};
+
+#define GNOMONIC_POINT_SOURCES_F32_ZERO {.x = VECF32_ZERO, .y = VECF32_ZERO, .t = VECF64_ZERO}
+
+int gnomonic_point_sources_f32_new(struct GnomonicPointSourcesF32 *gnomonic, size_t capacity);
+void gnomonic_point_sources_f32_free(struct GnomonicPointSourcesF32 *gnomonic);
+int gnomonic_point_sources_f32_push(struct GnomonicPointSourcesF32 *gnomonic, float x, float y, double t);
+int gnomonic_point_sources_f32_reserve(struct GnomonicPointSourcesF32 *gnomonic, size_t capacity);
+int gnomonic_point_sources_f32_resize(struct GnomonicPointSourcesF32 *gnomonic, size_t length);
+void gnomonic_point_sources_f32_clear(struct GnomonicPointSourcesF32 *gnomonic);
+int gnomonic_point_sources_f32_append(struct GnomonicPointSourcesF32 *gnomonic, const float *x, const float *y,
+                                      const double *t, size_t n);
 
 
 #endif
@@ -0,0 +1,830 @@
+#include "projection_kernels.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+#define RAD_TO_DEG (180.0 / M_PI)
+#define DEG_TO_RAD (M_PI / 180.0)
+
+static void project_scalar(double r[3][3], const double *x, const double *y, const double *z, double *gnomonic_x,
+                           double *gnomonic_y, size_t n) {
+  // Reference implementation. This matches the original per-point
+  // loop in cartesian_to_gnomonic operation for operation.
+  for (size_t i = 0; i < n; i++) {
+    double rx = r[0][0] * x[i] + r[0][1] * y[i] + r[0][2] * z[i];
+    double ry = r[1][0] * x[i] + r[1][1] * y[i] + r[1][2] * z[i];
+    double rz = r[2][0] * x[i] + r[2][1] * y[i] + r[2][2] * z[i];
+    gnomonic_x[i] = (ry / rx) * 180.0 / M_PI;
+    gnomonic_y[i] = (rz / rx) * 180.0 / M_PI;
+  }
+}
+
+// Finishes the last n < vector width points of an SSE2 kernel. Those
+// do the same operations as this, without FMA, so the tail rounds like
+// the body.
+static void project_tail(double r[3][3], const double *x, const double *y, const double *z, double *gnomonic_x,
+                         double *gnomonic_y, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    double rx = r[0][0] * x[i] + r[0][1] * y[i] + r[0][2] * z[i];
+    double ry = r[1][0] * x[i] + r[1][1] * y[i] + r[1][2] * z[i];
+    double rz = r[2][0] * x[i] + r[2][1] * y[i] + r[2][2] * z[i];
+    double scale = RAD_TO_DEG / rx;
+    gnomonic_x[i] = ry * scale;
+    gnomonic_y[i] = rz * scale;
+  }
+}
+
+static void project_scalar_f32(double r[3][3], const double *x, const double *y, const double *z, float *gnomonic_x,
+                               float *gnomonic_y, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    double rx = r[0][0] * x[i] + r[0][1] * y[i] + r[0][2] * z[i];
+    double ry = r[1][0] * x[i] + r[1][1] * y[i] + r[1][2] * z[i];
+    double rz = r[2][0] * x[i] + r[2][1] * y[i] + r[2][2] * z[i];
+    gnomonic_x[i] = (float)((ry / rx) * 180.0 / M_PI);
+    gnomonic_y[i] = (float)((rz / rx) * 180.0 / M_PI);
+  }
+}
+
+static void project_tail_f32(double r[3][3], const double *x, const double *y, const double *z, float *gnomonic_x,
+                             float *gnomonic_y, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    double rx = r[0][0] * x[i] + r[0][1] * y[i] + r[0][2] * z[i];
+    double ry = r[1][0] * x[i] + r[1][1] * y[i] + r[1][2] * z[i];
+    double rz = r[2][0] * x[i] + r[2][1] * y[i] + r[2][2] * z[i];
+    double scale = RAD_TO_DEG / rx;
+    gnomonic_x[i] = (float)(ry * scale);
+    gnomonic_y[i] = (float)(rz * scale);
+  }
+}
+
+static size_t project_filter_scalar(double r[3][3], const double *x, const double *y, const double *z, size_t n,
+                                    double radius, uint32_t first_row, double *gnomonic_x, double *gnomonic_y,
+                                    uint32_t *rows) {
+  // Every point is written at the next free slot, and the slot is only
+  // claimed if the point is kept, so there is no branch on the result.
+  double radius_squared = radius * radius;
+  size_t kept = 0;
+  for (size_t i = 0; i < n; i++) {
+    double rx = r[0][0] * x[i] + r[0][1] * y[i] + r[0][2] * z[i];
+    double ry = r[1][0] * x[i] + r[1][1] * y[i] + r[1][2] * z[i];
+    double rz = r[2][0] * x[i] + r[2][1] * y[i] + r[2][2] * z[i];
+    double gx = (ry / rx) * 180.0 / M_PI;
+    double gy = (rz / rx) * 180.0 / M_PI;
+    gnomonic_x[kept] = gx;
+    gnomonic_y[kept] = gy;
+    rows[kept] = first_row + (uint32_t)i;
+    kept += (rx > 0.0) & (gx * gx + gy * gy <= radius_squared);
+  }
+  return kept;
+}
+
+// Like project_tail, for the SSE2 filtering kernel.
+static size_t project_filter_tail(double r[3][3], const double *x, const double *y, const double *z, size_t n,
+                                  double radius, uint32_t first_row, double *gnomonic_x, double *gnomonic_y,
+                                  uint32_t *rows) {
+  double radius_squared = radius * radius;
+  size_t kept = 0;
+  for (size_t i = 0; i < n; i++) {
+    double rx = r[0][0] * x[i] + r[0][1] * y[i] + r[0][2] * z[i];
+    double ry = r[1][0] * x[i] + r[1][1] * y[i] + r[1][2] * z[i];
+    double rz = r[2][0] * x[i] + r[2][1] * y[i] + r[2][2] * z[i];
+    double scale = RAD_TO_DEG / rx;
+    double gx = ry * scale;
+    double gy = rz * scale;
+    gnomonic_x[kept] = gx;
+    gnomonic_y[kept] = gy;
+    rows[kept] = first_row + (uint32_t)i;
+    kept += (rx > 0.0) & (gx * gx + gy * gy <= radius_squared);
+  }
+  return kept;
+}
+
+static void unproject_scalar(double r[3][3], const double *gnomonic_x, const double *gnomonic_y, double *x, double *y,
+                             double *z, size_t n) {
+  // The point on the tangent plane is (1, u, v) in the rotated frame;
+  // normalizing it gives the direction, and the transpose of the
+  // (orthonormal) rotation takes it back to the original frame.
+  for (size_t i = 0; i < n; i++) {
+    double u = gnomonic_x[i] * DEG_TO_RAD;
+    double v = gnomonic_y[i] * DEG_TO_RAD;
+    double d0 = 1.0 / sqrt(1.0 + u * u + v * v);
+    double d1 = u * d0;
+    double d2 = v * d0;
+    x[i] = r[0][0] * d0 + r[1][0] * d1 + r[2][0] * d2;
+    y[i] = r[0][1] * d0 + r[1][1] * d1 + r[2][1] * d2;
+    z[i] = r[0][2] * d0 + r[1][2] * d1 + r[2][2] * d2;
+  }
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// The first n < 4 lanes of a masked AVX2 pass. Masked-out lanes load
+// as zero and are never stored, so the tail of an AVX2 kernel does the
+// same operations as its body rather than rounding differently in
+// scalar code.
+__attribute__((target("avx2"))) static inline __m256i tail_mask_avx2(size_t n) {
+  return _mm256_cmpgt_epi64(_mm256_set1_epi64x((long long)n), _mm256_setr_epi64x(0, 1, 2, 3));
+}
+
+static void project_sse2(double r[3][3], const double *x, const double *y, const double *z, double *gnomonic_x,
+                         double *gnomonic_y, size_t n) {
+  __m128d r00 = _mm_set1_pd(r[0][0]), r01 = _mm_set1_pd(r[0][1]), r02 = _mm_set1_pd(r[0][2]);
+  __m128d r10 = _mm_set1_pd(r[1][0]), r11 = _mm_set1_pd(r[1][1]), r12 = _mm_set1_pd(r[1][2]);
+  __m128d r20 = _mm_set1_pd(r[2][0]), r21 = _mm_set1_pd(r[2][1]), r22 = _mm_set1_pd(r[2][2]);
+  __m128d deg = _mm_set1_pd(RAD_TO_DEG);
+
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d vx = _mm_loadu_pd(x + i);
+    __m128d vy = _mm_loadu_pd(y + i);
+    __m128d vz = _mm_loadu_pd(z + i);
+    __m128d rx = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r00, vx), _mm_mul_pd(r01, vy)), _mm_mul_pd(r02, vz));
+    __m128d ry = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r10, vx), _mm_mul_pd(r11, vy)), _mm_mul_pd(r12, vz));
+    __m128d rz = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r20, vx), _mm_mul_pd(r21, vy)), _mm_mul_pd(r22, vz));
+    __m128d scale = _mm_div_pd(deg, rx);
+    _mm_storeu_pd(gnomonic_x + i, _mm_mul_pd(ry, scale));
+    _mm_storeu_pd(gnomonic_y + i, _mm_mul_pd(rz, scale));
+  }
+  project_tail(r, x + i, y + i, z + i, gnomonic_x + i, gnomonic_y + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) static void project_avx2(double r[3][3], const double *x, const double *y,
+                                                             const double *z, double *gnomonic_x, double *gnomonic_y,
+                                                             size_t n) {
+  __m256d r00 = _mm256_set1_pd(r[0][0]), r01 = _mm256_set1_pd(r[0][1]), r02 = _mm256_set1_pd(r[0][2]);
+  __m256d r10 = _mm256_set1_pd(r[1][0]), r11 = _mm256_set1_pd(r[1][1]), r12 = _mm256_set1_pd(r[1][2]);
+  __m256d r20 = _mm256_set1_pd(r[2][0]), r21 = _mm256_set1_pd(r[2][1]), r22 = _mm256_set1_pd(r[2][2]);
+  __m256d deg = _mm256_set1_pd(RAD_TO_DEG);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d vx = _mm256_loadu_pd(x + i);
+    __m256d vy = _mm256_loadu_pd(y + i);
+    __m256d vz = _mm256_loadu_pd(z + i);
+    __m256d rx = _mm256_fmadd_pd(r02, vz, _mm256_fmadd_pd(r01, vy, _mm256_mul_pd(r00, vx)));
+    __m256d ry = _mm256_fmadd_pd(r12, vz, _mm256_fmadd_pd(r11, vy, _mm256_mul_pd(r10, vx)));
+    __m256d rz = _mm256_fmadd_pd(r22, vz, _mm256_fmadd_pd(r21, vy, _mm256_mul_pd(r20, vx)));
+    __m256d scale = _mm256_div_pd(deg, rx);
+    _mm256_storeu_pd(gnomonic_x + i, _mm256_mul_pd(ry, scale));
+    _mm256_storeu_pd(gnomonic_y + i, _mm256_mul_pd(rz, scale));
+  }
+  if (i < n) {
+    __m256i mask = tail_mask_avx2(n - i);
+    __m256d vx = _mm256_maskload_pd(x + i, mask);
+    __m256d vy = _mm256_maskload_pd(y + i, mask);
+    __m256d vz = _mm256_maskload_pd(z + i, mask);
+    __m256d rx = _mm256_fmadd_pd(r02, vz, _mm256_fmadd_pd(r01, vy, _mm256_mul_pd(r00, vx)));
+    __m256d ry = _mm256_fmadd_pd(r12, vz, _mm256_fmadd_pd(r11, vy, _mm256_mul_pd(r10, vx)));
+    __m256d rz = _mm256_fmadd_pd(r22, vz, _mm256_fmadd_pd(r21, vy, _mm256_mul_pd(r20, vx)));
+    __m256d scale = _mm256_div_pd(deg, rx);
+    _mm256_maskstore_pd(gnomonic_x + i, mask, _mm256_mul_pd(ry, scale));
+    _mm256_maskstore_pd(gnomonic_y + i, mask, _mm256_mul_pd(rz, scale));
+  }
+}
+
+__attribute__((target("avx512f"))) static void project_avx512(double r[3][3], const double *x, const double *y,
+                                                               const double *z, double *gnomonic_x,
+                                                               double *gnomonic_y, size_t n) {
+  __m512d r00 = _mm512_set1_pd(r[0][0]), r01 = _mm512_set1_pd(r[0][1]), r02 = _mm512_set1_pd(r[0][2]);
+  __m512d r10 = _mm512_set1_pd(r[1][0]), r11 = _mm512_set1_pd(r[1][1]), r12 = _mm512_set1_pd(r[1][2]);
+  __m512d r20 = _mm512_set1_pd(r[2][0]), r21 = _mm512_set1_pd(r[2][1]), r22 = _mm512_set1_pd(r[2][2]);
+  __m512d deg = _mm512_set1_pd(RAD_TO_DEG);
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512d vx = _mm512_loadu_pd(x + i);
+    __m512d vy = _mm512_loadu_pd(y + i);
+    __m512d vz = _mm512_loadu_pd(z + i);
+    __m512d rx = _mm512_fmadd_pd(r02, vz, _mm512_fmadd_pd(r01, vy, _mm512_mul_pd(r00, vx)));
+    __m512d ry = _mm512_fmadd_pd(r12, vz, _mm512_fmadd_pd(r11, vy, _mm512_mul_pd(r10, vx)));
+    __m512d rz = _mm512_fmadd_pd(r22, vz, _mm512_fmadd_pd(r21, vy, _mm512_mul_pd(r20, vx)));
+    __m512d scale = _mm512_div_pd(deg, rx);
+    _mm512_storeu_pd(gnomonic_x + i, _mm512_mul_pd(ry, scale));
+    _mm512_storeu_pd(gnomonic_y + i, _mm512_mul_pd(rz, scale));
+  }
+  // Use a masked iteration for the tail rather than falling back to
+  // scalar code.
+  if (i < n) {
+    __mmask8 mask = (__mmask8)((1u << (n - i)) - 1);
+    __m512d vx = _mm512_maskz_loadu_pd(mask, x + i);
+    __m512d vy = _mm512_maskz_loadu_pd(mask, y + i);
+    __m512d vz = _mm512_maskz_loadu_pd(mask, z + i);
+    __m512d rx = _mm512_fmadd_pd(r02, vz, _mm512_fmadd_pd(r01, vy, _mm512_mul_pd(r00, vx)));
+    __m512d ry = _mm512_fmadd_pd(r12, vz, _mm512_fmadd_pd(r11, vy, _mm512_mul_pd(r10, vx)));
+    __m512d rz = _mm512_fmadd_pd(r22, vz, _mm512_fmadd_pd(r21, vy, _mm512_mul_pd(r20, vx)));
+    __m512d scale = _mm512_div_pd(deg, rx);
+    _mm512_mask_storeu_pd(gnomonic_x + i, mask, _mm512_mul_pd(ry, scale));
+    _mm512_mask_storeu_pd(gnomonic_y + i, mask, _mm512_mul_pd(rz, scale));
+  }
+}
+
+static void project_sse2_f32(double r[3][3], const double *x, const double *y, const double *z, float *gnomonic_x,
+                             float *gnomonic_y, size_t n) {
+  __m128d r00 = _mm_set1_pd(r[0][0]), r01 = _mm_set1_pd(r[0][1]), r02 = _mm_set1_pd(r[0][2]);
+  __m128d r10 = _mm_set1_pd(r[1][0]), r11 = _mm_set1_pd(r[1][1]), r12 = _mm_set1_pd(r[1][2]);
+  __m128d r20 = _mm_set1_pd(r[2][0]), r21 = _mm_set1_pd(r[2][1]), r22 = _mm_set1_pd(r[2][2]);
+  __m128d deg = _mm_set1_pd(RAD_TO_DEG);
+
+  // Two pairs of doubles convert into one vector of four floats.
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128d gx[2], gy[2];
+    for (int half = 0; half < 2; half++) {
+      __m128d vx = _mm_loadu_pd(x + i + 2 * half);
+      __m128d vy = _mm_loadu_pd(y + i + 2 * half);
+      __m128d vz = _mm_loadu_pd(z + i + 2 * half);
+      __m128d rx = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r00, vx), _mm_mul_pd(r01, vy)), _mm_mul_pd(r02, vz));
+      __m128d ry = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r10, vx), _mm_mul_pd(r11, vy)), _mm_mul_pd(r12, vz));
+      __m128d rz = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r20, vx), _mm_mul_pd(r21, vy)), _mm_mul_pd(r22, vz));
+      __m128d scale = _mm_div_pd(deg, rx);
+      gx[half] = _mm_mul_pd(ry, scale);
+      gy[half] = _mm_mul_pd(rz, scale);
+    }
+    _mm_storeu_ps(gnomonic_x + i, _mm_movelh_ps(_mm_cvtpd_ps(gx[0]), _mm_cvtpd_ps(gx[1])));
+    _mm_storeu_ps(gnomonic_y + i, _mm_movelh_ps(_mm_cvtpd_ps(gy[0]), _mm_cvtpd_ps(gy[1])));
+  }
+  project_tail_f32(r, x + i, y + i, z + i, gnomonic_x + i, gnomonic_y + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) static void project_avx2_f32(double r[3][3], const double *x, const double *y,
+                                                                 const double *z, float *gnomonic_x,
+                                                                 float *gnomonic_y, size_t n) {
+  __m256d r00 = _mm256_set1_pd(r[0][0]), r01 = _mm256_set1_pd(r[0][1]), r02 = _mm256_set1_pd(r[0][2]);
+  __m256d r10 = _mm256_set1_pd(r[1][0]), r11 = _mm256_set1_pd(r[1][1]), r12 = _mm256_set1_pd(r[1][2]);
+  __m256d r20 = _mm256_set1_pd(r[2][0]), r21 = _mm256_set1_pd(r[2][1]), r22 = _mm256_set1_pd(r[2][2]);
+  __m256d deg = _mm256_set1_pd(RAD_TO_DEG);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d vx = _mm256_loadu_pd(x + i);
+    __m256d vy = _mm256_loadu_pd(y + i);
+    __m256d vz = _mm256_loadu_pd(z + i);
+    __m256d rx = _mm256_fmadd_pd(r02, vz, _mm256_fmadd_pd(r01, vy, _mm256_mul_pd(r00, vx)));
+    __m256d ry = _mm256_fmadd_pd(r12, vz, _mm256_fmadd_pd(r11, vy, _mm256_mul_pd(r10, vx)));
+    __m256d rz = _mm256_fmadd_pd(r22, vz, _mm256_fmadd_pd(r21, vy, _mm256_mul_pd(r20, vx)));
+    __m256d scale = _mm256_div_pd(deg, rx);
+    _mm_storeu_ps(gnomonic_x + i, _mm256_cvtpd_ps(_mm256_mul_pd(ry, scale)));
+    _mm_storeu_ps(gnomonic_y + i, _mm256_cvtpd_ps(_mm256_mul_pd(rz, scale)));
+  }
+  if (i < n) {
+    __m256i mask = tail_mask_avx2(n - i);
+    __m128i mask_f32 = _mm_cmpgt_epi32(_mm_set1_epi32((int)(n - i)), _mm_setr_epi32(0, 1, 2, 3));
+    __m256d vx = _mm256_maskload_pd(x + i, mask);
+    __m256d vy = _mm256_maskload_pd(y + i, mask);
+    __m256d vz = _mm256_maskload_pd(z + i, mask);
+    __m256d rx = _mm256_fmadd_pd(r02, vz, _mm256_fmadd_pd(r01, vy, _mm256_mul_pd(r00, vx)));
+    __m256d ry = _mm256_fmadd_pd(r12, vz, _mm256_fmadd_pd(r11, vy, _mm256_mul_pd(r10, vx)));
+    __m256d rz = _mm256_fmadd_pd(r22, vz, _mm256_fmadd_pd(r21, vy, _mm256_mul_pd(r20, vx)));
+    __m256d scale = _mm256_div_pd(deg, rx);
+    _mm_maskstore_ps(gnomonic_x + i, mask_f32, _mm256_cvtpd_ps(_mm256_mul_pd(ry, scale)));
+    _mm_maskstore_ps(gnomonic_y + i, mask_f32, _mm256_cvtpd_ps(_mm256_mul_pd(rz, scale)));
+  }
+}
+
+__attribute__((target("avx512f"))) static void project_avx512_f32(double r[3][3], const double *x, const double *y,
+                                                                   const double *z, float *gnomonic_x,
+                                                                   float *gnomonic_y, size_t n) {
+  __m512d r00 = _mm512_set1_pd(r[0][0]), r01 = _mm512_set1_pd(r[0][1]), r02 = _mm512_set1_pd(r[0][2]);
+  __m512d r10 = _mm512_set1_pd(r[1][0]), r11 = _mm512_set1_pd(r[1][1]), r12 = _mm512_set1_pd(r[1][2]);
+  __m512d r20 = _mm512_set1_pd(r[2][0]), r21 = _mm512_set1_pd(r[2][1]), r22 = _mm512_set1_pd(r[2][2]);
+  __m512d deg = _mm512_set1_pd(RAD_TO_DEG);
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512d vx = _mm512_loadu_pd(x + i);
+    __m512d vy = _mm512_loadu_pd(y + i);
+    __m512d vz = _mm512_loadu_pd(z + i);
+    __m512d rx = _mm512_fmadd_pd(r02, vz, _mm512_fmadd_pd(r01, vy, _mm512_mul_pd(r00, vx)));
+    __m512d ry = _mm512_fmadd_pd(r12, vz, _mm512_fmadd_pd(r11, vy, _mm512_mul_pd(r10, vx)));
+    __m512d rz = _mm512_fmadd_pd(r22, vz, _mm512_fmadd_pd(r21, vy, _mm512_mul_pd(r20, vx)));
+    __m512d scale = _mm512_div_pd(deg, rx);
+    _mm256_storeu_ps(gnomonic_x + i, _mm512_cvtpd_ps(_mm512_mul_pd(ry, scale)));
+    _mm256_storeu_ps(gnomonic_y + i, _mm512_cvtpd_ps(_mm512_mul_pd(rz, scale)));
+  }
+  // Masked 256-bit float stores would need AVX-512VL, so the tail's
+  // floats go out through the low half of a masked 512-bit store.
+  if (i < n) {
+    __mmask8 mask = (__mmask8)((1u << (n - i)) - 1);
+    __m512d vx = _mm512_maskz_loadu_pd(mask, x + i);
+    __m512d vy = _mm512_maskz_loadu_pd(mask, y + i);
+    __m512d vz = _mm512_maskz_loadu_pd(mask, z + i);
+    __m512d rx = _mm512_fmadd_pd(r02, vz, _mm512_fmadd_pd(r01, vy, _mm512_mul_pd(r00, vx)));
+    __m512d ry = _mm512_fmadd_pd(r12, vz, _mm512_fmadd_pd(r11, vy, _mm512_mul_pd(r10, vx)));
+    __m512d rz = _mm512_fmadd_pd(r22, vz, _mm512_fmadd_pd(r21, vy, _mm512_mul_pd(r20, vx)));
+    __m512d scale = _mm512_div_pd(deg, rx);
+    _mm512_mask_storeu_ps(gnomonic_x + i, (__mmask16)mask,
+                          _mm512_castps256_ps512(_mm512_cvtpd_ps(_mm512_mul_pd(ry, scale))));
+    _mm512_mask_storeu_ps(gnomonic_y + i, (__mmask16)mask,
+                          _mm512_castps256_ps512(_mm512_cvtpd_ps(_mm512_mul_pd(rz, scale))));
+  }
+}
+
+static size_t project_filter_sse2(double r[3][3], const double *x, const double *y, const double *z, size_t n,
+                                  double radius, uint32_t first_row, double *gnomonic_x, double *gnomonic_y,
+                                  uint32_t *rows) {
+  __m128d r00 = _mm_set1_pd(r[0][0]), r01 = _mm_set1_pd(r[0][1]), r02 = _mm_set1_pd(r[0][2]);
+  __m128d r10 = _mm_set1_pd(r[1][0]), r11 = _mm_set1_pd(r[1][1]), r12 = _mm_set1_pd(r[1][2]);
+  __m128d r20 = _mm_set1_pd(r[2][0]), r21 = _mm_set1_pd(r[2][1]), r22 = _mm_set1_pd(r[2][2]);
+  __m128d deg = _mm_set1_pd(RAD_TO_DEG);
+  __m128d radius_squared = _mm_set1_pd(radius * radius);
+  __m128d zero = _mm_setzero_pd();
+
+  size_t kept = 0;
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d vx = _mm_loadu_pd(x + i);
+    __m128d vy = _mm_loadu_pd(y + i);
+    __m128d vz = _mm_loadu_pd(z + i);
+    __m128d rx = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r00, vx), _mm_mul_pd(r01, vy)), _mm_mul_pd(r02, vz));
+    __m128d ry = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r10, vx), _mm_mul_pd(r11, vy)), _mm_mul_pd(r12, vz));
+    __m128d rz = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r20, vx), _mm_mul_pd(r21, vy)), _mm_mul_pd(r22, vz));
+    __m128d scale = _mm_div_pd(deg, rx);
+    __m128d gx = _mm_mul_pd(ry, scale);
+    __m128d gy = _mm_mul_pd(rz, scale);
+    __m128d distance = _mm_add_pd(_mm_mul_pd(gx, gx), _mm_mul_pd(gy, gy));
+    int keep = _mm_movemask_pd(_mm_and_pd(_mm_cmpgt_pd(rx, zero), _mm_cmple_pd(distance, radius_squared)));
+    // Most points are dropped, so skip the stores for pairs that keep
+    // nothing.
+    if (keep != 0) {
+      double lanes_x[2], lanes_y[2];
+      _mm_storeu_pd(lanes_x, gx);
+      _mm_storeu_pd(lanes_y, gy);
+      for (int l = 0; l < 2; l++) {
+        gnomonic_x[kept] = lanes_x[l];
+        gnomonic_y[kept] = lanes_y[l];
+        rows[kept] = first_row + (uint32_t)(i + l);
+        kept += (keep >> l) & 1;
+      }
+    }
+  }
+  return kept + project_filter_tail(r, x + i, y + i, z + i, n - i, radius, first_row + (uint32_t)i,
+                                    gnomonic_x + kept, gnomonic_y + kept, rows + kept);
+}
+
+__attribute__((target("avx2,fma"))) static size_t project_filter_avx2(double r[3][3], const double *x,
+                                                                      const double *y, const double *z, size_t n,
+                                                                      double radius, uint32_t first_row,
+                                                                      double *gnomonic_x, double *gnomonic_y,
+                                                                      uint32_t *rows) {
+  __m256d r00 = _mm256_set1_pd(r[0][0]), r01 = _mm256_set1_pd(r[0][1]), r02 = _mm256_set1_pd(r[0][2]);
+  __m256d r10 = _mm256_set1_pd(r[1][0]), r11 = _mm256_set1_pd(r[1][1]), r12 = _mm256_set1_pd(r[1][2]);
+  __m256d r20 = _mm256_set1_pd(r[2][0]), r21 = _mm256_set1_pd(r[2][1]), r22 = _mm256_set1_pd(r[2][2]);
+  __m256d deg = _mm256_set1_pd(RAD_TO_DEG);
+  __m256d radius_squared = _mm256_set1_pd(radius * radius);
+  __m256d zero = _mm256_setzero_pd();
+
+  size_t kept = 0;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d vx = _mm256_loadu_pd(x + i);
+    __m256d vy = _mm256_loadu_pd(y + i);
+    __m256d vz = _mm256_loadu_pd(z + i);
+    __m256d rx = _mm256_fmadd_pd(r02, vz, _mm256_fmadd_pd(r01, vy, _mm256_mul_pd(r00, vx)));
+    __m256d ry = _mm256_fmadd_pd(r12, vz, _mm256_fmadd_pd(r11, vy, _mm256_mul_pd(r10, vx)));
+    __m256d rz = _mm256_fmadd_pd(r22, vz, _mm256_fmadd_pd(r21, vy, _mm256_mul_pd(r20, vx)));
+    __m256d scale = _mm256_div_pd(deg, rx);
+    __m256d gx = _mm256_mul_pd(ry, scale);
+    __m256d gy = _mm256_mul_pd(rz, scale);
+    __m256d distance = _mm256_fmadd_pd(gy, gy, _mm256_mul_pd(gx, gx));
+    int keep = _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(rx, zero, _CMP_GT_OQ),
+                                                _mm256_cmp_pd(distance, radius_squared, _CMP_LE_OQ)));
+    if (keep != 0) {
+      double lanes_x[4], lanes_y[4];
+      _mm256_storeu_pd(lanes_x, gx);
+      _mm256_storeu_pd(lanes_y, gy);
+      for (int l = 0; l < 4; l++) {
+        gnomonic_x[kept] = lanes_x[l];
+        gnomonic_y[kept] = lanes_y[l];
+        rows[kept] = first_row + (uint32_t)(i + l);
+        kept += (keep >> l) & 1;
+      }
+    }
+  }
+  if (i < n) {
+    __m256i mask = tail_mask_avx2(n - i);
+    __m256d vx = _mm256_maskload_pd(x + i, mask);
+    __m256d vy = _mm256_maskload_pd(y + i, mask);
+    __m256d vz = _mm256_maskload_pd(z + i, mask);
+    __m256d rx = _mm256_fmadd_pd(r02, vz, _mm256_fmadd_pd(r01, vy, _mm256_mul_pd(r00, vx)));
+    __m256d ry = _mm256_fmadd_pd(r12, vz, _mm256_fmadd_pd(r11, vy, _mm256_mul_pd(r10, vx)));
+    __m256d rz = _mm256_fmadd_pd(r22, vz, _mm256_fmadd_pd(r21, vy, _mm256_mul_pd(r20, vx)));
+    __m256d scale = _mm256_div_pd(deg, rx);
+    __m256d gx = _mm256_mul_pd(ry, scale);
+    __m256d gy = _mm256_mul_pd(rz, scale);
+    __m256d distance = _mm256_fmadd_pd(gy, gy, _mm256_mul_pd(gx, gx));
+    int keep = _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(rx, zero, _CMP_GT_OQ),
+                                                _mm256_cmp_pd(distance, radius_squared, _CMP_LE_OQ)));
+    double lanes_x[4], lanes_y[4];
+    _mm256_storeu_pd(lanes_x, gx);
+    _mm256_storeu_pd(lanes_y, gy);
+    // Only the valid lanes are written: the outputs have room for the
+    // points left, and no more.
+    for (int l = 0; l < (int)(n - i); l++) {
+      gnomonic_x[kept] = lanes_x[l];
+      gnomonic_y[kept] = lanes_y[l];
+      rows[kept] = first_row + (uint32_t)(i + l);
+      kept += (keep >> l) & 1;
+    }
+  }
+  return kept;
+}
+
+__attribute__((target("avx512f"))) static size_t project_filter_avx512(double r[3][3], const double *x,
+                                                                       const double *y, const double *z, size_t n,
+                                                                       double radius, uint32_t first_row,
+                                                                       double *gnomonic_x, double *gnomonic_y,
+                                                                       uint32_t *rows) {
+  __m512d r00 = _mm512_set1_pd(r[0][0]), r01 = _mm512_set1_pd(r[0][1]), r02 = _mm512_set1_pd(r[0][2]);
+  __m512d r10 = _mm512_set1_pd(r[1][0]), r11 = _mm512_set1_pd(r[1][1]), r12 = _mm512_set1_pd(r[1][2]);
+  __m512d r20 = _mm512_set1_pd(r[2][0]), r21 = _mm512_set1_pd(r[2][1]), r22 = _mm512_set1_pd(r[2][2]);
+  __m512d deg = _mm512_set1_pd(RAD_TO_DEG);
+  __m512d radius_squared = _mm512_set1_pd(radius * radius);
+  __m512d zero = _mm512_setzero_pd();
+  // Row numbers ride in the low half of a 16-lane vector, since
+  // compressing 8 32-bit lanes on their own would need AVX-512VL.
+  __m512i lane = _mm512_set_epi32(0, 0, 0, 0, 0, 0, 0, 0, 7, 6, 5, 4, 3, 2, 1, 0);
+
+  size_t kept = 0;
+  for (size_t i = 0; i < n; i += 8) {
+    __mmask8 active = n - i >= 8 ? 0xff : (__mmask8)((1u << (n - i)) - 1);
+    __m512d vx = _mm512_maskz_loadu_pd(active, x + i);
+    __m512d vy = _mm512_maskz_loadu_pd(active, y + i);
+    __m512d vz = _mm512_maskz_loadu_pd(active, z + i);
+    __m512d rx = _mm512_fmadd_pd(r02, vz, _mm512_fmadd_pd(r01, vy, _mm512_mul_pd(r00, vx)));
+    __m512d ry = _mm512_fmadd_pd(r12, vz, _mm512_fmadd_pd(r11, vy, _mm512_mul_pd(r10, vx)));
+    __m512d rz = _mm512_fmadd_pd(r22, vz, _mm512_fmadd_pd(r21, vy, _mm512_mul_pd(r20, vx)));
+    __m512d scale = _mm512_div_pd(deg, rx);
+    __m512d gx = _mm512_mul_pd(ry, scale);
+    __m512d gy = _mm512_mul_pd(rz, scale);
+    __m512d distance = _mm512_fmadd_pd(gy, gy, _mm512_mul_pd(gx, gx));
+    __mmask8 keep = _mm512_mask_cmp_pd_mask(active, rx, zero, _CMP_GT_OQ) &
+                    _mm512_cmp_pd_mask(distance, radius_squared, _CMP_LE_OQ);
+    if (keep != 0) {
+      __m512i row = _mm512_add_epi32(lane, _mm512_set1_epi32((int)(first_row + (uint32_t)i)));
+      _mm512_mask_compressstoreu_pd(gnomonic_x + kept, keep, gx);
+      _mm512_mask_compressstoreu_pd(gnomonic_y + kept, keep, gy);
+      _mm512_mask_compressstoreu_epi32(rows + kept, (__mmask16)keep, row);
+      kept += __builtin_popcount(keep);
+    }
+  }
+  return kept;
+}
+
+static void unproject_sse2(double r[3][3], const double *gnomonic_x, const double *gnomonic_y, double *x, double *y,
+                           double *z, size_t n) {
+  __m128d r00 = _mm_set1_pd(r[0][0]), r01 = _mm_set1_pd(r[0][1]), r02 = _mm_set1_pd(r[0][2]);
+  __m128d r10 = _mm_set1_pd(r[1][0]), r11 = _mm_set1_pd(r[1][1]), r12 = _mm_set1_pd(r[1][2]);
+  __m128d r20 = _mm_set1_pd(r[2][0]), r21 = _mm_set1_pd(r[2][1]), r22 = _mm_set1_pd(r[2][2]);
+  __m128d rad = _mm_set1_pd(DEG_TO_RAD), one = _mm_set1_pd(1.0);
+
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d u = _mm_mul_pd(_mm_loadu_pd(gnomonic_x + i), rad);
+    __m128d v = _mm_mul_pd(_mm_loadu_pd(gnomonic_y + i), rad);
+    __m128d d0 = _mm_div_pd(one, _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(one, _mm_mul_pd(u, u)), _mm_mul_pd(v, v))));
+    __m128d d1 = _mm_mul_pd(u, d0);
+    __m128d d2 = _mm_mul_pd(v, d0);
+    _mm_storeu_pd(x + i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(r00, d0), _mm_mul_pd(r10, d1)), _mm_mul_pd(r20, d2)));
+    _mm_storeu_pd(y + i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(r01, d0), _mm_mul_pd(r11, d1)), _mm_mul_pd(r21, d2)));
+    _mm_storeu_pd(z + i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(r02, d0), _mm_mul_pd(r12, d1)), _mm_mul_pd(r22, d2)));
+  }
+  unproject_scalar(r, gnomonic_x + i, gnomonic_y + i, x + i, y + i, z + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) static void unproject_avx2(double r[3][3], const double *gnomonic_x,
+                                                               const double *gnomonic_y, double *x, double *y,
+                                                               double *z, size_t n) {
+  __m256d r00 = _mm256_set1_pd(r[0][0]), r01 = _mm256_set1_pd(r[0][1]), r02 = _mm256_set1_pd(r[0][2]);
+  __m256d r10 = _mm256_set1_pd(r[1][0]), r11 = _mm256_set1_pd(r[1][1]), r12 = _mm256_set1_pd(r[1][2]);
+  __m256d r20 = _mm256_set1_pd(r[2][0]), r21 = _mm256_set1_pd(r[2][1]), r22 = _mm256_set1_pd(r[2][2]);
+  __m256d rad = _mm256_set1_pd(DEG_TO_RAD), one = _mm256_set1_pd(1.0);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d u = _mm256_mul_pd(_mm256_loadu_pd(gnomonic_x + i), rad);
+    __m256d v = _mm256_mul_pd(_mm256_loadu_pd(gnomonic_y + i), rad);
+    __m256d d0 = _mm256_div_pd(one, _mm256_sqrt_pd(_mm256_fmadd_pd(v, v, _mm256_fmadd_pd(u, u, one))));
+    __m256d d1 = _mm256_mul_pd(u, d0);
+    __m256d d2 = _mm256_mul_pd(v, d0);
+    _mm256_storeu_pd(x + i, _mm256_fmadd_pd(r20, d2, _mm256_fmadd_pd(r10, d1, _mm256_mul_pd(r00, d0))));
+    _mm256_storeu_pd(y + i, _mm256_fmadd_pd(r21, d2, _mm256_fmadd_pd(r11, d1, _mm256_mul_pd(r01, d0))));
+    _mm256_storeu_pd(z + i, _mm256_fmadd_pd(r22, d2, _mm256_fmadd_pd(r12, d1, _mm256_mul_pd(r02, d0))));
+  }
+  if (i < n) {
+    __m256i mask = tail_mask_avx2(n - i);
+    __m256d u = _mm256_mul_pd(_mm256_maskload_pd(gnomonic_x + i, mask), rad);
+    __m256d v = _mm256_mul_pd(_mm256_maskload_pd(gnomonic_y + i, mask), rad);
+    __m256d d0 = _mm256_div_pd(one, _mm256_sqrt_pd(_mm256_fmadd_pd(v, v, _mm256_fmadd_pd(u, u, one))));
+    __m256d d1 = _mm256_mul_pd(u, d0);
+    __m256d d2 = _mm256_mul_pd(v, d0);
+    _mm256_maskstore_pd(x + i, mask, _mm256_fmadd_pd(r20, d2, _mm256_fmadd_pd(r10, d1, _mm256_mul_pd(r00, d0))));
+    _mm256_maskstore_pd(y + i, mask, _mm256_fmadd_pd(r21, d2, _mm256_fmadd_pd(r11, d1, _mm256_mul_pd(r01, d0))));
+    _mm256_maskstore_pd(z + i, mask, _mm256_fmadd_pd(r22, d2, _mm256_fmadd_pd(r12, d1, _mm256_mul_pd(r02, d0))));
+  }
+}
+
+__attribute__((target("avx512f"))) static void unproject_avx512(double r[3][3], const double *gnomonic_x,
+                                                                 const double *gnomonic_y, double *x, double *y,
+                                                                 double *z, size_t n) {
+  __m512d r00 = _mm512_set1_pd(r[0][0]), r01 = _mm512_set1_pd(r[0][1]), r02 = _mm512_set1_pd(r[0][2]);
+  __m512d r10 = _mm512_set1_pd(r[1][0]), r11 = _mm512_set1_pd(r[1][1]), r12 = _mm512_set1_pd(r[1][2]);
+  __m512d r20 = _mm512_set1_pd(r[2][0]), r21 = _mm512_set1_pd(r[2][1]), r22 = _mm512_set1_pd(r[2][2]);
+  __m512d rad = _mm512_set1_pd(DEG_TO_RAD), one = _mm512_set1_pd(1.0);
+
+  for (size_t i = 0; i < n; i += 8) {
+    // The last iteration is masked rather than left to scalar code.
+    __mmask8 mask = n - i >= 8 ? (__mmask8)0xff : (__mmask8)((1u << (n - i)) - 1);
+    __m512d u = _mm512_mul_pd(_mm512_maskz_loadu_pd(mask, gnomonic_x + i), rad);
+    __m512d v = _mm512_mul_pd(_mm512_maskz_loadu_pd(mask, gnomonic_y + i), rad);
+    __m512d d0 = _mm512_div_pd(one, _mm512_sqrt_pd(_mm512_fmadd_pd(v, v, _mm512_fmadd_pd(u, u, one))));
+    __m512d d1 = _mm512_mul_pd(u, d0);
+    __m512d d2 = _mm512_mul_pd(v, d0);
+    _mm512_mask_storeu_pd(x + i, mask, _mm512_fmadd_pd(r20, d2, _mm512_fmadd_pd(r10, d1, _mm512_mul_pd(r00, d0))));
+    _mm512_mask_storeu_pd(y + i, mask, _mm512_fmadd_pd(r21, d2, _mm512_fmadd_pd(r11, d1, _mm512_mul_pd(r01, d0))));
+    _mm512_mask_storeu_pd(z + i, mask, _mm512_fmadd_pd(r22, d2, _mm512_fmadd_pd(r12, d1, _mm512_mul_pd(r02, d0))));
+  }
+}
+
+
+// Group kernels project the points offset through offset + n - 1 into
+// n_orbits frames at once. Each vector of points is loaded once and
+// then rotated into every frame; the matrix entries are broadcast from
+// L1 as they are used, since no more than two matrices fit in the
+// register file alongside the points. They do the same operations as
+// the single-frame kernel of their level, so their results are
+// identical to it.
+typedef void (*projection_group_kernel_fn)(double (*rotations)[3][3], size_t n_orbits, const double *x,
+                                           const double *y, const double *z, double *const *gnomonic_x,
+                                           double *const *gnomonic_y, size_t offset, size_t n);
+
+static void project_group_sse2(double (*rotations)[3][3], size_t n_orbits, const double *x, const double *y,
+                               const double *z, double *const *gnomonic_x, double *const *gnomonic_y, size_t offset,
+                               size_t n) {
+  __m128d deg = _mm_set1_pd(RAD_TO_DEG);
+
+  size_t i = offset, end = offset + n;
+  for (; i + 2 <= end; i += 2) {
+    __m128d vx = _mm_loadu_pd(x + i);
+    __m128d vy = _mm_loadu_pd(y + i);
+    __m128d vz = _mm_loadu_pd(z + i);
+    for (size_t k = 0; k < n_orbits; k++) {
+      double(*r)[3] = rotations[k];
+      __m128d r00 = _mm_set1_pd(r[0][0]), r01 = _mm_set1_pd(r[0][1]), r02 = _mm_set1_pd(r[0][2]);
+      __m128d r10 = _mm_set1_pd(r[1][0]), r11 = _mm_set1_pd(r[1][1]), r12 = _mm_set1_pd(r[1][2]);
+      __m128d r20 = _mm_set1_pd(r[2][0]), r21 = _mm_set1_pd(r[2][1]), r22 = _mm_set1_pd(r[2][2]);
+      __m128d rx = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r00, vx), _mm_mul_pd(r01, vy)), _mm_mul_pd(r02, vz));
+      __m128d ry = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r10, vx), _mm_mul_pd(r11, vy)), _mm_mul_pd(r12, vz));
+      __m128d rz = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r20, vx), _mm_mul_pd(r21, vy)), _mm_mul_pd(r22, vz));
+      __m128d scale = _mm_div_pd(deg, rx);
+      _mm_storeu_pd(gnomonic_x[k] + i, _mm_mul_pd(ry, scale));
+      _mm_storeu_pd(gnomonic_y[k] + i, _mm_mul_pd(rz, scale));
+    }
+  }
+  for (size_t k = 0; k < n_orbits; k++) {
+    project_tail(rotations[k], x + i, y + i, z + i, gnomonic_x[k] + i, gnomonic_y[k] + i, end - i);
+  }
+}
+
+__attribute__((target("avx2,fma"))) static void project_group_avx2(double (*rotations)[3][3], size_t n_orbits,
+                                                                   const double *x, const double *y,
+                                                                   const double *z, double *const *gnomonic_x,
+                                                                   double *const *gnomonic_y, size_t offset,
+                                                                   size_t n) {
+  __m256d deg = _mm256_set1_pd(RAD_TO_DEG);
+
+  // The tail is one more pass with a partial mask.
+  for (size_t i = offset, end = offset + n; i < end; i += 4) {
+    __m256i mask = tail_mask_avx2(end - i);
+    __m256d vx = _mm256_maskload_pd(x + i, mask);
+    __m256d vy = _mm256_maskload_pd(y + i, mask);
+    __m256d vz = _mm256_maskload_pd(z + i, mask);
+    for (size_t k = 0; k < n_orbits; k++) {
+      double(*r)[3] = rotations[k];
+      __m256d r00 = _mm256_set1_pd(r[0][0]), r01 = _mm256_set1_pd(r[0][1]), r02 = _mm256_set1_pd(r[0][2]);
+      __m256d r10 = _mm256_set1_pd(r[1][0]), r11 = _mm256_set1_pd(r[1][1]), r12 = _mm256_set1_pd(r[1][2]);
+      __m256d r20 = _mm256_set1_pd(r[2][0]), r21 = _mm256_set1_pd(r[2][1]), r22 = _mm256_set1_pd(r[2][2]);
+      __m256d rx = _mm256_fmadd_pd(r02, vz, _mm256_fmadd_pd(r01, vy, _mm256_mul_pd(r00, vx)));
+      __m256d ry = _mm256_fmadd_pd(r12, vz, _mm256_fmadd_pd(r11, vy, _mm256_mul_pd(r10, vx)));
+      __m256d rz = _mm256_fmadd_pd(r22, vz, _mm256_fmadd_pd(r21, vy, _mm256_mul_pd(r20, vx)));
+      __m256d scale = _mm256_div_pd(deg, rx);
+      _mm256_maskstore_pd(gnomonic_x[k] + i, mask, _mm256_mul_pd(ry, scale));
+      _mm256_maskstore_pd(gnomonic_y[k] + i, mask, _mm256_mul_pd(rz, scale));
+    }
+  }
+}
+
+__attribute__((target("avx512f"))) static void project_group_avx512(double (*rotations)[3][3], size_t n_orbits,
+                                                                     const double *x, const double *y,
+                                                                     const double *z, double *const *gnomonic_x,
+                                                                     double *const *gnomonic_y, size_t offset,
+                                                                     size_t n) {
+  __m512d deg = _mm512_set1_pd(RAD_TO_DEG);
+
+  for (size_t i = offset, end = offset + n; i < end; i += 8) {
+    __mmask8 mask = end - i >= 8 ? (__mmask8)0xff : (__mmask8)((1u << (end - i)) - 1);
+    __m512d vx = _mm512_maskz_loadu_pd(mask, x + i);
+    __m512d vy = _mm512_maskz_loadu_pd(mask, y + i);
+    __m512d vz = _mm512_maskz_loadu_pd(mask, z + i);
+    for (size_t k = 0; k < n_orbits; k++) {
+      double(*r)[3] = rotations[k];
+      __m512d r00 = _mm512_set1_pd(r[0][0]), r01 = _mm512_set1_pd(r[0][1]), r02 = _mm512_set1_pd(r[0][2]);
+      __m512d r10 = _mm512_set1_pd(r[1][0]), r11 = _mm512_set1_pd(r[1][1]), r12 = _mm512_set1_pd(r[1][2]);
+      __m512d r20 = _mm512_set1_pd(r[2][0]), r21 = _mm512_set1_pd(r[2][1]), r22 = _mm512_set1_pd(r[2][2]);
+      __m512d rx = _mm512_fmadd_pd(r02, vz, _mm512_fmadd_pd(r01, vy, _mm512_mul_pd(r00, vx)));
+      __m512d ry = _mm512_fmadd_pd(r12, vz, _mm512_fmadd_pd(r11, vy, _mm512_mul_pd(r10, vx)));
+      __m512d rz = _mm512_fmadd_pd(r22, vz, _mm512_fmadd_pd(r21, vy, _mm512_mul_pd(r20, vx)));
+      __m512d scale = _mm512_div_pd(deg, rx);
+      _mm512_mask_storeu_pd(gnomonic_x[k] + i, mask, _mm512_mul_pd(ry, scale));
+      _mm512_mask_storeu_pd(gnomonic_y[k] + i, mask, _mm512_mul_pd(rz, scale));
+    }
+  }
+}
+#endif
+
+projection_kernel_fn projection_kernel(enum SimdLevel level) {
+  if (!simd_level_supported(level)) {
+    return NULL;
+  }
+  switch (level) {
+    case SIMD_LEVEL_SCALAR:
+      return project_scalar;
+#ifdef HAVE_X86_KERNELS
+    case SIMD_LEVEL_SSE2:
+      return project_sse2;
+    case SIMD_LEVEL_AVX2:
+      return project_avx2;
+    case SIMD_LEVEL_AVX512:
+      return project_avx512;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+projection_kernel_fn projection_kernel_best(void) { return projection_kernel(simd_level_detect()); }
+
+projection_kernel_f32_fn projection_kernel_f32(enum SimdLevel level) {
+  if (!simd_level_supported(level)) {
+    return NULL;
+  }
+  switch (level) {
+    case SIMD_LEVEL_SCALAR:
+      return project_scalar_f32;
+#ifdef HAVE_X86_KERNELS
+    case SIMD_LEVEL_SSE2:
+      return project_sse2_f32;
+    case SIMD_LEVEL_AVX2:
+      return project_avx2_f32;
+    case SIMD_LEVEL_AVX512:
+      return project_avx512_f32;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+projection_kernel_f32_fn projection_kernel_f32_best(void) { return projection_kernel_f32(simd_level_detect()); }
+
+projection_filter_kernel_fn projection_filter_kernel(enum SimdLevel level) {
+  if (!simd_level_supported(level)) {
+    return NULL;
+  }
+  switch (level) {
+    case SIMD_LEVEL_SCALAR:
+      return project_filter_scalar;
+#ifdef HAVE_X86_KERNELS
+    case SIMD_LEVEL_SSE2:
+      return project_filter_sse2;
+    case SIMD_LEVEL_AVX2:
+      return project_filter_avx2;
+    case SIMD_LEVEL_AVX512:
+      return project_filter_avx512;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+projection_filter_kernel_fn projection_filter_kernel_best(void) {
+  return projection_filter_kernel(simd_level_detect());
+}
+
+inverse_projection_kernel_fn inverse_projection_kernel(enum SimdLevel level) {
+  if (!simd_level_supported(level)) {
+    return NULL;
+  }
+  switch (level) {
+    case SIMD_LEVEL_SCALAR:
+      return unproject_scalar;
+#ifdef HAVE_X86_KERNELS
+    case SIMD_LEVEL_SSE2:
+      return unproject_sse2;
+    case SIMD_LEVEL_AVX2:
+      return unproject_avx2;
+    case SIMD_LEVEL_AVX512:
+      return unproject_avx512;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+inverse_projection_kernel_fn inverse_projection_kernel_best(void) {
+  return inverse_projection_kernel(simd_level_detect());
+}
+
+static void project_group_scalar(double (*rotations)[3][3], size_t n_orbits, const double *x, const double *y,
+                                 const double *z, double *const *gnomonic_x, double *const *gnomonic_y,
+                                 size_t offset, size_t n) {
+  for (size_t k = 0; k < n_orbits; k++) {
+    project_scalar(rotations[k], x + offset, y + offset, z + offset, gnomonic_x[k] + offset,
+                   gnomonic_y[k] + offset, n);
+  }
+}
+
+// Projects n points into each of n_orbits frames, one cache block of
+// points at a time: the block is loaded from memory once and then
+// swept for every frame, width frames per pass of group, before moving
+// on. This is the loop order of a GEMM kernel, with the block playing
+// the part of the packed panel and each pass the register tile.
+static void project_multi(projection_group_kernel_fn group, size_t width, double (*rotations)[3][3],
+                          size_t n_orbits, const double *x, const double *y, const double *z,
+                          double *const *gnomonic_x, double *const *gnomonic_y, size_t n) {
+  for (size_t start = 0; start < n; start += PROJECTION_MULTI_BLOCK) {
+    size_t length = n - start < PROJECTION_MULTI_BLOCK ? n - start : PROJECTION_MULTI_BLOCK;
+    for (size_t k = 0; k < n_orbits; k += width) {
+      size_t frames = n_orbits - k < width ? n_orbits - k : width;
+      group(rotations + k, frames, x, y, z, gnomonic_x + k, gnomonic_y + k, start, length);
+    }
+  }
+}
+
+static void project_multi_scalar(double (*rotations)[3][3], size_t n_orbits, const double *x, const double *y,
+                                 const double *z, double *const *gnomonic_x, double *const *gnomonic_y, size_t n) {
+  project_multi(project_group_scalar, 1, rotations, n_orbits, x, y, z, gnomonic_x, gnomonic_y, n);
+}
+
+#ifdef HAVE_X86_KERNELS
+static void project_multi_sse2(double (*rotations)[3][3], size_t n_orbits, const double *x, const double *y,
+                               const double *z, double *const *gnomonic_x, double *const *gnomonic_y, size_t n) {
+  project_multi(project_group_sse2, projection_multi_kernel_width(SIMD_LEVEL_SSE2), rotations, n_orbits, x, y, z,
+                gnomonic_x, gnomonic_y, n);
+}
+
+static void project_multi_avx2(double (*rotations)[3][3], size_t n_orbits, const double *x, const double *y,
+                               const double *z, double *const *gnomonic_x, double *const *gnomonic_y, size_t n) {
+  project_multi(project_group_avx2, projection_multi_kernel_width(SIMD_LEVEL_AVX2), rotations, n_orbits, x, y, z,
+                gnomonic_x, gnomonic_y, n);
+}
+
+static void project_multi_avx512(double (*rotations)[3][3], size_t n_orbits, const double *x, const double *y,
+                                 const double *z, double *const *gnomonic_x, double *const *gnomonic_y, size_t n) {
+  project_multi(project_group_avx512, projection_multi_kernel_width(SIMD_LEVEL_AVX512), rotations, n_orbits, x, y,
+                z, gnomonic_x, gnomonic_y, n);
+}
+#endif
+
+size_t projection_multi_kernel_width(enum SimdLevel level) {
+  // Each pass writes two output streams per frame, so wider passes
+  // trade input reuse for more concurrent store streams. These widths
+  // keep a pass's stores to at most sixteen streams.
+  switch (level) {
+    case SIMD_LEVEL_SSE2:
+    case SIMD_LEVEL_AVX2:
+      return 4;
+    case SIMD_LEVEL_AVX512:
+      return 8;
+    default:
+      return 1;
+  }
+}
+
+projection_multi_kernel_fn projection_multi_kernel(enum SimdLevel level) {
+  if (!simd_level_supported(level)) {
+    return NULL;
+  }
+  switch (level) {
+    case SIMD_LEVEL_SCALAR:
+      return project_multi_scalar;
+#ifdef HAVE_X86_KERNELS
+    case SIMD_LEVEL_SSE2:
+      return project_multi_sse2;
+    case SIMD_LEVEL_AVX2:
+      return project_multi_avx2;
+    case SIMD_LEVEL_AVX512:
+      return project_multi_avx512;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+projection_multi_kernel_fn projection_multi_kernel_best(void) {
+  return projection_multi_kernel(simd_level_detect());
+}
@@ -0,0 +1,133 @@
+#ifndef projection_kernels_h
+#define projection_kernels_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "simd.h"
+
+/// A projection kernel rotates n points by a 3x3 gnomonic rotation
+/// matrix and writes their gnomonic x and y coordinates, in degrees.
+///
+/// The input columns x, y and z and the output columns gnomonic_x and
+/// gnomonic_y must each hold at least n values. Output columns must
+/// not alias input columns. No alignment is required.
+typedef void (*projection_kernel_fn)(double rotation[3][3], const double *x, const double *y, const double *z,
+                                     double *gnomonic_x, double *gnomonic_y, size_t n);
+
+/// Maximum relative difference between the result of any vectorized
+/// kernel and the scalar reference kernel. The vector kernels compute
+/// one reciprocal per point instead of two divisions, and may contract
+/// multiplies and adds into FMAs, so they can differ in the last few
+/// bits.
+#define PROJECTION_KERNEL_TOLERANCE 1E-12
+
+/// Returns the kernel for the given instruction set level, or NULL if
+/// the running CPU does not support it.
+projection_kernel_fn projection_kernel(enum SimdLevel level);
+
+/// Returns the fastest kernel supported by the running CPU.
+projection_kernel_fn projection_kernel_best(void);
+
+/// Like projection_kernel_fn, but writes single-precision outputs. The
+/// rotation and division are still done in double precision; only the
+/// final result is rounded to float.
+typedef void (*projection_kernel_f32_fn)(double rotation[3][3], const double *x, const double *y, const double *z,
+                                         float *gnomonic_x, float *gnomonic_y, size_t n);
+
+/// Maximum relative difference between the result of any
+/// single-precision kernel and the double-precision scalar reference
+/// kernel: half a float ulp (2^-24) for the final rounding, plus
+/// PROJECTION_KERNEL_TOLERANCE. For offsets up to 10 degrees this is
+/// under 0.003 arcseconds. It holds for results in the normal float
+/// range; results below FLT_MIN in magnitude may be off by up to
+/// 2^-150 absolute.
+#define PROJECTION_KERNEL_F32_TOLERANCE (0x1p-24 + PROJECTION_KERNEL_TOLERANCE)
+
+/// Returns the single-precision kernel for the given instruction set
+/// level, or NULL if the running CPU does not support it.
+projection_kernel_f32_fn projection_kernel_f32(enum SimdLevel level);
+
+/// Returns the fastest single-precision kernel supported by the running
+/// CPU.
+projection_kernel_f32_fn projection_kernel_f32_best(void);
+
+/// A filtering projection kernel projects n points like a
+/// projection_kernel_fn, but only keeps those in front of the tangent
+/// plane (positive rotated x) and within radius degrees of the origin
+/// of the gnomonic plane. Kept points are written contiguously, in
+/// input order, to gnomonic_x and gnomonic_y, and rows receives
+/// first_row plus each one's input position.
+///
+/// The outputs must have room for n values, although usually far fewer
+/// are written. Returns the number of points kept.
+typedef size_t (*projection_filter_kernel_fn)(double rotation[3][3], const double *x, const double *y,
+                                              const double *z, size_t n, double radius, uint32_t first_row,
+                                              double *gnomonic_x, double *gnomonic_y, uint32_t *rows);
+
+/// Returns the filtering kernel for the given instruction set level, or
+/// NULL if the running CPU does not support it. Kept points agree with
+/// the scalar kernel to within PROJECTION_KERNEL_TOLERANCE; a point
+/// within that tolerance of the radius may be kept by one kernel and
+/// dropped by another.
+projection_filter_kernel_fn projection_filter_kernel(enum SimdLevel level);
+
+/// Returns the fastest filtering kernel supported by the running CPU.
+projection_filter_kernel_fn projection_filter_kernel_best(void);
+
+/// An inverse projection kernel maps n points on a gnomonic plane, in
+/// degrees, back to unit direction vectors in the original frame.
+/// rotation is the same matrix the forward kernels take; since it is
+/// orthonormal, its transpose undoes it and no inverse is computed.
+///
+/// Each point maps to the direction in front of the tangent plane. The
+/// input columns gnomonic_x and gnomonic_y and the output columns x, y
+/// and z must each hold at least n values, and outputs must not alias
+/// inputs. No alignment is required.
+typedef void (*inverse_projection_kernel_fn)(double rotation[3][3], const double *gnomonic_x,
+                                             const double *gnomonic_y, double *x, double *y, double *z, size_t n);
+
+/// Returns the inverse kernel for the given instruction set level, or
+/// NULL if the running CPU does not support it. All inverse kernels
+/// agree with the scalar kernel to within PROJECTION_KERNEL_TOLERANCE
+/// (absolute, since the outputs are unit vectors).
+inverse_projection_kernel_fn inverse_projection_kernel(enum SimdLevel level);
+
+/// Returns the fastest inverse kernel supported by the running CPU.
+inverse_projection_kernel_fn inverse_projection_kernel_best(void);
+
+/// Number of points per cache block in the multi-orbit kernels. Three
+/// input columns of this many doubles, plus the outputs of one pass,
+/// fit in a 32 KiB L1 data cache.
+#define PROJECTION_MULTI_BLOCK 512
+
+/// A multi-orbit projection kernel projects the same n points into
+/// each of n_orbits frames: gnomonic_x[k] and gnomonic_y[k] receive
+/// the projection by rotations[k], as a projection_kernel_fn would
+/// write it.
+///
+/// Rather than streaming the inputs once per frame, it takes them
+/// PROJECTION_MULTI_BLOCK points at a time and applies every rotation
+/// to a block while it is in cache. Each pass over the block rotates
+/// every vector of points it loads into K frames, where K is
+/// projection_multi_kernel_width, so the block is read from cache once
+/// per K frames and from memory once for all n_orbits. The same
+/// requirements on the columns apply as for projection_kernel_fn.
+typedef void (*projection_multi_kernel_fn)(double (*rotations)[3][3], size_t n_orbits, const double *x,
+                                           const double *y, const double *z, double *const *gnomonic_x,
+                                           double *const *gnomonic_y, size_t n);
+
+/// Returns the multi-orbit kernel for the given instruction set level,
+/// or NULL if the running CPU does not support it. Its results are
+/// identical to those of projection_kernel at the same level.
+projection_multi_kernel_fn projection_multi_kernel(enum SimdLevel level);
+
+/// Returns the fastest multi-orbit kernel supported by the running CPU.
+projection_multi_kernel_fn projection_multi_kernel_best(void);
+
+/// Returns how many frames each pass of the multi-orbit kernel for a
+/// level applies to a vector of points: 4 with SSE2 and AVX2, 8 with
+/// AVX-512, and 1 for the scalar kernel.
+size_t projection_multi_kernel_width(enum SimdLevel level);
+
+#endif
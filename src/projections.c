@@ -1,21 +1,32 @@
 #include "projections.h"
 
-#include <assert.h>
 #include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#include "arena.h"
+#include "instrument.h"
 #include "matrixmath.h"
+#include "orbits.h"
+#include "projection_kernels.h"
+#include "sky_index.h"
+#include "thread_pool.h"
 
 #define FLOAT_EPSILON 1E-10
+
+// Number of directions per block in gnomonic_to_radec.
+#define RADEC_BLOCK 512
 #define _SQRT_TWO 1.41421356237309504880168872420969807856967187537694807317667973799
 
 int CT_ERR_INVALID_CENTER = 1;
 int CT_ERR_NOT_INVERTIBLE = 2;
 int CT_ERR_OUT_OF_MEMORY = 3;
-
-static double rad_to_deg(double rad);
-
-static double identity_matrix[3][3] = {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}};
+int CT_ERR_UNSUPPORTED_KERNEL = 4;
+int CT_ERR_MISSING_EPOCH = 5;
+int CT_ERR_TOO_MANY_POINTS = 6;
 
 int normal_vector(double center_pos[3], double center_velocity[3], double normal[3]) {
   // Check that the center point is not the origin.
@@ -43,105 +54,812 @@ int normal_vector(double center_pos[3], double center_velocity[3], double normal
   return 0;
 }
 
-static int r1_matrix(double center_pos[3], double center_velocity[3], double r1[3][3]) {
-  // Compute a vector normal to the orbital plane of the center object
-  double n_hat[3];
-  if (normal_vector(center_pos, center_velocity, n_hat) != 0) {
-    return -1;
+// Returns if_true when condition is nonzero, and if_false otherwise,
+// without a branch. Plain ternaries on doubles can be compiled into
+// branches around the arithmetic feeding them, which the vectorizer
+// then cannot if-convert.
+static inline double select_double(int condition, double if_true, double if_false) {
+  uint64_t mask = -(uint64_t)(condition != 0);
+  uint64_t t, f;
+  memcpy(&t, &if_true, sizeof(t));
+  memcpy(&f, &if_false, sizeof(f));
+  uint64_t bits = (t & mask) | (f & ~mask);
+  double result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+// Contraction into fused multiply-adds is turned off so that the
+// vectorized loop body and its scalar remainder round identically, and
+// a frame does not depend on how many others are built with it.
+SIMD_TARGET_CLONES __attribute__((optimize("fp-contract=off")))
+int gnomonic_rotation_matrices(const double *x, const double *y, const double *z, const double *vx,
+                               const double *vy, const double *vz, size_t n, double (*rotations)[3][3]) {
+  INSTRUMENT_SCOPE(INSTRUMENT_ROTATION_MATRICES, n);
+  // This computes the same frame as the original per-orbit
+  // construction (R = R2 R1, where R1 turns the orbit's normal onto the
+  // z axis and R2 then turns the center onto the x axis), with every
+  // step written out in closed form. Each special case is evaluated for
+  // every orbit and chosen with a bitwise select, so the loop has no
+  // branches and vectorizes across orbits.
+  size_t n_invalid = 0;
+  for (size_t i = 0; i < n; i++) {
+    double rx = x[i], ry = y[i], rz = z[i];
+
+    // Velocities nearly along the center, or nearly zero, are replaced
+    // as in normal_vector.
+    double r_dot_v = rx * vx[i] + ry * vy[i] + rz * vz[i];
+    double v_norm = sqrt(vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+    int degenerate = (fabs(r_dot_v) > 1 - FLOAT_EPSILON) | (v_norm < FLOAT_EPSILON);
+    double ux = select_double(degenerate, _SQRT_TWO, vx[i]);
+    double uy = select_double(degenerate, _SQRT_TWO, vy[i]);
+    double uz = select_double(degenerate, 0.0, vz[i]);
+
+    double nx = ry * uz - rz * uy;
+    double ny = rz * ux - rx * uz;
+    double nz = rx * uy - ry * ux;
+    double n_norm = sqrt(nx * nx + ny * ny + nz * nz);
+    int invalid = (n_norm == 0.0) | ((rx == 0.0) & (ry == 0.0) & (rz == 0.0));
+    nx /= n_norm;
+    ny /= n_norm;
+    nz /= n_norm;
+
+    // R1 = I + V + V^2 / (1 + cos theta), where V is the cross-product
+    // matrix of the rotation axis nu = n x z = (a, b, 0). R1 is the
+    // identity when nu vanishes, which zeroing a and b gives.
+    int aligned = sqrt(ny * ny + nx * nx) < FLOAT_EPSILON;
+    double a = select_double(aligned, 0.0, ny);
+    double b = select_double(aligned, 0.0, -nx);
+    double k = 1.0 / (1.0 + select_double(aligned, 0.0, nz));
+    double r1[3][3] = {{1.0 - k * b * b, k * a * b, b}, {k * a * b, 1.0 - k * a * a, -a},
+                       {-b, a, 1.0 - k * (a * a + b * b)}};
+
+    // R2 rotates about z by the angle of R1 r in the x-y plane.
+    double px = r1[0][0] * rx + r1[0][1] * ry + r1[0][2] * rz;
+    double py = r1[1][0] * rx + r1[1][1] * ry + r1[1][2] * rz;
+    double pz = r1[2][0] * rx + r1[2][1] * ry + r1[2][2] * rz;
+    double p_norm = sqrt(px * px + py * py + pz * pz);
+    invalid |= p_norm == 0.0;
+    double c = px / p_norm, s = py / p_norm;
+
+    double nan = select_double(invalid, NAN, 0.0);
+    for (int col = 0; col < 3; col++) {
+      rotations[i][0][col] = c * r1[0][col] + s * r1[1][col] + nan;
+      rotations[i][1][col] = -s * r1[0][col] + c * r1[1][col] + nan;
+      rotations[i][2][col] = r1[2][col] + nan;
+    }
+    n_invalid += invalid;
+  }
+  return n_invalid == 0 ? 0 : CT_ERR_INVALID_CENTER;
+}
+
+static int gnomonic_rotation_matrix(double center_pos[3], double center_velocity[3], double r_gnomonic[3][3]) {
+  return gnomonic_rotation_matrices(&center_pos[0], &center_pos[1], &center_pos[2], &center_velocity[0],
+                                    &center_velocity[1], &center_velocity[2], 1,
+                                    (double(*)[3][3])r_gnomonic);
+}
+
+int cartesian_to_gnomonic(struct CartesianPointSources *cartesian, double center_pos[3], double center_velocity[3],
+                          struct GnomonicPointSources *gnomonic) {
+  return cartesian_to_gnomonic_with_kernel(cartesian, center_pos, center_velocity, gnomonic, simd_level_detect());
+}
+
+int cartesian_to_gnomonic_with_kernel(struct CartesianPointSources *cartesian, double center_pos[3],
+                                      double center_velocity[3], struct GnomonicPointSources *gnomonic,
+                                      enum SimdLevel level) {
+  INSTRUMENT_SCOPE(INSTRUMENT_PROJECTION, cartesian->x.length);
+  // The output is overwritten, reusing whatever storage it already has.
+  gnomonic_point_sources_clear(gnomonic);
+
+  projection_kernel_fn kernel = projection_kernel(level);
+  if (kernel == NULL) {
+    return CT_ERR_UNSUPPORTED_KERNEL;
+  }
+
+  double rotation_matrix[3][3];
+  int status = gnomonic_rotation_matrix(center_pos, center_velocity, rotation_matrix);
+  if (status != 0) {
+    return status;
+  }
+
+  size_t n = cartesian->x.length;
+  if (n == 0) {
+    return 0;
+  }
+
+  // Size the output columns once up front, so the kernel can write
+  // them directly instead of pushing point by point.
+  if (vec_f64_reserve(&gnomonic->x, n) != 0 || vec_f64_reserve(&gnomonic->y, n) != 0 ||
+      vec_f64_reserve(&gnomonic->t, n) != 0) {
+    return CT_ERR_OUT_OF_MEMORY;
+  }
+
+  kernel(rotation_matrix, cartesian->x.data, cartesian->y.data, cartesian->z.data, gnomonic->x.data,
+         gnomonic->y.data, n);
+  memcpy(gnomonic->t.data, cartesian->t.data, n * sizeof(double));
+  gnomonic->x.length = n;
+  gnomonic->y.length = n;
+  gnomonic->t.length = n;
+
+  return 0;
+}
+
+int cartesian_to_gnomonic_f32(struct CartesianPointSources *cartesian, double center_pos[3],
+                              double center_velocity[3], struct GnomonicPointSourcesF32 *gnomonic) {
+  gnomonic_point_sources_f32_clear(gnomonic);
+
+  double rotation_matrix[3][3];
+  int status = gnomonic_rotation_matrix(center_pos, center_velocity, rotation_matrix);
+  if (status != 0) {
+    return status;
   }
 
-  // Find the rotation axis, nu.
-  double nu[3];
-  double z_axis[3] = {0.0, 0.0, 1.0};
-  cross(n_hat, z_axis, nu);
+  size_t n = cartesian->x.length;
+  if (n == 0) {
+    return 0;
+  }
+  if (vec_f32_reserve(&gnomonic->x, n) != 0 || vec_f32_reserve(&gnomonic->y, n) != 0 ||
+      vec_f64_reserve(&gnomonic->t, n) != 0) {
+    return CT_ERR_OUT_OF_MEMORY;
+  }
+
+  projection_kernel_f32_fn kernel = projection_kernel_f32_best();
+  kernel(rotation_matrix, cartesian->x.data, cartesian->y.data, cartesian->z.data, gnomonic->x.data,
+         gnomonic->y.data, n);
+  memcpy(gnomonic->t.data, cartesian->t.data, n * sizeof(double));
+  gnomonic->x.length = n;
+  gnomonic->y.length = n;
+  gnomonic->t.length = n;
+
+  return 0;
+}
+
+int cartesian_to_gnomonic_stream(struct CartesianPointSources *cartesian, double center_pos[3],
+                                 double center_velocity[3], size_t block_size, gnomonic_block_fn consume,
+                                 void *context) {
+  double rotation_matrix[3][3];
+  int status = gnomonic_rotation_matrix(center_pos, center_velocity, rotation_matrix);
+  if (status != 0) {
+    return status;
+  }
 
-  // If the rotation axis is parallel to the z-axis, then the rotation
-  // angle is 0, and the rotation matrix is the identity matrix.
-  if (magnitude(nu) < FLOAT_EPSILON) {
-    memcpy(r1, identity_matrix, sizeof(double) * 3 * 3);
+  size_t n = cartesian->x.length;
+  if (n == 0) {
     return 0;
   }
+  if (block_size == 0) {
+    block_size = PROJECTION_STREAM_BLOCK;
+  }
+  if (block_size > n) {
+    block_size = n;
+  }
 
-  // Find the cosine of the rotation angle, theta
-  //
-  // Since n_hat and z_axis are unit vectors, their dot product is the
-  // cosine of the angle between them.
-  double cos_theta = dot(n_hat, z_axis);
+  // x and y share one allocation that is reused for every block; t is
+  // the input's own column.
+  double *buffer = malloc(2 * block_size * sizeof(double));
+  if (buffer == NULL) {
+    return CT_ERR_OUT_OF_MEMORY;
+  }
+
+  projection_kernel_fn kernel = projection_kernel_best();
+  struct GnomonicPointSources block = GNOMONIC_POINT_SOURCES_ZERO;
+  for (size_t start = 0; start < n; start += block_size) {
+    size_t length = n - start < block_size ? n - start : block_size;
+    kernel(rotation_matrix, cartesian->x.data + start, cartesian->y.data + start, cartesian->z.data + start, buffer,
+           buffer + block_size, length);
+    vec_f64_view(&block.x, buffer, length);
+    vec_f64_view(&block.y, buffer + block_size, length);
+    vec_f64_view(&block.t, cartesian->t.data + start, length);
+    status = consume(&block, start, context);
+    if (status != 0) {
+      break;
+    }
+  }
+
+  free(buffer);
+  return status;
+}
 
-  // Compute the skew-symmetric matrix, V.
-  double V[3][3] = {{0.0, -nu[2], nu[1]}, {nu[2], 0.0, -nu[0]}, {-nu[1], nu[0], 0.0}};
+int cartesian_to_gnomonic_within(struct CartesianPointSources *cartesian, double center_pos[3],
+                                 double center_velocity[3], double radius, struct GnomonicPointSources *gnomonic,
+                                 struct VecU32 *rows) {
+  gnomonic_point_sources_clear(gnomonic);
+  vec_u32_clear(rows);
 
-  double V_squared[3][3];
-  matsquare_3x3(V, V_squared);
+  double rotation_matrix[3][3];
+  int status = gnomonic_rotation_matrix(center_pos, center_velocity, rotation_matrix);
+  if (status != 0) {
+    return status;
+  }
 
-  matscale(V_squared, (1 / (1 + cos_theta)));
+  size_t n = cartesian->x.length;
+  if (n > UINT32_MAX) {
+    return CT_ERR_TOO_MANY_POINTS;
+  }
 
-  // Compute the rotation matrix, r1.
-  for (size_t i = 0; i < 3; i++) {
-    for (size_t j = 0; j < 3; j++) {
-      r1[i][j] = identity_matrix[i][j] + V[i][j] + V_squared[i][j];
+  // The kernel needs room for a whole block in the outputs, but only
+  // what it keeps is committed, so the outputs are grown a block at a
+  // time rather than sized for the whole input. Growing only preserves
+  // items up to each vector's length, so the lengths are kept up to
+  // date block by block.
+  projection_filter_kernel_fn kernel = projection_filter_kernel_best();
+  size_t kept = 0;
+  for (size_t start = 0; start < n; start += PROJECTION_STREAM_BLOCK) {
+    size_t length = n - start < PROJECTION_STREAM_BLOCK ? n - start : PROJECTION_STREAM_BLOCK;
+    size_t capacity = vec_grown_capacity(gnomonic->x.capacity, kept + length);
+    if (vec_f64_reserve(&gnomonic->x, capacity) != 0 || vec_f64_reserve(&gnomonic->y, capacity) != 0 ||
+        vec_u32_reserve(rows, capacity) != 0) {
+      goto out_of_memory;
     }
+    kept += kernel(rotation_matrix, cartesian->x.data + start, cartesian->y.data + start, cartesian->z.data + start,
+                   length, radius, (uint32_t)start, gnomonic->x.data + kept, gnomonic->y.data + kept,
+                   rows->data + kept);
+    gnomonic->x.length = kept;
+    gnomonic->y.length = kept;
+    rows->length = kept;
   }
 
+  if (kept > 0 && vec_f64_reserve(&gnomonic->t, kept) != 0) {
+    goto out_of_memory;
+  }
+  for (size_t i = 0; i < kept; i++) {
+    gnomonic->t.data[i] = cartesian->t.data[rows->data[i]];
+  }
+  gnomonic->t.length = kept;
+
   return 0;
+
+out_of_memory:
+  // The blocks kept so far are dropped, so that a failed call leaves
+  // the outputs empty.
+  gnomonic_point_sources_clear(gnomonic);
+  vec_u32_clear(rows);
+  return CT_ERR_OUT_OF_MEMORY;
+}
+
+struct ProjectionTask {
+  /// One chunk of detections projected into the frames of a group of
+  /// n_orbits test orbits, whose rotations and outputs start at
+  /// rotations and gnomonic.
+  projection_multi_kernel_fn kernel;
+  double (*rotations)[3][3];
+  size_t n_orbits;
+  struct CartesianPointSources *cartesian;
+  struct GnomonicPointSources *gnomonic;
+  size_t start;
+  size_t length;
+  size_t node;
+};
+
+// Runs n tasks of size bytes each, starting at tasks, on pool, or on
+// the calling thread if pool is NULL, and waits for all of them. If
+// node is not NULL, each task is queued on the NUMA node it returns.
+static void run_tasks(struct ThreadPool *pool, void (*run)(void *), size_t (*node)(void *), void *tasks, size_t size,
+                      size_t n) {
+  char *task = tasks;
+  if (pool == NULL) {
+    for (size_t i = 0; i < n; i++) {
+      run(task + i * size);
+    }
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    int status = node != NULL ? thread_pool_submit_to_node(pool, node(task + i * size), run, task + i * size)
+                              : thread_pool_submit(pool, run, task + i * size);
+    if (status != 0) {
+      // Whatever was not queued runs here instead.
+      run(task + i * size);
+    }
+  }
+  thread_pool_wait(pool);
+}
+
+// Returns the NUMA node of pool that owns chunk of n_chunks chunks of
+// PROJECTION_BATCH_CHUNK detections. Each node owns one contiguous
+// range of chunks, and cartesian_to_gnomonic_batch_place puts them in
+// its memory.
+static size_t chunk_node(struct ThreadPool *pool, size_t chunk, size_t n_chunks) {
+  return pool != NULL ? chunk * pool->n_nodes / n_chunks : 0;
+}
+
+static size_t projection_task_node(void *arg) { return ((struct ProjectionTask *)arg)->node; }
+
+static void run_projection_task(void *arg) {
+  struct ProjectionTask *task = arg;
+  size_t start = task->start;
+  double *gnomonic_x[PROJECTION_BATCH_ORBITS], *gnomonic_y[PROJECTION_BATCH_ORBITS];
+  for (size_t k = 0; k < task->n_orbits; k++) {
+    gnomonic_x[k] = task->gnomonic[k].x.data + start;
+    gnomonic_y[k] = task->gnomonic[k].y.data + start;
+  }
+  task->kernel(task->rotations, task->n_orbits, task->cartesian->x.data + start, task->cartesian->y.data + start,
+               task->cartesian->z.data + start, gnomonic_x, gnomonic_y, task->length);
+  for (size_t k = 0; k < task->n_orbits; k++) {
+    memcpy(task->gnomonic[k].t.data + start, task->cartesian->t.data + start, task->length * sizeof(double));
+  }
+}
+
+int cartesian_to_gnomonic_batch(struct CartesianPointSources *cartesian, struct CartesianOrbits *orbits,
+                                struct GnomonicPointSources *gnomonic, struct ThreadPool *pool) {
+  size_t n_orbits = orbits->x.length;
+  size_t n_points = cartesian->x.length;
+  INSTRUMENT_SCOPE(INSTRUMENT_PROJECTION_BATCH, n_orbits * n_points);
+  // Every output is emptied before anything can fail, and only gets
+  // its length back once all the work is done, so the outputs are left
+  // empty on every early return.
+  for (size_t i = 0; i < n_orbits; i++) {
+    gnomonic_point_sources_clear(&gnomonic[i]);
+  }
+  if (n_orbits == 0 || n_points == 0) {
+    return 0;
+  }
+
+  double(*rotations)[3][3] = malloc(n_orbits * sizeof(double[3][3]));
+  if (rotations == NULL) {
+    return CT_ERR_OUT_OF_MEMORY;
+  }
+
+  size_t chunks = (n_points + PROJECTION_BATCH_CHUNK - 1) / PROJECTION_BATCH_CHUNK;
+  size_t groups = (n_orbits + PROJECTION_BATCH_ORBITS - 1) / PROJECTION_BATCH_ORBITS;
+  size_t n_tasks = groups * chunks;
+  struct ProjectionTask *tasks = malloc(n_tasks * sizeof(struct ProjectionTask));
+  if (tasks == NULL) {
+    free(rotations);
+    return CT_ERR_OUT_OF_MEMORY;
+  }
+
+  // Build every frame and size every output before starting any work,
+  // so that a bad orbit or a failed allocation leaves nothing running.
+  int status = gnomonic_rotation_matrices(orbits->x.data, orbits->y.data, orbits->z.data, orbits->vx.data,
+                                          orbits->vy.data, orbits->vz.data, n_orbits, rotations);
+  if (status != 0) {
+    goto done;
+  }
+  for (size_t i = 0; i < n_orbits; i++) {
+    if (vec_f64_reserve(&gnomonic[i].x, n_points) != 0 || vec_f64_reserve(&gnomonic[i].y, n_points) != 0 ||
+        vec_f64_reserve(&gnomonic[i].t, n_points) != 0) {
+      status = CT_ERR_OUT_OF_MEMORY;
+      goto done;
+    }
+  }
+
+  projection_multi_kernel_fn kernel = projection_multi_kernel_best();
+  size_t t = 0;
+  for (size_t first = 0; first < n_orbits; first += PROJECTION_BATCH_ORBITS) {
+    size_t group = n_orbits - first < PROJECTION_BATCH_ORBITS ? n_orbits - first : PROJECTION_BATCH_ORBITS;
+    for (size_t start = 0; start < n_points; start += PROJECTION_BATCH_CHUNK) {
+      size_t length = n_points - start < PROJECTION_BATCH_CHUNK ? n_points - start : PROJECTION_BATCH_CHUNK;
+      tasks[t] = (struct ProjectionTask){.kernel = kernel,
+                                         .rotations = &rotations[first],
+                                         .n_orbits = group,
+                                         .cartesian = cartesian,
+                                         .gnomonic = &gnomonic[first],
+                                         .start = start,
+                                         .length = length,
+                                         .node = chunk_node(pool, start / PROJECTION_BATCH_CHUNK, chunks)};
+      t++;
+    }
+  }
+
+  // Each chunk's tasks run on the node that owns it, so with placed
+  // detections every task reads local memory. Outputs are placed by
+  // first touch only: a fresh output's share lands on the node that
+  // writes it, and a reused one keeps the pages of its first use,
+  // which are on the right node as long as the detections are split
+  // the same way, with the same count and pool, as they were then.
+  run_tasks(pool, run_projection_task, pool != NULL && pool->n_nodes > 1 ? projection_task_node : NULL, tasks,
+            sizeof(struct ProjectionTask), n_tasks);
+
+  for (size_t i = 0; i < n_orbits; i++) {
+    gnomonic[i].x.length = n_points;
+    gnomonic[i].y.length = n_points;
+    gnomonic[i].t.length = n_points;
+  }
+
+done:
+  free(tasks);
+  free(rotations);
+  return status;
 }
 
-static int r2_matrix(double r1[3][3], double center_pos[3], double r2[3][3]) {
-  double r_rotated[3];
-  matmul_3x3_3x1(r1, center_pos, r_rotated);
-  if (normalize(r_rotated) != 0) {
-    return -1;
+struct PlacementTask {
+  /// One chunk of detections, copied on the node that owns it.
+  struct CartesianPointSources *cartesian;
+  struct CartesianPointSources *placed;
+  size_t start;
+  size_t length;
+  size_t node;
+};
+
+static size_t placement_task_node(void *arg) { return ((struct PlacementTask *)arg)->node; }
+
+static void run_placement_task(void *arg) {
+  struct PlacementTask *task = arg;
+  size_t bytes = task->length * sizeof(double);
+  memcpy(task->placed->x.data + task->start, task->cartesian->x.data + task->start, bytes);
+  memcpy(task->placed->y.data + task->start, task->cartesian->y.data + task->start, bytes);
+  memcpy(task->placed->z.data + task->start, task->cartesian->z.data + task->start, bytes);
+  memcpy(task->placed->t.data + task->start, task->cartesian->t.data + task->start, bytes);
+}
+
+// Drops the whole pages in bytes bytes at data, so that the next write
+// faults each one in afresh, on the writer's node, however the pages
+// were placed before. data must lie in an arena, whose private
+// anonymous mapping gives back zeroed pages.
+static void release_pages(void *data, size_t bytes) {
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t start = ((uintptr_t)data + page - 1) / page * page;
+  uintptr_t end = ((uintptr_t)data + bytes) / page * page;
+  if (end > start) {
+    madvise((void *)start, end - start, MADV_DONTNEED);
   }
+}
 
-  r2[0][0] = r_rotated[0];
-  r2[0][1] = r_rotated[1];
-  r2[0][2] = 0.0;
-  r2[1][0] = -r_rotated[1];
-  r2[1][1] = r_rotated[0];
-  r2[1][2] = 0.0;
-  r2[2][0] = 0.0;
-  r2[2][1] = 0.0;
-  r2[2][2] = 1.0;
+int cartesian_to_gnomonic_batch_place(struct CartesianPointSources *cartesian, struct ThreadPool *pool,
+                                      struct Arena *arena, struct CartesianPointSources *placed) {
+  size_t n_points = cartesian->x.length;
+  if (n_points == 0) {
+    *placed = (struct CartesianPointSources)CARTESIAN_POINT_SOURCES_ZERO;
+    return 0;
+  }
+  size_t chunks = (n_points + PROJECTION_BATCH_CHUNK - 1) / PROJECTION_BATCH_CHUNK;
+  struct PlacementTask *tasks = malloc(chunks * sizeof(struct PlacementTask));
+  if (tasks == NULL) {
+    return CT_ERR_OUT_OF_MEMORY;
+  }
+  // A failure part-way through carving the columns gives their space
+  // back, so a failed call leaves the arena as it was.
+  size_t used = arena->used;
+  if (cartesian_point_sources_new_in(placed, n_points, arena) != 0) {
+    arena->used = used;
+    free(tasks);
+    return CT_ERR_OUT_OF_MEMORY;
+  }
 
+  int multi_node = pool != NULL && pool->n_nodes > 1;
+  if (multi_node) {
+    // Arena memory may have been touched, and so placed, by an earlier
+    // use before arena_reset. Its pages are dropped so that each
+    // node's copy below faults them in again locally.
+    struct VecF64 *columns[4] = {&placed->x, &placed->y, &placed->z, &placed->t};
+    for (size_t c = 0; c < 4; c++) {
+      release_pages(columns[c]->data, n_points * sizeof(double));
+    }
+  }
+  for (size_t c = 0; c < chunks; c++) {
+    size_t start = c * PROJECTION_BATCH_CHUNK;
+    size_t length = n_points - start < PROJECTION_BATCH_CHUNK ? n_points - start : PROJECTION_BATCH_CHUNK;
+    tasks[c] = (struct PlacementTask){.cartesian = cartesian,
+                                      .placed = placed,
+                                      .start = start,
+                                      .length = length,
+                                      .node = chunk_node(pool, c, chunks)};
+  }
+  run_tasks(pool, run_placement_task, multi_node ? placement_task_node : NULL, tasks, sizeof(struct PlacementTask),
+            chunks);
+  cartesian_point_sources_resize(placed, n_points);
+  free(tasks);
   return 0;
 }
 
-static int gnomonic_rotation_matrix(double center_pos[3], double center_velocity[3], double r_gnomonic[3][3]) {
-  double r1[3][3];
-  int status = r1_matrix(center_pos, center_velocity, r1);
+struct EpochFrame {
+  /// A row of a per-epoch center table.
+  double t;
+  size_t row;
+};
+
+static int compare_epoch_frames(const void *a, const void *b) {
+  double x = ((const struct EpochFrame *)a)->t, y = ((const struct EpochFrame *)b)->t;
+  return (x > y) - (x < y);
+}
+
+static struct EpochFrame *find_epoch_frame(struct EpochFrame *frames, size_t n, double t) {
+  size_t lo = 0, hi = n;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (frames[mid].t < t) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo < n && frames[lo].t == t ? &frames[lo] : NULL;
+}
+
+int cartesian_to_gnomonic_epochs(struct CartesianPointSources *cartesian, struct CartesianOrbits *centers,
+                                 struct GnomonicPointSources *gnomonic) {
+  gnomonic_point_sources_clear(gnomonic);
+
+  size_t n = cartesian->x.length;
+  if (n == 0) {
+    return 0;
+  }
+
+  // The per-epoch tables of a typical test orbit fit on the stack, so
+  // only very long tables are allocated.
+  size_t n_centers = centers->x.length;
+  struct EpochFrame stack_frames[PROJECTION_EPOCHS_ON_STACK];
+  double stack_rotations[PROJECTION_EPOCHS_ON_STACK][3][3];
+  int on_stack = n_centers <= PROJECTION_EPOCHS_ON_STACK;
+  struct EpochFrame *frames = on_stack ? stack_frames : malloc(n_centers * sizeof(struct EpochFrame));
+  double(*rotations)[3][3] = on_stack ? stack_rotations : malloc(n_centers * sizeof(double[3][3]));
+  int status = 0;
+  if (frames == NULL || rotations == NULL) {
+    status = CT_ERR_OUT_OF_MEMORY;
+    goto done;
+  }
+  for (size_t i = 0; i < n_centers; i++) {
+    frames[i] = (struct EpochFrame){.t = centers->t.data[i], .row = i};
+  }
+  if (on_stack) {
+    // glibc's qsort may allocate a merge buffer, so short tables, which
+    // usually arrive in time order already, are insertion sorted.
+    for (size_t i = 1; i < n_centers; i++) {
+      struct EpochFrame frame = frames[i];
+      size_t j = i;
+      for (; j > 0 && compare_epoch_frames(&frames[j - 1], &frame) > 0; j--) {
+        frames[j] = frames[j - 1];
+      }
+      frames[j] = frame;
+    }
+  } else {
+    qsort(frames, n_centers, sizeof(struct EpochFrame), compare_epoch_frames);
+  }
+
+  // Every epoch's frame is built up front in one pass. A bad center
+  // only matters if some detection is projected with it.
+  gnomonic_rotation_matrices(centers->x.data, centers->y.data, centers->z.data, centers->vx.data,
+                             centers->vy.data, centers->vz.data, n_centers, rotations);
+
+  if (vec_f64_reserve(&gnomonic->x, n) != 0 || vec_f64_reserve(&gnomonic->y, n) != 0 ||
+      vec_f64_reserve(&gnomonic->t, n) != 0) {
+    status = CT_ERR_OUT_OF_MEMORY;
+    goto done;
+  }
+
+  projection_kernel_fn kernel = projection_kernel_best();
+  const double *t = cartesian->t.data;
+  for (size_t start = 0, end; start < n; start = end) {
+    for (end = start + 1; end < n && t[end] == t[start]; end++) {
+    }
+
+    struct EpochFrame *frame = find_epoch_frame(frames, n_centers, t[start]);
+    if (frame == NULL) {
+      status = CT_ERR_MISSING_EPOCH;
+      goto done;
+    }
+    double(*rotation)[3] = rotations[frame->row];
+    if (isnan(rotation[0][0])) {
+      status = CT_ERR_INVALID_CENTER;
+      goto done;
+    }
+    kernel(rotation, cartesian->x.data + start, cartesian->y.data + start, cartesian->z.data + start,
+           gnomonic->x.data + start, gnomonic->y.data + start, end - start);
+  }
+
+  memcpy(gnomonic->t.data, t, n * sizeof(double));
+  gnomonic->x.length = n;
+  gnomonic->y.length = n;
+  gnomonic->t.length = n;
+
+done:
+  if (!on_stack) {
+    free(rotations);
+    free(frames);
+  }
+  return status;
+}
+
+int cartesian_to_gnomonic_indexed(struct SkyIndex *index, size_t first_epoch, size_t last_epoch, double center[3],
+                                  double center_velocity[3], double radius, struct GnomonicPointSources *gnomonic,
+                                  struct VecU32 *rows) {
+  gnomonic_point_sources_clear(gnomonic);
+  if (rows != NULL) {
+    vec_u32_clear(rows);
+  }
+
+  double rotation_matrix[3][3];
+  int status = gnomonic_rotation_matrix(center, center_velocity, rotation_matrix);
   if (status != 0) {
     return status;
   }
 
-  double r2[3][3];
-  status = r2_matrix(r1, center_pos, r2);
+  struct SkyIndexRuns runs = SKY_INDEX_RUNS_ZERO;
+  if (sky_index_query(index, first_epoch, last_epoch, center, radius, &runs) != SKY_INDEX_ERROR_NONE) {
+    sky_index_runs_free(&runs);
+    return CT_ERR_OUT_OF_MEMORY;
+  }
+  size_t n = 0;
+  for (size_t i = 0; i < runs.length; i++) {
+    n += runs.end[i] - runs.start[i];
+  }
+  if (n == 0) {
+    sky_index_runs_free(&runs);
+    return 0;
+  }
+
+  if (vec_f64_reserve(&gnomonic->x, n) != 0 || vec_f64_reserve(&gnomonic->y, n) != 0 ||
+      vec_f64_reserve(&gnomonic->t, n) != 0 || (rows != NULL && vec_u32_reserve(rows, n) != 0)) {
+    sky_index_runs_free(&runs);
+    return CT_ERR_OUT_OF_MEMORY;
+  }
+
+  projection_kernel_fn kernel = projection_kernel_best();
+  struct CartesianPointSources *points = &index->points;
+  size_t offset = 0;
+  for (size_t i = 0; i < runs.length; i++) {
+    size_t start = runs.start[i], length = runs.end[i] - start;
+    kernel(rotation_matrix, points->x.data + start, points->y.data + start, points->z.data + start,
+           gnomonic->x.data + offset, gnomonic->y.data + offset, length);
+    memcpy(gnomonic->t.data + offset, points->t.data + start, length * sizeof(double));
+    if (rows != NULL) {
+      memcpy(rows->data + offset, index->rows + start, length * sizeof(uint32_t));
+    }
+    offset += length;
+  }
+  gnomonic->x.length = n;
+  gnomonic->y.length = n;
+  gnomonic->t.length = n;
+  if (rows != NULL) {
+    rows->length = n;
+  }
+
+  sky_index_runs_free(&runs);
+  return 0;
+}
+
+int gnomonic_to_cartesian(struct GnomonicPointSources *gnomonic, double center[3], double center_velocity[3],
+                          struct CartesianPointSources *cartesian) {
+  cartesian_point_sources_clear(cartesian);
+
+  double rotation_matrix[3][3];
+  int status = gnomonic_rotation_matrix(center, center_velocity, rotation_matrix);
   if (status != 0) {
     return status;
   }
+  return gnomonic_to_cartesian_rotated(gnomonic, rotation_matrix, cartesian);
+}
 
-  matmul_3x3_3x3(r2, r1, r_gnomonic);
+int gnomonic_to_cartesian_rotated(struct GnomonicPointSources *gnomonic, double rotation[3][3],
+                                  struct CartesianPointSources *cartesian) {
+  cartesian_point_sources_clear(cartesian);
+
+  size_t n = gnomonic->x.length;
+  if (n == 0) {
+    return 0;
+  }
+  if (cartesian_point_sources_reserve(cartesian, n) != 0) {
+    return CT_ERR_OUT_OF_MEMORY;
+  }
+
+  inverse_projection_kernel_fn kernel = inverse_projection_kernel_best();
+  kernel(rotation, gnomonic->x.data, gnomonic->y.data, cartesian->x.data, cartesian->y.data, cartesian->z.data, n);
+  memcpy(cartesian->t.data, gnomonic->t.data, n * sizeof(double));
+  cartesian_point_sources_resize(cartesian, n);
   return 0;
 }
 
-int cartesian_to_gnomonic(struct CartesianPointSources *cartesian, double center_pos[3], double center_velocity[3],
-                          struct GnomonicPointSources *gnomonic) {
-  // Check that the gnomonic point sources are empty.
-  assert(gnomonic->x.length == 0);
+int gnomonic_to_radec(struct GnomonicPointSources *gnomonic, double center[3], double center_velocity[3],
+                      struct VecF64 *ra, struct VecF64 *dec) {
+  vec_f64_clear(ra);
+  vec_f64_clear(dec);
 
   double rotation_matrix[3][3];
-  int status = gnomonic_rotation_matrix(center_pos, center_velocity, rotation_matrix);
+  int status = gnomonic_rotation_matrix(center, center_velocity, rotation_matrix);
   if (status != 0) {
     return status;
   }
-  for (size_t i = 0; i < cartesian->x.length; i++) {
-    double cartesian_vec[3] = {cartesian->x.data[i], cartesian->y.data[i], cartesian->z.data[i]};
-    double rotated_vec[3];
-    matmul_3x3_3x1(rotation_matrix, cartesian_vec, rotated_vec);
-    gnomonic_point_sources_push(gnomonic, rad_to_deg(rotated_vec[1] / rotated_vec[0]),
-                                rad_to_deg(rotated_vec[2] / rotated_vec[0]), cartesian->t.data[i]);
+
+  size_t n = gnomonic->x.length;
+  if (n == 0) {
+    return 0;
+  }
+  if (vec_f64_reserve(ra, n) != 0 || vec_f64_reserve(dec, n) != 0) {
+    return CT_ERR_OUT_OF_MEMORY;
   }
 
+  // Directions are built a block at a time into a stack buffer that
+  // stays in cache, rather than materializing all three columns.
+  inverse_projection_kernel_fn kernel = inverse_projection_kernel_best();
+  double x[RADEC_BLOCK], y[RADEC_BLOCK], z[RADEC_BLOCK];
+  for (size_t start = 0; start < n; start += RADEC_BLOCK) {
+    size_t length = n - start < RADEC_BLOCK ? n - start : RADEC_BLOCK;
+    kernel(rotation_matrix, gnomonic->x.data + start, gnomonic->y.data + start, x, y, z, length);
+    for (size_t i = 0; i < length; i++) {
+      double alpha = atan2(y[i], x[i]) * 180.0 / M_PI;
+      ra->data[start + i] = alpha < 0.0 ? alpha + 360.0 : alpha;
+      // atan2 rather than asin, which loses precision near the poles
+      // and fails on a z rounded just past 1.
+      dec->data[start + i] = atan2(z[i], hypot(x[i], y[i])) * 180.0 / M_PI;
+    }
+  }
+  ra->length = n;
+  dec->length = n;
   return 0;
 }
 
-static double rad_to_deg(double rad) { return rad * 180.0 / M_PI; }
+struct InverseProjectionTask {
+  /// One chunk of one frame's gnomonic points mapped back to directions.
+  inverse_projection_kernel_fn kernel;
+  double (*rotation)[3];
+  struct GnomonicPointSources *gnomonic;
+  struct CartesianPointSources *cartesian;
+  size_t start;
+  size_t length;
+};
+
+static void run_inverse_projection_task(void *arg) {
+  struct InverseProjectionTask *task = arg;
+  size_t start = task->start;
+  task->kernel(task->rotation, task->gnomonic->x.data + start, task->gnomonic->y.data + start,
+               task->cartesian->x.data + start, task->cartesian->y.data + start, task->cartesian->z.data + start,
+               task->length);
+  memcpy(task->cartesian->t.data + start, task->gnomonic->t.data + start, task->length * sizeof(double));
+}
+
+int gnomonic_to_cartesian_batch(struct GnomonicPointSources *gnomonic, struct CartesianOrbits *orbits,
+                                struct CartesianPointSources *cartesian, struct ThreadPool *pool) {
+  size_t n_orbits = orbits->x.length;
+  // As in cartesian_to_gnomonic_batch, the outputs are emptied first
+  // and only get their lengths once everything has succeeded.
+  for (size_t i = 0; i < n_orbits; i++) {
+    cartesian_point_sources_clear(&cartesian[i]);
+  }
+  if (n_orbits == 0) {
+    return 0;
+  }
+
+  double(*rotations)[3][3] = malloc(n_orbits * sizeof(double[3][3]));
+  if (rotations == NULL) {
+    return CT_ERR_OUT_OF_MEMORY;
+  }
+  size_t n_tasks = 0;
+  for (size_t i = 0; i < n_orbits; i++) {
+    n_tasks += (gnomonic[i].x.length + PROJECTION_BATCH_CHUNK - 1) / PROJECTION_BATCH_CHUNK;
+  }
+  struct InverseProjectionTask *tasks = malloc((n_tasks > 0 ? n_tasks : 1) * sizeof(struct InverseProjectionTask));
+  if (tasks == NULL) {
+    free(rotations);
+    return CT_ERR_OUT_OF_MEMORY;
+  }
+
+  // As in cartesian_to_gnomonic_batch, everything that can fail is done
+  // before any work starts.
+  int status = gnomonic_rotation_matrices(orbits->x.data, orbits->y.data, orbits->z.data, orbits->vx.data,
+                                          orbits->vy.data, orbits->vz.data, n_orbits, rotations);
+  if (status != 0) {
+    goto done;
+  }
+  for (size_t i = 0; i < n_orbits; i++) {
+    if (cartesian_point_sources_reserve(&cartesian[i], gnomonic[i].x.length) != 0) {
+      status = CT_ERR_OUT_OF_MEMORY;
+      goto done;
+    }
+  }
+
+  inverse_projection_kernel_fn kernel = inverse_projection_kernel_best();
+  size_t t = 0;
+  for (size_t i = 0; i < n_orbits; i++) {
+    size_t n_points = gnomonic[i].x.length;
+    for (size_t start = 0; start < n_points; start += PROJECTION_BATCH_CHUNK) {
+      size_t length = n_points - start < PROJECTION_BATCH_CHUNK ? n_points - start : PROJECTION_BATCH_CHUNK;
+      tasks[t] = (struct InverseProjectionTask){.kernel = kernel,
+                                                .rotation = rotations[i],
+                                                .gnomonic = &gnomonic[i],
+                                                .cartesian = &cartesian[i],
+                                                .start = start,
+                                                .length = length};
+      t++;
+    }
+  }
+  run_tasks(pool, run_inverse_projection_task, NULL, tasks, sizeof(struct InverseProjectionTask), n_tasks);
+
+  for (size_t i = 0; i < n_orbits; i++) {
+    cartesian_point_sources_resize(&cartesian[i], gnomonic[i].x.length);
+  }
+
+done:
+  free(tasks);
+  free(rotations);
+  return status;
+}
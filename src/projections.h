@@ -1,7 +1,19 @@
 #ifndef projections_h
 #define projections_h
 
+#include "orbits.h"
 #include "point_sources.h"
+#include "simd.h"
+#include "sky_index.h"
+#include "thread_pool.h"
+
+/// Error codes returned by the projection functions.
+extern int CT_ERR_INVALID_CENTER;
+extern int CT_ERR_NOT_INVERTIBLE;
+extern int CT_ERR_OUT_OF_MEMORY;
+extern int CT_ERR_UNSUPPORTED_KERNEL;
+extern int CT_ERR_MISSING_EPOCH;
+extern int CT_ERR_TOO_MANY_POINTS;
 
 /// Computes a vector normal to a plane defined by a vector to a position and
 /// a velocity vector.
@@ -14,6 +26,22 @@ int normal_vector(double center_pos[3], double center_velocity[3], double normal
 /// Builds an orthonormal basis from a radial position vector and a velocity vector.
 int build_orthonormal_basis(double center_pos[3], double center_velocity[3], double basis[3][3]);
 
+/// Builds the rotation matrix into the gnomonic frame of each of n
+/// centers, given as struct-of-arrays positions and velocities. The
+/// frame is the one used by cartesian_to_gnomonic: it turns the
+/// center onto the x axis and its orbital plane onto the x-y plane.
+/// Velocities that normal_vector would replace are replaced here too.
+///
+/// The matrices are written to rotations, which must have room for n.
+/// The loop over centers is branch-free and vectorized.
+///
+/// Returns 0 on success, or CT_ERR_INVALID_CENTER if any center has no
+/// frame (a zero position, or a velocity parallel to it); those
+/// centers' matrices are filled with NaN, and the rest are still
+/// valid.
+int gnomonic_rotation_matrices(const double *x, const double *y, const double *z, const double *vx,
+                               const double *vy, const double *vz, size_t n, double (*rotations)[3][3]);
+
 /// Project a set of Cartesian point sources onto a gnomonic plane.
 ///
 /// The gnomonic plane is defined by a center point and a velocity
@@ -27,9 +55,243 @@ int build_orthonormal_basis(double center_pos[3], double center_velocity[3], dou
 /// matters, since the direction defines the plane's x and y axes.
 ///
 /// The result is written to the gnomonic argument, which must be
-/// initialized by the caller, and must have zero length.
+/// initialized by the caller. Whatever it held before is overwritten
+/// from row 0, and its storage is reused, growing only when it is too
+/// small, so a loop over many test orbits that reuses one container
+/// makes no heap allocations once the container has grown to the
+/// largest projection. The same holds for every output container in
+/// this file. On failure the outputs are left empty.
+///
+/// The projection runs with the fastest vectorized kernel the running
+/// CPU supports; see cartesian_to_gnomonic_with_kernel.
 ///
 /// Returns 0 on success, or an error code on failure.
 int cartesian_to_gnomonic(struct CartesianPointSources *cartesian, double center[3], double center_velocity[3], struct GnomonicPointSources *gnomonic);
 
+/// Like cartesian_to_gnomonic, but uses the projection kernel for a
+/// specific instruction set level. All kernels agree with the scalar
+/// kernel to within PROJECTION_KERNEL_TOLERANCE (relative).
+///
+/// Returns CT_ERR_UNSUPPORTED_KERNEL if the running CPU does not
+/// support the requested level.
+int cartesian_to_gnomonic_with_kernel(struct CartesianPointSources *cartesian, double center[3],
+                                      double center_velocity[3], struct GnomonicPointSources *gnomonic,
+                                      enum SimdLevel level);
+
+/// Like cartesian_to_gnomonic, but writes x and y in single precision,
+/// halving the output's size. The rotation and projection are computed
+/// in double precision and only the results are rounded, so each x and
+/// y is within PROJECTION_KERNEL_F32_TOLERANCE (relative) of
+/// cartesian_to_gnomonic's result: under 0.003 arcseconds for offsets
+/// up to 10 degrees.
+///
+/// Returns 0 on success, or an error code on failure.
+int cartesian_to_gnomonic_f32(struct CartesianPointSources *cartesian, double center[3], double center_velocity[3],
+                              struct GnomonicPointSourcesF32 *gnomonic);
+
+/// Default number of detections per block in
+/// cartesian_to_gnomonic_stream. The block's three input columns, two
+/// output columns and t fit in L1 and L2 together, with room left for
+/// the consumer's own state.
+#define PROJECTION_STREAM_BLOCK 4096
+
+/// Receives one block of projected detections from
+/// cartesian_to_gnomonic_stream. block holds the projections of input
+/// rows offset through offset + block->x.length - 1. Its columns are
+/// borrowed and only valid until the consumer returns; a consumer that
+/// needs to keep points must copy them.
+///
+/// Returns 0 to continue, or any other value to stop the stream.
+typedef int (*gnomonic_block_fn)(struct GnomonicPointSources *block, size_t offset, void *context);
+
+/// Like cartesian_to_gnomonic, but instead of writing the whole
+/// projection to an output container, projects block_size detections
+/// at a time (PROJECTION_STREAM_BLOCK if block_size is 0) and passes
+/// each block to consume, along with context, while it is still in
+/// cache. Blocks arrive in input order. The only memory allocated is
+/// one block's x and y, so memory use does not grow with the number of
+/// detections.
+///
+/// Returns 0 on success, the consumer's return value if it stopped
+/// the stream, or an error code on failure.
+int cartesian_to_gnomonic_stream(struct CartesianPointSources *cartesian, double center[3], double center_velocity[3],
+                                 size_t block_size, gnomonic_block_fn consume, void *context);
+
+/// Like cartesian_to_gnomonic, but only keeps detections in front of
+/// the tangent plane and within radius degrees of the center on the
+/// gnomonic plane. Projection and filtering are fused into one pass,
+/// so dropped detections are never written anywhere.
+///
+/// The kept detections are written to gnomonic in input order, and
+/// rows receives each one's row in cartesian. Both must be initialized
+/// by the caller and are overwritten. The outputs grow with the number
+/// of kept detections, not the size of the input.
+///
+/// Returns CT_ERR_TOO_MANY_POINTS if cartesian has more rows than fit
+/// in a uint32_t, or another error code on failure.
+int cartesian_to_gnomonic_within(struct CartesianPointSources *cartesian, double center[3],
+                                 double center_velocity[3], double radius, struct GnomonicPointSources *gnomonic,
+                                 struct VecU32 *rows);
+
+/// Number of detections per task in cartesian_to_gnomonic_batch.
+/// Three input and three output columns of this many doubles fit
+/// comfortably in L2.
+#define PROJECTION_BATCH_CHUNK 16384
+
+/// Number of test orbits per task in cartesian_to_gnomonic_batch. Each
+/// block of a task's detections is read from memory once for all of
+/// them. Eight is one pass of the widest multi-orbit kernel; groups
+/// several passes wide project more slowly, as each pass's outputs
+/// push the block out of cache.
+#define PROJECTION_BATCH_ORBITS 8
+
+/// Project one set of Cartesian point sources into the gnomonic frame
+/// of each of many test orbits.
+///
+/// Each row of orbits gives the center position and velocity of one
+/// frame, as in cartesian_to_gnomonic; the orbits' t column is
+/// ignored. gnomonic must point to an array of orbits->x.length
+/// initialized containers; the i-th is overwritten with the projection
+/// into the i-th orbit's frame.
+///
+/// The work is split into (group of PROJECTION_BATCH_ORBITS orbits,
+/// chunk of PROJECTION_BATCH_CHUNK detections) tasks and run on pool,
+/// so orbits with few detections do not leave workers idle. If pool is
+/// NULL, everything runs on the calling thread. Each task projects
+/// with a multi-orbit kernel, which reads each cache block of
+/// detections once for the whole group instead of once per orbit. On a
+/// pool from thread_pool_new_pinned that spans several NUMA nodes,
+/// each chunk's tasks are queued on the node that owns it; see
+/// cartesian_to_gnomonic_batch_place.
+///
+/// The frame and task tables are allocated on the calling thread, once
+/// per call; workers never allocate.
+///
+/// Returns 0 on success, or an error code on failure. Every output
+/// container is emptied first, so on failure, or with no detections,
+/// they are all left empty.
+int cartesian_to_gnomonic_batch(struct CartesianPointSources *cartesian, struct CartesianOrbits *orbits,
+                                struct GnomonicPointSources *gnomonic, struct ThreadPool *pool);
+
+/// Largest number of centers whose per-epoch tables
+/// cartesian_to_gnomonic_epochs keeps on the stack: under 6 KB.
+#define PROJECTION_EPOCHS_ON_STACK 64
+
+/// Copies cartesian into placed, laid out for
+/// cartesian_to_gnomonic_batch on a pool that spans several NUMA nodes.
+/// placed's columns are carved from arena, as with
+/// cartesian_point_sources_new_in, so arena needs room for four columns
+/// of cartesian->x.length doubles, each rounded up to ARENA_ALIGNMENT
+/// bytes. The detections are split into one contiguous range of
+/// chunks per node of pool, and each range is copied by its own node's
+/// workers. The columns' pages are dropped first, so even arena memory
+/// used before an arena_reset is faulted in afresh by those writes,
+/// and the kernel's first-touch policy puts each range in its node's
+/// memory. The batch projection then runs each chunk's tasks on the
+/// node holding its detections.
+///
+/// Output containers are not placed here: their pages land on the
+/// node that first writes them, so fresh outputs are placed, and
+/// reused ones stay placed while the detections keep the same count
+/// and pool.
+///
+/// arena should not be backed by huge pages, which would place memory
+/// 2 MB at a time. With a single-node pool, or with pool NULL, this is
+/// a plain copy.
+///
+/// Returns 0 on success, or CT_ERR_OUT_OF_MEMORY if arena is too small
+/// or allocation fails, in which case the arena is left as it was.
+int cartesian_to_gnomonic_batch_place(struct CartesianPointSources *cartesian, struct ThreadPool *pool,
+                                      struct Arena *arena, struct CartesianPointSources *placed);
+
+/// Project Cartesian point sources into a frame that follows a test
+/// orbit from exposure to exposure.
+///
+/// centers is a per-epoch table of the test orbit's states, such as one
+/// orbit's rows of propagate_orbits output. Each detection is
+/// projected into the frame of the centers row whose t equals its own
+/// exactly. Detections are processed in runs of equal t, so that each
+/// exposure's frame is built once, however many detections it has and
+/// however many runs it is split into, and applied to the whole run
+/// at once. Detections sorted or grouped by exposure make the fewest
+/// runs.
+///
+/// The result is written to gnomonic, in the same order as the input,
+/// which must be initialized by the caller and is overwritten. The
+/// per-epoch tables live on the stack for up to
+/// PROJECTION_EPOCHS_ON_STACK centers, so only longer tables allocate.
+///
+/// Returns CT_ERR_MISSING_EPOCH if a detection's t has no row in
+/// centers, or another error code on failure.
+int cartesian_to_gnomonic_epochs(struct CartesianPointSources *cartesian, struct CartesianOrbits *centers,
+                                 struct GnomonicPointSources *gnomonic);
+
+/// Like cartesian_to_gnomonic, but only projects the detections of an
+/// index that lie in sky cells within radius (in degrees) of the
+/// center's direction, in the epochs first_epoch through last_epoch -
+/// 1 of the index.
+///
+/// Detections come out in the index's (epoch, cell) order. If rows is
+/// not NULL, it must be an initialized vector; it is overwritten with
+/// the row in the indexed container that each output came from.
+///
+/// The cells are culled conservatively: a detection within radius
+/// degrees of the center, measured either by angle or by distance on
+/// the gnomonic plane, is always projected, but detections somewhat
+/// farther out may be too.
+///
+/// Returns 0 on success, or an error code on failure.
+int cartesian_to_gnomonic_indexed(struct SkyIndex *index, size_t first_epoch, size_t last_epoch, double center[3],
+                                  double center_velocity[3], double radius, struct GnomonicPointSources *gnomonic,
+                                  struct VecU32 *rows);
+
+/// Maps gnomonic point sources back to the directions they were
+/// projected from: the inverse of cartesian_to_gnomonic with the same
+/// center and velocity. This is how cluster centroids and fitted tracks
+/// found on the gnomonic plane get back to the sky.
+///
+/// Each point becomes a unit vector in the frame of the center, in
+/// front of the tangent plane; the distance along the line of sight is
+/// not recoverable. The result, with each point's t, is written to
+/// cartesian, which must be initialized by the caller and is
+/// overwritten.
+///
+/// The rotation is undone with its transpose, in the same vectorized
+/// kernels as the forward projection, so round trips agree to within
+/// PROJECTION_KERNEL_TOLERANCE.
+///
+/// Returns 0 on success, or an error code on failure.
+int gnomonic_to_cartesian(struct GnomonicPointSources *gnomonic, double center[3], double center_velocity[3],
+                          struct CartesianPointSources *cartesian);
+
+/// Like gnomonic_to_cartesian, but takes the frame's rotation matrix,
+/// as built by gnomonic_rotation_matrices, instead of building it, for
+/// callers that keep their frames around.
+int gnomonic_to_cartesian_rotated(struct GnomonicPointSources *gnomonic, double rotation[3][3],
+                                  struct CartesianPointSources *cartesian);
+
+/// Like gnomonic_to_cartesian, but writes each direction as right
+/// ascension in [0, 360) and declination, both in degrees, with the
+/// x-y plane of the Cartesian frame as the equator, so equatorial
+/// Cartesian input gives equatorial RA/Dec. Both outputs must be
+/// initialized and are overwritten. Directions are built one block at
+/// a time in a stack buffer, so nothing else is allocated.
+///
+/// Returns 0 on success, or an error code on failure.
+int gnomonic_to_radec(struct GnomonicPointSources *gnomonic, double center[3], double center_velocity[3],
+                      struct VecF64 *ra, struct VecF64 *dec);
+
+/// The inverse of cartesian_to_gnomonic_batch: maps gnomonic[i] back
+/// to directions in the frame of the i-th orbit, writing the result to
+/// cartesian[i], which must be initialized and is overwritten. The
+/// containers in gnomonic may differ in length.
+///
+/// Work is split into (orbit, chunk of PROJECTION_BATCH_CHUNK points)
+/// tasks and run on pool, or on the calling thread if pool is NULL.
+///
+/// Returns 0 on success, or an error code on failure. On failure every
+/// output container is left empty.
+int gnomonic_to_cartesian_batch(struct GnomonicPointSources *gnomonic, struct CartesianOrbits *orbits,
+                                struct CartesianPointSources *cartesian, struct ThreadPool *pool);
+
 #endif
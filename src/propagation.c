@@ -0,0 +1,299 @@
+#include "propagation.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "instrument.h"
+#include "orbits.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#define L PROPAGATION_LANES
+
+#define MAX_ITERATIONS 50
+#define CONVERGENCE_TOLERANCE 1E-14
+
+// The Stumpff series is summed for arguments up to this magnitude, and
+// larger ones are reduced by quartering first, at most
+// 2^QUARTERING_STEPS times.
+#define SERIES_LIMIT 0.5
+#define SERIES_TERMS 9
+#define QUARTERING_STEPS 6
+
+// Adding and then subtracting 1.5 * 2^52 rounds a double of magnitude
+// below 2^51 to the nearest integer.
+#define ROUNDING_SHIFTER 0x1.8p52
+
+// Evaluates the Stumpff functions c0(z) through c3(z) in each lane.
+//
+// Small arguments are summed as a series. Larger ones are divided by 4
+// until they are small, and the results scaled back up with the
+// quadrupling identities
+//
+//   c0(4z) = 2 c0(z)^2 - 1       c1(4z) = c0(z) c1(z)
+//   c2(4z) = c1(z)^2 / 2         c3(4z) = (c3(z) + c1(z) c2(z)) / 4
+//
+// so no lane needs a branch on the sign of z, or trigonometric or
+// hyperbolic functions.
+static inline void stumpff(const double z[L], double c0[L], double c1[L], double c2[L], double c3[L]) {
+  // Each lane's number of quarterings is found by a binary search with
+  // a fixed number of steps, the same in every lane: the argument is
+  // quartered 32, 16, ..., 1 times wherever it stays above the limit,
+  // then once more wherever it still is.
+  double quarterings[L], y[L];
+  for (int l = 0; l < L; l++) {
+    quarterings[l] = 0.0;
+    y[l] = z[l];
+  }
+  for (int step = QUARTERING_STEPS - 1; step >= -1; step--) {
+    int times = step >= 0 ? 1 << step : 1;
+    double scale = ldexp(1.0, -2 * times);
+    double limit = step >= 0 ? SERIES_LIMIT : 0.25 * SERIES_LIMIT;
+    for (int l = 0; l < L; l++) {
+      double w = y[l] * scale;
+      uint64_t apply = simd_mask(fabs(w) > limit);
+      y[l] = simd_select(apply, w, y[l]);
+      quarterings[l] += simd_select(apply, times, 0.0);
+    }
+  }
+  double max_quarterings = 0.0;
+  for (int l = 0; l < L; l++) {
+    max_quarterings = quarterings[l] > max_quarterings ? quarterings[l] : max_quarterings;
+  }
+
+  for (int l = 0; l < L; l++) {
+    double s2 = 1.0, s3 = 1.0;
+    for (int j = SERIES_TERMS; j >= 1; j--) {
+      s2 = 1.0 - y[l] * s2 / ((2.0 * j + 1.0) * (2.0 * j + 2.0));
+      s3 = 1.0 - y[l] * s3 / ((2.0 * j + 2.0) * (2.0 * j + 3.0));
+    }
+    c2[l] = s2 / 2.0;
+    c3[l] = s3 / 6.0;
+    c0[l] = 1.0 - y[l] * c2[l];
+    c1[l] = 1.0 - y[l] * c3[l];
+  }
+
+  for (int j = 0; j < max_quarterings; j++) {
+    for (int l = 0; l < L; l++) {
+      double a0 = 2.0 * c0[l] * c0[l] - 1.0;
+      double a1 = c0[l] * c1[l];
+      double a2 = 0.5 * c1[l] * c1[l];
+      double a3 = 0.25 * (c3[l] + c1[l] * c2[l]);
+      uint64_t apply = simd_mask(j < quarterings[l]);
+      c0[l] = simd_select(apply, a0, c0[l]);
+      c1[l] = simd_select(apply, a1, c1[l]);
+      c2[l] = simd_select(apply, a2, c2[l]);
+      c3[l] = simd_select(apply, a3, c3[l]);
+    }
+  }
+}
+
+// Solves the universal Kepler equation for every lane of a block and
+// writes the propagated states.
+SIMD_TARGET_CLONES
+void propagate_block(struct PropagationBlock *block, double mu) {
+  double sqrt_mu = sqrt(mu);
+  double r0n[L], rv[L], alpha[L], dt[L], chi[L], log_scale[L], log_argument[L];
+  for (int l = 0; l < L; l++) {
+    double x = block->r0[0][l], y = block->r0[1][l], z = block->r0[2][l];
+    double vx = block->v0[0][l], vy = block->v0[1][l], vz = block->v0[2][l];
+    r0n[l] = sqrt(x * x + y * y + z * z);
+    rv[l] = (x * vx + y * vy + z * vz) / sqrt_mu;
+    alpha[l] = 2.0 / r0n[l] - (vx * vx + vy * vy + vz * vz) / mu;
+
+    // Bound orbits repeat every period, so only the time to the
+    // nearest whole period matters. That keeps z = alpha chi^2 below
+    // pi^2, however far the orbit is propagated. The number of periods
+    // is rounded by adding and subtracting 1.5 * 2^52, as floor has no
+    // vector instruction on baseline x86-64.
+    double period = 2.0 * M_PI / (sqrt_mu * alpha[l] * sqrt(fabs(alpha[l])));
+    double periods = (block->dt[l] / period + ROUNDING_SHIFTER) - ROUNDING_SHIFTER;
+    dt[l] = simd_select(simd_mask(alpha[l] > 0.0), block->dt[l] - period * periods, block->dt[l]);
+
+    // Starting guesses from Vallado, "Fundamentals of Astrodynamics and
+    // Applications", algorithm 8. Near-parabolic orbits start from the
+    // guess for a straight-line path. The hyperbolic guess needs a log,
+    // which is taken below, outside the vectorized loop.
+    double a = 1.0 / alpha[l];
+    double sign = copysign(1.0, dt[l]);
+    log_scale[l] = sign * sqrt(-a);
+    log_argument[l] = -2.0 * mu * alpha[l] * dt[l] /
+                      (rv[l] * sqrt_mu + sign * sqrt(-mu * a) * (1.0 - r0n[l] * alpha[l]));
+    double straight = sqrt_mu * dt[l] / r0n[l];
+    chi[l] = simd_select(simd_mask(alpha[l] > 0.0), sqrt_mu * alpha[l] * dt[l], straight);
+  }
+  for (int l = 0; l < L; l++) {
+    if (!(alpha[l] > 0.0)) {
+      double hyperbolic = log_scale[l] * log(log_argument[l]);
+      chi[l] = isfinite(hyperbolic) ? hyperbolic : chi[l];
+    }
+  }
+
+  // Laguerre-Conway iteration, which is far less sensitive to the
+  // starting guess than Newton's method. Lanes stop updating once
+  // converged; a lane whose step is NaN counts as converged, and one
+  // whose guess is already NaN starts out so.
+  double c0[L], c1[L], c2[L], c3[L], z[L];
+  uint64_t done[L];
+  for (int l = 0; l < L; l++) {
+    done[l] = simd_mask(chi[l] != chi[l]);
+  }
+  for (int iteration = 0; iteration < MAX_ITERATIONS; iteration++) {
+    for (int l = 0; l < L; l++) {
+      z[l] = alpha[l] * chi[l] * chi[l];
+    }
+    stumpff(z, c0, c1, c2, c3);
+
+    uint64_t all_done = ~(uint64_t)0;
+    for (int l = 0; l < L; l++) {
+      double k = 1.0 - alpha[l] * r0n[l];
+      double x = chi[l];
+      double f = rv[l] * x * x * c2[l] + k * x * x * x * c3[l] + r0n[l] * x - sqrt_mu * dt[l];
+      double df = rv[l] * x * c1[l] + k * x * x * c2[l] + r0n[l];
+      double ddf = rv[l] * c0[l] + k * x * c1[l];
+      double root = sqrt(fabs(16.0 * df * df - 20.0 * f * ddf));
+      double delta = 5.0 * f / (df + copysign(root, df));
+      double magnitude = fabs(x);
+      double scale = simd_select(simd_mask(magnitude > 1.0), magnitude, 1.0);
+      uint64_t converged = ~simd_mask(fabs(delta) > CONVERGENCE_TOLERANCE * scale);
+      chi[l] = simd_select(done[l], x, x - delta);
+      done[l] |= converged;
+      all_done &= done[l];
+    }
+    if (all_done) {
+      break;
+    }
+  }
+
+  for (int l = 0; l < L; l++) {
+    z[l] = alpha[l] * chi[l] * chi[l];
+  }
+  stumpff(z, c0, c1, c2, c3);
+
+  for (int l = 0; l < L; l++) {
+    double x = chi[l];
+    double f = 1.0 - x * x * c2[l] / r0n[l];
+    double g = dt[l] - x * x * x * c3[l] / sqrt_mu;
+    double r[3];
+    for (int d = 0; d < 3; d++) {
+      r[d] = f * block->r0[d][l] + g * block->v0[d][l];
+    }
+    double rn = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+    double fdot = -sqrt_mu * x * c1[l] / (rn * r0n[l]);
+    double gdot = 1.0 - x * x * c2[l] / rn;
+    for (int d = 0; d < 3; d++) {
+      block->r[d][l] = r[d];
+      block->v[d][l] = fdot * block->r0[d][l] + gdot * block->v0[d][l];
+    }
+  }
+}
+
+struct PropagationTask {
+  /// A run of orbits propagated to every epoch.
+  struct CartesianOrbits *orbits;
+  const double *epochs;
+  size_t n_epochs;
+  double mu;
+  struct CartesianOrbits *out;
+  size_t start;
+  size_t length;
+};
+
+static void run_propagation_task(void *arg) {
+  struct PropagationTask *task = arg;
+  struct CartesianOrbits *orbits = task->orbits;
+  struct CartesianOrbits *out = task->out;
+  double *in_columns[6] = {orbits->x.data, orbits->y.data, orbits->z.data,
+                           orbits->vx.data, orbits->vy.data, orbits->vz.data};
+  double *out_columns[6] = {out->x.data, out->y.data, out->z.data, out->vx.data, out->vy.data, out->vz.data};
+
+  struct PropagationBlock block;
+  for (size_t first = task->start; first < task->start + task->length; first += L) {
+    size_t n = task->start + task->length - first < L ? task->start + task->length - first : L;
+    // Short blocks repeat their last orbit in the spare lanes.
+    for (int l = 0; l < L; l++) {
+      size_t i = first + ((size_t)l < n ? (size_t)l : n - 1);
+      for (int d = 0; d < 3; d++) {
+        block.r0[d][l] = in_columns[d][i];
+        block.v0[d][l] = in_columns[d + 3][i];
+      }
+    }
+    for (size_t e = 0; e < task->n_epochs; e++) {
+      for (int l = 0; l < L; l++) {
+        size_t i = first + ((size_t)l < n ? (size_t)l : n - 1);
+        block.dt[l] = task->epochs[e] - orbits->t.data[i];
+      }
+      propagate_block(&block, task->mu);
+      for (size_t l = 0; l < n; l++) {
+        size_t row = (first + l) * task->n_epochs + e;
+        for (int d = 0; d < 3; d++) {
+          out_columns[d][row] = block.r[d][l];
+          out_columns[d + 3][row] = block.v[d][l];
+        }
+        out->t.data[row] = task->epochs[e];
+      }
+    }
+  }
+}
+
+enum PropagationError propagate_orbits(struct CartesianOrbits *orbits, const double *epochs, size_t n_epochs,
+                                       double mu, struct ThreadPool *pool, struct CartesianOrbits *out) {
+  INSTRUMENT_SCOPE(INSTRUMENT_PROPAGATION, orbits->x.length * n_epochs);
+  cartesian_orbits_clear(out);
+  if (!(mu > 0.0) || !isfinite(mu)) {
+    return PROPAGATION_ERROR_INVALID_ARGUMENT;
+  }
+  size_t n_orbits = orbits->x.length;
+  if (n_orbits == 0 || n_epochs == 0) {
+    return PROPAGATION_ERROR_NONE;
+  }
+  if (n_orbits > SIZE_MAX / sizeof(double) / n_epochs) {
+    return PROPAGATION_ERROR_OUT_OF_MEMORY;
+  }
+
+  size_t n = n_orbits * n_epochs;
+  struct VecF64 *columns[7] = {&out->x, &out->y, &out->z, &out->vx, &out->vy, &out->vz, &out->t};
+  for (size_t c = 0; c < 7; c++) {
+    if (vec_f64_reserve(columns[c], n) != 0) {
+      return PROPAGATION_ERROR_OUT_OF_MEMORY;
+    }
+  }
+
+  size_t n_tasks = (n_orbits + PROPAGATION_TASK_ORBITS - 1) / PROPAGATION_TASK_ORBITS;
+  struct PropagationTask *tasks = malloc(n_tasks * sizeof(struct PropagationTask));
+  if (tasks == NULL) {
+    return PROPAGATION_ERROR_OUT_OF_MEMORY;
+  }
+  for (size_t k = 0; k < n_tasks; k++) {
+    size_t start = k * PROPAGATION_TASK_ORBITS;
+    size_t length = n_orbits - start < PROPAGATION_TASK_ORBITS ? n_orbits - start : PROPAGATION_TASK_ORBITS;
+    tasks[k] = (struct PropagationTask){.orbits = orbits,
+                                        .epochs = epochs,
+                                        .n_epochs = n_epochs,
+                                        .mu = mu,
+                                        .out = out,
+                                        .start = start,
+                                        .length = length};
+  }
+
+  if (pool == NULL) {
+    for (size_t k = 0; k < n_tasks; k++) {
+      run_propagation_task(&tasks[k]);
+    }
+  } else {
+    for (size_t k = 0; k < n_tasks; k++) {
+      if (thread_pool_submit(pool, run_propagation_task, &tasks[k]) != 0) {
+        // Whatever was not queued runs here instead.
+        run_propagation_task(&tasks[k]);
+      }
+    }
+    thread_pool_wait(pool);
+  }
+
+  for (size_t c = 0; c < 7; c++) {
+    columns[c]->length = n;
+  }
+  free(tasks);
+  return PROPAGATION_ERROR_NONE;
+}
@@ -0,0 +1,66 @@
+#ifndef propagation_h
+#define propagation_h
+
+#include <stddef.h>
+
+#include "orbits.h"
+#include "thread_pool.h"
+
+/// Gravitational parameter of the sun, in AU^3 / day^2 (the square of
+/// the Gaussian gravitational constant).
+#define PROPAGATION_MU_SUN 2.959122082855911e-4
+
+/// Number of orbits whose Kepler equations are solved in lockstep. The
+/// solver's loops run across this many lanes, so the compiler can keep
+/// one orbit per vector lane.
+#define PROPAGATION_LANES 8
+
+/// Number of orbits per task in propagate_orbits.
+#define PROPAGATION_TASK_ORBITS 64
+
+/// Inputs and outputs of propagate_block: PROPAGATION_LANES orbits,
+/// one per lane, each advanced from r0 and v0 by its own dt.
+struct PropagationBlock {
+  double r0[3][PROPAGATION_LANES];
+  double v0[3][PROPAGATION_LANES];
+  double dt[PROPAGATION_LANES];
+  double r[3][PROPAGATION_LANES];
+  double v[3][PROPAGATION_LANES];
+};
+
+enum PropagationError {
+  PROPAGATION_ERROR_NONE = 0,
+  PROPAGATION_ERROR_OUT_OF_MEMORY = -1,
+  PROPAGATION_ERROR_INVALID_ARGUMENT = -2,
+};
+
+/// Propagates each of a set of orbits to each of a list of epochs
+/// under two-body motion about a central body with gravitational
+/// parameter mu (PROPAGATION_MU_SUN for heliocentric orbits).
+///
+/// Each orbit starts from its own position, velocity and t. The
+/// result is written to out, which must be initialized by the caller:
+/// row i * n_epochs + e holds orbit i at epochs[e], with t set to
+/// epochs[e]. A block of rows for one orbit is therefore a per-epoch
+/// table of projection centers, ready for cartesian_orbits_get.
+/// Whatever out held before is overwritten and its storage reused, as
+/// with the containers in projections.h. On failure out is left empty.
+///
+/// Kepler's equation is solved in universal variables, which handles
+/// elliptic, parabolic and hyperbolic orbits alike. Orbits are solved
+/// PROPAGATION_LANES at a time, and groups of PROPAGATION_TASK_ORBITS
+/// orbits run as tasks on pool; if pool is NULL, everything runs on
+/// the calling thread. Orbits whose state is degenerate (zero position,
+/// or non-finite values) produce NaN rows.
+///
+/// Returns 0 on success, or an error code on failure.
+enum PropagationError propagate_orbits(struct CartesianOrbits *orbits, const double *epochs, size_t n_epochs,
+                                       double mu, struct ThreadPool *pool, struct CartesianOrbits *out);
+
+/// Propagates every lane of block under two-body motion, writing r
+/// and v. This is the kernel behind propagate_orbits, for callers that
+/// keep their own lanes of states, such as orbit fitting. Lanes whose
+/// state is degenerate get NaN results.
+void propagate_block(struct PropagationBlock *block, double mu);
+
+#endif
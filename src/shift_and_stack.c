@@ -0,0 +1,246 @@
+#include "shift_and_stack.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "point_sources.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#define INITIAL_HITS 64
+#define TASKS_PER_THREAD 4
+
+struct ShiftStackTask {
+  /// A contiguous range of trial velocities searched by one task.
+  const double *x;
+  const double *y;
+  const double *dt;
+  size_t n_points;
+  const double *vx;
+  const double *vy;
+  size_t first;
+  size_t last;
+  struct ShiftStackParams *params;
+  uint32_t nx;
+  uint32_t ny;
+  struct ShiftStackHits hits;
+  enum ShiftStackError status;
+};
+
+void shift_stack_hits_free(struct ShiftStackHits *hits) {
+  free(hits->velocity);
+  free(hits->bin_x);
+  free(hits->bin_y);
+  free(hits->count);
+  *hits = (struct ShiftStackHits)SHIFT_STACK_HITS_ZERO;
+}
+
+static int hits_reserve(struct ShiftStackHits *hits, size_t capacity) {
+  if (capacity <= hits->capacity) {
+    return 0;
+  }
+  uint32_t *velocity = realloc(hits->velocity, capacity * sizeof(uint32_t));
+  if (velocity != NULL) {
+    hits->velocity = velocity;
+  }
+  uint32_t *bin_x = realloc(hits->bin_x, capacity * sizeof(uint32_t));
+  if (bin_x != NULL) {
+    hits->bin_x = bin_x;
+  }
+  uint32_t *bin_y = realloc(hits->bin_y, capacity * sizeof(uint32_t));
+  if (bin_y != NULL) {
+    hits->bin_y = bin_y;
+  }
+  uint32_t *count = realloc(hits->count, capacity * sizeof(uint32_t));
+  if (count != NULL) {
+    hits->count = count;
+  }
+  if (velocity == NULL || bin_x == NULL || bin_y == NULL || count == NULL) {
+    return -1;
+  }
+  hits->capacity = capacity;
+  return 0;
+}
+
+static int hits_push(struct ShiftStackHits *hits, uint32_t velocity, uint32_t bin_x, uint32_t bin_y,
+                     uint32_t count) {
+  if (hits->length == hits->capacity) {
+    if (hits_reserve(hits, hits->capacity > 0 ? hits->capacity * 2 : INITIAL_HITS) != 0) {
+      return -1;
+    }
+  }
+  hits->velocity[hits->length] = velocity;
+  hits->bin_x[hits->length] = bin_x;
+  hits->bin_y[hits->length] = bin_y;
+  hits->count[hits->length] = count;
+  hits->length++;
+  return 0;
+}
+
+// Shifts every point by one trial velocity and computes its bin, or
+// outside for points that leave the region. This is the hot loop; it
+// is branch-free so that it vectorizes.
+SIMD_TARGET_CLONES
+static void bin_points(const double *restrict x, const double *restrict y, const double *restrict dt, size_t n,
+                       double vx, double vy, double x_min, double y_min, double inv_bin_size, uint32_t nx,
+                       uint32_t ny, uint32_t outside, uint32_t *restrict bins) {
+  double nx_d = nx, ny_d = ny;
+  for (size_t i = 0; i < n; i++) {
+    double fx = (x[i] - vx * dt[i] - x_min) * inv_bin_size;
+    double fy = (y[i] - vy * dt[i] - y_min) * inv_bin_size;
+    int inside = (fx >= 0.0) & (fx < nx_d) & (fy >= 0.0) & (fy < ny_d);
+    // Clamp before converting, since converting an out of range value
+    // is undefined. Truncation is floor for non-negative values.
+    int32_t ix = (int32_t)(inside ? fx : 0.0);
+    int32_t iy = (int32_t)(inside ? fy : 0.0);
+    bins[i] = inside ? (uint32_t)iy * nx + (uint32_t)ix : outside;
+  }
+}
+
+static void run_shift_stack_task(void *arg) {
+  struct ShiftStackTask *task = arg;
+  struct ShiftStackParams *params = task->params;
+  uint32_t nx = task->nx, ny = task->ny;
+  uint32_t outside = nx * ny;
+
+  // One extra counter absorbs the points that left the region.
+  uint32_t *counts = calloc((size_t)outside + 1, sizeof(uint32_t));
+  uint32_t *bins = malloc((task->n_points > 0 ? task->n_points : 1) * sizeof(uint32_t));
+  if (counts == NULL || bins == NULL) {
+    task->status = SHIFT_STACK_ERROR_OUT_OF_MEMORY;
+    goto done;
+  }
+
+  double inv_bin_size = 1.0 / params->bin_size;
+  for (size_t k = task->first; k < task->last; k++) {
+    bin_points(task->x, task->y, task->dt, task->n_points, task->vx[k], task->vy[k], params->x_min, params->y_min,
+               inv_bin_size, nx, ny, outside, bins);
+    for (size_t i = 0; i < task->n_points; i++) {
+      counts[bins[i]]++;
+    }
+    counts[outside] = 0;
+
+    // Visit only the bins that points landed in, instead of the whole
+    // grid. Clearing each bin on its first visit both deduplicates the
+    // output and leaves the grid zeroed for the next velocity.
+    for (size_t i = 0; i < task->n_points; i++) {
+      uint32_t bin = bins[i];
+      uint32_t count = counts[bin];
+      if (count >= params->min_count && count > 0) {
+        if (hits_push(&task->hits, (uint32_t)k, bin % nx, bin / nx, count) != 0) {
+          task->status = SHIFT_STACK_ERROR_OUT_OF_MEMORY;
+          goto done;
+        }
+      }
+      counts[bin] = 0;
+    }
+  }
+
+done:
+  free(counts);
+  free(bins);
+}
+
+enum ShiftStackError shift_and_stack(struct GnomonicPointSources *gnomonic, const double *vx, const double *vy,
+                                     size_t n_velocities, struct ShiftStackParams *params, struct ThreadPool *pool,
+                                     struct ShiftStackHits *hits) {
+  *hits = (struct ShiftStackHits)SHIFT_STACK_HITS_ZERO;
+  if (!(params->bin_size > 0) || !(params->x_max > params->x_min) || !(params->y_max > params->y_min) ||
+      n_velocities >= UINT32_MAX) {
+    return SHIFT_STACK_ERROR_INVALID_ARGUMENT;
+  }
+  double nx_d = ceil((params->x_max - params->x_min) / params->bin_size);
+  double ny_d = ceil((params->y_max - params->y_min) / params->bin_size);
+  if (nx_d * ny_d >= (double)UINT32_MAX || nx_d >= INT32_MAX || ny_d >= INT32_MAX) {
+    return SHIFT_STACK_ERROR_INVALID_ARGUMENT;
+  }
+  if (n_velocities == 0) {
+    return SHIFT_STACK_ERROR_NONE;
+  }
+
+  // Time offsets are shared by every velocity, so compute them once.
+  size_t n_points = gnomonic->x.length;
+  double *dt = malloc((n_points > 0 ? n_points : 1) * sizeof(double));
+  if (dt == NULL) {
+    return SHIFT_STACK_ERROR_OUT_OF_MEMORY;
+  }
+  for (size_t i = 0; i < n_points; i++) {
+    dt[i] = gnomonic->t.data[i] - params->t0;
+  }
+
+  size_t n_tasks = pool == NULL ? 1 : pool->n_threads * TASKS_PER_THREAD;
+  if (n_tasks > n_velocities) {
+    n_tasks = n_velocities;
+  }
+  struct ShiftStackTask *tasks = calloc(n_tasks, sizeof(struct ShiftStackTask));
+  if (tasks == NULL) {
+    free(dt);
+    return SHIFT_STACK_ERROR_OUT_OF_MEMORY;
+  }
+
+  for (size_t i = 0; i < n_tasks; i++) {
+    tasks[i] = (struct ShiftStackTask){.x = gnomonic->x.data,
+                                       .y = gnomonic->y.data,
+                                       .dt = dt,
+                                       .n_points = n_points,
+                                       .vx = vx,
+                                       .vy = vy,
+                                       .first = n_velocities * i / n_tasks,
+                                       .last = n_velocities * (i + 1) / n_tasks,
+                                       .params = params,
+                                       .nx = (uint32_t)nx_d,
+                                       .ny = (uint32_t)ny_d,
+                                       .hits = SHIFT_STACK_HITS_ZERO,
+                                       .status = SHIFT_STACK_ERROR_NONE};
+  }
+  if (pool == NULL) {
+    for (size_t i = 0; i < n_tasks; i++) {
+      run_shift_stack_task(&tasks[i]);
+    }
+  } else {
+    for (size_t i = 0; i < n_tasks; i++) {
+      if (thread_pool_submit(pool, run_shift_stack_task, &tasks[i]) != 0) {
+        run_shift_stack_task(&tasks[i]);
+      }
+    }
+    thread_pool_wait(pool);
+  }
+
+  // Tasks cover increasing velocity ranges, so concatenating their hits
+  // in task order keeps the result ordered by velocity.
+  enum ShiftStackError status = SHIFT_STACK_ERROR_NONE;
+  size_t total = 0;
+  for (size_t i = 0; i < n_tasks; i++) {
+    if (tasks[i].status != SHIFT_STACK_ERROR_NONE) {
+      status = tasks[i].status;
+    }
+    total += tasks[i].hits.length;
+  }
+  if (status == SHIFT_STACK_ERROR_NONE && hits_reserve(hits, total > 0 ? total : 1) != 0) {
+    status = SHIFT_STACK_ERROR_OUT_OF_MEMORY;
+  }
+  if (status == SHIFT_STACK_ERROR_NONE) {
+    for (size_t i = 0; i < n_tasks; i++) {
+      struct ShiftStackHits *part = &tasks[i].hits;
+      if (part->length == 0) {
+        continue;
+      }
+      memcpy(hits->velocity + hits->length, part->velocity, part->length * sizeof(uint32_t));
+      memcpy(hits->bin_x + hits->length, part->bin_x, part->length * sizeof(uint32_t));
+      memcpy(hits->bin_y + hits->length, part->bin_y, part->length * sizeof(uint32_t));
+      memcpy(hits->count + hits->length, part->count, part->length * sizeof(uint32_t));
+      hits->length += part->length;
+    }
+  } else {
+    shift_stack_hits_free(hits);
+  }
+
+  for (size_t i = 0; i < n_tasks; i++) {
+    shift_stack_hits_free(&tasks[i].hits);
+  }
+  free(tasks);
+  free(dt);
+  return status;
+}
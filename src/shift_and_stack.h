@@ -0,0 +1,66 @@
+#ifndef shift_and_stack_h
+#define shift_and_stack_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "point_sources.h"
+#include "thread_pool.h"
+
+enum ShiftStackError {
+  SHIFT_STACK_ERROR_NONE = 0,
+  SHIFT_STACK_ERROR_INVALID_ARGUMENT = -1,
+  SHIFT_STACK_ERROR_OUT_OF_MEMORY = -2,
+};
+
+struct ShiftStackParams {
+  /// Reference time (MJD) at which shifted points are compared.
+  double t0;
+  /// Edge length of a square bin, in degrees.
+  double bin_size;
+  /// Region binned after shifting, in degrees. Points that land
+  /// outside it are not counted.
+  double x_min;
+  double x_max;
+  double y_min;
+  double y_max;
+  /// Minimum number of points for a bin to be reported.
+  uint32_t min_count;
+};
+
+struct ShiftStackHits {
+  /// Bins that reached the threshold, one row per bin, ordered by
+  /// velocity index. Bin (0, 0) is the one whose corner is at
+  /// (x_min, y_min).
+  size_t length;
+  size_t capacity;
+  uint32_t *velocity;  // Index into the velocity grid.
+  uint32_t *bin_x;
+  uint32_t *bin_y;
+  uint32_t *count;
+};
+
+#define SHIFT_STACK_HITS_ZERO {.length = 0, .capacity = 0, .velocity = NULL, .bin_x = NULL, .bin_y = NULL, .count = NULL}
+
+void shift_stack_hits_free(struct ShiftStackHits *hits);
+
+/// Searches for linear motion by shift and stack.
+///
+/// For each trial velocity (vx[k], vy[k]), in degrees per day, every
+/// gnomonic point is moved to (x - vx * (t - t0), y - vy * (t - t0))
+/// and counted into a grid of square bins. Bins holding at least
+/// min_count points are appended to hits.
+///
+/// Velocities are split across pool; if pool is NULL everything runs
+/// on the calling thread. Each concurrently running task keeps a dense
+/// count grid of 4 bytes per bin, so the bin size and region should be
+/// chosen with memory in mind.
+///
+/// hits must be zeroed or freed; it is overwritten.
+///
+/// Returns 0 on success, or an error code on failure.
+enum ShiftStackError shift_and_stack(struct GnomonicPointSources *gnomonic, const double *vx, const double *vy,
+                                     size_t n_velocities, struct ShiftStackParams *params, struct ThreadPool *pool,
+                                     struct ShiftStackHits *hits);
+
+#endif
@@ -0,0 +1,48 @@
+#include "simd.h"
+
+static int detected_level = -1;
+
+static enum SimdLevel detect(void) {
+#if defined(__x86_64__) && defined(__GNUC__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return SIMD_LEVEL_AVX512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return SIMD_LEVEL_AVX2;
+  }
+  // SSE2 is part of the x86-64 baseline.
+  return SIMD_LEVEL_SSE2;
+#else
+  return SIMD_LEVEL_SCALAR;
+#endif
+}
+
+enum SimdLevel simd_level_detect(void) {
+  // Detection is idempotent, so concurrent first calls only repeat the
+  // same work. The cached level is read and written atomically, and
+  // nothing else is published through it, so relaxed ordering is
+  // enough.
+  int level = __atomic_load_n(&detected_level, __ATOMIC_RELAXED);
+  if (level < 0) {
+    level = detect();
+    __atomic_store_n(&detected_level, level, __ATOMIC_RELAXED);
+  }
+  return (enum SimdLevel)level;
+}
+
+int simd_level_supported(enum SimdLevel level) { return level >= SIMD_LEVEL_SCALAR && level <= simd_level_detect(); }
+
+const char *simd_level_name(enum SimdLevel level) {
+  switch (level) {
+    case SIMD_LEVEL_SCALAR:
+      return "scalar";
+    case SIMD_LEVEL_SSE2:
+      return "sse2";
+    case SIMD_LEVEL_AVX2:
+      return "avx2";
+    case SIMD_LEVEL_AVX512:
+      return "avx512";
+  }
+  return "unknown";
+}
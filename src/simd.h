@@ -0,0 +1,66 @@
+#ifndef simd_h
+#define simd_h
+
+#include <stdint.h>
+#include <string.h>
+
+/// Instruction set levels that cthor ships hand-vectorized kernels for,
+/// ordered from narrowest to widest.
+enum SimdLevel {
+  SIMD_LEVEL_SCALAR = 0,
+  SIMD_LEVEL_SSE2 = 1,
+  SIMD_LEVEL_AVX2 = 2,
+  SIMD_LEVEL_AVX512 = 3,
+};
+
+#define SIMD_LEVEL_COUNT 4
+
+/// Marks a function whose loops are written for the auto-vectorizer.
+/// On x86-64 the compiler emits AVX-512, AVX2 and baseline versions of
+/// it and picks one at load time for the running CPU.
+#if defined(__x86_64__) && defined(__GNUC__) && defined(__linux__)
+#define SIMD_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define SIMD_TARGET_CLONES
+#endif
+
+/// Lane masks and selects for loops written for the auto-vectorizer. A
+/// ternary between computed doubles can be compiled into branches the
+/// vectorizer cannot if-convert, and a mask made by converting a
+/// comparison to a 64-bit integer has no vector type on baseline
+/// x86-64, which lacks 64-bit integer compares. simd_mask makes the
+/// mask as a double instead, as the compare instructions themselves
+/// do, and simd_select blends bit for bit.
+static inline uint64_t simd_mask(int condition) {
+  uint64_t ones = ~(uint64_t)0;
+  double all_ones;
+  memcpy(&all_ones, &ones, sizeof(all_ones));
+  double mask = condition ? all_ones : 0.0;
+  uint64_t bits;
+  memcpy(&bits, &mask, sizeof(bits));
+  return bits;
+}
+
+/// Returns if_true in the lanes where mask is set, and if_false where
+/// it is clear.
+static inline double simd_select(uint64_t mask, double if_true, double if_false) {
+  uint64_t t, f;
+  memcpy(&t, &if_true, sizeof(t));
+  memcpy(&f, &if_false, sizeof(f));
+  uint64_t bits = (t & mask) | (f & ~mask);
+  double result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+/// Returns the widest instruction set level supported by the running
+/// CPU (and operating system). The result is computed once and cached.
+enum SimdLevel simd_level_detect(void);
+
+/// Returns 1 if the running CPU supports the given level, 0 otherwise.
+int simd_level_supported(enum SimdLevel level);
+
+/// Returns a short human-readable name for a level, e.g. "avx2".
+const char *simd_level_name(enum SimdLevel level);
+
+#endif
@@ -0,0 +1,383 @@
+#include "sky_index.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "point_sources.h"
+
+#define DEG_TO_RAD (M_PI / 180.0)
+
+// Slack on cone tests, so that rounding never drops a cell that just
+// touches the cone.
+#define CONE_EPSILON 1E-12
+
+static uint32_t face_coordinate(double u, uint32_t resolution) {
+  double f = (u + 1.0) * 0.5 * resolution;
+  if (!(f > 0.0)) {
+    return 0;
+  }
+  uint32_t i = (uint32_t)f;
+  return i < resolution ? i : resolution - 1;
+}
+
+static uint32_t cell_of(uint32_t resolution, double x, double y, double z) {
+  // The face is the cube face the direction exits through; u and v
+  // are the coordinates where it crosses that face, in [-1, 1].
+  double ax = fabs(x), ay = fabs(y), az = fabs(z);
+  uint32_t axis;
+  double major, u, v;
+  if (ax >= ay && ax >= az) {
+    axis = 0, major = x, u = y, v = z;
+  } else if (ay >= az) {
+    axis = 1, major = y, u = z, v = x;
+  } else {
+    axis = 2, major = z, u = x, v = y;
+  }
+  uint32_t face = axis * 2 + (major < 0.0);
+  double inv = 1.0 / fabs(major);
+  uint32_t i = face_coordinate(u * inv, resolution);
+  uint32_t j = face_coordinate(v * inv, resolution);
+  return (face * resolution + i) * resolution + j;
+}
+
+// The unit vector through face coordinates (u, v) of a face.
+static void face_point(uint32_t face, double u, double v, double out[3]) {
+  uint32_t axis = face / 2;
+  out[axis] = face % 2 == 0 ? 1.0 : -1.0;
+  out[(axis + 1) % 3] = u;
+  out[(axis + 2) % 3] = v;
+  double norm = sqrt(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
+  out[0] /= norm;
+  out[1] /= norm;
+  out[2] /= norm;
+}
+
+static void cell_geometry(struct SkyIndex *index) {
+  uint32_t resolution = index->resolution;
+  double step = 2.0 / resolution;
+  for (size_t c = 0; c < index->n_cells; c++) {
+    uint32_t face = (uint32_t)(c / ((size_t)resolution * resolution));
+    uint32_t i = (uint32_t)(c / resolution % resolution);
+    uint32_t j = (uint32_t)(c % resolution);
+    double u0 = -1.0 + i * step, v0 = -1.0 + j * step;
+
+    double *center = index->cell_centers + 3 * c;
+    face_point(face, u0 + 0.5 * step, v0 + 0.5 * step, center);
+
+    // Cell edges are great circles, so the farthest point of the cell
+    // from its center is a corner.
+    double min_cos = 1.0;
+    for (int corner = 0; corner < 4; corner++) {
+      double p[3];
+      face_point(face, u0 + (corner & 1) * step, v0 + (corner >> 1) * step, p);
+      double cos_angle = center[0] * p[0] + center[1] * p[1] + center[2] * p[2];
+      if (cos_angle < min_cos) {
+        min_cos = cos_angle;
+      }
+    }
+    index->cell_cos_radius[c] = min_cos;
+    index->cell_sin_radius[c] = sqrt(fmax(0.0, 1.0 - min_cos * min_cos));
+  }
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static size_t find_epoch(const double *epochs, size_t n_epochs, double t) {
+  size_t lo = 0, hi = n_epochs;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (epochs[mid] < t) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static int is_indexable(struct CartesianPointSources *cartesian, size_t i) {
+  double x = cartesian->x.data[i], y = cartesian->y.data[i], z = cartesian->z.data[i];
+  return isfinite(x) && isfinite(y) && isfinite(z) && isfinite(cartesian->t.data[i]) &&
+         (x != 0.0 || y != 0.0 || z != 0.0);
+}
+
+void sky_index_free(struct SkyIndex *index) {
+  cartesian_point_sources_free(&index->points);
+  free(index->rows);
+  free(index->epochs);
+  free(index->epoch_start);
+  free(index->cell_ids);
+  free(index->cell_start);
+  free(index->cell_centers);
+  free(index->cell_cos_radius);
+  free(index->cell_sin_radius);
+  *index = (struct SkyIndex)SKY_INDEX_ZERO;
+}
+
+enum SkyIndexError sky_index_new(struct SkyIndex *index, struct CartesianPointSources *cartesian,
+                                 uint32_t resolution) {
+  *index = (struct SkyIndex)SKY_INDEX_ZERO;
+  // Cell ids must fit in 32 bits.
+  if (resolution == 0 || resolution > 16384) {
+    return SKY_INDEX_ERROR_INVALID_ARGUMENT;
+  }
+  size_t n_input = cartesian->x.length;
+  if (n_input >= UINT32_MAX) {
+    return SKY_INDEX_ERROR_TOO_MANY_POINTS;
+  }
+
+  enum SkyIndexError status = SKY_INDEX_ERROR_OUT_OF_MEMORY;
+  uint32_t *valid = NULL, *epoch_of = NULL, *cell = NULL, *by_cell = NULL, *order = NULL;
+  size_t *counts = NULL;
+
+  index->resolution = resolution;
+  index->n_cells = 6 * (size_t)resolution * resolution;
+  index->cell_centers = malloc(3 * index->n_cells * sizeof(double));
+  index->cell_cos_radius = malloc(index->n_cells * sizeof(double));
+  index->cell_sin_radius = malloc(index->n_cells * sizeof(double));
+  if (index->cell_centers == NULL || index->cell_cos_radius == NULL || index->cell_sin_radius == NULL) {
+    goto fail;
+  }
+  cell_geometry(index);
+
+  // Distinct epochs of the indexable detections.
+  valid = malloc((n_input + 1) * sizeof(uint32_t));
+  index->epochs = malloc((n_input + 1) * sizeof(double));
+  if (valid == NULL || index->epochs == NULL) {
+    goto fail;
+  }
+  size_t n = 0;
+  for (size_t i = 0; i < n_input; i++) {
+    if (is_indexable(cartesian, i)) {
+      valid[n] = (uint32_t)i;
+      index->epochs[n] = cartesian->t.data[i];
+      n++;
+    }
+  }
+  qsort(index->epochs, n, sizeof(double), compare_doubles);
+  size_t n_epochs = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (n_epochs == 0 || index->epochs[i] != index->epochs[n_epochs - 1]) {
+      index->epochs[n_epochs++] = index->epochs[i];
+    }
+  }
+  index->n_epochs = n_epochs;
+
+  // Key every detection by (epoch, cell). Detections usually arrive
+  // grouped by exposure, so the epoch search is mostly skipped.
+  epoch_of = malloc((n + 1) * sizeof(uint32_t));
+  cell = malloc((n + 1) * sizeof(uint32_t));
+  if (epoch_of == NULL || cell == NULL) {
+    goto fail;
+  }
+  size_t epoch = 0;
+  for (size_t k = 0; k < n; k++) {
+    size_t i = valid[k];
+    double t = cartesian->t.data[i];
+    if (index->epochs[epoch] != t) {
+      epoch = find_epoch(index->epochs, n_epochs, t);
+    }
+    epoch_of[k] = (uint32_t)epoch;
+    cell[k] = cell_of(resolution, cartesian->x.data[i], cartesian->y.data[i], cartesian->z.data[i]);
+  }
+
+  // Sort by cell, then stably by epoch: two counting passes.
+  size_t n_counts = index->n_cells > n_epochs ? index->n_cells : n_epochs;
+  counts = malloc((n_counts + 1) * sizeof(size_t));
+  by_cell = malloc((n + 1) * sizeof(uint32_t));
+  order = malloc((n + 1) * sizeof(uint32_t));
+  if (counts == NULL || by_cell == NULL || order == NULL) {
+    goto fail;
+  }
+  memset(counts, 0, (index->n_cells + 1) * sizeof(size_t));
+  for (size_t k = 0; k < n; k++) {
+    counts[cell[k] + 1]++;
+  }
+  for (size_t c = 0; c < index->n_cells; c++) {
+    counts[c + 1] += counts[c];
+  }
+  for (size_t k = 0; k < n; k++) {
+    by_cell[counts[cell[k]]++] = (uint32_t)k;
+  }
+  memset(counts, 0, (n_epochs + 1) * sizeof(size_t));
+  for (size_t k = 0; k < n; k++) {
+    counts[epoch_of[k] + 1]++;
+  }
+  for (size_t e = 0; e < n_epochs; e++) {
+    counts[e + 1] += counts[e];
+  }
+  for (size_t k = 0; k < n; k++) {
+    uint32_t m = by_cell[k];
+    order[counts[epoch_of[m]]++] = m;
+  }
+
+  // Copy the detections out in sorted order.
+  if (cartesian_point_sources_new(&index->points, n > 0 ? n : 1) != 0) {
+    goto fail;
+  }
+  index->rows = malloc((n + 1) * sizeof(uint32_t));
+  if (index->rows == NULL) {
+    goto fail;
+  }
+  for (size_t k = 0; k < n; k++) {
+    size_t i = valid[order[k]];
+    index->rows[k] = (uint32_t)i;
+    index->points.x.data[k] = cartesian->x.data[i];
+    index->points.y.data[k] = cartesian->y.data[i];
+    index->points.z.data[k] = cartesian->z.data[i];
+    index->points.t.data[k] = cartesian->t.data[i];
+  }
+  index->points.x.length = n;
+  index->points.y.length = n;
+  index->points.z.length = n;
+  index->points.t.length = n;
+
+  // Directory of non-empty cells per epoch.
+  size_t n_runs = 0;
+  for (size_t k = 0; k < n; k++) {
+    n_runs += k == 0 || epoch_of[order[k]] != epoch_of[order[k - 1]] || cell[order[k]] != cell[order[k - 1]];
+  }
+  index->epoch_start = malloc((n_epochs + 1) * sizeof(size_t));
+  index->cell_ids = malloc((n_runs + 1) * sizeof(uint32_t));
+  index->cell_start = malloc((n_runs + 1) * sizeof(size_t));
+  if (index->epoch_start == NULL || index->cell_ids == NULL || index->cell_start == NULL) {
+    goto fail;
+  }
+  size_t run = 0;
+  for (size_t k = 0; k < n; k++) {
+    uint32_t e = epoch_of[order[k]];
+    int new_epoch = k == 0 || e != epoch_of[order[k - 1]];
+    if (new_epoch || cell[order[k]] != cell[order[k - 1]]) {
+      if (new_epoch) {
+        index->epoch_start[e] = run;
+      }
+      index->cell_ids[run] = cell[order[k]];
+      index->cell_start[run] = k;
+      run++;
+    }
+  }
+  index->epoch_start[n_epochs] = n_runs;
+  index->cell_start[n_runs] = n;
+
+  status = SKY_INDEX_ERROR_NONE;
+  goto done;
+
+fail:
+  sky_index_free(index);
+done:
+  free(valid);
+  free(epoch_of);
+  free(cell);
+  free(counts);
+  free(by_cell);
+  free(order);
+  return status;
+}
+
+uint32_t sky_index_cell(const struct SkyIndex *index, const double direction[3]) {
+  return cell_of(index->resolution, direction[0], direction[1], direction[2]);
+}
+
+size_t sky_index_cone_cells(const struct SkyIndex *index, const double direction[3], double radius,
+                            uint32_t *cells) {
+  double norm = sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+  if (!(radius >= 0.0) || !(norm > 0.0) || !isfinite(norm)) {
+    return 0;
+  }
+  double d[3] = {direction[0] / norm, direction[1] / norm, direction[2] / norm};
+  double r = fmin(radius * DEG_TO_RAD, M_PI);
+  double cos_r = cos(r), sin_r = sin(r);
+
+  // A cell overlaps the cone if the angle from its center to the
+  // cone's axis is at most r plus the cell's radius R, which in
+  // cosines is cos(angle) >= cos(r + R), unless r + R reaches pi.
+  size_t n = 0;
+  for (size_t c = 0; c < index->n_cells; c++) {
+    const double *center = index->cell_centers + 3 * c;
+    double cos_angle = center[0] * d[0] + center[1] * d[1] + center[2] * d[2];
+    double cos_R = index->cell_cos_radius[c];
+    double cos_sum = cos_r * cos_R - sin_r * index->cell_sin_radius[c];
+    if (cos_R <= -cos_r || cos_angle >= cos_sum - CONE_EPSILON) {
+      cells[n++] = (uint32_t)c;
+    }
+  }
+  return n;
+}
+
+void sky_index_runs_free(struct SkyIndexRuns *runs) {
+  free(runs->start);
+  free(runs->end);
+  *runs = (struct SkyIndexRuns)SKY_INDEX_RUNS_ZERO;
+}
+
+static int runs_push(struct SkyIndexRuns *runs, size_t start, size_t end) {
+  if (runs->length > 0 && runs->end[runs->length - 1] == start) {
+    runs->end[runs->length - 1] = end;
+    return 0;
+  }
+  if (runs->length == runs->capacity) {
+    size_t capacity = runs->capacity > 0 ? runs->capacity * 2 : 16;
+    size_t *new_start = realloc(runs->start, capacity * sizeof(size_t));
+    if (new_start == NULL) {
+      return -1;
+    }
+    runs->start = new_start;
+    size_t *new_end = realloc(runs->end, capacity * sizeof(size_t));
+    if (new_end == NULL) {
+      return -1;
+    }
+    runs->end = new_end;
+    runs->capacity = capacity;
+  }
+  runs->start[runs->length] = start;
+  runs->end[runs->length] = end;
+  runs->length++;
+  return 0;
+}
+
+enum SkyIndexError sky_index_query(const struct SkyIndex *index, size_t first_epoch, size_t last_epoch,
+                                   const double direction[3], double radius, struct SkyIndexRuns *runs) {
+  if (last_epoch > index->n_epochs) {
+    last_epoch = index->n_epochs;
+  }
+  if (first_epoch >= last_epoch) {
+    return SKY_INDEX_ERROR_NONE;
+  }
+  uint32_t *cells = malloc(index->n_cells * sizeof(uint32_t));
+  if (cells == NULL) {
+    return SKY_INDEX_ERROR_OUT_OF_MEMORY;
+  }
+  size_t n_cells = sky_index_cone_cells(index, direction, radius, cells);
+
+  enum SkyIndexError status = SKY_INDEX_ERROR_NONE;
+  for (size_t e = first_epoch; e < last_epoch && status == SKY_INDEX_ERROR_NONE; e++) {
+    // Both the cone's cells and the epoch's cells are ascending, so
+    // each search starts where the last one ended.
+    size_t lo = index->epoch_start[e], end = index->epoch_start[e + 1];
+    for (size_t q = 0; q < n_cells && lo < end; q++) {
+      size_t hi = end;
+      while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index->cell_ids[mid] < cells[q]) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      if (lo < end && index->cell_ids[lo] == cells[q]) {
+        if (runs_push(runs, index->cell_start[lo], index->cell_start[lo + 1]) != 0) {
+          status = SKY_INDEX_ERROR_OUT_OF_MEMORY;
+          break;
+        }
+        lo++;
+      }
+    }
+  }
+  free(cells);
+  return status;
+}
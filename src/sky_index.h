@@ -0,0 +1,106 @@
+#ifndef sky_index_h
+#define sky_index_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "point_sources.h"
+
+/// A sky index buckets Cartesian detections by exposure epoch and by
+/// the sky cell their direction from the origin falls in, so that a
+/// projection only has to visit the detections near its line of sight.
+///
+/// The sky is divided by projecting it onto the faces of a cube
+/// centered at the origin; each face is split into resolution x
+/// resolution cells. Cell c lies on face c / (resolution *
+/// resolution). Cells are not of equal area, but vary by less than a
+/// factor of 3 (larger near the face centers), and their edges are
+/// great circles, which keeps cone tests simple and exact.
+
+#define SKY_INDEX_DEFAULT_RESOLUTION 16
+
+enum SkyIndexError {
+  SKY_INDEX_ERROR_NONE = 0,
+  SKY_INDEX_ERROR_INVALID_ARGUMENT = -1,
+  SKY_INDEX_ERROR_OUT_OF_MEMORY = -2,
+  SKY_INDEX_ERROR_TOO_MANY_POINTS = -3,
+};
+
+struct SkyIndex {
+  /// The detections, reordered by (epoch, cell), and the row each came
+  /// from in the indexed container. Detections with a non-finite or
+  /// zero position are left out.
+  struct CartesianPointSources points;
+  uint32_t *rows;
+
+  uint32_t resolution;
+  size_t n_cells;
+
+  /// Distinct epochs, ascending. The non-empty cells of epoch e are
+  /// cell_ids[epoch_start[e]] through cell_ids[epoch_start[e + 1] - 1],
+  /// ascending, and the detections of the k-th non-empty cell are
+  /// points[cell_start[k]] through points[cell_start[k + 1] - 1].
+  size_t n_epochs;
+  double *epochs;
+  size_t *epoch_start;
+  uint32_t *cell_ids;
+  size_t *cell_start;
+
+  /// Per-cell geometry for cone tests: the unit vector to each cell's
+  /// center, and the cosine and sine of the angle from the center to
+  /// the cell's farthest corner.
+  double *cell_centers;  // 3 * n_cells
+  double *cell_cos_radius;
+  double *cell_sin_radius;
+};
+
+#define SKY_INDEX_ZERO                                                                                        \
+  {.points = CARTESIAN_POINT_SOURCES_ZERO, .rows = NULL, .resolution = 0, .n_cells = 0, .n_epochs = 0,        \
+   .epochs = NULL, .epoch_start = NULL, .cell_ids = NULL, .cell_start = NULL, .cell_centers = NULL,           \
+   .cell_cos_radius = NULL, .cell_sin_radius = NULL}
+
+/// Builds an index over cartesian, which is copied and may be freed
+/// afterwards. Detections with exactly equal t share an epoch.
+///
+/// index must be zeroed or freed; it is overwritten.
+///
+/// Returns 0 on success, or an error code on failure.
+enum SkyIndexError sky_index_new(struct SkyIndex *index, struct CartesianPointSources *cartesian,
+                                 uint32_t resolution);
+void sky_index_free(struct SkyIndex *index);
+
+/// Returns the cell a direction falls in. The direction need not be
+/// normalized, but must be finite and nonzero.
+uint32_t sky_index_cell(const struct SkyIndex *index, const double direction[3]);
+
+/// Writes the ids of every cell that comes within radius (in degrees)
+/// of direction to cells, which must have room for index->n_cells ids,
+/// in ascending order. Returns the number of ids written.
+size_t sky_index_cone_cells(const struct SkyIndex *index, const double direction[3], double radius,
+                            uint32_t *cells);
+
+struct SkyIndexRuns {
+  /// Ranges of the index's reordered points, [start[i], end[i]).
+  size_t length;
+  size_t capacity;
+  size_t *start;
+  size_t *end;
+};
+
+#define SKY_INDEX_RUNS_ZERO {.length = 0, .capacity = 0, .start = NULL, .end = NULL}
+
+void sky_index_runs_free(struct SkyIndexRuns *runs);
+
+/// Appends to runs the ranges of detections from epochs first_epoch
+/// through last_epoch - 1 that lie in cells within radius (in degrees)
+/// of direction. Ranges come out in (epoch, cell) order, with adjacent
+/// ranges merged.
+///
+/// The result is a superset of the detections within radius: every
+/// detection of a cell that overlaps the cone is included.
+///
+/// Returns 0 on success, or an error code on failure.
+enum SkyIndexError sky_index_query(const struct SkyIndex *index, size_t first_epoch, size_t last_epoch,
+                                   const double direction[3], double radius, struct SkyIndexRuns *runs);
+
+#endif
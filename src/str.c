@@ -30,3 +30,7 @@ void string_free(struct String *string) {
     string->data = NULL;
   }
 }
+
+int string_equal(const struct String *a, const struct String *b) {
+  return a->length == b->length && memcmp(a->data, b->data, a->length) == 0;
+}
@@ -11,6 +11,8 @@ struct String {
 int string_new(struct String *string, size_t length);
 struct String string_create(const char *data);
 void string_free(struct String *string);
+/// Returns 1 if the two strings hold the same bytes, 0 otherwise.
+int string_equal(const struct String *a, const struct String *b);
 
 #endif
 
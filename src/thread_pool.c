@@ -0,0 +1,371 @@
+// For pthread_attr_setaffinity_np and the CPU_* macros.
+#define _GNU_SOURCE
+
+#include "thread_pool.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define INITIAL_QUEUE_CAPACITY 64
+
+struct WorkerArgs {
+  struct ThreadPool *pool;
+  size_t index;
+  size_t node;
+};
+
+// Identifies the pool and queue of the worker running on this thread,
+// so that tasks can submit more tasks to their own queue.
+static _Thread_local struct ThreadPool *current_pool = NULL;
+static _Thread_local size_t current_index = 0;
+
+static int queue_new(struct ThreadPoolQueue *queue) {
+  queue->head = 0;
+  queue->length = 0;
+  queue->capacity = INITIAL_QUEUE_CAPACITY;
+  queue->tasks = malloc(queue->capacity * sizeof(struct ThreadPoolTask));
+  if (queue->tasks == NULL) {
+    return -1;
+  }
+  pthread_mutex_init(&queue->lock, NULL);
+  return 0;
+}
+
+static void queue_free(struct ThreadPoolQueue *queue) {
+  pthread_mutex_destroy(&queue->lock);
+  free(queue->tasks);
+  queue->tasks = NULL;
+}
+
+static int queue_push_back(struct ThreadPoolQueue *queue, struct ThreadPoolTask task) {
+  pthread_mutex_lock(&queue->lock);
+  if (queue->length == queue->capacity) {
+    // Grow, and unwrap the ring so the live tasks start at index 0.
+    size_t capacity = queue->capacity * 2;
+    struct ThreadPoolTask *tasks = malloc(capacity * sizeof(struct ThreadPoolTask));
+    if (tasks == NULL) {
+      pthread_mutex_unlock(&queue->lock);
+      return -1;
+    }
+    for (size_t i = 0; i < queue->length; i++) {
+      tasks[i] = queue->tasks[(queue->head + i) % queue->capacity];
+    }
+    free(queue->tasks);
+    queue->tasks = tasks;
+    queue->capacity = capacity;
+    queue->head = 0;
+  }
+  queue->tasks[(queue->head + queue->length) % queue->capacity] = task;
+  queue->length++;
+  pthread_mutex_unlock(&queue->lock);
+  return 0;
+}
+
+static int queue_pop_back(struct ThreadPoolQueue *queue, struct ThreadPoolTask *task) {
+  int found = 0;
+  pthread_mutex_lock(&queue->lock);
+  if (queue->length > 0) {
+    queue->length--;
+    *task = queue->tasks[(queue->head + queue->length) % queue->capacity];
+    found = 1;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return found;
+}
+
+static int queue_pop_front(struct ThreadPoolQueue *queue, struct ThreadPoolTask *task) {
+  int found = 0;
+  pthread_mutex_lock(&queue->lock);
+  if (queue->length > 0) {
+    *task = queue->tasks[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->length--;
+    found = 1;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return found;
+}
+
+static int find_task(struct ThreadPool *pool, size_t index, size_t node, struct ThreadPoolTask *task) {
+  // Newest local work first, since it is most likely to be in cache.
+  if (queue_pop_back(&pool->queues[index], task)) {
+    return 1;
+  }
+  // Otherwise steal the oldest work from the other workers, starting
+  // with those on the same node, whose tasks' data is local here too.
+  size_t first = pool->node_offsets[node], n_local = pool->node_offsets[node + 1] - first;
+  for (size_t k = 1; k < n_local; k++) {
+    if (queue_pop_front(&pool->queues[first + (index - first + k) % n_local], task)) {
+      return 1;
+    }
+  }
+  for (size_t k = 1; k < pool->n_threads; k++) {
+    size_t victim = (index + k) % pool->n_threads;
+    if ((victim < first || victim >= first + n_local) && queue_pop_front(&pool->queues[victim], task)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void *worker_main(void *arg) {
+  struct WorkerArgs *worker = arg;
+  struct ThreadPool *pool = worker->pool;
+  size_t index = worker->index;
+  size_t node = worker->node;
+  free(worker);
+
+  current_pool = pool;
+  current_index = index;
+
+  for (;;) {
+    struct ThreadPoolTask task;
+    if (find_task(pool, index, node, &task)) {
+      __atomic_fetch_sub(&pool->queued, 1, __ATOMIC_ACQ_REL);
+      task.fn(task.arg);
+
+      pthread_mutex_lock(&pool->lock);
+      pool->pending--;
+      if (pool->pending == 0) {
+        pthread_cond_broadcast(&pool->all_done);
+      }
+      pthread_mutex_unlock(&pool->lock);
+      continue;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (__atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0 && !pool->shutdown) {
+      pthread_cond_wait(&pool->work_available, &pool->lock);
+    }
+    int done = pool->shutdown && __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (done) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+// Starts a worker thread, pinned to cpu unless cpu is negative. A
+// worker that cannot be pinned is started unpinned instead.
+static int start_worker(pthread_t *thread, struct WorkerArgs *worker, int cpu) {
+  if (cpu >= 0) {
+    pthread_attr_t attr;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (pthread_attr_init(&attr) == 0) {
+      int status = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+      if (status == 0) {
+        status = pthread_create(thread, &attr, worker_main, worker);
+      }
+      pthread_attr_destroy(&attr);
+      if (status == 0) {
+        return 0;
+      }
+    }
+  }
+  return pthread_create(thread, NULL, worker_main, worker);
+}
+
+// Starts a pool of n_threads workers. If topology is NULL, the workers
+// form one node and are not pinned; otherwise each node of topology
+// gets a share of the workers in proportion to its CPUs, and each
+// worker is pinned to one of them.
+static int start_pool(struct ThreadPool *pool, size_t n_threads, const struct NumaTopology *topology) {
+  size_t n_nodes = topology != NULL ? topology->n_nodes : 1;
+  pool->n_threads = 0;
+  pool->n_nodes = n_nodes;
+  pool->next_queue = 0;
+  pool->queued = 0;
+  pool->pending = 0;
+  pool->shutdown = 0;
+  pool->threads = malloc(n_threads * sizeof(pthread_t));
+  pool->queues = malloc(n_threads * sizeof(struct ThreadPoolQueue));
+  pool->node_offsets = malloc((n_nodes + 1) * sizeof(size_t));
+  if (pool->threads == NULL || pool->queues == NULL || pool->node_offsets == NULL) {
+    free(pool->threads);
+    free(pool->queues);
+    free(pool->node_offsets);
+    return -1;
+  }
+  for (size_t k = 0; k <= n_nodes; k++) {
+    pool->node_offsets[k] = topology != NULL ? n_threads * topology->node_offsets[k] / topology->n_cpus
+                                             : k * n_threads;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work_available, NULL);
+  pthread_cond_init(&pool->all_done, NULL);
+
+  for (size_t i = 0; i < n_threads; i++) {
+    if (queue_new(&pool->queues[i]) != 0) {
+      goto fail;
+    }
+    // n_threads tracks the number of initialized queues until all
+    // workers are running, so that cleanup on failure is exact.
+    pool->n_threads = i + 1;
+  }
+  size_t started = 0;
+  for (size_t node = 0; node < n_nodes; node++) {
+    for (; started < pool->node_offsets[node + 1]; started++) {
+      struct WorkerArgs *worker = malloc(sizeof(struct WorkerArgs));
+      if (worker == NULL) {
+        goto stop;
+      }
+      worker->pool = pool;
+      worker->index = started;
+      worker->node = node;
+      int cpu = -1;
+      if (topology != NULL) {
+        // Workers take their node's CPUs in turn.
+        size_t first_cpu = topology->node_offsets[node];
+        size_t n_cpus = topology->node_offsets[node + 1] - first_cpu;
+        cpu = topology->cpus[first_cpu + (started - pool->node_offsets[node]) % n_cpus];
+      }
+      if (start_worker(&pool->threads[started], worker, cpu) != 0) {
+        free(worker);
+        goto stop;
+      }
+    }
+  }
+stop:
+  if (started < n_threads) {
+    // Stop the workers that did start, then release everything.
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 0; i < started; i++) {
+      pthread_join(pool->threads[i], NULL);
+    }
+    goto fail;
+  }
+  return 0;
+
+fail:
+  for (size_t i = 0; i < pool->n_threads; i++) {
+    queue_free(&pool->queues[i]);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->work_available);
+  pthread_cond_destroy(&pool->all_done);
+  free(pool->threads);
+  free(pool->queues);
+  free(pool->node_offsets);
+  pool->threads = NULL;
+  pool->queues = NULL;
+  pool->node_offsets = NULL;
+  pool->n_threads = 0;
+  return -1;
+}
+
+int thread_pool_new(struct ThreadPool *pool, size_t n_threads) {
+  if (n_threads == 0) {
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    n_threads = n_cpus > 0 ? (size_t)n_cpus : 1;
+  }
+  return start_pool(pool, n_threads, NULL);
+}
+
+int thread_pool_new_pinned(struct ThreadPool *pool, size_t n_threads, const struct NumaTopology *topology) {
+  if (topology != NULL) {
+    return start_pool(pool, n_threads > 0 ? n_threads : topology->n_cpus, topology);
+  }
+  struct NumaTopology machine;
+  if (numa_topology_new(&machine) != 0) {
+    return -1;
+  }
+  int status = start_pool(pool, n_threads > 0 ? n_threads : machine.n_cpus, &machine);
+  numa_topology_free(&machine);
+  return status;
+}
+
+void thread_pool_free(struct ThreadPool *pool) {
+  if (pool->threads == NULL) {
+    return;
+  }
+  thread_pool_wait(pool);
+
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->work_available);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (size_t i = 0; i < pool->n_threads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  for (size_t i = 0; i < pool->n_threads; i++) {
+    queue_free(&pool->queues[i]);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->work_available);
+  pthread_cond_destroy(&pool->all_done);
+  free(pool->threads);
+  free(pool->queues);
+  free(pool->node_offsets);
+  pool->threads = NULL;
+  pool->queues = NULL;
+  pool->node_offsets = NULL;
+}
+
+// Queues task on the queue of worker target.
+static int submit_to_queue(struct ThreadPool *pool, size_t target, struct ThreadPoolTask task) {
+  // Count the task before it becomes visible to workers, so that it
+  // cannot finish before it has been counted.
+  pthread_mutex_lock(&pool->lock);
+  pool->pending++;
+  __atomic_fetch_add(&pool->queued, 1, __ATOMIC_ACQ_REL);
+  pthread_mutex_unlock(&pool->lock);
+
+  if (queue_push_back(&pool->queues[target], task) != 0) {
+    pthread_mutex_lock(&pool->lock);
+    pool->pending--;
+    __atomic_fetch_sub(&pool->queued, 1, __ATOMIC_ACQ_REL);
+    if (pool->pending == 0) {
+      pthread_cond_broadcast(&pool->all_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return -1;
+  }
+
+  // Wake every worker when the pool spans several nodes, so that one
+  // on the task's own node is sure to be among those looking for it.
+  pthread_mutex_lock(&pool->lock);
+  if (pool->n_nodes > 1) {
+    pthread_cond_broadcast(&pool->work_available);
+  } else {
+    pthread_cond_signal(&pool->work_available);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
+
+int thread_pool_submit(struct ThreadPool *pool, thread_pool_task_fn fn, void *arg) {
+  size_t target;
+  if (current_pool == pool) {
+    target = current_index;
+  } else {
+    target = __atomic_fetch_add(&pool->next_queue, 1, __ATOMIC_RELAXED) % pool->n_threads;
+  }
+  return submit_to_queue(pool, target, (struct ThreadPoolTask){.fn = fn, .arg = arg});
+}
+
+int thread_pool_submit_to_node(struct ThreadPool *pool, size_t node, thread_pool_task_fn fn, void *arg) {
+  if (node >= pool->n_nodes) {
+    return -1;
+  }
+  size_t first = pool->node_offsets[node], n_local = pool->node_offsets[node + 1] - first;
+  size_t next = __atomic_fetch_add(&pool->next_queue, 1, __ATOMIC_RELAXED);
+  size_t target = n_local > 0 ? first + next % n_local : next % pool->n_threads;
+  return submit_to_queue(pool, target, (struct ThreadPoolTask){.fn = fn, .arg = arg});
+}
+
+void thread_pool_wait(struct ThreadPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  while (pool->pending > 0) {
+    pthread_cond_wait(&pool->all_done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,91 @@
+#ifndef thread_pool_h
+#define thread_pool_h
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "numa.h"
+
+typedef void (*thread_pool_task_fn)(void *arg);
+
+struct ThreadPoolTask {
+  thread_pool_task_fn fn;
+  void *arg;
+};
+
+struct ThreadPoolQueue {
+  /// A double-ended ring buffer of tasks owned by one worker. The
+  /// owner pops from the back; idle workers steal from the front.
+  pthread_mutex_t lock;
+  struct ThreadPoolTask *tasks;
+  size_t head;
+  size_t length;
+  size_t capacity;
+};
+
+struct ThreadPool {
+  /// A fixed-size pool of worker threads with one task queue per
+  /// worker. Workers that run out of local work steal from the others,
+  /// so unevenly sized tasks still balance across the pool.
+  size_t n_threads;
+  pthread_t *threads;
+  struct ThreadPoolQueue *queues;
+
+  /// Workers node_offsets[k] through node_offsets[k + 1] - 1 are pinned
+  /// to the CPUs of NUMA node k. Pools from thread_pool_new have one
+  /// node holding every worker, and their workers are not pinned.
+  size_t n_nodes;
+  size_t *node_offsets;
+
+  pthread_mutex_t lock;
+  pthread_cond_t work_available;
+  pthread_cond_t all_done;
+  size_t next_queue;  // Round-robin target for submissions from outside the pool.
+  size_t queued;      // Tasks sitting in queues.
+  size_t pending;     // Tasks submitted and not yet finished.
+  int shutdown;
+};
+
+/// Starts a pool with n_threads workers. If n_threads is 0, starts one
+/// worker per online CPU.
+///
+/// Returns 0 on success, -1 on failure.
+int thread_pool_new(struct ThreadPool *pool, size_t n_threads);
+
+/// Like thread_pool_new, but spreads the workers over the NUMA nodes of
+/// topology, in proportion to their CPUs, and pins each to one CPU of
+/// its node. If topology is NULL, the machine's own is used (see
+/// numa_topology_new); passing one allows, for example, running on a
+/// subset of the nodes. If n_threads is 0, starts one worker per CPU
+/// of the topology. Pinning is best effort: a worker that cannot be
+/// pinned runs unpinned. On a single-node machine the pool only
+/// differs from thread_pool_new's by the pinning.
+///
+/// Returns 0 on success, -1 on failure.
+int thread_pool_new_pinned(struct ThreadPool *pool, size_t n_threads, const struct NumaTopology *topology);
+
+/// Waits for all submitted tasks to finish, then stops the workers and
+/// releases the pool's resources.
+void thread_pool_free(struct ThreadPool *pool);
+
+/// Queues fn(arg) to run on some worker. Tasks submitted from a worker
+/// go to that worker's own queue.
+///
+/// Returns 0 on success, -1 on allocation failure.
+int thread_pool_submit(struct ThreadPool *pool, thread_pool_task_fn fn, void *arg);
+
+/// Queues fn(arg) to run on a worker of NUMA node node, such as the one
+/// whose memory holds the task's data. Idle workers steal from their
+/// own node before others, so the task only moves off its node when
+/// that node's workers are all busy. If the node has no workers, the
+/// task goes to any worker.
+///
+/// Returns 0 on success, -1 if node is not below pool->n_nodes or on
+/// allocation failure.
+int thread_pool_submit_to_node(struct ThreadPool *pool, size_t node, thread_pool_task_fn fn, void *arg);
+
+/// Blocks until every task submitted so far has finished. Must not be
+/// called from inside a task.
+void thread_pool_wait(struct ThreadPool *pool);
+
+#endif
@@ -1,79 +1,110 @@
 #include "vectors.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-int vector_new(struct Vec *vec, size_t capacity, size_t item_size) {
-  if (capacity < 1) {
-    return -1;
-  }
-  vec->length = 0;
-  vec->item_size = item_size;
-  vec->capacity = capacity;
-  vec->data = malloc(capacity * item_size);
-  if (vec->data == NULL) {
-    return -1;
-  }
-  return 0;
-}
-
-void vector_free(struct Vec *vec) {
-  if (vec->data != NULL) {
-    free(vec->data);
-    vec->data = NULL;
-  }
-}
-
-void vector_push(struct Vec *vec, void *item) {
-  if (vec->length == vec->capacity) {
-    vec->capacity *= 2;
-    vec->data = realloc(vec->data, vec->capacity * vec->item_size);
-  }
-  memcpy(vec->data + vec->length * vec->item_size, item, vec->item_size);
-  vec->length++;
-}
-
-int vector_get(struct Vec *vec, size_t index, void *item) {
-  if (index >= vec->length) {
-    return -1;
-  }
-  memcpy(item, vec->data + index * vec->item_size, vec->item_size);
-  return 0;
-}
+#include "instrument.h"
 
-void vec_f64_free(struct VecF64 *vec) {
-  if (vec->data != NULL) {
-    free(vec->data);
-    vec->data = NULL;
+size_t vec_grown_capacity(size_t capacity, size_t needed) {
+  if (needed <= capacity) {
+    return capacity;
   }
+  return capacity * 2 > needed ? capacity * 2 : needed;
 }
 
-int vec_f64_new(struct VecF64 *vec, size_t capacity) {
-  if (capacity < 1) {
-    return -1;
+// Returns an allocation of at least bytes bytes aligned to
+// VEC_ALIGNMENT, or NULL. aligned_alloc wants a multiple of the
+// alignment, so the size is rounded up.
+static void *vec_alloc(size_t bytes) {
+  if (bytes > SIZE_MAX - (VEC_ALIGNMENT - 1)) {
+    return NULL;
   }
-  vec->length = 0;
-  vec->capacity = capacity;
-  vec->data = malloc(capacity * sizeof(double));
-  if (vec->data == NULL) {
-    return -1;
-  }
-  return 0;
+  return aligned_alloc(VEC_ALIGNMENT, (bytes + VEC_ALIGNMENT - 1) / VEC_ALIGNMENT * VEC_ALIGNMENT);
 }
 
-void vec_f64_push(struct VecF64 *vec, double item) {
-  if (vec->length == vec->capacity) {
-    vec->capacity *= 2;
-    vec->data = realloc(vec->data, vec->capacity * sizeof(double));
+// Defines the out-of-line functions declared by VEC_DECLARE. Growth
+// cannot use realloc, which only guarantees malloc's alignment, so it
+// copies into a fresh aligned allocation; doubling keeps that amortized
+// constant time per item.
+#define VEC_DEFINE(Name, prefix, T)                                                          \
+  int prefix##_new(struct Name *vec, size_t capacity) {                                      \
+    /* On failure vec is left empty, so it is still safe to free. */                         \
+    *vec = (struct Name)VEC_ZERO;                                                            \
+    if (capacity < 1 || capacity > SIZE_MAX / sizeof(T)) {                                   \
+      return -1;                                                                             \
+    }                                                                                        \
+    vec->data = vec_alloc(capacity * sizeof(T));                                             \
+    if (vec->data == NULL) {                                                                 \
+      return -1;                                                                             \
+    }                                                                                        \
+    vec->capacity = capacity;                                                                \
+    return 0;                                                                                \
+  }                                                                                          \
+                                                                                             \
+  void prefix##_free(struct Name *vec) {                                                     \
+    if (vec->data != NULL && !vec->borrowed) {                                               \
+      free(vec->data);                                                                       \
+    }                                                                                        \
+    vec->data = NULL;                                                                        \
+  }                                                                                          \
+                                                                                             \
+  int prefix##_reserve(struct Name *vec, size_t capacity) {                                  \
+    if (capacity <= vec->capacity) {                                                         \
+      return 0;                                                                              \
+    }                                                                                        \
+    if (capacity > SIZE_MAX / sizeof(T)) {                                                   \
+      return -1;                                                                             \
+    }                                                                                        \
+    INSTRUMENT_SCOPE(INSTRUMENT_VEC_GROWTH, capacity * sizeof(T));                           \
+    T *data = vec_alloc(capacity * sizeof(T));                                               \
+    if (data == NULL) {                                                                      \
+      return -1;                                                                             \
+    }                                                                                        \
+    if (vec->length > 0) {                                                                   \
+      memcpy(data, vec->data, vec->length * sizeof(T));                                      \
+    }                                                                                        \
+    /* Never free memory we do not own. */                                                  \
+    if (!vec->borrowed) {                                                                    \
+      free(vec->data);                                                                       \
+    }                                                                                        \
+    vec->data = data;                                                                        \
+    vec->capacity = capacity;                                                                \
+    vec->borrowed = 0;                                                                       \
+    return 0;                                                                                \
+  }                                                                                          \
+                                                                                             \
+  void prefix##_view(struct Name *vec, T *data, size_t length) {                             \
+    /* capacity == length, so the first push copies out of the view. */                     \
+    vec->length = length;                                                                    \
+    vec->capacity = length;                                                                  \
+    vec->data = data;                                                                        \
+    vec->borrowed = 1;                                                                       \
+  }                                                                                          \
+                                                                                             \
+  void prefix##_from_buffer(struct Name *vec, T *data, size_t capacity) {                    \
+    vec->length = 0;                                                                         \
+    vec->capacity = capacity;                                                                \
+    vec->data = data;                                                                        \
+    vec->borrowed = 1;                                                                       \
+  }                                                                                          \
+                                                                                             \
+  int prefix##_append(struct Name *vec, const T *items, size_t n) {                          \
+    if (n > SIZE_MAX - vec->length) {                                                        \
+      return -1;                                                                             \
+    }                                                                                        \
+    if (prefix##_reserve(vec, vec_grown_capacity(vec->capacity, vec->length + n)) != 0) {    \
+      return -1;                                                                             \
+    }                                                                                        \
+    if (n > 0) {                                                                             \
+      memcpy(vec->data + vec->length, items, n * sizeof(T));                                 \
+    }                                                                                        \
+    vec->length += n;                                                                        \
+    return 0;                                                                                \
   }
-  vec->data[vec->length] = item;
-  vec->length++;
-}
 
-int vec_f64_get(struct VecF64 *vec, size_t index, double *item) {
-  if (index >= vec->length) {
-    return -1;
-  }
-  *item = vec->data[index];
-  return 0;
-}
+VEC_DEFINE(VecF64, vec_f64, double)
+VEC_DEFINE(VecF32, vec_f32, float)
+VEC_DEFINE(VecU16, vec_u16, uint16_t)
+VEC_DEFINE(VecU32, vec_u32, uint32_t)
+VEC_DEFINE(VecI64, vec_i64, int64_t)
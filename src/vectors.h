@@ -1,30 +1,122 @@
 #ifndef vectors_h
 #define vectors_h
 
-struct Vec {
-  /// A generic vector.
-  size_t length;
-  size_t capacity;
-  size_t item_size;
-  void *data;
-};
-int vector_new(struct Vec *vec, size_t capacity, size_t item_size);
-void vector_free(struct Vec *vec);
-void vector_push(struct Vec *vec, void *item);
-int vector_get(struct Vec *vec, size_t index, void *item);
-
-#define VECF64_ZERO {.length = 0, .capacity = 0, .data = NULL}
-
-struct VecF64 {
-  /// A vector of 64-bit floating point numbers.
-  size_t length;
-  size_t capacity;
-  double *data;
-};
-int vec_f64_new(struct VecF64 *vec, size_t capacity);
-void vec_f64_free(struct VecF64 *vec);
-void vec_f64_push(struct VecF64 *vec, double item);
-int vec_f64_get(struct VecF64 *vec, size_t index, double *item);
+#include <stddef.h>
+#include <stdint.h>
 
+/// Storage that a vector allocates itself is aligned to VEC_ALIGNMENT
+/// bytes, one cache line and one AVX-512 register, so kernels can use
+/// aligned loads from the start of a column. Borrowed storage keeps the
+/// caller's alignment.
+#define VEC_ALIGNMENT 64
+
+/// Returns the capacity to grow a vector of the given capacity to so
+/// that it can hold needed items: needed or double the old capacity,
+/// whichever is more, so that repeated growth takes amortized constant
+/// time per item. Returns capacity if it is already enough.
+size_t vec_grown_capacity(size_t capacity, size_t needed);
+
+/// Declares struct Name, a vector of items of type T, and its
+/// functions, each named prefix_<operation>. Every vector type has the
+/// same fields and the same operations:
+///
+/// - new(vec, capacity): allocates room for capacity (at least 1)
+///   items. Returns 0 on success, -1 on failure.
+/// - free(vec): frees the storage, unless it is borrowed.
+/// - push(vec, item): adds an item to the end of the vector, growing it
+///   if needed. Returns 0 on success, -1 on allocation failure, in
+///   which case the vector is unchanged.
+/// - get(vec, index, item): copies the item at index to *item. Returns
+///   -1 if index is out of range.
+/// - reserve(vec, capacity): ensures the vector can hold at least
+///   capacity items without reallocating. Returns 0 on success, -1 on
+///   allocation failure.
+/// - view(vec, data, length): makes vec a borrowed view of length
+///   items at data, without copying. The caller keeps ownership of
+///   data, which must outlive the view.
+/// - from_buffer(vec, data, capacity): makes vec an empty, borrowed
+///   vector that fills the caller-owned buffer at data, which has room
+///   for capacity items. Pushing past capacity moves the items to an
+///   owned allocation.
+/// - resize(vec, length): sets the length, growing the vector if
+///   needed. Items past the old length are left uninitialized, for the
+///   caller to fill in place. Returns 0 on success, -1 on allocation
+///   failure.
+/// - clear(vec): empties the vector, keeping its storage for reuse.
+/// - append(vec, items, n): copies n items onto the end of the vector,
+///   growing it once if needed. items must not point into the vector.
+///   Returns 0 on success, -1 on allocation failure, in which case the
+///   vector is unchanged.
+///
+/// push, get, resize and clear are static inline, so that in a hot loop
+/// they compile down to a bounds check and a plain load or store; the
+/// rest are defined once per type in vectors.c by VEC_DEFINE.
+#define VEC_DECLARE(Name, prefix, T)                                                     \
+  struct Name {                                                                          \
+    size_t length;                                                                       \
+    size_t capacity;                                                                     \
+    T *data;                                                                             \
+    /* Set when data is owned by someone else (see view and from_buffer).            \
+       A borrowed vector never frees or reallocates data; growing it                  \
+       first copies the items into a new, owned allocation. */                        \
+    int borrowed;                                                                        \
+  };                                                                                     \
+  int prefix##_new(struct Name *vec, size_t capacity);                                   \
+  void prefix##_free(struct Name *vec);                                                  \
+  int prefix##_reserve(struct Name *vec, size_t capacity);                               \
+  void prefix##_view(struct Name *vec, T *data, size_t length);                          \
+  void prefix##_from_buffer(struct Name *vec, T *data, size_t capacity);                 \
+  int prefix##_append(struct Name *vec, const T *items, size_t n);                       \
+                                                                                         \
+  static inline int prefix##_push(struct Name *vec, T item) {                            \
+    if (vec->length == vec->capacity &&                                                  \
+        prefix##_reserve(vec, vec_grown_capacity(vec->capacity, vec->length + 1)) != 0) { \
+      return -1;                                                                         \
+    }                                                                                    \
+    vec->data[vec->length] = item;                                                       \
+    vec->length++;                                                                       \
+    return 0;                                                                            \
+  }                                                                                      \
+                                                                                         \
+  static inline int prefix##_get(const struct Name *vec, size_t index, T *item) {        \
+    if (index >= vec->length) {                                                          \
+      return -1;                                                                         \
+    }                                                                                    \
+    *item = vec->data[index];                                                            \
+    return 0;                                                                            \
+  }                                                                                      \
+                                                                                         \
+  static inline int prefix##_resize(struct Name *vec, size_t length) {                   \
+    if (prefix##_reserve(vec, length) != 0) {                                            \
+      return -1;                                                                         \
+    }                                                                                    \
+    vec->length = length;                                                                \
+    return 0;                                                                            \
+  }                                                                                      \
+                                                                                         \
+  static inline void prefix##_clear(struct Name *vec) { vec->length = 0; }
+
+/// An empty vector of any type, owning no storage.
+#define VEC_ZERO {.length = 0, .capacity = 0, .data = NULL, .borrowed = 0}
+
+/// A vector of 64-bit floating point numbers.
+VEC_DECLARE(VecF64, vec_f64, double)
+#define VECF64_ZERO VEC_ZERO
+
+/// A vector of single-precision floats.
+VEC_DECLARE(VecF32, vec_f32, float)
+#define VECF32_ZERO VEC_ZERO
+
+/// A vector of 16-bit unsigned integers.
+VEC_DECLARE(VecU16, vec_u16, uint16_t)
+#define VECU16_ZERO VEC_ZERO
+
+/// A vector of 32-bit unsigned integers.
+VEC_DECLARE(VecU32, vec_u32, uint32_t)
+#define VECU32_ZERO VEC_ZERO
+
+/// A vector of 64-bit signed integers, for ids.
+VEC_DECLARE(VecI64, vec_i64, int64_t)
+#define VECI64_ZERO VEC_ZERO
 
 #endif
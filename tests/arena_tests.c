@@ -0,0 +1,59 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "arena.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+static char *test_arena_alloc() {
+  struct Arena arena;
+  int status = arena_new(&arena, 1024, ARENA_DEFAULT);
+  ut_assert(status == 0, "arena_new failed");
+
+  char *a = arena_alloc(&arena, 10);
+  char *b = arena_alloc(&arena, 100);
+  ut_assert(a != NULL && b != NULL, "arena_alloc failed");
+  ut_assert((uintptr_t)a % ARENA_ALIGNMENT == 0, "first allocation is not aligned");
+  ut_assert((uintptr_t)b % ARENA_ALIGNMENT == 0, "second allocation is not aligned");
+  ut_assert(b - a == ARENA_ALIGNMENT, "allocations are not packed");
+
+  // Exhaustion returns NULL rather than growing.
+  ut_assert(arena_alloc(&arena, 1024) == NULL, "oversized allocation should fail");
+
+  // A reset hands the same memory out again.
+  arena_reset(&arena);
+  char *c = arena_alloc(&arena, 1024);
+  ut_assert(c == a, "reset should reuse the arena from the start");
+
+  arena_free(&arena);
+  ut_assert(arena.base == NULL, "arena_free should clear the base");
+  return 0;
+}
+
+static char *test_arena_huge_pages() {
+  struct Arena arena;
+  int status = arena_new(&arena, 4096, ARENA_HUGE_PAGES);
+  ut_assert(status == 0, "arena_new with huge pages failed");
+  ut_assert(arena.size % (2 * 1024 * 1024) == 0, "huge page arena should be whole huge pages");
+  ut_assert(arena_alloc(&arena, 4096) != NULL, "arena_alloc failed");
+  arena_free(&arena);
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_arena_alloc);
+  ut_run_test(test_arena_huge_pages);
+  return 0;
+}
+
+int main(void) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
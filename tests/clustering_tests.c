@@ -0,0 +1,147 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "clustering.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+static char *test_cluster_gnomonic() {
+  struct GnomonicPointSources gnomonic;
+  gnomonic_point_sources_new(&gnomonic, 16);
+
+  gnomonic_point_sources_push(&gnomonic, 5.0, 5.0, 0.0);    // 0: noise
+  gnomonic_point_sources_push(&gnomonic, 0.0, 0.0, 0.0);    // 1: cluster A
+  gnomonic_point_sources_push(&gnomonic, 1.0, 1.0, 0.0);    // 2: cluster B
+  gnomonic_point_sources_push(&gnomonic, 0.01, 0.0, 0.0);   // 3: cluster A
+  gnomonic_point_sources_push(&gnomonic, 1.01, 1.0, 0.0);   // 4: cluster B
+  gnomonic_point_sources_push(&gnomonic, 0.0, 0.01, 0.0);   // 5: cluster A
+  gnomonic_point_sources_push(&gnomonic, 1.0, 1.01, 0.0);   // 6: cluster B
+  gnomonic_point_sources_push(&gnomonic, 0.02, 0.01, 0.0);  // 7: cluster A, chained through 3 and 5
+  gnomonic_point_sources_push(&gnomonic, -3.0, 2.0, 0.0);   // 8: noise
+  gnomonic_point_sources_push(&gnomonic, NAN, 0.0, 0.0);    // 9: noise
+
+  struct Clusters clusters = CLUSTERS_ZERO;
+  enum ClusteringError status = cluster_gnomonic(&gnomonic, 0.015, 2, &clusters);
+  ut_assert(status == CLUSTERING_ERROR_NONE, "cluster_gnomonic failed");
+  ut_assert(clusters.n_clusters == 2, "wrong number of clusters");
+
+  // Clusters are numbered by their lowest index, and list members in
+  // increasing order.
+  ut_assert(clusters.offsets[0] == 0 && clusters.offsets[1] == 4 && clusters.offsets[2] == 7, "wrong offsets");
+  ut_assert(clusters.indices[0] == 1, "wrong member of cluster A");
+  ut_assert(clusters.indices[1] == 3, "wrong member of cluster A");
+  ut_assert(clusters.indices[2] == 5, "wrong member of cluster A");
+  ut_assert(clusters.indices[3] == 7, "wrong member of cluster A");
+  ut_assert(clusters.indices[4] == 2, "wrong member of cluster B");
+  ut_assert(clusters.indices[5] == 4, "wrong member of cluster B");
+  ut_assert(clusters.indices[6] == 6, "wrong member of cluster B");
+  clusters_free(&clusters);
+
+  // With a higher density threshold, B has no core points.
+  status = cluster_gnomonic(&gnomonic, 0.015, 4, &clusters);
+  ut_assert(status == CLUSTERING_ERROR_NONE, "cluster_gnomonic failed");
+  ut_assert(clusters.n_clusters == 1, "wrong number of clusters at min_samples=4");
+  ut_assert(clusters.offsets[1] == 4, "wrong size of cluster A at min_samples=4");
+  clusters_free(&clusters);
+
+  status = cluster_gnomonic(&gnomonic, 0.0, 2, &clusters);
+  ut_assert(status == CLUSTERING_ERROR_INVALID_ARGUMENT, "zero radius should be rejected");
+
+  gnomonic_point_sources_free(&gnomonic);
+  return 0;
+}
+
+static char *test_cluster_gnomonic_empty() {
+  struct GnomonicPointSources gnomonic;
+  gnomonic_point_sources_new(&gnomonic, 1);
+  struct Clusters clusters = CLUSTERS_ZERO;
+  enum ClusteringError status = cluster_gnomonic(&gnomonic, 0.1, 1, &clusters);
+  ut_assert(status == CLUSTERING_ERROR_NONE, "cluster_gnomonic failed on empty input");
+  ut_assert(clusters.n_clusters == 0, "empty input should have no clusters");
+  clusters_free(&clusters);
+  gnomonic_point_sources_free(&gnomonic);
+  return 0;
+}
+
+static char *test_cluster_gnomonic_matches_brute_force() {
+  // A dense random field, compared against an O(n^2) count of core
+  // points.
+  struct GnomonicPointSources gnomonic;
+  gnomonic_point_sources_new(&gnomonic, 2000);
+  srand(3);
+  for (size_t i = 0; i < 2000; i++) {
+    gnomonic_point_sources_push(&gnomonic, (double)rand() / RAND_MAX, (double)rand() / RAND_MAX, 0.0);
+  }
+  double radius = 0.02;
+  size_t min_samples = 4;
+
+  static int is_core[2000];
+  static size_t component[2000];
+  size_t n_core = 0;
+  for (size_t i = 0; i < 2000; i++) {
+    size_t count = 0;
+    for (size_t j = 0; j < 2000; j++) {
+      double dx = gnomonic.x.data[i] - gnomonic.x.data[j];
+      double dy = gnomonic.y.data[i] - gnomonic.y.data[j];
+      count += dx * dx + dy * dy <= radius * radius;
+    }
+    is_core[i] = count >= min_samples;
+    n_core += is_core[i];
+    component[i] = i;
+  }
+  // Label connected components of core points by repeated relaxation.
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (size_t i = 0; i < 2000; i++) {
+      for (size_t j = 0; j < 2000; j++) {
+        double dx = gnomonic.x.data[i] - gnomonic.x.data[j];
+        double dy = gnomonic.y.data[i] - gnomonic.y.data[j];
+        if (is_core[i] && is_core[j] && dx * dx + dy * dy <= radius * radius && component[j] < component[i]) {
+          component[i] = component[j];
+          changed = 1;
+        }
+      }
+    }
+  }
+  size_t n_components = 0;
+  for (size_t i = 0; i < 2000; i++) {
+    n_components += is_core[i] && component[i] == i;
+  }
+
+  struct Clusters clusters = CLUSTERS_ZERO;
+  enum ClusteringError status = cluster_gnomonic(&gnomonic, radius, min_samples, &clusters);
+  ut_assert(status == CLUSTERING_ERROR_NONE, "cluster_gnomonic failed");
+  ut_assert(clusters.n_clusters > 0, "expected some clusters");
+  ut_assert(clusters.n_clusters == n_components, "cluster count differs from brute force");
+  // Every core point is clustered, so there are at least as many
+  // members as core points.
+  ut_assert(clusters.offsets[clusters.n_clusters] >= n_core, "core points missing from clusters");
+  for (size_t c = 0; c < clusters.n_clusters; c++) {
+    ut_assert(clusters.offsets[c + 1] - clusters.offsets[c] >= 1, "empty cluster");
+  }
+
+  clusters_free(&clusters);
+  gnomonic_point_sources_free(&gnomonic);
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_cluster_gnomonic);
+  ut_run_test(test_cluster_gnomonic_empty);
+  ut_run_test(test_cluster_gnomonic_matches_brute_force);
+  return 0;
+}
+
+int main(void) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
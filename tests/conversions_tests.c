@@ -0,0 +1,205 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "conversions.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+#define RAD_TO_DEG (180.0 / M_PI)
+
+static char *test_topocentric_to_cartesian() {
+  struct String obscode = string_create("W84");
+  struct ObservatoryTable table;
+  observatory_table_new(&table);
+  double observer_a[3] = {0.9, 0.4, 0.0};
+  double observer_b[3] = {0.8, 0.6, 0.0};
+  observatory_table_add(&table, &obscode, 59000.0, observer_a);
+  observatory_table_add(&table, &obscode, 59001.0, observer_b);
+
+  // Build detections of known heliocentric positions, as seen from the
+  // observatory, in two exposures.
+  double targets[4][3] = {{2.0, 1.0, 0.3}, {1.9, 1.1, 0.2}, {-1.0, 2.0, 0.5}, {2.1, 0.9, -0.1}};
+  double times[4] = {59000.0, 59000.0, 59001.0, 59001.0};
+
+  struct String *owned_obscode = malloc(sizeof(struct String));
+  *owned_obscode = string_create("W84");
+  struct TopocentricPointSources topocentric;
+  topocentric_point_sources_new(&topocentric, 4, owned_obscode);
+  for (size_t i = 0; i < 4; i++) {
+    double *observer = times[i] == 59000.0 ? observer_a : observer_b;
+    double d[3] = {targets[i][0] - observer[0], targets[i][1] - observer[1], targets[i][2] - observer[2]};
+    double rho = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    double ra = atan2(d[1], d[0]) * RAD_TO_DEG;
+    double dec = asin(d[2] / rho) * RAD_TO_DEG;
+    topocentric_point_sources_push(&topocentric, ra, dec, times[i]);
+  }
+
+  struct CartesianPointSources cartesian;
+  cartesian_point_sources_new(&cartesian, 4);
+
+  // Each target lies at its own heliocentric distance, so convert one
+  // row at a time through a one-row view of the input.
+  for (size_t i = 0; i < 4; i++) {
+    struct TopocentricPointSources row = {
+        .ra = {.length = 1, .capacity = 1, .data = topocentric.ra.data + i},
+        .dec = {.length = 1, .capacity = 1, .data = topocentric.dec.data + i},
+        .t = {.length = 1, .capacity = 1, .data = topocentric.t.data + i},
+        .obscode_id = {.length = 1, .capacity = 1, .data = topocentric.obscode_id.data + i},
+    };
+    double r = sqrt(targets[i][0] * targets[i][0] + targets[i][1] * targets[i][1] + targets[i][2] * targets[i][2]);
+    int status = topocentric_to_cartesian(&row, &table, r, &cartesian);
+    ut_assert(status == CONVERSION_ERROR_NONE, "topocentric_to_cartesian failed");
+  }
+
+  ut_assert(cartesian.x.length == 4, "wrong length for x");
+  for (size_t i = 0; i < 4; i++) {
+    ut_assert_feq(cartesian.x.data[i], targets[i][0]);
+    ut_assert_feq(cartesian.y.data[i], targets[i][1]);
+    ut_assert_feq(cartesian.z.data[i], targets[i][2]);
+    ut_assert(cartesian.t.data[i] == times[i], "wrong value for t");
+  }
+
+  // Whole batch at one distance: every output lies on that sphere.
+  struct CartesianPointSources batch;
+  cartesian_point_sources_new(&batch, 4);
+  int status = topocentric_to_cartesian(&topocentric, &table, 2.5, &batch);
+  ut_assert(status == CONVERSION_ERROR_NONE, "batch topocentric_to_cartesian failed");
+  for (size_t i = 0; i < 4; i++) {
+    double r = sqrt(batch.x.data[i] * batch.x.data[i] + batch.y.data[i] * batch.y.data[i] +
+                    batch.z.data[i] * batch.z.data[i]);
+    ut_assert_feq(r, 2.5);
+  }
+
+  // An epoch outside the table is an error.
+  topocentric.t.data[3] = 59002.0;
+  struct CartesianPointSources out_of_range;
+  cartesian_point_sources_new(&out_of_range, 4);
+  status = topocentric_to_cartesian(&topocentric, &table, 2.5, &out_of_range);
+  ut_assert(status == CONVERSION_ERROR_OUT_OF_RANGE, "epoch outside the table should fail");
+  topocentric.t.data[3] = NAN;
+  status = topocentric_to_cartesian(&topocentric, &table, 2.5, &out_of_range);
+  ut_assert(status == CONVERSION_ERROR_OUT_OF_RANGE, "a NaN epoch should fail");
+
+  cartesian_point_sources_free(&out_of_range);
+  cartesian_point_sources_free(&batch);
+  cartesian_point_sources_free(&cartesian);
+  topocentric_point_sources_free(&topocentric);
+  free(owned_obscode);
+  observatory_table_free(&table);
+  string_free(&obscode);
+  return 0;
+}
+
+static char *test_mixed_observatories() {
+  // Two sites see the same target at the same epochs; rows from both
+  // are interleaved in one batch.
+  struct String west = string_create("W84");
+  struct String east = string_create("E10");
+  struct ObservatoryTable table;
+  observatory_table_new(&table);
+  double west_position[3] = {0.9, 0.4, 0.0};
+  double east_position[3] = {0.9, 0.4, 0.0001};
+  observatory_table_add(&table, &west, 59000.0, west_position);
+  observatory_table_add(&table, &west, 59001.0, west_position);
+  observatory_table_add(&table, &east, 59000.0, east_position);
+  observatory_table_add(&table, &east, 59001.0, east_position);
+  uint16_t west_id = obscode_intern(&west);
+  uint16_t east_id = obscode_intern(&east);
+
+  double target[3] = {2.0, 1.0, 0.3};
+  double r = sqrt(target[0] * target[0] + target[1] * target[1] + target[2] * target[2]);
+  struct TopocentricPointSources topocentric;
+  topocentric_point_sources_new(&topocentric, 4, NULL);
+  for (size_t i = 0; i < 4; i++) {
+    double *observer = i % 2 == 0 ? west_position : east_position;
+    double d[3] = {target[0] - observer[0], target[1] - observer[1], target[2] - observer[2]};
+    double rho = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    topocentric_point_sources_push_obscode(&topocentric, atan2(d[1], d[0]) * RAD_TO_DEG,
+                                           asin(d[2] / rho) * RAD_TO_DEG, 59000.0 + (double)(i / 2),
+                                           i % 2 == 0 ? west_id : east_id);
+  }
+
+  struct CartesianPointSources cartesian;
+  cartesian_point_sources_new(&cartesian, 4);
+  int status = topocentric_to_cartesian(&topocentric, &table, r, &cartesian);
+  ut_assert(status == CONVERSION_ERROR_NONE, "mixed topocentric_to_cartesian failed");
+  for (size_t i = 0; i < 4; i++) {
+    ut_assert_feq(cartesian.x.data[i], target[0]);
+    ut_assert_feq(cartesian.y.data[i], target[1]);
+    ut_assert_feq(cartesian.z.data[i], target[2]);
+  }
+
+  // A row from an observatory missing from the table is an error.
+  struct String unknown = string_create("X00");
+  topocentric_point_sources_push_obscode(&topocentric, 0.0, 0.0, 59000.0, obscode_intern(&unknown));
+  struct CartesianPointSources failed;
+  cartesian_point_sources_new(&failed, 5);
+  status = topocentric_to_cartesian(&topocentric, &table, r, &failed);
+  ut_assert(status == CONVERSION_ERROR_UNKNOWN_OBSERVATORY, "unknown observatory should fail");
+
+  cartesian_point_sources_free(&failed);
+  cartesian_point_sources_free(&cartesian);
+  topocentric_point_sources_free(&topocentric);
+  observatory_table_free(&table);
+  string_free(&unknown);
+  string_free(&east);
+  string_free(&west);
+  return 0;
+}
+
+static char *test_every_quadrant() {
+  // Seen from the sun, at unit distance, each detection lands on its
+  // unit vector, whatever quadrant and turn its angles are in.
+  struct String obscode = string_create("500");
+  struct ObservatoryTable table;
+  observatory_table_new(&table);
+  double sun[3] = {0.0, 0.0, 0.0};
+  observatory_table_add(&table, &obscode, 59000.0, sun);
+  observatory_table_add(&table, &obscode, 59001.0, sun);
+  uint16_t id = obscode_intern(&obscode);
+
+  struct TopocentricPointSources topocentric;
+  topocentric_point_sources_new(&topocentric, 8, NULL);
+  for (int i = -192; i <= 192; i++) {
+    double ra = i * 3.75;
+    double dec = -90.0 + fmod((i + 192) * 7.5, 180.0);
+    topocentric_point_sources_push_obscode(&topocentric, ra, dec, 59000.5, id);
+  }
+
+  struct CartesianPointSources cartesian;
+  cartesian_point_sources_new(&cartesian, 8);
+  int status = topocentric_to_cartesian(&topocentric, &table, 1.0, &cartesian);
+  ut_assert(status == CONVERSION_ERROR_NONE, "topocentric_to_cartesian failed");
+  for (size_t i = 0; i < topocentric.ra.length; i++) {
+    double ra = topocentric.ra.data[i] / RAD_TO_DEG, dec = topocentric.dec.data[i] / RAD_TO_DEG;
+    ut_assert(fabs(cartesian.x.data[i] - cos(dec) * cos(ra)) < 1e-14, "wrong x");
+    ut_assert(fabs(cartesian.y.data[i] - cos(dec) * sin(ra)) < 1e-14, "wrong y");
+    ut_assert(fabs(cartesian.z.data[i] - sin(dec)) < 1e-14, "wrong z");
+  }
+
+  cartesian_point_sources_free(&cartesian);
+  topocentric_point_sources_free(&topocentric);
+  observatory_table_free(&table);
+  string_free(&obscode);
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_topocentric_to_cartesian);
+  ut_run_test(test_mixed_observatories);
+  ut_run_test(test_every_quadrant);
+  return 0;
+}
+
+int main(void) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
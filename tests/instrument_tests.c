@@ -0,0 +1,103 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "instrument.h"
+#include "point_sources.h"
+#include "projections.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+#define N_THREADS 4
+#define N_RECORDS 1000
+
+static void *record_many(void *arg) {
+  (void)arg;
+  for (int i = 0; i < N_RECORDS; i++) {
+    instrument_record(INSTRUMENT_CLUSTERING, 3, 5);
+  }
+  return NULL;
+}
+
+static char *test_threads_record_separately(void) {
+  instrument_reset();
+  pthread_t threads[N_THREADS];
+  for (int i = 0; i < N_THREADS; i++) {
+    ut_assert(pthread_create(&threads[i], NULL, record_many, NULL) == 0, "pthread_create failed");
+  }
+  for (int i = 0; i < N_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  // The threads have exited, but their counts remain.
+  struct InstrumentStats stats;
+  instrument_snapshot(&stats);
+  struct InstrumentProbeStats *probe = &stats.probes[INSTRUMENT_CLUSTERING];
+  ut_assert(probe->calls == N_THREADS * N_RECORDS, "wrong number of calls");
+  ut_assert(probe->ticks == 3 * N_THREADS * N_RECORDS, "wrong number of ticks");
+  ut_assert(probe->items == 5 * N_THREADS * N_RECORDS, "wrong number of items");
+  ut_assert(stats.ticks_per_second > 0, "tick rate should be known once something is recorded");
+
+  instrument_reset();
+  instrument_snapshot(&stats);
+  ut_assert(stats.probes[INSTRUMENT_CLUSTERING].calls == 0, "reset should zero the counters");
+  return 0;
+}
+
+static char *test_probe_names(void) {
+  ut_assert(strcmp(instrument_probe_name(INSTRUMENT_PROJECTION), "projection") == 0, "wrong name");
+  ut_assert(strcmp(instrument_probe_name(INSTRUMENT_VEC_GROWTH), "vec_growth") == 0, "wrong name");
+  ut_assert(strcmp(instrument_probe_name(INSTRUMENT_PROBE_COUNT), "unknown") == 0, "out of range name");
+  return 0;
+}
+
+static char *test_projection_probes(void) {
+  struct CartesianPointSources cartesian;
+  ut_assert(cartesian_point_sources_new(&cartesian, 1) == 0, "cartesian_point_sources_new failed");
+  instrument_reset();
+  for (int i = 0; i < 100; i++) {
+    cartesian_point_sources_push(&cartesian, 1.0, 0.01 * i, 0.0, 1.0);
+  }
+  struct GnomonicPointSources gnomonic;
+  ut_assert(gnomonic_point_sources_new(&gnomonic, 1) == 0, "gnomonic_point_sources_new failed");
+  double center[3] = {1.0, 0.0, 0.0};
+  double velocity[3] = {0.0, 1.0, 0.0};
+  ut_assert(cartesian_to_gnomonic(&cartesian, center, velocity, &gnomonic) == 0, "cartesian_to_gnomonic failed");
+
+  struct InstrumentStats stats;
+  instrument_snapshot(&stats);
+  if (stats.enabled) {
+    ut_assert(stats.probes[INSTRUMENT_PROJECTION].calls == 1, "projection should be counted once");
+    ut_assert(stats.probes[INSTRUMENT_PROJECTION].items == 100, "projection should count its detections");
+    ut_assert(stats.probes[INSTRUMENT_ROTATION_MATRICES].calls == 1, "the frame should be counted");
+    ut_assert(stats.probes[INSTRUMENT_VEC_GROWTH].calls > 0, "pushes should have grown the vectors");
+  } else {
+    // Built without instrumentation, nothing records.
+    for (size_t p = 0; p < INSTRUMENT_PROBE_COUNT; p++) {
+      ut_assert(stats.probes[p].calls == 0, "disabled probes should not record");
+    }
+  }
+
+  gnomonic_point_sources_free(&gnomonic);
+  cartesian_point_sources_free(&cartesian);
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_threads_record_separately);
+  ut_run_test(test_probe_names);
+  ut_run_test(test_projection_probes);
+  return 0;
+}
+
+int main(void) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
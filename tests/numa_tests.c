@@ -0,0 +1,65 @@
+#include <stdio.h>
+
+#include "numa.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+static char *test_numa_parse_cpu_list() {
+  int cpus[16];
+  size_t n_cpus = 0;
+  int status = numa_parse_cpu_list("0-3,8,10-11\n", cpus, 16, &n_cpus);
+  ut_assert(status == 0, "numa_parse_cpu_list failed");
+  int want[7] = {0, 1, 2, 3, 8, 10, 11};
+  ut_assert(n_cpus == 7, "wrong number of CPUs");
+  for (size_t i = 0; i < 7; i++) {
+    ut_assert(cpus[i] == want[i], "wrong CPU");
+  }
+
+  // Memory-only nodes have an empty list.
+  status = numa_parse_cpu_list("\n", cpus, 16, &n_cpus);
+  ut_assert(status == 0 && n_cpus == 0, "empty list should parse");
+
+  ut_assert(numa_parse_cpu_list("0-3,", cpus, 16, &n_cpus) != 0, "trailing comma should fail");
+  ut_assert(numa_parse_cpu_list("3-1", cpus, 16, &n_cpus) != 0, "backwards range should fail");
+  ut_assert(numa_parse_cpu_list("0;1", cpus, 16, &n_cpus) != 0, "bad separator should fail");
+  ut_assert(numa_parse_cpu_list("0-16", cpus, 16, &n_cpus) != 0, "too many CPUs should fail");
+  return 0;
+}
+
+static char *test_numa_topology() {
+  struct NumaTopology topology;
+  int status = numa_topology_new(&topology);
+  ut_assert(status == 0, "numa_topology_new failed");
+  ut_assert(topology.n_nodes >= 1, "topology should have a node");
+  ut_assert(topology.node_offsets[0] == 0 && topology.node_offsets[topology.n_nodes] == topology.n_cpus,
+            "node offsets should cover every CPU");
+  for (size_t k = 0; k < topology.n_nodes; k++) {
+    ut_assert(topology.node_offsets[k] < topology.node_offsets[k + 1], "every node should have a CPU");
+  }
+  for (size_t i = 0; i < topology.n_cpus; i++) {
+    for (size_t j = 0; j < i; j++) {
+      ut_assert(topology.cpus[i] != topology.cpus[j], "a CPU should appear once");
+    }
+  }
+  numa_topology_free(&topology);
+  ut_assert(topology.cpus == NULL && topology.n_nodes == 0, "numa_topology_free should reset the topology");
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_numa_parse_cpu_list);
+  ut_run_test(test_numa_topology);
+  return 0;
+}
+
+int main(void) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
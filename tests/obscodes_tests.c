@@ -0,0 +1,63 @@
+#include <stdio.h>
+
+#include "obscodes.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+static char *test_intern() {
+  struct String a = string_create("I41");
+  struct String b = string_create("W84");
+  struct String a_again = string_create("I41");
+
+  uint16_t a_id = obscode_intern(&a);
+  uint16_t b_id = obscode_intern(&b);
+  ut_assert(a_id != OBSCODE_NONE && b_id != OBSCODE_NONE, "intern failed");
+  ut_assert(a_id != b_id, "distinct obscodes share an id");
+  ut_assert(obscode_intern(&a_again) == a_id, "equal obscodes have different ids");
+  ut_assert(obscode_count() == 2, "wrong count");
+
+  ut_assert(string_equal(obscode_lookup(a_id), &a), "wrong lookup");
+  ut_assert(string_equal(obscode_lookup(b_id), &b), "wrong lookup");
+  ut_assert(obscode_lookup(OBSCODE_NONE) == NULL, "lookup of no id should fail");
+  ut_assert(obscode_lookup(2) == NULL, "lookup of an unused id should fail");
+
+  string_free(&a_again);
+  string_free(&b);
+  string_free(&a);
+  return 0;
+}
+
+static char *test_many() {
+  char buf[8];
+  size_t before = obscode_count();
+  for (int i = 0; i < 1000; i++) {
+    snprintf(buf, sizeof(buf), "%03X", i);
+    struct String s = string_create(buf);
+    uint16_t id = obscode_intern(&s);
+    ut_assert(id == before + (size_t)i, "ids are not dense");
+    string_free(&s);
+  }
+  snprintf(buf, sizeof(buf), "%03X", 500);
+  struct String s = string_create(buf);
+  ut_assert(obscode_intern(&s) == before + 500, "re-interning changed the id");
+  string_free(&s);
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_intern);
+  ut_run_test(test_many);
+  return 0;
+}
+
+int main(void) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
@@ -0,0 +1,127 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "observatories.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+static char *test_observatory_table_interpolation() {
+  struct ObservatoryTable table;
+  int status = observatory_table_new(&table);
+  ut_assert(status == 0, "observatory_table_new failed");
+
+  struct String obscode = string_create("I41");
+  double a[3] = {1.0, 0.0, 0.0};
+  double b[3] = {0.0, 1.0, 0.0};
+  double c[3] = {0.0, 0.0, 1.0};
+  // Out of order on purpose.
+  observatory_table_add(&table, &obscode, 10.0, b);
+  observatory_table_add(&table, &obscode, 0.0, a);
+  observatory_table_add(&table, &obscode, 20.0, c);
+
+  struct ObservatoryEphemeris *ephemeris = observatory_table_find(&table, &obscode);
+  ut_assert(ephemeris != NULL, "observatory not found");
+  ut_assert(ephemeris->t.length == 3, "wrong number of samples");
+  ut_assert(ephemeris->t.data[0] == 0.0 && ephemeris->t.data[1] == 10.0, "samples not sorted");
+
+  double pos[3];
+  status = observatory_ephemeris_position(ephemeris, 10.0, pos);
+  ut_assert(status == OBSERVATORY_ERROR_NONE, "exact lookup failed");
+  ut_assert(pos[0] == 0.0 && pos[1] == 1.0 && pos[2] == 0.0, "wrong exact position");
+
+  status = observatory_ephemeris_position(ephemeris, 15.0, pos);
+  ut_assert(status == OBSERVATORY_ERROR_NONE, "interpolated lookup failed");
+  ut_assert_feq(pos[0], 0.0);
+  ut_assert_feq(pos[1], 0.5);
+  ut_assert_feq(pos[2], 0.5);
+
+  status = observatory_ephemeris_position(ephemeris, 20.5, pos);
+  ut_assert(status == OBSERVATORY_ERROR_OUT_OF_RANGE, "lookup past the end should fail");
+
+  // NaN times are rejected rather than searched for, and never added.
+  status = observatory_ephemeris_position(ephemeris, NAN, pos);
+  ut_assert(status == OBSERVATORY_ERROR_OUT_OF_RANGE, "lookup at a NaN time should fail");
+  status = observatory_table_add(&table, &obscode, NAN, a);
+  ut_assert(status == OBSERVATORY_ERROR_OUT_OF_RANGE, "a sample at a NaN time should be rejected");
+  status = observatory_table_add(&table, &obscode, INFINITY, a);
+  ut_assert(status == OBSERVATORY_ERROR_OUT_OF_RANGE, "a sample at an infinite time should be rejected");
+  ut_assert(ephemeris->t.length == 3, "rejected samples should not be added");
+
+  struct String missing = string_create("X05");
+  ut_assert(observatory_table_find(&table, &missing) == NULL, "unknown observatory was found");
+
+  string_free(&missing);
+  string_free(&obscode);
+  observatory_table_free(&table);
+  return 0;
+}
+
+static char *test_observatory_table_load() {
+  char path[] = "/tmp/cthor_observatories_XXXXXX";
+  int fd = mkstemp(path);
+  ut_assert(fd >= 0, "mkstemp failed");
+  FILE *file = fdopen(fd, "w");
+  fprintf(file, "# obscode mjd x y z\n");
+  fprintf(file, "500 59000.0 0.1 0.2 0.3\n");
+  fprintf(file, "\n");
+  fprintf(file, "500 59001.0 0.3 0.4 0.5\n");
+  fprintf(file, "W84 59000.0 1.0 1.0 1.0\n");
+  fclose(file);
+
+  struct ObservatoryTable table;
+  observatory_table_new(&table);
+  int status = observatory_table_load(&table, path);
+  unlink(path);
+  ut_assert(status == OBSERVATORY_ERROR_NONE, "observatory_table_load failed");
+  ut_assert(table.length == 2, "wrong number of observatories");
+
+  struct String obscode = string_create("500");
+  double pos[3];
+  status = observatory_ephemeris_position(observatory_table_find(&table, &obscode), 59000.5, pos);
+  ut_assert(status == OBSERVATORY_ERROR_NONE, "lookup failed");
+  ut_assert_feq(pos[0], 0.2);
+  ut_assert_feq(pos[1], 0.3);
+  ut_assert_feq(pos[2], 0.4);
+
+  string_free(&obscode);
+  observatory_table_free(&table);
+
+  // A file with a NaN time stops loading there.
+  char nan_path[] = "/tmp/cthor_observatories_XXXXXX";
+  fd = mkstemp(nan_path);
+  ut_assert(fd >= 0, "mkstemp failed");
+  file = fdopen(fd, "w");
+  fprintf(file, "500 59000.0 0.1 0.2 0.3\n");
+  fprintf(file, "500 nan 0.3 0.4 0.5\n");
+  fclose(file);
+  observatory_table_new(&table);
+  status = observatory_table_load(&table, nan_path);
+  unlink(nan_path);
+  ut_assert(status == OBSERVATORY_ERROR_OUT_OF_RANGE, "loading a NaN time should fail");
+  ut_assert(table.length == 1 && table.observatories[0].t.length == 1, "the NaN sample should not be added");
+  observatory_table_free(&table);
+
+  status = observatory_table_load(&table, "/nonexistent/observatories.txt");
+  ut_assert(status == OBSERVATORY_ERROR_IO, "loading a missing file should fail");
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_observatory_table_interpolation);
+  ut_run_test(test_observatory_table_load);
+  return 0;
+}
+
+int main(void) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
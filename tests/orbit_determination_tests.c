@@ -0,0 +1,567 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "orbit_determination.h"
+#include "propagation.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+#define MU PROPAGATION_MU_SUN
+#define RAD_TO_DEG (180.0 / M_PI)
+#define N_OBJECTS 20
+
+static double epochs[3] = {59000.0, 59004.0, 59009.0};
+
+// The observer moves on a circular orbit at 1 AU in the x-y plane.
+static void observer_position(double t, double pos[3]) {
+  double angle = sqrt(MU) * (t - epochs[0]);
+  pos[0] = cos(angle);
+  pos[1] = sin(angle);
+  pos[2] = 0.0;
+}
+
+// Builds N_OBJECTS test orbits at epochs[1], observes each of them at
+// each of times, and fills the observatory table with the observer
+// positions. Row n_times * i + k of detections is object i at times[k].
+static void observe_at(const double *times, size_t n_times, struct CartesianOrbits *truth,
+                       struct TopocentricPointSources *detections, struct ObservatoryTable *table) {
+  cartesian_orbits_new(truth, N_OBJECTS);
+  for (size_t i = 0; i < N_OBJECTS; i++) {
+    // Main-belt-like orbits at a range of distances, inclinations and
+    // eccentricities.
+    double r = 1.8 + 0.1 * i;
+    double angle = 0.3 + 0.05 * i;
+    double pos[3] = {r * cos(angle), r * sin(angle), 0.05 * r * sin(3.0 * i)};
+    double speed = sqrt(MU / r) * (1.0 + 0.01 * (double)(i % 5));
+    double vel[3] = {-speed * sin(angle), speed * cos(angle), 0.1 * speed * cos(2.0 * i)};
+    cartesian_orbits_push(truth, pos, vel, epochs[1]);
+  }
+
+  struct CartesianOrbits states;
+  cartesian_orbits_new(&states, 1);
+  propagate_orbits(truth, times, n_times, MU, NULL, &states);
+
+  struct String obscode = string_create("500");
+  observatory_table_new(table);
+  for (size_t k = 0; k < n_times; k++) {
+    double observer[3];
+    observer_position(times[k], observer);
+    observatory_table_add(table, &obscode, times[k], observer);
+  }
+  string_free(&obscode);
+
+  struct String *owned_obscode = malloc(sizeof(struct String));
+  *owned_obscode = string_create("500");
+  topocentric_point_sources_new(detections, n_times * N_OBJECTS, owned_obscode);
+  for (size_t i = 0; i < N_OBJECTS; i++) {
+    for (size_t k = 0; k < n_times; k++) {
+      size_t row = i * n_times + k;
+      double observer[3];
+      observer_position(times[k], observer);
+      double d[3] = {states.x.data[row] - observer[0], states.y.data[row] - observer[1],
+                     states.z.data[row] - observer[2]};
+      double rho = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+      topocentric_point_sources_push(detections, atan2(d[1], d[0]) * RAD_TO_DEG, asin(d[2] / rho) * RAD_TO_DEG,
+                                     times[k]);
+    }
+  }
+  cartesian_orbits_free(&states);
+}
+
+static void observe(struct CartesianOrbits *truth, struct TopocentricPointSources *detections,
+                    struct ObservatoryTable *table) {
+  observe_at(epochs, 3, truth, detections, table);
+}
+
+static char *test_gauss_recovers_orbits(void) {
+  struct CartesianOrbits truth;
+  struct TopocentricPointSources detections;
+  struct ObservatoryTable table;
+  observe(&truth, &detections, &table);
+
+  uint32_t triplets[3 * N_OBJECTS];
+  for (uint32_t i = 0; i < 3 * N_OBJECTS; i++) {
+    triplets[i] = i;
+  }
+  struct CartesianOrbits orbits = CARTESIAN_ORBITS_ZERO;
+  struct VecU32 candidates = VECU32_ZERO;
+  enum OrbitDeterminationError status = gauss_iod(&detections, &table, triplets, N_OBJECTS, MU, NULL, &orbits,
+                                                  &candidates);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_NONE, "gauss_iod failed");
+  ut_assert(orbits.x.length == candidates.length && orbits.t.length == candidates.length, "mismatched lengths");
+
+  // Every object gets an orbit close to the truth. Gauss's method with
+  // truncated f and g series is only approximate over nine days, so
+  // the tolerance is loose; differential correction does the rest.
+  for (uint32_t i = 0; i < N_OBJECTS; i++) {
+    double want_pos[3], want_vel[3];
+    cartesian_orbits_get(&truth, i, want_pos, want_vel);
+    double best_pos = INFINITY, best_vel = INFINITY;
+    for (size_t o = 0; o < candidates.length; o++) {
+      if (candidates.data[o] != i) {
+        continue;
+      }
+      ut_assert(o == 0 || candidates.data[o - 1] <= i, "orbits are not in candidate order");
+      ut_assert(orbits.t.data[o] == epochs[1], "orbit epoch should be the middle detection's");
+      double pos[3], vel[3];
+      cartesian_orbits_get(&orbits, o, pos, vel);
+      double dp = sqrt(pow(pos[0] - want_pos[0], 2) + pow(pos[1] - want_pos[1], 2) + pow(pos[2] - want_pos[2], 2));
+      double dv = sqrt(pow(vel[0] - want_vel[0], 2) + pow(vel[1] - want_vel[1], 2) + pow(vel[2] - want_vel[2], 2));
+      best_pos = dp < best_pos ? dp : best_pos;
+      best_vel = dv < best_vel ? dv : best_vel;
+    }
+    double r = sqrt(want_pos[0] * want_pos[0] + want_pos[1] * want_pos[1] + want_pos[2] * want_pos[2]);
+    double v = sqrt(want_vel[0] * want_vel[0] + want_vel[1] * want_vel[1] + want_vel[2] * want_vel[2]);
+    if (!(best_pos < 1e-3 * r) || !(best_vel < 1e-3 * v)) {
+      sprintf(message, "object %u: position off by %g AU, velocity off by %g AU/day", i, best_pos, best_vel);
+      return message;
+    }
+  }
+
+  cartesian_orbits_free(&orbits);
+  vec_u32_free(&candidates);
+  topocentric_point_sources_free(&detections);
+  free(detections.obscode);
+  observatory_table_free(&table);
+  cartesian_orbits_free(&truth);
+  return 0;
+}
+
+static char *test_gauss_threads_match_serial(void) {
+  struct CartesianOrbits truth;
+  struct TopocentricPointSources detections;
+  struct ObservatoryTable table;
+  observe(&truth, &detections, &table);
+
+  // Enough candidates for several tasks, reusing the same detections.
+  size_t n_candidates = 3 * ORBIT_DETERMINATION_TASK_CANDIDATES + 5;
+  uint32_t *triplets = malloc(3 * n_candidates * sizeof(uint32_t));
+  for (size_t i = 0; i < n_candidates; i++) {
+    for (size_t k = 0; k < 3; k++) {
+      triplets[3 * i + k] = (uint32_t)(3 * (i % N_OBJECTS) + k);
+    }
+  }
+
+  struct CartesianOrbits serial = CARTESIAN_ORBITS_ZERO, threaded = CARTESIAN_ORBITS_ZERO;
+  struct VecU32 serial_candidates = VECU32_ZERO, threaded_candidates = VECU32_ZERO;
+  enum OrbitDeterminationError status =
+      gauss_iod(&detections, &table, triplets, n_candidates, MU, NULL, &serial, &serial_candidates);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_NONE, "serial gauss_iod failed");
+  struct ThreadPool pool;
+  ut_assert(thread_pool_new(&pool, 3) == 0, "thread_pool_new failed");
+  status = gauss_iod(&detections, &table, triplets, n_candidates, MU, &pool, &threaded, &threaded_candidates);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_NONE, "threaded gauss_iod failed");
+
+  ut_assert(serial.x.length >= n_candidates, "every candidate should have an orbit");
+  ut_assert(threaded.x.length == serial.x.length, "threaded run found a different number of orbits");
+  for (size_t o = 0; o < serial.x.length; o++) {
+    ut_assert(threaded_candidates.data[o] == serial_candidates.data[o], "threaded candidates differ");
+    ut_assert(threaded.x.data[o] == serial.x.data[o] && threaded.vz.data[o] == serial.vz.data[o],
+              "threaded orbits differ");
+  }
+
+  // A used output is overwritten from row 0, and left empty on failure.
+  double *storage = threaded.x.data;
+  status = gauss_iod(&detections, &table, triplets, n_candidates, MU, &pool, &threaded, &threaded_candidates);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_NONE, "repeated gauss_iod failed");
+  ut_assert(threaded.x.length == serial.x.length && threaded_candidates.length == serial_candidates.length,
+            "wrong length on reuse");
+  ut_assert(threaded.x.data == storage, "reused output should keep its storage");
+  for (size_t o = 0; o < serial.x.length; o++) {
+    ut_assert(threaded_candidates.data[o] == serial_candidates.data[o] && threaded.x.data[o] == serial.x.data[o],
+              "reused output differs from a fresh one");
+  }
+  status = gauss_iod(&detections, &table, triplets, n_candidates, -MU, NULL, &threaded, &threaded_candidates);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT, "negative mu should fail");
+  ut_assert(threaded.x.length == 0 && threaded.t.length == 0 && threaded_candidates.length == 0,
+            "failed output should be empty");
+
+  thread_pool_free(&pool);
+  free(triplets);
+  cartesian_orbits_free(&serial);
+  cartesian_orbits_free(&threaded);
+  vec_u32_free(&serial_candidates);
+  vec_u32_free(&threaded_candidates);
+  topocentric_point_sources_free(&detections);
+  free(detections.obscode);
+  observatory_table_free(&table);
+  cartesian_orbits_free(&truth);
+  return 0;
+}
+
+static char *test_gauss_invalid_input(void) {
+  struct CartesianOrbits truth;
+  struct TopocentricPointSources detections;
+  struct ObservatoryTable table;
+  observe(&truth, &detections, &table);
+
+  struct CartesianOrbits orbits = CARTESIAN_ORBITS_ZERO;
+  struct VecU32 candidates = VECU32_ZERO;
+  uint32_t out_of_range[3] = {0, 1, 3 * N_OBJECTS};
+  enum OrbitDeterminationError status =
+      gauss_iod(&detections, &table, out_of_range, 1, MU, NULL, &orbits, &candidates);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT, "out of range row should fail");
+
+  uint32_t triplet[3] = {0, 1, 2};
+  status = gauss_iod(&detections, &table, triplet, 1, -1.0, NULL, &orbits, &candidates);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT, "negative mu should fail");
+
+  // Detections out of time order give no orbit, but are not an error.
+  uint32_t reversed[3] = {2, 1, 0};
+  status = gauss_iod(&detections, &table, reversed, 1, MU, NULL, &orbits, &candidates);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_NONE, "reversed triplet should not fail");
+  ut_assert(orbits.x.length == 0 && candidates.length == 0, "reversed triplet should give no orbit");
+
+  // A detection from an observatory missing from the table.
+  struct ObservatoryTable empty;
+  observatory_table_new(&empty);
+  status = gauss_iod(&detections, &empty, triplet, 1, MU, NULL, &orbits, &candidates);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_UNKNOWN_OBSERVATORY, "unknown observatory should fail");
+  observatory_table_free(&empty);
+
+  // A detection time outside the observatory's samples.
+  detections.t.data[0] = epochs[0] - 1.0;
+  status = gauss_iod(&detections, &table, triplet, 1, MU, NULL, &orbits, &candidates);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_OUT_OF_RANGE, "time outside the ephemeris should fail");
+
+  cartesian_orbits_free(&orbits);
+  vec_u32_free(&candidates);
+  topocentric_point_sources_free(&detections);
+  free(detections.obscode);
+  observatory_table_free(&table);
+  cartesian_orbits_free(&truth);
+  return 0;
+}
+
+// Two weeks of detections for the differential correction tests.
+static double fit_times[8] = {59000.0, 59001.0, 59003.0, 59004.0, 59006.0, 59008.0, 59009.0, 59014.0};
+#define N_FIT_TIMES 8
+
+// Links object i's first 3 + i % 6 detections, so lanes in one block
+// have different numbers of detections.
+static void link_objects(size_t *offsets, uint32_t *indices) {
+  offsets[0] = 0;
+  for (uint32_t i = 0; i < N_OBJECTS; i++) {
+    size_t count = 3 + i % (N_FIT_TIMES - 2);
+    for (size_t k = 0; k < count; k++) {
+      indices[offsets[i] + k] = (uint32_t)(i * N_FIT_TIMES + k);
+    }
+    offsets[i + 1] = offsets[i] + count;
+  }
+}
+
+// Starts each fit from the true orbit, offset by about 1% in position
+// and velocity.
+static void perturb(struct CartesianOrbits *truth, struct CartesianOrbits *start) {
+  cartesian_orbits_new(start, N_OBJECTS);
+  for (size_t i = 0; i < N_OBJECTS; i++) {
+    double pos[3], vel[3];
+    cartesian_orbits_get(truth, i, pos, vel);
+    for (int d = 0; d < 3; d++) {
+      pos[d] *= 1.0 + 0.01 * sin(7.0 * i + d);
+      vel[d] *= 1.0 + 0.01 * cos(5.0 * i + d);
+    }
+    cartesian_orbits_push(start, pos, vel, truth->t.data[i]);
+  }
+}
+
+static char *test_differential_correction_recovers_orbits(void) {
+  struct CartesianOrbits truth, start;
+  struct TopocentricPointSources detections;
+  struct ObservatoryTable table;
+  observe_at(fit_times, N_FIT_TIMES, &truth, &detections, &table);
+  perturb(&truth, &start);
+  size_t offsets[N_OBJECTS + 1];
+  uint32_t indices[N_OBJECTS * N_FIT_TIMES];
+  link_objects(offsets, indices);
+
+  struct CartesianOrbits fitted = CARTESIAN_ORBITS_ZERO;
+  struct VecF64 rms = VECF64_ZERO;
+  enum OrbitDeterminationError status =
+      differential_correction(&start, &detections, &table, offsets, indices, MU, NULL, &fitted, &rms);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_NONE, "differential_correction failed");
+  ut_assert(fitted.x.length == N_OBJECTS && rms.length == N_OBJECTS, "wrong number of fits");
+
+  for (uint32_t i = 0; i < N_OBJECTS; i++) {
+    double want_pos[3], want_vel[3], pos[3], vel[3];
+    cartesian_orbits_get(&truth, i, want_pos, want_vel);
+    cartesian_orbits_get(&fitted, i, pos, vel);
+    double dp = sqrt(pow(pos[0] - want_pos[0], 2) + pow(pos[1] - want_pos[1], 2) + pow(pos[2] - want_pos[2], 2));
+    double dv = sqrt(pow(vel[0] - want_vel[0], 2) + pow(vel[1] - want_vel[1], 2) + pow(vel[2] - want_vel[2], 2));
+    double r = sqrt(want_pos[0] * want_pos[0] + want_pos[1] * want_pos[1] + want_pos[2] * want_pos[2]);
+    double v = sqrt(want_vel[0] * want_vel[0] + want_vel[1] * want_vel[1] + want_vel[2] * want_vel[2]);
+    // Three detections determine the orbit exactly, so even the
+    // shortest fits should land on the truth.
+    if (!(dp < 1e-7 * r) || !(dv < 1e-7 * v)) {
+      sprintf(message, "object %u: position off by %g AU, velocity off by %g AU/day", i, dp, dv);
+      return message;
+    }
+    ut_assert(fitted.t.data[i] == truth.t.data[i], "fit epoch should be the starting orbit's");
+    ut_assert(rms.data[i] < 1e-9, "noiseless fit should have tiny residuals");
+  }
+
+  // A used output is overwritten from row 0, and left empty on failure.
+  struct CartesianOrbits first;
+  cartesian_orbits_new(&first, N_OBJECTS);
+  for (uint32_t i = 0; i < N_OBJECTS; i++) {
+    double pos[3], vel[3];
+    cartesian_orbits_get(&fitted, i, pos, vel);
+    cartesian_orbits_push(&first, pos, vel, fitted.t.data[i]);
+  }
+  double *storage = fitted.x.data;
+  status = differential_correction(&start, &detections, &table, offsets, indices, MU, NULL, &fitted, &rms);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_NONE, "repeated differential_correction failed");
+  ut_assert(fitted.x.length == N_OBJECTS && rms.length == N_OBJECTS, "wrong length on reuse");
+  ut_assert(fitted.x.data == storage, "reused output should keep its storage");
+  for (uint32_t i = 0; i < N_OBJECTS; i++) {
+    ut_assert(fitted.x.data[i] == first.x.data[i] && fitted.vz.data[i] == first.vz.data[i],
+              "reused output differs from a fresh one");
+  }
+  status = differential_correction(&start, &detections, &table, offsets, indices, -MU, NULL, &fitted, &rms);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT, "negative mu should fail");
+  ut_assert(fitted.x.length == 0 && fitted.t.length == 0 && rms.length == 0, "failed output should be empty");
+
+  cartesian_orbits_free(&first);
+  cartesian_orbits_free(&fitted);
+  vec_f64_free(&rms);
+  cartesian_orbits_free(&start);
+  topocentric_point_sources_free(&detections);
+  free(detections.obscode);
+  observatory_table_free(&table);
+  cartesian_orbits_free(&truth);
+  return 0;
+}
+
+static char *test_differential_correction_noisy(void) {
+  struct CartesianOrbits truth, start;
+  struct TopocentricPointSources detections;
+  struct ObservatoryTable table;
+  observe_at(fit_times, N_FIT_TIMES, &truth, &detections, &table);
+  perturb(&truth, &start);
+  size_t offsets[N_OBJECTS + 1];
+  uint32_t indices[N_OBJECTS * N_FIT_TIMES];
+  link_objects(offsets, indices);
+
+  // Deterministic errors of up to 0.1 arcseconds on every detection.
+  double noise = 0.1 / 3600.0;
+  for (size_t row = 0; row < detections.ra.length; row++) {
+    detections.ra.data[row] += noise * sin(3.1 * row);
+    detections.dec.data[row] += noise * cos(1.7 * row);
+  }
+
+  struct CartesianOrbits fitted = CARTESIAN_ORBITS_ZERO;
+  struct VecF64 rms = VECF64_ZERO;
+  enum OrbitDeterminationError status =
+      differential_correction(&start, &detections, &table, offsets, indices, MU, NULL, &fitted, &rms);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_NONE, "differential_correction failed");
+  for (uint32_t i = 0; i < N_OBJECTS; i++) {
+    size_t count = offsets[i + 1] - offsets[i];
+    ut_assert(isfinite(fitted.x.data[i]) && isfinite(fitted.vz.data[i]), "noisy fit should converge");
+    // The fit can never do worse than the truth, whose residuals are
+    // the noise itself.
+    ut_assert(rms.data[i] <= 1.5 * noise, "residuals should be at the noise level");
+    ut_assert(count == 3 || rms.data[i] > 0.0, "overdetermined fits should leave residuals");
+  }
+
+  cartesian_orbits_free(&fitted);
+  vec_f64_free(&rms);
+  cartesian_orbits_free(&start);
+  topocentric_point_sources_free(&detections);
+  free(detections.obscode);
+  observatory_table_free(&table);
+  cartesian_orbits_free(&truth);
+  return 0;
+}
+
+static char *test_differential_correction_empty_fits(void) {
+  struct CartesianOrbits truth, start;
+  struct TopocentricPointSources detections;
+  struct ObservatoryTable table;
+  observe_at(fit_times, N_FIT_TIMES, &truth, &detections, &table);
+  perturb(&truth, &start);
+
+  // Objects 0 and 9 have no detections and object 5 only two; they
+  // share lane blocks with fits that do.
+  size_t offsets[N_OBJECTS + 1];
+  uint32_t indices[N_OBJECTS * N_FIT_TIMES];
+  offsets[0] = 0;
+  for (uint32_t i = 0; i < N_OBJECTS; i++) {
+    size_t count = i == 0 || i == 9 ? 0 : i == 5 ? 2 : 3 + i % (N_FIT_TIMES - 2);
+    for (size_t k = 0; k < count; k++) {
+      indices[offsets[i] + k] = (uint32_t)(i * N_FIT_TIMES + k);
+    }
+    offsets[i + 1] = offsets[i] + count;
+  }
+
+  struct CartesianOrbits fitted = CARTESIAN_ORBITS_ZERO;
+  struct VecF64 rms = VECF64_ZERO;
+  enum OrbitDeterminationError status =
+      differential_correction(&start, &detections, &table, offsets, indices, MU, NULL, &fitted, &rms);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_NONE, "differential_correction failed");
+  ut_assert(fitted.x.length == N_OBJECTS && rms.length == N_OBJECTS, "wrong number of fits");
+
+  for (uint32_t i = 0; i < N_OBJECTS; i++) {
+    double want_pos[3], want_vel[3], pos[3], vel[3];
+    cartesian_orbits_get(&truth, i, want_pos, want_vel);
+    cartesian_orbits_get(&fitted, i, pos, vel);
+    if (offsets[i + 1] - offsets[i] < 3) {
+      ut_assert(isnan(pos[0]) && isnan(vel[2]) && isnan(rms.data[i]), "short fit should give a NaN row");
+      continue;
+    }
+    double dp = sqrt(pow(pos[0] - want_pos[0], 2) + pow(pos[1] - want_pos[1], 2) + pow(pos[2] - want_pos[2], 2));
+    double r = sqrt(want_pos[0] * want_pos[0] + want_pos[1] * want_pos[1] + want_pos[2] * want_pos[2]);
+    if (!(dp < 1e-7 * r)) {
+      sprintf(message, "object %u: position off by %g AU next to empty fits", i, dp);
+      return message;
+    }
+  }
+
+  cartesian_orbits_free(&fitted);
+  vec_f64_free(&rms);
+  cartesian_orbits_free(&start);
+  topocentric_point_sources_free(&detections);
+  free(detections.obscode);
+  observatory_table_free(&table);
+  cartesian_orbits_free(&truth);
+  return 0;
+}
+
+static char *test_differential_correction_threads_match_serial(void) {
+  struct CartesianOrbits truth, start, repeated;
+  struct TopocentricPointSources detections;
+  struct ObservatoryTable table;
+  observe_at(fit_times, N_FIT_TIMES, &truth, &detections, &table);
+  perturb(&truth, &start);
+  size_t object_offsets[N_OBJECTS + 1];
+  uint32_t object_indices[N_OBJECTS * N_FIT_TIMES];
+  link_objects(object_offsets, object_indices);
+
+  // Enough fits for several tasks, reusing the same objects.
+  size_t n_fits = 3 * DIFFERENTIAL_CORRECTION_TASK_FITS + 5;
+  size_t *offsets = malloc((n_fits + 1) * sizeof(size_t));
+  uint32_t *indices = malloc(n_fits * N_FIT_TIMES * sizeof(uint32_t));
+  cartesian_orbits_new(&repeated, n_fits);
+  offsets[0] = 0;
+  for (size_t f = 0; f < n_fits; f++) {
+    size_t i = f % N_OBJECTS;
+    double pos[3], vel[3];
+    cartesian_orbits_get(&start, i, pos, vel);
+    cartesian_orbits_push(&repeated, pos, vel, start.t.data[i]);
+    size_t count = object_offsets[i + 1] - object_offsets[i];
+    for (size_t k = 0; k < count; k++) {
+      indices[offsets[f] + k] = object_indices[object_offsets[i] + k];
+    }
+    offsets[f + 1] = offsets[f] + count;
+  }
+
+  struct CartesianOrbits serial = CARTESIAN_ORBITS_ZERO, threaded = CARTESIAN_ORBITS_ZERO;
+  struct VecF64 serial_rms = VECF64_ZERO, threaded_rms = VECF64_ZERO;
+  enum OrbitDeterminationError status =
+      differential_correction(&repeated, &detections, &table, offsets, indices, MU, NULL, &serial, &serial_rms);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_NONE, "serial differential_correction failed");
+  struct ThreadPool pool;
+  ut_assert(thread_pool_new(&pool, 3) == 0, "thread_pool_new failed");
+  status = differential_correction(&repeated, &detections, &table, offsets, indices, MU, &pool, &threaded,
+                                   &threaded_rms);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_NONE, "threaded differential_correction failed");
+
+  ut_assert(threaded.x.length == n_fits, "threaded run has the wrong number of fits");
+  for (size_t f = 0; f < n_fits; f++) {
+    ut_assert(threaded.x.data[f] == serial.x.data[f] && threaded.vz.data[f] == serial.vz.data[f],
+              "threaded fits differ");
+    ut_assert(threaded_rms.data[f] == serial_rms.data[f], "threaded residuals differ");
+  }
+
+  thread_pool_free(&pool);
+  free(offsets);
+  free(indices);
+  cartesian_orbits_free(&serial);
+  cartesian_orbits_free(&threaded);
+  vec_f64_free(&serial_rms);
+  vec_f64_free(&threaded_rms);
+  cartesian_orbits_free(&repeated);
+  cartesian_orbits_free(&start);
+  topocentric_point_sources_free(&detections);
+  free(detections.obscode);
+  observatory_table_free(&table);
+  cartesian_orbits_free(&truth);
+  return 0;
+}
+
+static char *test_differential_correction_invalid_input(void) {
+  struct CartesianOrbits truth, start;
+  struct TopocentricPointSources detections;
+  struct ObservatoryTable table;
+  observe_at(fit_times, N_FIT_TIMES, &truth, &detections, &table);
+  perturb(&truth, &start);
+  size_t offsets[N_OBJECTS + 1];
+  uint32_t indices[N_OBJECTS * N_FIT_TIMES];
+  link_objects(offsets, indices);
+
+  struct CartesianOrbits fitted = CARTESIAN_ORBITS_ZERO;
+  struct VecF64 rms = VECF64_ZERO;
+  enum OrbitDeterminationError status =
+      differential_correction(&start, &detections, &table, offsets, indices, -1.0, NULL, &fitted, &rms);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT, "negative mu should fail");
+
+  uint32_t saved = indices[4];
+  indices[4] = N_OBJECTS * N_FIT_TIMES;
+  status = differential_correction(&start, &detections, &table, offsets, indices, MU, NULL, &fitted, &rms);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT, "out of range index should fail");
+  indices[4] = saved;
+
+  size_t saved_offset = offsets[2];
+  offsets[2] = offsets[1] - 1;
+  status = differential_correction(&start, &detections, &table, offsets, indices, MU, NULL, &fitted, &rms);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_INVALID_ARGUMENT, "decreasing offsets should fail");
+  offsets[2] = saved_offset;
+
+  struct ObservatoryTable empty;
+  observatory_table_new(&empty);
+  status = differential_correction(&start, &detections, &empty, offsets, indices, MU, NULL, &fitted, &rms);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_UNKNOWN_OBSERVATORY, "unknown observatory should fail");
+  observatory_table_free(&empty);
+
+  // A fit with only two detections gives a NaN row, and the others are
+  // unaffected.
+  offsets[1] = 2;
+  status = differential_correction(&start, &detections, &table, offsets, indices, MU, NULL, &fitted, &rms);
+  ut_assert(status == ORBIT_DETERMINATION_ERROR_NONE, "short fit should not fail");
+  ut_assert(isnan(fitted.x.data[0]) && isnan(rms.data[0]), "short fit should give a NaN row");
+  ut_assert(fabs(fitted.x.data[2] - truth.x.data[2]) < 1e-7, "other fits should be unaffected");
+
+  cartesian_orbits_free(&fitted);
+  vec_f64_free(&rms);
+  cartesian_orbits_free(&start);
+  topocentric_point_sources_free(&detections);
+  free(detections.obscode);
+  observatory_table_free(&table);
+  cartesian_orbits_free(&truth);
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_gauss_recovers_orbits);
+  ut_run_test(test_gauss_threads_match_serial);
+  ut_run_test(test_gauss_invalid_input);
+  ut_run_test(test_differential_correction_recovers_orbits);
+  ut_run_test(test_differential_correction_noisy);
+  ut_run_test(test_differential_correction_empty_fits);
+  ut_run_test(test_differential_correction_threads_match_serial);
+  ut_run_test(test_differential_correction_invalid_input);
+  return 0;
+}
+
+int main() {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+
+#include "orbits.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+static char *test_cartesian_orbits() {
+  struct CartesianOrbits orbits;
+  int status = cartesian_orbits_new(&orbits, 1);
+  ut_assert(status == 0, "cartesian_orbits_new failed");
+
+  double pos_a[3] = {1.0, 2.0, 3.0};
+  double vel_a[3] = {0.1, 0.2, 0.3};
+  double pos_b[3] = {4.0, 5.0, 6.0};
+  double vel_b[3] = {0.4, 0.5, 0.6};
+  cartesian_orbits_push(&orbits, pos_a, vel_a, 100.0);
+  cartesian_orbits_push(&orbits, pos_b, vel_b, 200.0);
+
+  ut_assert(orbits.x.length == 2, "wrong length for x");
+  ut_assert(orbits.vz.length == 2, "wrong length for vz");
+  ut_assert(orbits.t.data[1] == 200.0, "wrong value for t[1]");
+
+  double pos[3], vel[3];
+  status = cartesian_orbits_get(&orbits, 1, pos, vel);
+  ut_assert(status == 0, "cartesian_orbits_get failed");
+  ut_assert(pos[0] == 4.0 && pos[1] == 5.0 && pos[2] == 6.0, "wrong position");
+  ut_assert(vel[0] == 0.4 && vel[1] == 0.5 && vel[2] == 0.6, "wrong velocity");
+
+  status = cartesian_orbits_get(&orbits, 2, pos, vel);
+  ut_assert(status == -1, "out of range get should fail");
+
+  struct CartesianOrbits view;
+  status = cartesian_orbits_view(&orbits, 1, 1, &view);
+  ut_assert(status == 0, "cartesian_orbits_view failed");
+  ut_assert(view.x.length == 1 && view.x.data == orbits.x.data + 1, "view should not copy");
+  ut_assert(view.t.data[0] == 200.0, "wrong value for view t[0]");
+  status = cartesian_orbits_view(&orbits, 1, 2, &view);
+  ut_assert(status == -1, "out of range view should fail");
+
+  cartesian_orbits_free(&orbits);
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_cartesian_orbits);
+  return 0;
+}
+
+int main(void) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
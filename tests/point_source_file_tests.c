@@ -0,0 +1,237 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "point_source_file.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+static char *test_cartesian_round_trip() {
+  char path[] = "/tmp/cthor_point_sources_XXXXXX";
+  int fd = mkstemp(path);
+  ut_assert(fd >= 0, "mkstemp failed");
+  close(fd);
+
+  struct CartesianPointSources cartesian;
+  cartesian_point_sources_new(&cartesian, 8);
+  for (size_t i = 0; i < 37; i++) {
+    cartesian_point_sources_push(&cartesian, i * 1.0, i * 2.0, i * 3.0, 59000.0 + i);
+  }
+  enum PointSourceFileError status = point_source_file_write_cartesian(path, &cartesian);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_NONE, "write failed");
+
+  struct PointSourceFile file;
+  status = point_source_file_open(&file, path);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_NONE, "open failed");
+
+  struct CartesianPointSources view;
+  status = point_source_file_cartesian(&file, &view);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_NONE, "cartesian view failed");
+  ut_assert(view.x.length == 37 && view.t.length == 37, "wrong length");
+  ut_assert((uintptr_t)view.x.data % 64 == 0, "x column is not 64-byte aligned");
+  ut_assert((uintptr_t)view.y.data % 64 == 0, "y column is not 64-byte aligned");
+  ut_assert((uintptr_t)view.z.data % 64 == 0, "z column is not 64-byte aligned");
+  ut_assert((uintptr_t)view.t.data % 64 == 0, "t column is not 64-byte aligned");
+  ut_assert(view.x.borrowed, "view should be borrowed");
+  ut_assert(memcmp(view.x.data, cartesian.x.data, 37 * sizeof(double)) == 0, "wrong x column");
+  ut_assert(memcmp(view.y.data, cartesian.y.data, 37 * sizeof(double)) == 0, "wrong y column");
+  ut_assert(memcmp(view.z.data, cartesian.z.data, 37 * sizeof(double)) == 0, "wrong z column");
+  ut_assert(memcmp(view.t.data, cartesian.t.data, 37 * sizeof(double)) == 0, "wrong t column");
+
+  // A view is read-only; pushing copies it out of the mapping.
+  struct TopocentricPointSources wrong_kind;
+  status = point_source_file_topocentric(&file, &wrong_kind);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_WRONG_KIND, "opened a Cartesian file as topocentric");
+
+  cartesian_point_sources_push(&view, 100.0, 200.0, 300.0, 400.0);
+  ut_assert(!view.x.borrowed, "push should have copied the column");
+  ut_assert(view.x.length == 38, "wrong length after push");
+  ut_assert(view.x.data[36] == 36.0 && view.x.data[37] == 100.0, "wrong values after push");
+  cartesian_point_sources_free(&view);
+
+  point_source_file_close(&file);
+  cartesian_point_sources_free(&cartesian);
+  unlink(path);
+  return 0;
+}
+
+static char *test_topocentric_round_trip() {
+  char path[] = "/tmp/cthor_point_sources_XXXXXX";
+  int fd = mkstemp(path);
+  ut_assert(fd >= 0, "mkstemp failed");
+  close(fd);
+
+  struct String *obscode = malloc(sizeof(struct String));
+  *obscode = string_create("I41");
+  struct TopocentricPointSources topocentric;
+  topocentric_point_sources_new(&topocentric, 4, obscode);
+  topocentric_point_sources_push(&topocentric, 10.0, 20.0, 59000.0);
+  topocentric_point_sources_push(&topocentric, 11.0, 21.0, 59000.5);
+  struct String other = string_create("F51");
+  uint16_t other_id = obscode_intern(&other);
+  topocentric_point_sources_push_obscode(&topocentric, 12.0, 22.0, 59000.5, other_id);
+
+  enum PointSourceFileError status = point_source_file_write_topocentric(path, &topocentric);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_NONE, "write failed");
+
+  struct PointSourceFile file;
+  status = point_source_file_open(&file, path);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_NONE, "open failed");
+  struct TopocentricPointSources view;
+  status = point_source_file_topocentric(&file, &view);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_NONE, "topocentric view failed");
+  ut_assert(view.ra.length == 3 && view.obscode_id.length == 3, "wrong length");
+  ut_assert(view.ra.data[1] == 11.0 && view.dec.data[1] == 21.0 && view.t.data[1] == 59000.5, "wrong values");
+  ut_assert(string_equal(obscode_lookup(view.obscode_id.data[0]), obscode), "wrong obscode");
+  ut_assert(string_equal(obscode_lookup(view.obscode_id.data[2]), &other), "wrong obscode");
+  ut_assert(view.default_obscode_id == OBSCODE_NONE, "two observatories have no default");
+
+  point_source_file_close(&file);
+  topocentric_point_sources_free(&topocentric);
+  free(obscode);
+  string_free(&other);
+  unlink(path);
+  return 0;
+}
+
+// Writes a three-row topocentric file by hand, with its first
+// n_columns columns and a dictionary holding obscode, so that old and
+// malformed layouts can be tested. Every row gets obscode id 0 except
+// row bad_row, which gets bad_id.
+static int write_raw_file(const char *path, uint32_t version, uint32_t n_columns, const char *obscode,
+                          size_t bad_row, uint16_t bad_id) {
+  enum { N_ROWS = 3, SIZE = 512, DICTIONARY_OFFSET = 384 };
+  char buf[SIZE];
+  memset(buf, 0, sizeof(buf));
+  struct PointSourceFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, POINT_SOURCE_FILE_MAGIC, sizeof(POINT_SOURCE_FILE_MAGIC));
+  header.version = version;
+  header.byte_order = POINT_SOURCE_FILE_BYTE_ORDER;
+  header.kind = POINT_SOURCE_FILE_TOPOCENTRIC;
+  header.n_columns = n_columns;
+  header.n_rows = N_ROWS;
+  header.dictionary_offset = DICTIONARY_OFFSET;
+  header.dictionary_size = sizeof(uint32_t) + strlen(obscode);
+  header.n_obscodes = 1;
+  memcpy(buf, &header, sizeof(header));
+
+  // Columns 0 to 3 sit at 128, 192, 256 and 320, whether or not the
+  // header admits to them.
+  uint64_t column_offsets[8] = {128, 192, 256, 320};
+  memcpy(buf + sizeof(header), column_offsets, sizeof(column_offsets));
+  for (size_t i = 0; i < N_ROWS; i++) {
+    double ra = 10.0 + i, dec = 20.0 + i, t = 59000.0 + i;
+    uint16_t id = i == bad_row ? bad_id : 0;
+    memcpy(buf + 128 + i * sizeof(double), &ra, sizeof(double));
+    memcpy(buf + 192 + i * sizeof(double), &dec, sizeof(double));
+    memcpy(buf + 256 + i * sizeof(double), &t, sizeof(double));
+    memcpy(buf + 320 + i * sizeof(uint16_t), &id, sizeof(uint16_t));
+  }
+  uint32_t length = (uint32_t)strlen(obscode);
+  memcpy(buf + DICTIONARY_OFFSET, &length, sizeof(length));
+  memcpy(buf + DICTIONARY_OFFSET + sizeof(length), obscode, length);
+
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    return -1;
+  }
+  int failed = fwrite(buf, sizeof(buf), 1, f) != 1;
+  return fclose(f) != 0 || failed ? -1 : 0;
+}
+
+static char *test_reads_version_1() {
+  char path[] = "/tmp/cthor_point_sources_XXXXXX";
+  int fd = mkstemp(path);
+  ut_assert(fd >= 0, "mkstemp failed");
+  close(fd);
+  ut_assert(write_raw_file(path, 1, 3, "W84", 3, 0) == 0, "write failed");
+
+  struct PointSourceFile file;
+  enum PointSourceFileError status = point_source_file_open(&file, path);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_NONE, "version 1 file should open");
+  struct TopocentricPointSources view;
+  status = point_source_file_topocentric(&file, &view);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_NONE, "topocentric view failed");
+  ut_assert(view.ra.length == 3 && view.obscode_id.length == 3, "wrong length");
+  ut_assert(view.ra.data[2] == 12.0 && view.dec.data[2] == 22.0 && view.t.data[2] == 59002.0, "wrong values");
+
+  // Every row belongs to the dictionary's one observatory.
+  struct String w84 = string_create("W84");
+  uint16_t id = obscode_intern(&w84);
+  for (size_t i = 0; i < 3; i++) {
+    ut_assert(view.obscode_id.data[i] == id, "rows should take the file's observatory");
+  }
+  ut_assert(view.default_obscode_id == id, "wrong default observatory");
+
+  point_source_file_close(&file);
+  string_free(&w84);
+  unlink(path);
+  return 0;
+}
+
+static char *test_rejects_bad_files() {
+  char path[] = "/tmp/cthor_point_sources_XXXXXX";
+  int fd = mkstemp(path);
+  ut_assert(fd >= 0, "mkstemp failed");
+  char garbage[256];
+  memset(garbage, 'x', sizeof(garbage));
+  ut_assert(write(fd, garbage, sizeof(garbage)) == sizeof(garbage), "write failed");
+  close(fd);
+
+  struct PointSourceFile file;
+  enum PointSourceFileError status = point_source_file_open(&file, path);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_FORMAT, "garbage should not open");
+
+  // A version 2 topocentric file must have its obscode_id column.
+  ut_assert(write_raw_file(path, 2, 3, "I41", 3, 0) == 0, "write failed");
+  status = point_source_file_open(&file, path);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_FORMAT, "missing obscode_id column should not open");
+  ut_assert(write_raw_file(path, 1, 4, "I41", 3, 0) == 0, "write failed");
+  status = point_source_file_open(&file, path);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_FORMAT, "extra column should not open");
+
+  // Ids outside the dictionary are rejected, both when the file's ids
+  // match the process's (I41 was interned first) and when they are
+  // translated.
+  struct String i41 = string_create("I41");
+  ut_assert(obscode_intern(&i41) == 0, "I41 should have the first id");
+  string_free(&i41);
+  ut_assert(write_raw_file(path, 2, 4, "I41", 1, 1) == 0, "write failed");
+  status = point_source_file_open(&file, path);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_FORMAT, "out of range id should not open");
+  ut_assert(write_raw_file(path, 2, 4, "F51", 1, 1) == 0, "write failed");
+  status = point_source_file_open(&file, path);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_FORMAT, "out of range id should not open");
+  ut_assert(write_raw_file(path, 2, 4, "I41", 1, OBSCODE_NONE) == 0, "write failed");
+  status = point_source_file_open(&file, path);
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_NONE, "rows with no observatory should open");
+  point_source_file_close(&file);
+  unlink(path);
+
+  status = point_source_file_open(&file, "/nonexistent/points.cthor");
+  ut_assert(status == POINT_SOURCE_FILE_ERROR_IO, "missing file should not open");
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_cartesian_round_trip);
+  ut_run_test(test_topocentric_round_trip);
+  ut_run_test(test_reads_version_1);
+  ut_run_test(test_rejects_bad_files);
+  return 0;
+}
+
+int main(void) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
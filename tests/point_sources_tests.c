@@ -1,3 +1,4 @@
+#include <stdint.h>
 #include <stdio.h>
 
 #include "point_sources.h"
@@ -96,10 +97,130 @@ static char* test_gnomonic_point_sources() {
   return 0;
 }
 
+static char* test_point_sources_in_arena() {
+  struct Arena arena;
+  int status = arena_new(&arena, 1 << 16, ARENA_DEFAULT);
+  ut_assert(status == 0, "arena_new failed");
+
+  struct CartesianPointSources cartesian;
+  status = cartesian_point_sources_new_in(&cartesian, 10, &arena);
+  ut_assert(status == 0, "cartesian_point_sources_new_in failed");
+  ut_assert(cartesian.x.capacity == 10, "wrong capacity");
+  ut_assert((uintptr_t)cartesian.x.data % ARENA_ALIGNMENT == 0, "x is not aligned");
+  ut_assert((uintptr_t)cartesian.t.data % ARENA_ALIGNMENT == 0, "t is not aligned");
+  ut_assert((char*)cartesian.y.data - (char*)cartesian.x.data == 128, "columns are not in one block");
+
+  cartesian_point_sources_push(&cartesian, 1.0, 2.0, 3.0, 4.0);
+  ut_assert(cartesian.z.length == 1 && cartesian.z.data[0] == 3.0, "wrong value for z[0]");
+
+  // Growing past capacity moves the columns out of the arena.
+  for (size_t i = 0; i < 10; i++) {
+    cartesian_point_sources_push(&cartesian, 1.0, 2.0, 3.0, 4.0);
+  }
+  ut_assert(cartesian.x.length == 11, "wrong length after growth");
+  ut_assert(!cartesian.x.borrowed, "grown column should be owned");
+  cartesian_point_sources_free(&cartesian);
+
+  struct GnomonicPointSources gnomonic;
+  status = gnomonic_point_sources_new_in(&gnomonic, 1 << 20, &arena);
+  ut_assert(status == -1, "allocation larger than the arena should fail");
+
+  // So is one whose size does not fit in a size_t.
+  status = gnomonic_point_sources_new_in(&gnomonic, SIZE_MAX / 16, &arena);
+  ut_assert(status == -1, "overflowing allocation should fail");
+  status = cartesian_point_sources_new_in(&cartesian, SIZE_MAX / 8, &arena);
+  ut_assert(status == -1, "overflowing allocation should fail");
+
+  arena_reset(&arena);
+  // The obscode ids share the block, on a cache line after the times.
+  struct TopocentricPointSources topocentric;
+  status = topocentric_point_sources_new_in(&topocentric, 10, NULL, &arena);
+  ut_assert(status == 0, "topocentric_point_sources_new_in failed");
+  ut_assert((uintptr_t)topocentric.obscode_id.data % ARENA_ALIGNMENT == 0, "obscode_id is not aligned");
+  ut_assert((char*)topocentric.obscode_id.data - (char*)topocentric.t.data == 128, "obscode_id is not in the block");
+  ut_assert(topocentric.obscode_id.capacity == 10 && topocentric.obscode_id.borrowed, "wrong obscode_id column");
+  status = topocentric_point_sources_new_in(&topocentric, SIZE_MAX / 16, NULL, &arena);
+  ut_assert(status == -1, "overflowing allocation should fail");
+
+  arena_reset(&arena);
+  status = gnomonic_point_sources_new_in(&gnomonic, 100, &arena);
+  ut_assert(status == 0, "gnomonic_point_sources_new_in failed after reset");
+  gnomonic_point_sources_push(&gnomonic, 1.0, 2.0, 3.0);
+  ut_assert(gnomonic.t.data[0] == 3.0, "wrong value for t[0]");
+  // Freeing arena-backed containers is allowed, and leaves the arena
+  // memory alone.
+  gnomonic_point_sources_free(&gnomonic);
+
+  arena_free(&arena);
+  return 0;
+}
+
+static char* test_point_sources_bulk() {
+  struct TopocentricPointSources topocentric;
+  struct String obscode = string_create("500");
+  int status = topocentric_point_sources_new(&topocentric, 1, &obscode);
+  ut_assert(status == 0, "topocentric_point_sources_new failed");
+
+  double ra[3] = {1.0, 2.0, 3.0};
+  double dec[3] = {4.0, 5.0, 6.0};
+  double t[3] = {7.0, 8.0, 9.0};
+  uint16_t obscode_id[3] = {11, 12, 13};
+  status = topocentric_point_sources_append(&topocentric, ra, dec, t, NULL, 3);
+  ut_assert(status == 0, "topocentric_point_sources_append failed");
+  status = topocentric_point_sources_append(&topocentric, ra, dec, t, obscode_id, 3);
+  ut_assert(status == 0, "topocentric_point_sources_append with obscodes failed");
+  ut_assert(topocentric.ra.length == 6 && topocentric.obscode_id.length == 6, "wrong length after append");
+  ut_assert(topocentric.dec.data[4] == 5.0 && topocentric.t.data[5] == 9.0, "wrong appended values");
+  ut_assert(topocentric.obscode_id.data[2] == topocentric.default_obscode_id, "wrong default obscode");
+  ut_assert(topocentric.obscode_id.data[3] == 11, "wrong explicit obscode");
+
+  size_t capacity = topocentric.ra.capacity;
+  topocentric_point_sources_clear(&topocentric);
+  ut_assert(topocentric.ra.length == 0 && topocentric.obscode_id.length == 0, "clear should empty every column");
+  ut_assert(topocentric.ra.capacity == capacity, "clear should keep the capacity");
+  topocentric_point_sources_free(&topocentric);
+
+  struct CartesianPointSources cartesian = CARTESIAN_POINT_SOURCES_ZERO;
+  status = cartesian_point_sources_reserve(&cartesian, 50);
+  ut_assert(status == 0 && cartesian.x.capacity >= 50 && cartesian.t.capacity >= 50, "reserve failed");
+  ut_assert(cartesian.x.length == 0, "reserve should not change the length");
+  status = cartesian_point_sources_resize(&cartesian, 20);
+  ut_assert(status == 0 && cartesian.z.length == 20, "resize failed");
+  for (size_t i = 0; i < 20; i++) {
+    cartesian.x.data[i] = (double)i;
+    cartesian.y.data[i] = cartesian.z.data[i] = cartesian.t.data[i] = 0.0;
+  }
+  status = cartesian_point_sources_append(&cartesian, ra, dec, t, ra, 3);
+  ut_assert(status == 0 && cartesian.x.length == 23 && cartesian.t.data[22] == 3.0, "append after resize failed");
+  ut_assert(cartesian.x.data[19] == 19.0, "append should keep earlier rows");
+  ut_assert(cartesian_point_sources_push(&cartesian, 1.0, 2.0, 3.0, 4.0) == 0, "push failed");
+  ut_assert(cartesian.y.length == 24 && cartesian.y.data[23] == 2.0, "wrong pushed value");
+  cartesian_point_sources_free(&cartesian);
+
+  struct GnomonicPointSources gnomonic = GNOMONIC_POINT_SOURCES_ZERO;
+  status = gnomonic_point_sources_append(&gnomonic, ra, dec, t, 3);
+  ut_assert(status == 0 && gnomonic.y.data[1] == 5.0 && gnomonic.t.length == 3, "gnomonic append failed");
+  gnomonic_point_sources_clear(&gnomonic);
+  ut_assert(gnomonic.x.length == 0 && gnomonic.x.capacity >= 3, "gnomonic clear failed");
+  gnomonic_point_sources_free(&gnomonic);
+
+  struct GnomonicPointSourcesF32 gnomonic_f32 = GNOMONIC_POINT_SOURCES_F32_ZERO;
+  float x32[2] = {1.0f, 2.0f};
+  status = gnomonic_point_sources_f32_append(&gnomonic_f32, x32, x32, t, 2);
+  ut_assert(status == 0 && gnomonic_f32.y.data[1] == 2.0f && gnomonic_f32.t.data[1] == 8.0,
+            "f32 append failed");
+  status = gnomonic_point_sources_f32_resize(&gnomonic_f32, 10);
+  ut_assert(status == 0 && gnomonic_f32.t.length == 10, "f32 resize failed");
+  gnomonic_point_sources_f32_free(&gnomonic_f32);
+  return 0;
+}
+
 static char* all_tests() {
   ut_run_test(test_topocentric_point_sources);
   ut_run_test(test_cartesian_point_sources);
   ut_run_test(test_gnomonic_point_sources);
+  ut_run_test(test_point_sources_in_arena);
+  ut_run_test(test_point_sources_bulk);
   return 0;
 }
 
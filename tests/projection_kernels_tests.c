@@ -0,0 +1,373 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "projection_kernels.h"
+#include "simd.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+// Odd, so that every vector kernel runs its tail path.
+#define N_POINTS 1003
+
+static double rotation[3][3] = {{0.8, 0.5, 0.33}, {-0.52, 0.85, 0.0}, {-0.28, -0.17, 0.94}};
+
+static double rand_near(double x) { return x + ((double)rand() / RAND_MAX - 0.5) / 5.0; }
+
+static char *test_kernels_match_scalar(void) {
+  double *x = malloc(N_POINTS * sizeof(double));
+  double *y = malloc(N_POINTS * sizeof(double));
+  double *z = malloc(N_POINTS * sizeof(double));
+  double *want_x = malloc(N_POINTS * sizeof(double));
+  double *want_y = malloc(N_POINTS * sizeof(double));
+  double *got_x = malloc(N_POINTS * sizeof(double));
+  double *got_y = malloc(N_POINTS * sizeof(double));
+
+  srand(42);
+  for (size_t i = 0; i < N_POINTS; i++) {
+    x[i] = rand_near(0.9);
+    y[i] = rand_near(0.8);
+    z[i] = rand_near(0.01);
+  }
+
+  projection_kernel_fn scalar = projection_kernel(SIMD_LEVEL_SCALAR);
+  ut_assert(scalar != NULL, "scalar kernel must always be available");
+  scalar(rotation, x, y, z, want_x, want_y, N_POINTS);
+
+  char *result = 0;
+  for (int level = SIMD_LEVEL_SSE2; level < SIMD_LEVEL_COUNT && result == 0; level++) {
+    projection_kernel_fn kernel = projection_kernel(level);
+    if (kernel == NULL) {
+      printf("  skipping %s: not supported on this CPU\n", simd_level_name(level));
+      continue;
+    }
+    kernel(rotation, x, y, z, got_x, got_y, N_POINTS);
+    for (size_t i = 0; i < N_POINTS; i++) {
+      if (fabs(got_x[i] - want_x[i]) > PROJECTION_KERNEL_TOLERANCE * fabs(want_x[i]) ||
+          fabs(got_y[i] - want_y[i]) > PROJECTION_KERNEL_TOLERANCE * fabs(want_y[i])) {
+        sprintf(message, "%s kernel differs from scalar at %zu: (%.17g, %.17g) != (%.17g, %.17g)",
+                simd_level_name(level), i, got_x[i], got_y[i], want_x[i], want_y[i]);
+        result = message;
+        break;
+      }
+    }
+  }
+
+  free(x);
+  free(y);
+  free(z);
+  free(want_x);
+  free(want_y);
+  free(got_x);
+  free(got_y);
+  return result;
+}
+
+static char *test_f32_kernels_within_tolerance(void) {
+  double *x = malloc(N_POINTS * sizeof(double));
+  double *y = malloc(N_POINTS * sizeof(double));
+  double *z = malloc(N_POINTS * sizeof(double));
+  double *want_x = malloc(N_POINTS * sizeof(double));
+  double *want_y = malloc(N_POINTS * sizeof(double));
+  float *got_x = malloc(N_POINTS * sizeof(float));
+  float *got_y = malloc(N_POINTS * sizeof(float));
+
+  srand(43);
+  for (size_t i = 0; i < N_POINTS; i++) {
+    x[i] = rand_near(0.9);
+    y[i] = rand_near(0.8);
+    z[i] = rand_near(0.01);
+  }
+  projection_kernel(SIMD_LEVEL_SCALAR)(rotation, x, y, z, want_x, want_y, N_POINTS);
+
+  char *result = 0;
+  for (int level = SIMD_LEVEL_SCALAR; level < SIMD_LEVEL_COUNT && result == 0; level++) {
+    projection_kernel_f32_fn kernel = projection_kernel_f32(level);
+    if (kernel == NULL) {
+      printf("  skipping %s: not supported on this CPU\n", simd_level_name(level));
+      continue;
+    }
+    kernel(rotation, x, y, z, got_x, got_y, N_POINTS);
+    for (size_t i = 0; i < N_POINTS; i++) {
+      if (fabs(got_x[i] - want_x[i]) > PROJECTION_KERNEL_F32_TOLERANCE * fabs(want_x[i]) ||
+          fabs(got_y[i] - want_y[i]) > PROJECTION_KERNEL_F32_TOLERANCE * fabs(want_y[i])) {
+        sprintf(message, "%s f32 kernel out of tolerance at %zu: (%.9g, %.9g) != (%.17g, %.17g)",
+                simd_level_name(level), i, got_x[i], got_y[i], want_x[i], want_y[i]);
+        result = message;
+        break;
+      }
+    }
+  }
+
+  free(x);
+  free(y);
+  free(z);
+  free(want_x);
+  free(want_y);
+  free(got_x);
+  free(got_y);
+  return result;
+}
+
+static char *test_filter_kernels(void) {
+  double *x = malloc(N_POINTS * sizeof(double));
+  double *y = malloc(N_POINTS * sizeof(double));
+  double *z = malloc(N_POINTS * sizeof(double));
+  double *all_x = malloc(N_POINTS * sizeof(double));
+  double *all_y = malloc(N_POINTS * sizeof(double));
+  double *got_x = malloc(N_POINTS * sizeof(double));
+  double *got_y = malloc(N_POINTS * sizeof(double));
+  uint32_t *got_rows = malloc(N_POINTS * sizeof(uint32_t));
+
+  // A spread of points, a quarter of them mirrored behind the tangent
+  // plane, where they would otherwise project onto the same spots as
+  // points in front.
+  srand(44);
+  for (size_t i = 0; i < N_POINTS; i++) {
+    double sign = i % 4 == 0 ? -1.0 : 1.0;
+    x[i] = sign * rand_near(0.9);
+    y[i] = sign * rand_near(0.8);
+    z[i] = sign * rand_near(0.01);
+  }
+  // About a quarter of the points in front fall within this radius.
+  double radius = 20.0;
+  uint32_t first_row = 1000;
+  projection_kernel(SIMD_LEVEL_SCALAR)(rotation, x, y, z, all_x, all_y, N_POINTS);
+
+  char *result = 0;
+  for (int level = SIMD_LEVEL_SCALAR; level < SIMD_LEVEL_COUNT && result == 0; level++) {
+    projection_filter_kernel_fn kernel = projection_filter_kernel(level);
+    if (kernel == NULL) {
+      printf("  skipping %s: not supported on this CPU\n", simd_level_name(level));
+      continue;
+    }
+    size_t kept = kernel(rotation, x, y, z, N_POINTS, radius, first_row, got_x, got_y, got_rows);
+    size_t want = 0;
+    for (size_t i = 0; i < N_POINTS && result == 0; i++) {
+      double rx = rotation[0][0] * x[i] + rotation[0][1] * y[i] + rotation[0][2] * z[i];
+      if (!(rx > 0.0 && all_x[i] * all_x[i] + all_y[i] * all_y[i] <= radius * radius)) {
+        continue;
+      }
+      if (want >= kept || got_rows[want] != first_row + i ||
+          fabs(got_x[want] - all_x[i]) > PROJECTION_KERNEL_TOLERANCE * fabs(all_x[i]) ||
+          fabs(got_y[want] - all_y[i]) > PROJECTION_KERNEL_TOLERANCE * fabs(all_y[i])) {
+        sprintf(message, "%s filter kernel disagrees with scalar at input %zu", simd_level_name(level), i);
+        result = message;
+      }
+      want++;
+    }
+    if (result == 0 && (want != kept || want == 0 || want > N_POINTS / 2)) {
+      sprintf(message, "%s filter kernel kept %zu points, want %zu", simd_level_name(level), kept, want);
+      result = message;
+    }
+  }
+
+  free(x);
+  free(y);
+  free(z);
+  free(all_x);
+  free(all_y);
+  free(got_x);
+  free(got_y);
+  free(got_rows);
+  return result;
+}
+
+static char *test_inverse_kernels_match_scalar(void) {
+  double *gx = malloc(N_POINTS * sizeof(double));
+  double *gy = malloc(N_POINTS * sizeof(double));
+  double *want = malloc(3 * N_POINTS * sizeof(double));
+  double *got = malloc(3 * N_POINTS * sizeof(double));
+
+  srand(44);
+  for (size_t i = 0; i < N_POINTS; i++) {
+    gx[i] = rand_near(0.0) * 50.0;
+    gy[i] = rand_near(0.0) * 50.0;
+  }
+
+  inverse_projection_kernel_fn scalar = inverse_projection_kernel(SIMD_LEVEL_SCALAR);
+  ut_assert(scalar != NULL, "scalar inverse kernel must always be available");
+  scalar(rotation, gx, gy, want, want + N_POINTS, want + 2 * N_POINTS, N_POINTS);
+
+  char *result = 0;
+  for (int level = SIMD_LEVEL_SSE2; level < SIMD_LEVEL_COUNT && result == 0; level++) {
+    inverse_projection_kernel_fn kernel = inverse_projection_kernel(level);
+    if (kernel == NULL) {
+      printf("  skipping %s: not supported on this CPU\n", simd_level_name(level));
+      continue;
+    }
+    kernel(rotation, gx, gy, got, got + N_POINTS, got + 2 * N_POINTS, N_POINTS);
+    for (size_t i = 0; i < 3 * N_POINTS; i++) {
+      if (fabs(got[i] - want[i]) > PROJECTION_KERNEL_TOLERANCE) {
+        sprintf(message, "%s inverse kernel differs from scalar at %zu: %.17g != %.17g", simd_level_name(level),
+                i, got[i], want[i]);
+        result = message;
+        break;
+      }
+    }
+  }
+
+  free(gx);
+  free(gy);
+  free(want);
+  free(got);
+  return result;
+}
+
+static char *test_multi_kernels_match_single(void) {
+  // More frames than the widest pass, and not a multiple of any pass
+  // width, so that the last pass is partial.
+  enum { N_ORBITS = 11 };
+  double rotations[N_ORBITS][3][3];
+  for (size_t k = 0; k < N_ORBITS; k++) {
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        rotations[k][i][j] = rotation[i][j] + 0.01 * (double)k * (i == j);
+      }
+    }
+  }
+  double *x = malloc(N_POINTS * sizeof(double));
+  double *y = malloc(N_POINTS * sizeof(double));
+  double *z = malloc(N_POINTS * sizeof(double));
+  double *want_x = malloc(N_POINTS * sizeof(double));
+  double *want_y = malloc(N_POINTS * sizeof(double));
+  double *got_x[N_ORBITS], *got_y[N_ORBITS];
+  for (size_t k = 0; k < N_ORBITS; k++) {
+    got_x[k] = malloc(N_POINTS * sizeof(double));
+    got_y[k] = malloc(N_POINTS * sizeof(double));
+  }
+
+  srand(42);
+  for (size_t i = 0; i < N_POINTS; i++) {
+    x[i] = rand_near(0.9);
+    y[i] = rand_near(0.8);
+    z[i] = rand_near(0.01);
+  }
+
+  // N_POINTS spans two cache blocks, the second partial.
+  char *result = 0;
+  for (int level = SIMD_LEVEL_SCALAR; level < SIMD_LEVEL_COUNT && result == 0; level++) {
+    projection_multi_kernel_fn multi = projection_multi_kernel(level);
+    projection_kernel_fn single = projection_kernel(level);
+    if (multi == NULL) {
+      ut_assert(single == NULL, "multi-orbit kernel missing for a supported level");
+      continue;
+    }
+    multi(rotations, N_ORBITS, x, y, z, got_x, got_y, N_POINTS);
+    for (size_t k = 0; k < N_ORBITS && result == 0; k++) {
+      single(rotations[k], x, y, z, want_x, want_y, N_POINTS);
+      for (size_t i = 0; i < N_POINTS; i++) {
+        if (got_x[k][i] != want_x[i] || got_y[k][i] != want_y[i]) {
+          sprintf(message, "%s multi-orbit kernel differs in frame %zu at %zu", simd_level_name(level), k, i);
+          result = message;
+          break;
+        }
+      }
+    }
+  }
+
+  free(x);
+  free(y);
+  free(z);
+  free(want_x);
+  free(want_y);
+  for (size_t k = 0; k < N_ORBITS; k++) {
+    free(got_x[k]);
+    free(got_y[k]);
+  }
+  return result;
+}
+
+static char *test_kernels_independent_of_position(void) {
+  // A point's result must not depend on whether it falls in the body
+  // or the tail of a call, so every short call must reproduce the
+  // full one exactly.
+  enum { N = 64, MAX_LENGTH = 9 };
+  double x[N], y[N], z[N], want_x[N], want_y[N], got_x[N], got_y[N];
+  float want_x32[N], want_y32[N], got_x32[N], got_y32[N];
+  double want[3][N], got[3][N];
+  uint32_t rows[N];
+
+  srand(45);
+  for (size_t i = 0; i < N; i++) {
+    x[i] = rand_near(0.9);
+    y[i] = rand_near(0.8);
+    z[i] = rand_near(0.01);
+  }
+
+  for (int level = SIMD_LEVEL_SCALAR; level < SIMD_LEVEL_COUNT; level++) {
+    projection_kernel_fn kernel = projection_kernel(level);
+    if (kernel == NULL) {
+      continue;
+    }
+    projection_kernel_f32_fn kernel_f32 = projection_kernel_f32(level);
+    projection_filter_kernel_fn filter = projection_filter_kernel(level);
+    inverse_projection_kernel_fn inverse = inverse_projection_kernel(level);
+    kernel(rotation, x, y, z, want_x, want_y, N);
+    kernel_f32(rotation, x, y, z, want_x32, want_y32, N);
+    inverse(rotation, want_x, want_y, want[0], want[1], want[2], N);
+    for (size_t start = 0; start + MAX_LENGTH <= N; start += 7) {
+      for (size_t n = 1; n <= MAX_LENGTH; n++) {
+        kernel(rotation, x + start, y + start, z + start, got_x, got_y, n);
+        kernel_f32(rotation, x + start, y + start, z + start, got_x32, got_y32, n);
+        inverse(rotation, want_x + start, want_y + start, got[0], got[1], got[2], n);
+        for (size_t i = 0; i < n; i++) {
+          sprintf(message, "%s kernels differ at %zu in a call of %zu from %zu", simd_level_name(level), i, n,
+                  start);
+          ut_assert(got_x[i] == want_x[start + i] && got_y[i] == want_y[start + i], message);
+          ut_assert(got_x32[i] == want_x32[start + i] && got_y32[i] == want_y32[start + i], message);
+          for (int d = 0; d < 3; d++) {
+            ut_assert(got[d][i] == want[d][start + i], message);
+          }
+        }
+        // With a radius that keeps everything, the filter kernel must
+        // agree with the projection kernel of its level.
+        size_t kept = filter(rotation, x + start, y + start, z + start, n, 1e9, (uint32_t)start, got_x, got_y, rows);
+        sprintf(message, "%s filter kernel differs in a call of %zu from %zu", simd_level_name(level), n, start);
+        ut_assert(kept == n, message);
+        for (size_t i = 0; i < n; i++) {
+          ut_assert(rows[i] == start + i, message);
+          ut_assert(got_x[i] == want_x[start + i] && got_y[i] == want_y[start + i], message);
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+static char *test_unsupported_level(void) {
+  ut_assert(projection_kernel(SIMD_LEVEL_COUNT) == NULL, "out of range level should have no kernel");
+  ut_assert(projection_kernel_best() != NULL, "there should always be a best kernel");
+  ut_assert(projection_kernel_f32(SIMD_LEVEL_COUNT) == NULL, "out of range level should have no f32 kernel");
+  ut_assert(projection_kernel_f32_best() != NULL, "there should always be a best f32 kernel");
+  ut_assert(projection_filter_kernel(SIMD_LEVEL_COUNT) == NULL, "out of range level should have no filter kernel");
+  ut_assert(projection_filter_kernel_best() != NULL, "there should always be a best filter kernel");
+  ut_assert(inverse_projection_kernel(SIMD_LEVEL_COUNT) == NULL, "out of range level should have no inverse kernel");
+  ut_assert(inverse_projection_kernel_best() != NULL, "there should always be a best inverse kernel");
+  ut_assert(projection_multi_kernel(SIMD_LEVEL_COUNT) == NULL, "out of range level should have no multi kernel");
+  ut_assert(projection_multi_kernel_best() != NULL, "there should always be a best multi kernel");
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_kernels_match_scalar);
+  ut_run_test(test_f32_kernels_within_tolerance);
+  ut_run_test(test_filter_kernels);
+  ut_run_test(test_inverse_kernels_match_scalar);
+  ut_run_test(test_multi_kernels_match_single);
+  ut_run_test(test_kernels_independent_of_position);
+  ut_run_test(test_unsupported_level);
+  return 0;
+}
+
+int main(void) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
@@ -1,10 +1,46 @@
+#include <math.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "matrixmath.h"
 #include "point_sources.h"
+#include "projection_kernels.h"
 #include "projections.h"
+#include "propagation.h"
 #include "unittests.h"
 
+// The Makefile links this file with --wrap for each allocator, so
+// every allocation made by the tests or the library passes through
+// these and is counted.
+static atomic_size_t allocations;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void* __real_aligned_alloc(size_t alignment, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  atomic_fetch_add(&allocations, 1);
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+  atomic_fetch_add(&allocations, 1);
+  return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  atomic_fetch_add(&allocations, 1);
+  return __real_realloc(ptr, size);
+}
+
+void* __wrap_aligned_alloc(size_t alignment, size_t size) {
+  atomic_fetch_add(&allocations, 1);
+  return __real_aligned_alloc(alignment, size);
+}
+
 int tests_run = 0;
 
 static char* test_cartesian_to_gnomonic_projection(void) {
@@ -51,8 +87,914 @@ static char* test_cartesian_to_gnomonic_projection(void) {
   return 0;
 }
 
+static char* test_cartesian_to_gnomonic_f32(void) {
+  struct CartesianPointSources cartesian;
+  int status = cartesian_point_sources_new(&cartesian, 10);
+  ut_assert(status == 0, "cartesian_point_sources_new failed");
+  cartesian_point_sources_push(&cartesian, 2.32724566583692, -0.449382385055792, 0.0866176471970003, 56537.2416032334);
+  cartesian_point_sources_push(&cartesian, 2.32728038367672, -0.44938629368127, 0.0856592596632065, 56537.2416032334);
+  cartesian_point_sources_push(&cartesian, 2.32729293752894, -0.449243941523289, 0.0860639174895683, 56537.2416032335);
+  cartesian_point_sources_push(&cartesian, 2.32545784897911, -0.459940068868785, 0.0788698905258432, 56537.2416032336);
+
+  double center[3] = {2.32545784897911, -0.459940068868785, 0.0788698905258432};
+  double center_velocity[3] = {0.00257146073153728, 0.011315544836752, 0.00041171196985311};
+
+  struct GnomonicPointSources want;
+  status = gnomonic_point_sources_new(&want, cartesian.x.length);
+  ut_assert(status == 0, "gnomonic_point_sources_new failed");
+  status = cartesian_to_gnomonic(&cartesian, center, center_velocity, &want);
+  ut_assert(status == 0, "cartesian_to_gnomonic failed");
+
+  struct GnomonicPointSourcesF32 got;
+  status = gnomonic_point_sources_f32_new(&got, 1);
+  ut_assert(status == 0, "gnomonic_point_sources_f32_new failed");
+  status = cartesian_to_gnomonic_f32(&cartesian, center, center_velocity, &got);
+  ut_assert(status == 0, "cartesian_to_gnomonic_f32 failed");
+
+  ut_assert(got.x.length == 4 && got.y.length == 4 && got.t.length == 4, "wrong lengths");
+  for (size_t i = 0; i < 4; i++) {
+    // The last detection is the center itself, which projects to 0.
+    ut_assert(fabs(got.x.data[i] - want.x.data[i]) <= PROJECTION_KERNEL_F32_TOLERANCE * fabs(want.x.data[i]) + 1E-15,
+              "x out of tolerance");
+    ut_assert(fabs(got.y.data[i] - want.y.data[i]) <= PROJECTION_KERNEL_F32_TOLERANCE * fabs(want.y.data[i]) + 1E-15,
+              "y out of tolerance");
+    // Times are carried through at full precision.
+    ut_assert(got.t.data[i] == cartesian.t.data[i], "t should be unchanged");
+  }
+
+  double bad_center[3] = {0, 0, 0};
+  gnomonic_point_sources_f32_free(&got);
+  status = gnomonic_point_sources_f32_new(&got, 1);
+  ut_assert(status == 0, "gnomonic_point_sources_f32_new failed");
+  status = cartesian_to_gnomonic_f32(&cartesian, bad_center, center_velocity, &got);
+  ut_assert(status == CT_ERR_INVALID_CENTER, "zero center should be rejected");
+  ut_assert(got.x.length == 0, "nothing should be written for an invalid center");
+
+  gnomonic_point_sources_f32_free(&got);
+  gnomonic_point_sources_free(&want);
+  cartesian_point_sources_free(&cartesian);
+  return 0;
+}
+
+struct StreamCollector {
+  struct GnomonicPointSources gnomonic;
+  size_t n_blocks;
+  size_t stop_after;
+  int offsets_ok;
+};
+
+static int collect_block(struct GnomonicPointSources* block, size_t offset, void* context) {
+  struct StreamCollector* collector = context;
+  collector->offsets_ok = collector->offsets_ok && offset == collector->gnomonic.x.length;
+  for (size_t i = 0; i < block->x.length; i++) {
+    gnomonic_point_sources_push(&collector->gnomonic, block->x.data[i], block->y.data[i], block->t.data[i]);
+  }
+  collector->n_blocks++;
+  return collector->n_blocks == collector->stop_after ? 42 : 0;
+}
+
+static char* test_cartesian_to_gnomonic_stream(void) {
+  struct CartesianPointSources cartesian;
+  int status = cartesian_point_sources_new(&cartesian, 100);
+  ut_assert(status == 0, "cartesian_point_sources_new failed");
+  srand(7);
+  for (size_t i = 0; i < 100; i++) {
+    cartesian_point_sources_push(&cartesian, 0.9 + (double)rand() / RAND_MAX * 0.2 - 0.1,
+                                 0.8 + (double)rand() / RAND_MAX * 0.2 - 0.1, 0.01, (double)i);
+  }
+  double center[3] = {0.9, 0.8, 0.01};
+  double center_velocity[3] = {-0.05, 0.05, 0.00001};
+
+  struct GnomonicPointSources want;
+  status = gnomonic_point_sources_new(&want, cartesian.x.length);
+  ut_assert(status == 0, "gnomonic_point_sources_new failed");
+  status = cartesian_to_gnomonic(&cartesian, center, center_velocity, &want);
+  ut_assert(status == 0, "cartesian_to_gnomonic failed");
+
+  // Blocks of 7 leave a short final block.
+  struct StreamCollector collector = {.n_blocks = 0, .stop_after = 0, .offsets_ok = 1};
+  status = gnomonic_point_sources_new(&collector.gnomonic, 1);
+  ut_assert(status == 0, "gnomonic_point_sources_new failed");
+  status = cartesian_to_gnomonic_stream(&cartesian, center, center_velocity, 7, collect_block, &collector);
+  ut_assert(status == 0, "cartesian_to_gnomonic_stream failed");
+  ut_assert(collector.n_blocks == 15, "wrong number of blocks");
+  ut_assert(collector.offsets_ok, "blocks should arrive in order with matching offsets");
+  ut_assert(collector.gnomonic.x.length == 100, "wrong number of points");
+  for (size_t i = 0; i < 100; i++) {
+    // Block boundaries move which points take a kernel's tail path.
+    ut_assert(fabs(collector.gnomonic.x.data[i] - want.x.data[i]) <= PROJECTION_KERNEL_TOLERANCE * fabs(want.x.data[i]),
+              "x differs from cartesian_to_gnomonic");
+    ut_assert(fabs(collector.gnomonic.y.data[i] - want.y.data[i]) <= PROJECTION_KERNEL_TOLERANCE * fabs(want.y.data[i]),
+              "y differs from cartesian_to_gnomonic");
+    ut_assert(collector.gnomonic.t.data[i] == want.t.data[i], "t differs from cartesian_to_gnomonic");
+  }
+  gnomonic_point_sources_free(&collector.gnomonic);
+
+  // A consumer can stop the stream early, and its status comes back.
+  collector = (struct StreamCollector){.n_blocks = 0, .stop_after = 1, .offsets_ok = 1};
+  status = gnomonic_point_sources_new(&collector.gnomonic, 1);
+  ut_assert(status == 0, "gnomonic_point_sources_new failed");
+  status = cartesian_to_gnomonic_stream(&cartesian, center, center_velocity, 0, collect_block, &collector);
+  ut_assert(status == 42, "the consumer's status should be returned");
+  ut_assert(collector.n_blocks == 1, "the default block size should cover all points");
+  gnomonic_point_sources_free(&collector.gnomonic);
+
+  collector = (struct StreamCollector){.n_blocks = 0, .stop_after = 2, .offsets_ok = 1};
+  status = gnomonic_point_sources_new(&collector.gnomonic, 1);
+  ut_assert(status == 0, "gnomonic_point_sources_new failed");
+  status = cartesian_to_gnomonic_stream(&cartesian, center, center_velocity, 10, collect_block, &collector);
+  ut_assert(status == 42, "the consumer's status should be returned");
+  ut_assert(collector.n_blocks == 2, "no blocks should follow a stop");
+  gnomonic_point_sources_free(&collector.gnomonic);
+
+  double bad_center[3] = {0, 0, 0};
+  status = cartesian_to_gnomonic_stream(&cartesian, bad_center, center_velocity, 0, collect_block, &collector);
+  ut_assert(status == CT_ERR_INVALID_CENTER, "zero center should be rejected");
+
+  gnomonic_point_sources_free(&want);
+  cartesian_point_sources_free(&cartesian);
+  return 0;
+}
+
+static char* test_cartesian_to_gnomonic_within(void) {
+  // More points than one stream block, so the outputs grow.
+  size_t n = PROJECTION_STREAM_BLOCK * 2 + 77;
+  struct CartesianPointSources cartesian;
+  int status = cartesian_point_sources_new(&cartesian, n);
+  ut_assert(status == 0, "cartesian_point_sources_new failed");
+  srand(8);
+  for (size_t i = 0; i < n; i++) {
+    double sign = i % 3 == 0 ? -1.0 : 1.0;
+    cartesian_point_sources_push(&cartesian, sign * (0.9 + (double)rand() / RAND_MAX * 0.4 - 0.2),
+                                 sign * (0.8 + (double)rand() / RAND_MAX * 0.4 - 0.2), 0.01, (double)i);
+  }
+  double center[3] = {0.9, 0.8, 0.01};
+  double center_velocity[3] = {-0.05, 0.05, 0.00001};
+  double radius = 2.0;
+
+  struct GnomonicPointSources all;
+  status = gnomonic_point_sources_new(&all, n);
+  ut_assert(status == 0, "gnomonic_point_sources_new failed");
+  status = cartesian_to_gnomonic(&cartesian, center, center_velocity, &all);
+  ut_assert(status == 0, "cartesian_to_gnomonic failed");
+
+  struct GnomonicPointSources gnomonic;
+  status = gnomonic_point_sources_new(&gnomonic, 1);
+  ut_assert(status == 0, "gnomonic_point_sources_new failed");
+  struct VecU32 rows;
+  status = vec_u32_new(&rows, 1);
+  ut_assert(status == 0, "vec_u32_new failed");
+  status = cartesian_to_gnomonic_within(&cartesian, center, center_velocity, radius, &gnomonic, &rows);
+  ut_assert(status == 0, "cartesian_to_gnomonic_within failed");
+
+  ut_assert(rows.length == gnomonic.x.length && gnomonic.y.length == gnomonic.x.length &&
+                gnomonic.t.length == gnomonic.x.length,
+            "output lengths should match");
+  ut_assert(gnomonic.x.length > 0 && gnomonic.x.length < n / 2, "should keep some but not most points");
+  size_t kept = 0;
+  for (size_t i = 0; i < n; i++) {
+    // Points behind the plane are the ones pushed with a negative sign.
+    if (i % 3 == 0 || all.x.data[i] * all.x.data[i] + all.y.data[i] * all.y.data[i] > radius * radius) {
+      continue;
+    }
+    ut_assert(kept < rows.length && rows.data[kept] == i, "wrong row kept");
+    ut_assert(fabs(gnomonic.x.data[kept] - all.x.data[i]) <= PROJECTION_KERNEL_TOLERANCE * fabs(all.x.data[i]),
+              "x differs from cartesian_to_gnomonic");
+    ut_assert(fabs(gnomonic.y.data[kept] - all.y.data[i]) <= PROJECTION_KERNEL_TOLERANCE * fabs(all.y.data[i]),
+              "y differs from cartesian_to_gnomonic");
+    ut_assert(gnomonic.t.data[kept] == cartesian.t.data[i], "t should follow its row");
+    kept++;
+  }
+  ut_assert(kept == rows.length, "wrong number of points kept");
+
+  gnomonic_point_sources_free(&gnomonic);
+  gnomonic_point_sources_free(&all);
+  vec_u32_free(&rows);
+  cartesian_point_sources_free(&cartesian);
+  return 0;
+}
+
+// The per-orbit frame construction gnomonic_rotation_matrices
+// replaced: R1 turns the orbit normal onto z, R2 turns the rotated
+// center onto x.
+static int reference_rotation(double pos[3], double vel[3], double rotation[3][3]) {
+  double n_hat[3];
+  if (normal_vector(pos, vel, n_hat) != 0) {
+    return -1;
+  }
+  double z_axis[3] = {0.0, 0.0, 1.0};
+  double nu[3];
+  cross(n_hat, z_axis, nu);
+  double r1[3][3] = {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}};
+  if (magnitude(nu) >= 1e-10) {
+    double v[3][3] = {{0.0, -nu[2], nu[1]}, {nu[2], 0.0, -nu[0]}, {-nu[1], nu[0], 0.0}};
+    double v_squared[3][3];
+    matsquare_3x3(v, v_squared);
+    matscale(v_squared, 1 / (1 + dot(n_hat, z_axis)));
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        r1[i][j] += v[i][j] + v_squared[i][j];
+      }
+    }
+  }
+  double p[3];
+  matmul_3x3_3x1(r1, pos, p);
+  if (normalize(p) != 0) {
+    return -1;
+  }
+  double r2[3][3] = {{p[0], p[1], 0.0}, {-p[1], p[0], 0.0}, {0.0, 0.0, 1.0}};
+  matmul_3x3_3x3(r2, r1, rotation);
+  return 0;
+}
+
+static char* test_gnomonic_rotation_matrices(void) {
+  // Random frames, plus each special case: zero velocity, a velocity
+  // along the center, an orbit normal along +z and along -z.
+  size_t n = 100;
+  double x[100], y[100], z[100], vx[100], vy[100], vz[100];
+  srand(9);
+  for (size_t i = 0; i < n; i++) {
+    x[i] = 4.0 * rand() / RAND_MAX - 2.0;
+    y[i] = 4.0 * rand() / RAND_MAX - 2.0;
+    z[i] = 4.0 * rand() / RAND_MAX - 2.0;
+    vx[i] = 0.04 * rand() / RAND_MAX - 0.02;
+    vy[i] = 0.04 * rand() / RAND_MAX - 0.02;
+    vz[i] = 0.04 * rand() / RAND_MAX - 0.02;
+  }
+  vx[1] = vy[1] = vz[1] = 0.0;
+  vx[2] = 2 * x[2], vy[2] = 2 * y[2], vz[2] = 2 * z[2];
+  z[3] = vz[3] = 0.0;
+  vx[3] = -0.01 * y[3], vy[3] = 0.01 * x[3];
+  z[4] = vz[4] = 0.0;
+  vx[4] = 0.01 * y[4], vy[4] = -0.01 * x[4];
+
+  double(*rotations)[3][3] = malloc(n * sizeof(double[3][3]));
+  int status = gnomonic_rotation_matrices(x, y, z, vx, vy, vz, n, rotations);
+  ut_assert(status == 0, "gnomonic_rotation_matrices failed");
+  for (size_t i = 0; i < n; i++) {
+    double pos[3] = {x[i], y[i], z[i]};
+    double vel[3] = {vx[i], vy[i], vz[i]};
+    double expected[3][3];
+    ut_assert(reference_rotation(pos, vel, expected) == 0, "reference rotation failed");
+    for (int r = 0; r < 3; r++) {
+      for (int c = 0; c < 3; c++) {
+        ut_assert(fabs(rotations[i][r][c] - expected[r][c]) < 1e-14, "rotation differs from reference");
+      }
+    }
+  }
+
+  // A zero center has no frame; the others are still built.
+  x[5] = y[5] = z[5] = 0.0;
+  status = gnomonic_rotation_matrices(x, y, z, vx, vy, vz, n, rotations);
+  ut_assert(status == CT_ERR_INVALID_CENTER, "zero center should fail");
+  ut_assert(isnan(rotations[5][0][0]) && isnan(rotations[5][2][2]), "invalid frame should be NaN");
+  ut_assert(!isnan(rotations[6][0][0]), "valid frame should be built");
+
+  free(rotations);
+  return 0;
+}
+
+static char* test_cartesian_to_gnomonic_batch(void) {
+  // Enough detections to span several tasks per orbit, and enough
+  // orbits for two groups, the second with an odd number of orbits.
+  size_t n_orbits = PROJECTION_BATCH_ORBITS + 5;
+  size_t n_points = 2 * PROJECTION_BATCH_CHUNK + 17;
+  struct CartesianPointSources cartesian;
+  int status = cartesian_point_sources_new(&cartesian, n_points);
+  ut_assert(status == 0, "cartesian_point_sources_new failed");
+  srand(7);
+  for (size_t i = 0; i < n_points; i++) {
+    double dx = (double)rand() / RAND_MAX - 0.5;
+    double dy = (double)rand() / RAND_MAX - 0.5;
+    cartesian_point_sources_push(&cartesian, 2.3 + dx / 10, -0.45 + dy / 10, 0.08, 56537.0 + i % 5);
+  }
+
+  struct CartesianOrbits orbits;
+  status = cartesian_orbits_new(&orbits, n_orbits);
+  ut_assert(status == 0, "cartesian_orbits_new failed");
+  for (size_t i = 0; i < n_orbits; i++) {
+    double center[3] = {2.32545784897911, -0.459940068868785 + i * 0.001, 0.0788698905258432};
+    double center_velocity[3] = {0.00257146073153728, 0.011315544836752, 0.00041171196985311 * (i % 5)};
+    cartesian_orbits_push(&orbits, center, center_velocity, 56537.0);
+  }
+
+  struct ThreadPool pool;
+  status = thread_pool_new(&pool, 3);
+  ut_assert(status == 0, "thread_pool_new failed");
+
+  struct GnomonicPointSources *batch = malloc(n_orbits * sizeof(struct GnomonicPointSources));
+  for (size_t i = 0; i < n_orbits; i++) {
+    gnomonic_point_sources_new(&batch[i], 1);
+  }
+  status = cartesian_to_gnomonic_batch(&cartesian, &orbits, batch, &pool);
+  ut_assert(status == 0, "cartesian_to_gnomonic_batch failed");
+
+  // Every frame must match a single-orbit projection exactly.
+  for (size_t i = 0; i < n_orbits; i++) {
+    double center[3], center_velocity[3];
+    cartesian_orbits_get(&orbits, i, center, center_velocity);
+    struct GnomonicPointSources single;
+    gnomonic_point_sources_new(&single, n_points);
+    status = cartesian_to_gnomonic(&cartesian, center, center_velocity, &single);
+    ut_assert(status == 0, "cartesian_to_gnomonic failed");
+
+    ut_assert(batch[i].x.length == n_points, "wrong length for batch x");
+    ut_assert(batch[i].t.length == n_points, "wrong length for batch t");
+    for (size_t j = 0; j < n_points; j++) {
+      ut_assert(batch[i].x.data[j] == single.x.data[j], "batch x differs from single projection");
+      ut_assert(batch[i].y.data[j] == single.y.data[j], "batch y differs from single projection");
+      ut_assert(batch[i].t.data[j] == single.t.data[j], "batch t differs from single projection");
+    }
+    gnomonic_point_sources_free(&single);
+    gnomonic_point_sources_free(&batch[i]);
+  }
+
+  free(batch);
+  thread_pool_free(&pool);
+  cartesian_orbits_free(&orbits);
+  cartesian_point_sources_free(&cartesian);
+  return 0;
+}
+
+static char* test_cartesian_to_gnomonic_batch_placed(void) {
+  // Detections spread over several chunks, and a pool with two nodes
+  // sharing CPU 0, so that placement and node scheduling run on any
+  // machine.
+  size_t n_orbits = PROJECTION_BATCH_ORBITS + 3;
+  size_t n_points = 3 * PROJECTION_BATCH_CHUNK + 11;
+  struct CartesianPointSources cartesian = CARTESIAN_POINT_SOURCES_ZERO;
+  srand(16);
+  for (size_t i = 0; i < n_points; i++) {
+    double dx = (double)rand() / RAND_MAX - 0.5;
+    double dy = (double)rand() / RAND_MAX - 0.5;
+    cartesian_point_sources_push(&cartesian, 2.3 + dx / 10, -0.45 + dy / 10, 0.08, 56537.0 + i % 5);
+  }
+  struct CartesianOrbits orbits = CARTESIAN_ORBITS_ZERO;
+  for (size_t i = 0; i < n_orbits; i++) {
+    double center[3] = {2.32545784897911, -0.459940068868785 + i * 0.001, 0.0788698905258432};
+    double center_velocity[3] = {0.00257146073153728, 0.011315544836752, 0.00041171196985311 * (i % 5)};
+    cartesian_orbits_push(&orbits, center, center_velocity, 56537.0);
+  }
+  int cpus[2] = {0, 0};
+  size_t node_offsets[3] = {0, 1, 2};
+  struct NumaTopology topology = {.n_nodes = 2, .n_cpus = 2, .cpus = cpus, .node_offsets = node_offsets};
+  struct ThreadPool pool;
+  int status = thread_pool_new_pinned(&pool, 4, &topology);
+  ut_assert(status == 0, "thread_pool_new_pinned failed");
+
+  struct Arena arena;
+  status = arena_new(&arena, 4 * (n_points * sizeof(double) + ARENA_ALIGNMENT), ARENA_DEFAULT);
+  ut_assert(status == 0, "arena_new failed");
+  struct CartesianPointSources placed;
+  status = cartesian_to_gnomonic_batch_place(&cartesian, &pool, &arena, &placed);
+  ut_assert(status == 0, "cartesian_to_gnomonic_batch_place failed");
+  ut_assert(placed.x.length == n_points && placed.t.length == n_points, "wrong placed length");
+  for (size_t i = 0; i < n_points; i++) {
+    ut_assert(placed.x.data[i] == cartesian.x.data[i] && placed.y.data[i] == cartesian.y.data[i] &&
+                  placed.z.data[i] == cartesian.z.data[i] && placed.t.data[i] == cartesian.t.data[i],
+              "placed detections differ from the input");
+  }
+
+  // The node-scheduled projection of the placed detections matches a
+  // serial one exactly.
+  struct GnomonicPointSources* batch = malloc(n_orbits * sizeof(struct GnomonicPointSources));
+  struct GnomonicPointSources* serial = malloc(n_orbits * sizeof(struct GnomonicPointSources));
+  for (size_t i = 0; i < n_orbits; i++) {
+    batch[i] = (struct GnomonicPointSources)GNOMONIC_POINT_SOURCES_ZERO;
+    serial[i] = (struct GnomonicPointSources)GNOMONIC_POINT_SOURCES_ZERO;
+  }
+  status = cartesian_to_gnomonic_batch(&placed, &orbits, batch, &pool);
+  ut_assert(status == 0, "cartesian_to_gnomonic_batch failed");
+  status = cartesian_to_gnomonic_batch(&cartesian, &orbits, serial, NULL);
+  ut_assert(status == 0, "cartesian_to_gnomonic_batch failed");
+  for (size_t i = 0; i < n_orbits; i++) {
+    ut_assert(batch[i].x.length == n_points, "wrong batch length");
+    for (size_t j = 0; j < n_points; j++) {
+      ut_assert(batch[i].x.data[j] == serial[i].x.data[j] && batch[i].y.data[j] == serial[i].y.data[j] &&
+                    batch[i].t.data[j] == serial[i].t.data[j],
+                "placed batch differs from serial batch");
+    }
+    gnomonic_point_sources_free(&batch[i]);
+    gnomonic_point_sources_free(&serial[i]);
+  }
+
+  // Placing again after a reset drops and refills the arena's pages,
+  // which must still give the detections back.
+  arena_reset(&arena);
+  memset(arena.base, 0xff, arena.size);
+  status = cartesian_to_gnomonic_batch_place(&cartesian, &pool, &arena, &placed);
+  ut_assert(status == 0, "cartesian_to_gnomonic_batch_place failed after a reset");
+  for (size_t i = 0; i < n_points; i++) {
+    ut_assert(placed.x.data[i] == cartesian.x.data[i] && placed.t.data[i] == cartesian.t.data[i],
+              "detections placed after a reset differ from the input");
+  }
+
+  // An arena without room for all four columns fails, and gets back
+  // the space of the columns that did fit.
+  struct Arena small;
+  status = arena_new(&small, 2 * n_points * sizeof(double) + ARENA_ALIGNMENT, ARENA_DEFAULT);
+  ut_assert(status == 0, "arena_new failed");
+  struct CartesianPointSources unplaced;
+  status = cartesian_to_gnomonic_batch_place(&cartesian, &pool, &small, &unplaced);
+  ut_assert(status == CT_ERR_OUT_OF_MEMORY, "placing into too small an arena should fail");
+  ut_assert(small.used == 0, "a failed placement should leave the arena as it was");
+  arena_free(&small);
+
+  // Nothing to place is not an error.
+  struct CartesianPointSources empty = CARTESIAN_POINT_SOURCES_ZERO, placed_empty;
+  status = cartesian_to_gnomonic_batch_place(&empty, &pool, &arena, &placed_empty);
+  ut_assert(status == 0 && placed_empty.x.length == 0, "placing nothing should succeed");
+
+  free(batch);
+  free(serial);
+  arena_free(&arena);
+  thread_pool_free(&pool);
+  cartesian_orbits_free(&orbits);
+  cartesian_point_sources_free(&cartesian);
+  return 0;
+}
+
+static char* test_cartesian_to_gnomonic_epochs(void) {
+  // A test orbit propagated to three exposures.
+  struct CartesianOrbits orbit;
+  cartesian_orbits_new(&orbit, 1);
+  double center[3] = {2.32545784897911, -0.459940068868785, 0.0788698905258432};
+  double center_velocity[3] = {0.00257146073153728, 0.011315544836752, 0.00041171196985311};
+  cartesian_orbits_push(&orbit, center, center_velocity, 56537.0);
+  double epochs[3] = {56540.0, 56537.0, 56545.5};
+  struct CartesianOrbits states;
+  cartesian_orbits_new(&states, 3);
+  int status = propagate_orbits(&orbit, epochs, 3, PROPAGATION_MU_SUN, NULL, &states);
+  ut_assert(status == PROPAGATION_ERROR_NONE, "propagate_orbits failed");
+
+  // Detections from the exposures, with one exposure split into two
+  // runs.
+  size_t n_points = 600;
+  struct CartesianPointSources cartesian;
+  cartesian_point_sources_new(&cartesian, n_points);
+  srand(5);
+  for (size_t i = 0; i < n_points; i++) {
+    size_t e = i < 200 ? 0 : i < 350 ? 1 : i < 500 ? 2 : 0;
+    double dx = (double)rand() / RAND_MAX - 0.5;
+    double dy = (double)rand() / RAND_MAX - 0.5;
+    cartesian_point_sources_push(&cartesian, states.x.data[e] + dx / 10, states.y.data[e] + dy / 10,
+                                 states.z.data[e], epochs[e]);
+  }
+
+  struct GnomonicPointSources gnomonic;
+  gnomonic_point_sources_new(&gnomonic, 1);
+  status = cartesian_to_gnomonic_epochs(&cartesian, &states, &gnomonic);
+  ut_assert(status == 0, "cartesian_to_gnomonic_epochs failed");
+  ut_assert(gnomonic.x.length == n_points, "wrong length");
+
+  // Each detection matches a projection into its own exposure's frame.
+  for (size_t e = 0; e < 3; e++) {
+    double pos[3], vel[3];
+    cartesian_orbits_get(&states, e, pos, vel);
+    struct GnomonicPointSources single;
+    gnomonic_point_sources_new(&single, n_points);
+    status = cartesian_to_gnomonic(&cartesian, pos, vel, &single);
+    ut_assert(status == 0, "cartesian_to_gnomonic failed");
+    for (size_t i = 0; i < n_points; i++) {
+      if (cartesian.t.data[i] == epochs[e]) {
+        ut_assert(gnomonic.x.data[i] == single.x.data[i], "x differs from the exposure's projection");
+        ut_assert(gnomonic.y.data[i] == single.y.data[i], "y differs from the exposure's projection");
+        ut_assert(gnomonic.t.data[i] == epochs[e], "wrong t");
+      }
+    }
+    gnomonic_point_sources_free(&single);
+  }
+
+  // An exposure with no center is an error.
+  cartesian_point_sources_push(&cartesian, 2.3, -0.4, 0.08, 56550.0);
+  struct GnomonicPointSources missing;
+  gnomonic_point_sources_new(&missing, 1);
+  status = cartesian_to_gnomonic_epochs(&cartesian, &states, &missing);
+  ut_assert(status == CT_ERR_MISSING_EPOCH, "missing epoch should fail");
+
+  gnomonic_point_sources_free(&missing);
+  gnomonic_point_sources_free(&gnomonic);
+  cartesian_point_sources_free(&cartesian);
+  cartesian_orbits_free(&states);
+  cartesian_orbits_free(&orbit);
+  return 0;
+}
+
+static char* test_cartesian_to_gnomonic_indexed(void) {
+  // Detections scattered over the whole sky, in four exposures.
+  size_t n_points = 50000;
+  struct CartesianPointSources cartesian;
+  int status = cartesian_point_sources_new(&cartesian, n_points);
+  ut_assert(status == 0, "cartesian_point_sources_new failed");
+  srand(11);
+  for (size_t i = 0; i < n_points; i++) {
+    double z = 2.0 * rand() / RAND_MAX - 1.0;
+    double phi = 2.0 * M_PI * rand() / RAND_MAX;
+    double r = 2.0 + (double)rand() / RAND_MAX;
+    cartesian_point_sources_push(&cartesian, r * sqrt(1 - z * z) * cos(phi), r * sqrt(1 - z * z) * sin(phi), r * z,
+                                 56537.0 + i % 4);
+  }
+
+  struct SkyIndex index;
+  status = sky_index_new(&index, &cartesian, SKY_INDEX_DEFAULT_RESOLUTION);
+  ut_assert(status == SKY_INDEX_ERROR_NONE, "sky_index_new failed");
+
+  double center[3] = {2.32545784897911, -0.459940068868785, 0.0788698905258432};
+  double center_velocity[3] = {0.00257146073153728, 0.011315544836752, 0.00041171196985311};
+  double radius = 5.0;
+
+  struct GnomonicPointSources full;
+  gnomonic_point_sources_new(&full, n_points);
+  status = cartesian_to_gnomonic(&cartesian, center, center_velocity, &full);
+  ut_assert(status == 0, "cartesian_to_gnomonic failed");
+
+  struct GnomonicPointSources culled;
+  gnomonic_point_sources_new(&culled, 1);
+  struct VecU32 rows;
+  vec_u32_new(&rows, 1);
+  status = cartesian_to_gnomonic_indexed(&index, 0, index.n_epochs, center, center_velocity, radius, &culled, &rows);
+  ut_assert(status == 0, "cartesian_to_gnomonic_indexed failed");
+  ut_assert(culled.x.length == rows.length, "rows and outputs differ in length");
+  ut_assert(culled.x.length < n_points / 10, "index culled too little");
+
+  // Every output matches the full projection of its row, and every
+  // detection within radius on the plane is present.
+  int *seen = calloc(n_points, sizeof(int));
+  for (size_t k = 0; k < culled.x.length; k++) {
+    uint32_t row = rows.data[k];
+    ut_assert(culled.x.data[k] == full.x.data[row], "indexed x differs from full projection");
+    ut_assert(culled.y.data[k] == full.y.data[row], "indexed y differs from full projection");
+    ut_assert(culled.t.data[k] == full.t.data[row], "indexed t differs from full projection");
+    seen[row] = 1;
+  }
+  for (size_t i = 0; i < n_points; i++) {
+    double in_front = cartesian.x.data[i] * center[0] + cartesian.y.data[i] * center[1] +
+                      cartesian.z.data[i] * center[2];
+    if (in_front > 0 && hypot(full.x.data[i], full.y.data[i]) <= radius) {
+      ut_assert(seen[i], "detection within radius was culled");
+    }
+  }
+
+  free(seen);
+  vec_u32_free(&rows);
+  gnomonic_point_sources_free(&culled);
+  gnomonic_point_sources_free(&full);
+  sky_index_free(&index);
+  cartesian_point_sources_free(&cartesian);
+  return 0;
+}
+
+static char* test_gnomonic_to_cartesian(void) {
+  double center[3] = {2.32545784897911, -0.459940068868785, 0.0788698905258432};
+  double center_velocity[3] = {0.00257146073153728, 0.011315544836752, 0.00041171196985311};
+
+  size_t n_points = 1001;
+  struct CartesianPointSources cartesian;
+  cartesian_point_sources_new(&cartesian, n_points);
+  srand(11);
+  for (size_t i = 0; i < n_points; i++) {
+    double dx = (double)rand() / RAND_MAX - 0.5;
+    double dy = (double)rand() / RAND_MAX - 0.5;
+    double dz = (double)rand() / RAND_MAX - 0.5;
+    cartesian_point_sources_push(&cartesian, 2.3 + dx, -0.45 + dy, 0.08 + dz, 56537.0 + i);
+  }
+
+  struct GnomonicPointSources gnomonic = GNOMONIC_POINT_SOURCES_ZERO;
+  int status = cartesian_to_gnomonic(&cartesian, center, center_velocity, &gnomonic);
+  ut_assert(status == 0, "cartesian_to_gnomonic failed");
+
+  // Projecting and mapping back recovers each point's direction.
+  struct CartesianPointSources directions = CARTESIAN_POINT_SOURCES_ZERO;
+  status = gnomonic_to_cartesian(&gnomonic, center, center_velocity, &directions);
+  ut_assert(status == 0, "gnomonic_to_cartesian failed");
+  ut_assert(directions.x.length == n_points && directions.t.length == n_points, "wrong output length");
+  for (size_t i = 0; i < n_points; i++) {
+    double p[3] = {cartesian.x.data[i], cartesian.y.data[i], cartesian.z.data[i]};
+    normalize(p);
+    ut_assert(fabs(directions.x.data[i] - p[0]) < 1e-12, "wrong direction");
+    ut_assert(fabs(directions.y.data[i] - p[1]) < 1e-12, "wrong direction");
+    ut_assert(fabs(directions.z.data[i] - p[2]) < 1e-12, "wrong direction");
+    ut_assert(directions.t.data[i] == cartesian.t.data[i], "wrong t");
+  }
+
+  // A cached rotation matrix gives the same result.
+  double rotation[1][3][3];
+  status = gnomonic_rotation_matrices(&center[0], &center[1], &center[2], &center_velocity[0], &center_velocity[1],
+                                      &center_velocity[2], 1, rotation);
+  ut_assert(status == 0, "gnomonic_rotation_matrices failed");
+  struct CartesianPointSources rotated = CARTESIAN_POINT_SOURCES_ZERO;
+  status = gnomonic_to_cartesian_rotated(&gnomonic, rotation[0], &rotated);
+  ut_assert(status == 0, "gnomonic_to_cartesian_rotated failed");
+  for (size_t i = 0; i < n_points; i++) {
+    ut_assert(rotated.x.data[i] == directions.x.data[i] && rotated.z.data[i] == directions.z.data[i],
+              "cached rotation gives a different result");
+  }
+
+  // The origin of the plane is the center's own direction.
+  struct GnomonicPointSources origin = GNOMONIC_POINT_SOURCES_ZERO;
+  gnomonic_point_sources_push(&origin, 0.0, 0.0, 1.0);
+  struct CartesianPointSources center_direction = CARTESIAN_POINT_SOURCES_ZERO;
+  status = gnomonic_to_cartesian(&origin, center, center_velocity, &center_direction);
+  ut_assert(status == 0, "gnomonic_to_cartesian failed for the origin");
+  double c[3] = {center[0], center[1], center[2]};
+  normalize(c);
+  ut_assert(fabs(center_direction.x.data[0] - c[0]) < 1e-15, "wrong direction");
+  ut_assert(fabs(center_direction.y.data[0] - c[1]) < 1e-15, "wrong direction");
+  ut_assert(fabs(center_direction.z.data[0] - c[2]) < 1e-15, "wrong direction");
+
+  double zero[3] = {0.0, 0.0, 0.0};
+  cartesian_point_sources_free(&center_direction);
+  center_direction = (struct CartesianPointSources)CARTESIAN_POINT_SOURCES_ZERO;
+  status = gnomonic_to_cartesian(&origin, zero, center_velocity, &center_direction);
+  ut_assert(status == CT_ERR_INVALID_CENTER, "a zero center should be rejected");
+
+  cartesian_point_sources_free(&center_direction);
+  gnomonic_point_sources_free(&origin);
+  cartesian_point_sources_free(&rotated);
+  cartesian_point_sources_free(&directions);
+  gnomonic_point_sources_free(&gnomonic);
+  cartesian_point_sources_free(&cartesian);
+  return 0;
+}
+
+static char* test_gnomonic_to_radec(void) {
+  double center[3] = {2.32545784897911, -0.459940068868785, 0.0788698905258432};
+  double center_velocity[3] = {0.00257146073153728, 0.011315544836752, 0.00041171196985311};
+
+  // More points than one block, so the blocked conversion is covered.
+  size_t n_points = PROJECTION_STREAM_BLOCK + 5;
+  struct GnomonicPointSources gnomonic = GNOMONIC_POINT_SOURCES_ZERO;
+  srand(12);
+  for (size_t i = 0; i < n_points; i++) {
+    gnomonic_point_sources_push(&gnomonic, ((double)rand() / RAND_MAX - 0.5) * 20,
+                                ((double)rand() / RAND_MAX - 0.5) * 20, 1.0);
+  }
+  struct CartesianPointSources directions = CARTESIAN_POINT_SOURCES_ZERO;
+  int status = gnomonic_to_cartesian(&gnomonic, center, center_velocity, &directions);
+  ut_assert(status == 0, "gnomonic_to_cartesian failed");
+
+  struct VecF64 ra = VECF64_ZERO, dec = VECF64_ZERO;
+  status = gnomonic_to_radec(&gnomonic, center, center_velocity, &ra, &dec);
+  ut_assert(status == 0, "gnomonic_to_radec failed");
+  ut_assert(ra.length == n_points && dec.length == n_points, "wrong output length");
+  for (size_t i = 0; i < n_points; i++) {
+    ut_assert(ra.data[i] >= 0.0 && ra.data[i] < 360.0, "ra out of range");
+    double r = ra.data[i] * M_PI / 180.0, d = dec.data[i] * M_PI / 180.0;
+    ut_assert(fabs(cos(d) * cos(r) - directions.x.data[i]) < 1e-12, "wrong direction");
+    ut_assert(fabs(cos(d) * sin(r) - directions.y.data[i]) < 1e-12, "wrong direction");
+    ut_assert(fabs(sin(d) - directions.z.data[i]) < 1e-12, "wrong direction");
+  }
+
+  vec_f64_free(&ra);
+  vec_f64_free(&dec);
+  cartesian_point_sources_free(&directions);
+  gnomonic_point_sources_free(&gnomonic);
+  return 0;
+}
+
+static char* test_gnomonic_to_cartesian_batch(void) {
+  struct CartesianOrbits orbits;
+  int status = cartesian_orbits_new(&orbits, 3);
+  ut_assert(status == 0, "cartesian_orbits_new failed");
+  struct GnomonicPointSources gnomonic[3];
+  // Lengths differ per orbit, and one spans several tasks.
+  size_t lengths[3] = {2 * PROJECTION_BATCH_CHUNK + 3, 0, 100};
+  srand(13);
+  for (size_t i = 0; i < 3; i++) {
+    double center[3] = {2.32545784897911, -0.459940068868785 + i * 0.01, 0.0788698905258432};
+    double center_velocity[3] = {0.00257146073153728, 0.011315544836752, 0.00041171196985311 * i};
+    cartesian_orbits_push(&orbits, center, center_velocity, 56537.0);
+    gnomonic[i] = (struct GnomonicPointSources)GNOMONIC_POINT_SOURCES_ZERO;
+    for (size_t j = 0; j < lengths[i]; j++) {
+      gnomonic_point_sources_push(&gnomonic[i], (double)rand() / RAND_MAX - 0.5, (double)rand() / RAND_MAX - 0.5,
+                                  (double)j);
+    }
+  }
+
+  struct ThreadPool pool;
+  status = thread_pool_new(&pool, 3);
+  ut_assert(status == 0, "thread_pool_new failed");
+  struct CartesianPointSources batch[3];
+  for (size_t i = 0; i < 3; i++) {
+    batch[i] = (struct CartesianPointSources)CARTESIAN_POINT_SOURCES_ZERO;
+  }
+  status = gnomonic_to_cartesian_batch(gnomonic, &orbits, batch, &pool);
+  ut_assert(status == 0, "gnomonic_to_cartesian_batch failed");
+
+  // Every frame matches a single-frame inverse exactly.
+  for (size_t i = 0; i < 3; i++) {
+    double center[3], center_velocity[3];
+    cartesian_orbits_get(&orbits, i, center, center_velocity);
+    struct CartesianPointSources single = CARTESIAN_POINT_SOURCES_ZERO;
+    status = gnomonic_to_cartesian(&gnomonic[i], center, center_velocity, &single);
+    ut_assert(status == 0, "gnomonic_to_cartesian failed");
+    ut_assert(batch[i].x.length == lengths[i] && batch[i].t.length == lengths[i], "wrong batch length");
+    for (size_t j = 0; j < lengths[i]; j++) {
+      ut_assert(batch[i].x.data[j] == single.x.data[j], "batch x differs from single inverse");
+      ut_assert(batch[i].y.data[j] == single.y.data[j], "batch y differs from single inverse");
+      ut_assert(batch[i].z.data[j] == single.z.data[j], "batch z differs from single inverse");
+      ut_assert(batch[i].t.data[j] == single.t.data[j], "batch t differs from single inverse");
+    }
+    cartesian_point_sources_free(&single);
+    cartesian_point_sources_free(&batch[i]);
+    gnomonic_point_sources_free(&gnomonic[i]);
+  }
+
+  thread_pool_free(&pool);
+  cartesian_orbits_free(&orbits);
+  return 0;
+}
+
+static char* test_outputs_are_overwritten(void) {
+  double center[3] = {0.9, 0.8, 0.01};
+  double center_velocity[3] = {-0.05, 0.05, 0.00001};
+  size_t n_large = 3000, n_small = 1000;
+  struct CartesianPointSources large = CARTESIAN_POINT_SOURCES_ZERO, small = CARTESIAN_POINT_SOURCES_ZERO;
+  srand(14);
+  for (size_t i = 0; i < n_large; i++) {
+    cartesian_point_sources_push(&large, 0.9 + (double)rand() / RAND_MAX * 0.4 - 0.2,
+                                 0.8 + (double)rand() / RAND_MAX * 0.4 - 0.2, 0.01, 1.0);
+  }
+  for (size_t i = 0; i < n_small; i++) {
+    cartesian_point_sources_push(&small, 0.9 + (double)rand() / RAND_MAX * 0.4 - 0.2,
+                                 0.8 + (double)rand() / RAND_MAX * 0.4 - 0.2, 0.01, 2.0);
+  }
+
+  // A smaller projection into a container that already holds a larger
+  // one replaces it from row 0, in the storage it already has.
+  struct GnomonicPointSources reused = GNOMONIC_POINT_SOURCES_ZERO;
+  int status = cartesian_to_gnomonic(&large, center, center_velocity, &reused);
+  ut_assert(status == 0, "cartesian_to_gnomonic failed");
+  double* storage = reused.x.data;
+  status = cartesian_to_gnomonic(&small, center, center_velocity, &reused);
+  ut_assert(status == 0, "cartesian_to_gnomonic failed");
+  ut_assert(reused.x.data == storage, "storage should be reused");
+  ut_assert(reused.x.length == n_small && reused.y.length == n_small && reused.t.length == n_small,
+            "wrong length after reuse");
+
+  struct GnomonicPointSources fresh = GNOMONIC_POINT_SOURCES_ZERO;
+  status = cartesian_to_gnomonic(&small, center, center_velocity, &fresh);
+  ut_assert(status == 0, "cartesian_to_gnomonic failed");
+  for (size_t i = 0; i < n_small; i++) {
+    ut_assert(reused.x.data[i] == fresh.x.data[i] && reused.y.data[i] == fresh.y.data[i] &&
+                  reused.t.data[i] == fresh.t.data[i],
+              "reused output differs from a fresh projection");
+  }
+
+  // Likewise for the inverse.
+  struct CartesianPointSources directions = CARTESIAN_POINT_SOURCES_ZERO;
+  struct GnomonicPointSources large_gnomonic = GNOMONIC_POINT_SOURCES_ZERO;
+  status = cartesian_to_gnomonic(&large, center, center_velocity, &large_gnomonic);
+  ut_assert(status == 0, "cartesian_to_gnomonic failed");
+  status = gnomonic_to_cartesian(&large_gnomonic, center, center_velocity, &directions);
+  ut_assert(status == 0, "gnomonic_to_cartesian failed");
+  status = gnomonic_to_cartesian(&fresh, center, center_velocity, &directions);
+  ut_assert(status == 0, "gnomonic_to_cartesian failed");
+  ut_assert(directions.x.length == n_small && directions.t.length == n_small, "wrong inverse length after reuse");
+  ut_assert(directions.t.data[0] == 2.0, "inverse should be overwritten from row 0");
+
+  // Empty input, or a center with no frame, leaves every output empty
+  // rather than holding the previous call's rows.
+  double bad_center[3] = {0.0, 0.0, 0.0};
+  struct CartesianPointSources empty = CARTESIAN_POINT_SOURCES_ZERO;
+  struct GnomonicPointSources empty_gnomonic = GNOMONIC_POINT_SOURCES_ZERO;
+  status = cartesian_to_gnomonic(&empty, center, center_velocity, &reused);
+  ut_assert(status == 0 && reused.x.length == 0 && reused.t.length == 0, "empty input should empty the output");
+  cartesian_to_gnomonic(&small, center, center_velocity, &reused);
+  status = cartesian_to_gnomonic(&small, bad_center, center_velocity, &reused);
+  ut_assert(status == CT_ERR_INVALID_CENTER, "bad center should fail");
+  ut_assert(reused.x.length == 0 && reused.t.length == 0, "bad center should empty the output");
+
+  struct VecU32 rows = VECU32_ZERO;
+  cartesian_to_gnomonic_within(&small, center, center_velocity, 90.0, &reused, &rows);
+  status = cartesian_to_gnomonic_within(&small, bad_center, center_velocity, 90.0, &reused, &rows);
+  ut_assert(status == CT_ERR_INVALID_CENTER, "bad center should fail");
+  ut_assert(reused.x.length == 0 && rows.length == 0, "bad center should empty the filtered output");
+
+  status = gnomonic_to_cartesian(&empty_gnomonic, center, center_velocity, &directions);
+  ut_assert(status == 0 && directions.x.length == 0, "empty input should empty the inverse output");
+  gnomonic_to_cartesian(&fresh, center, center_velocity, &directions);
+  status = gnomonic_to_cartesian(&fresh, bad_center, center_velocity, &directions);
+  ut_assert(status == CT_ERR_INVALID_CENTER, "bad center should fail");
+  ut_assert(directions.x.length == 0 && directions.t.length == 0, "bad center should empty the inverse output");
+
+  // Likewise for each output of the batch projections.
+  struct CartesianOrbits orbits = CARTESIAN_ORBITS_ZERO, bad_orbits = CARTESIAN_ORBITS_ZERO;
+  cartesian_orbits_push(&orbits, center, center_velocity, 0.0);
+  cartesian_orbits_push(&orbits, center, center_velocity, 0.0);
+  cartesian_orbits_push(&bad_orbits, center, center_velocity, 0.0);
+  cartesian_orbits_push(&bad_orbits, bad_center, center_velocity, 0.0);
+  struct GnomonicPointSources batch[2] = {GNOMONIC_POINT_SOURCES_ZERO, GNOMONIC_POINT_SOURCES_ZERO};
+  struct CartesianPointSources batch_directions[2] = {CARTESIAN_POINT_SOURCES_ZERO, CARTESIAN_POINT_SOURCES_ZERO};
+  cartesian_to_gnomonic_batch(&small, &orbits, batch, NULL);
+  status = cartesian_to_gnomonic_batch(&empty, &orbits, batch, NULL);
+  ut_assert(status == 0 && batch[0].x.length == 0 && batch[1].x.length == 0,
+            "empty input should empty the batch outputs");
+  cartesian_to_gnomonic_batch(&small, &orbits, batch, NULL);
+  status = cartesian_to_gnomonic_batch(&small, &bad_orbits, batch, NULL);
+  ut_assert(status == CT_ERR_INVALID_CENTER, "bad orbit should fail");
+  ut_assert(batch[0].x.length == 0 && batch[1].x.length == 0, "bad orbit should empty the batch outputs");
+
+  cartesian_to_gnomonic_batch(&small, &orbits, batch, NULL);
+  gnomonic_to_cartesian_batch(batch, &orbits, batch_directions, NULL);
+  status = gnomonic_to_cartesian_batch(batch, &bad_orbits, batch_directions, NULL);
+  ut_assert(status == CT_ERR_INVALID_CENTER, "bad orbit should fail");
+  ut_assert(batch_directions[0].x.length == 0 && batch_directions[1].x.length == 0,
+            "bad orbit should empty the inverse batch outputs");
+
+  for (size_t i = 0; i < 2; i++) {
+    gnomonic_point_sources_free(&batch[i]);
+    cartesian_point_sources_free(&batch_directions[i]);
+  }
+  cartesian_orbits_free(&orbits);
+  cartesian_orbits_free(&bad_orbits);
+  vec_u32_free(&rows);
+  cartesian_point_sources_free(&directions);
+  gnomonic_point_sources_free(&large_gnomonic);
+  gnomonic_point_sources_free(&fresh);
+  gnomonic_point_sources_free(&reused);
+  cartesian_point_sources_free(&small);
+  cartesian_point_sources_free(&large);
+  return 0;
+}
+
+static char* test_reused_outputs_do_not_allocate(void) {
+  // Detections from eight exposures, and sixteen test orbits, each
+  // with its state at every exposure.
+  size_t n_points = 2 * PROJECTION_STREAM_BLOCK + 100, n_epochs = 8, n_orbits = 16;
+  struct CartesianPointSources cartesian = CARTESIAN_POINT_SOURCES_ZERO;
+  srand(15);
+  for (size_t i = 0; i < n_points; i++) {
+    cartesian_point_sources_push(&cartesian, 0.9 + (double)rand() / RAND_MAX * 0.4 - 0.2,
+                                 0.8 + (double)rand() / RAND_MAX * 0.4 - 0.2, 0.01,
+                                 56537.0 + (double)(i * n_epochs / n_points));
+  }
+  struct CartesianOrbits centers[16];
+  for (size_t o = 0; o < n_orbits; o++) {
+    centers[o] = (struct CartesianOrbits)CARTESIAN_ORBITS_ZERO;
+    for (size_t e = 0; e < n_epochs; e++) {
+      double position[3] = {0.9 + 0.01 * o, 0.8 - 0.005 * e, 0.01};
+      double velocity[3] = {-0.05, 0.05, 0.00001 * o};
+      cartesian_orbits_push(&centers[o], position, velocity, 56537.0 + (double)e);
+    }
+  }
+
+  struct GnomonicPointSources gnomonic = GNOMONIC_POINT_SOURCES_ZERO;
+  struct GnomonicPointSourcesF32 gnomonic_f32 = GNOMONIC_POINT_SOURCES_F32_ZERO;
+  struct GnomonicPointSources within = GNOMONIC_POINT_SOURCES_ZERO;
+  struct VecU32 rows = VECU32_ZERO;
+  struct CartesianPointSources directions = CARTESIAN_POINT_SOURCES_ZERO;
+  struct VecF64 ra = VECF64_ZERO, dec = VECF64_ZERO;
+
+  // The first sweep grows the outputs to their largest size; the
+  // second reuses them and must not allocate at all.
+  for (size_t sweep = 0; sweep < 2; sweep++) {
+    atomic_store(&allocations, 0);
+    for (size_t o = 0; o < n_orbits; o++) {
+      double center[3], center_velocity[3];
+      cartesian_orbits_get(&centers[o], 0, center, center_velocity);
+      int status = cartesian_to_gnomonic(&cartesian, center, center_velocity, &gnomonic);
+      status |= cartesian_to_gnomonic_f32(&cartesian, center, center_velocity, &gnomonic_f32);
+      status |= cartesian_to_gnomonic_within(&cartesian, center, center_velocity, 1.0 + 0.5 * o, &within, &rows);
+      status |= gnomonic_to_cartesian(&gnomonic, center, center_velocity, &directions);
+      status |= gnomonic_to_radec(&gnomonic, center, center_velocity, &ra, &dec);
+      status |= cartesian_to_gnomonic_epochs(&cartesian, &centers[o], &gnomonic);
+      ut_assert(status == 0, "projection failed");
+      ut_assert(gnomonic.x.length == n_points && ra.length == n_points, "wrong output length");
+    }
+  }
+  sprintf(message, "steady-state sweep made %zu allocations", atomic_load(&allocations));
+  ut_assert(atomic_load(&allocations) == 0, message);
+
+  vec_f64_free(&ra);
+  vec_f64_free(&dec);
+  cartesian_point_sources_free(&directions);
+  vec_u32_free(&rows);
+  gnomonic_point_sources_free(&within);
+  gnomonic_point_sources_f32_free(&gnomonic_f32);
+  gnomonic_point_sources_free(&gnomonic);
+  for (size_t o = 0; o < n_orbits; o++) {
+    cartesian_orbits_free(&centers[o]);
+  }
+  cartesian_point_sources_free(&cartesian);
+  return 0;
+}
+
 static char* all_tests() {
   ut_run_test(test_cartesian_to_gnomonic_projection);
+  ut_run_test(test_cartesian_to_gnomonic_f32);
+  ut_run_test(test_cartesian_to_gnomonic_stream);
+  ut_run_test(test_cartesian_to_gnomonic_within);
+  ut_run_test(test_gnomonic_rotation_matrices);
+  ut_run_test(test_cartesian_to_gnomonic_batch);
+  ut_run_test(test_cartesian_to_gnomonic_batch_placed);
+  ut_run_test(test_cartesian_to_gnomonic_epochs);
+  ut_run_test(test_cartesian_to_gnomonic_indexed);
+  ut_run_test(test_gnomonic_to_cartesian);
+  ut_run_test(test_gnomonic_to_radec);
+  ut_run_test(test_gnomonic_to_cartesian_batch);
+  ut_run_test(test_outputs_are_overwritten);
+  ut_run_test(test_reused_outputs_do_not_allocate);
   return 0;
 }
 
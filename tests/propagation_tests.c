@@ -0,0 +1,165 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "propagation.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+#define MU PROPAGATION_MU_SUN
+
+static int close_to(double a, double b, double tolerance) { return fabs(a - b) <= tolerance; }
+
+static char *test_circular_and_elliptic() {
+  struct CartesianOrbits orbits;
+  cartesian_orbits_new(&orbits, 2);
+  // A circular orbit at 1 AU, and an orbit with e = 0.5 at perihelion.
+  double circular_pos[3] = {1.0, 0.0, 0.0};
+  double circular_vel[3] = {0.0, sqrt(MU), 0.0};
+  cartesian_orbits_push(&orbits, circular_pos, circular_vel, 59000.0);
+  double a = 2.0, e = 0.5;
+  double perihelion[3] = {a * (1 - e), 0.0, 0.0};
+  double perihelion_vel[3] = {0.0, 0.0, sqrt(MU / a * (1 + e) / (1 - e))};
+  cartesian_orbits_push(&orbits, perihelion, perihelion_vel, 59000.0);
+
+  double circular_period = 2.0 * M_PI / sqrt(MU);
+  double elliptic_period = 2.0 * M_PI * sqrt(a * a * a / MU);
+  double epochs[3] = {59000.0 + circular_period / 4, 59000.0 + elliptic_period / 2,
+                      59000.0 + 10 * circular_period + circular_period / 4};
+
+  struct CartesianOrbits out;
+  cartesian_orbits_new(&out, 1);
+  enum PropagationError status = propagate_orbits(&orbits, epochs, 3, MU, NULL, &out);
+  ut_assert(status == PROPAGATION_ERROR_NONE, "propagate_orbits failed");
+  ut_assert(out.x.length == 6, "wrong output length");
+
+  // Quarter of a circular orbit, directly and ten revolutions later.
+  double pos[3], vel[3];
+  for (size_t row = 0; row < 3; row += 2) {
+    cartesian_orbits_get(&out, row, pos, vel);
+    ut_assert(close_to(pos[0], 0.0, 1e-12) && close_to(pos[1], 1.0, 1e-12), "wrong circular position");
+    ut_assert(close_to(vel[0], -sqrt(MU), 1e-14) && close_to(vel[1], 0.0, 1e-14), "wrong circular velocity");
+    ut_assert(out.t.data[row] == epochs[row], "wrong epoch");
+  }
+
+  // Half an elliptic orbit reaches aphelion.
+  cartesian_orbits_get(&out, 4, pos, vel);
+  ut_assert(close_to(pos[0], -a * (1 + e), 1e-11) && close_to(pos[2], 0.0, 1e-11), "wrong aphelion");
+
+  cartesian_orbits_free(&out);
+  cartesian_orbits_free(&orbits);
+  return 0;
+}
+
+static double energy(double pos[3], double vel[3]) {
+  double r = sqrt(pos[0] * pos[0] + pos[1] * pos[1] + pos[2] * pos[2]);
+  return 0.5 * (vel[0] * vel[0] + vel[1] * vel[1] + vel[2] * vel[2]) - MU / r;
+}
+
+static char *test_conservation_and_round_trip() {
+  // Bound and unbound orbits, in a count that leaves partial blocks.
+  size_t n_orbits = 70;
+  struct CartesianOrbits orbits;
+  cartesian_orbits_new(&orbits, n_orbits);
+  srand(3);
+  for (size_t i = 0; i < n_orbits; i++) {
+    double pos[3], vel[3];
+    for (int d = 0; d < 3; d++) {
+      pos[d] = 4.0 * rand() / RAND_MAX - 2.0;
+      vel[d] = (0.04 * rand() / RAND_MAX - 0.02) * (i % 7 == 0 ? 3.0 : 1.0);
+    }
+    cartesian_orbits_push(&orbits, pos, vel, 59000.0 + i);
+  }
+  double epochs[4] = {58000.0, 59000.0, 59030.5, 62650.0};
+
+  struct ThreadPool pool;
+  thread_pool_new(&pool, 3);
+  struct CartesianOrbits out;
+  cartesian_orbits_new(&out, 1);
+  enum PropagationError status = propagate_orbits(&orbits, epochs, 4, MU, &pool, &out);
+  ut_assert(status == PROPAGATION_ERROR_NONE, "propagate_orbits failed");
+  ut_assert(out.x.length == n_orbits * 4, "wrong output length");
+
+  // Threaded and inline runs agree exactly.
+  struct CartesianOrbits inline_out;
+  cartesian_orbits_new(&inline_out, 1);
+  status = propagate_orbits(&orbits, epochs, 4, MU, NULL, &inline_out);
+  ut_assert(status == PROPAGATION_ERROR_NONE, "propagate_orbits failed");
+  for (size_t row = 0; row < out.x.length; row++) {
+    ut_assert(out.x.data[row] == inline_out.x.data[row] && out.vz.data[row] == inline_out.vz.data[row],
+              "threaded result differs from inline result");
+  }
+
+  for (size_t i = 0; i < n_orbits; i++) {
+    double pos0[3], vel0[3];
+    cartesian_orbits_get(&orbits, i, pos0, vel0);
+    double h0[3] = {pos0[1] * vel0[2] - pos0[2] * vel0[1], pos0[2] * vel0[0] - pos0[0] * vel0[2],
+                    pos0[0] * vel0[1] - pos0[1] * vel0[0]};
+    for (size_t e = 0; e < 4; e++) {
+      double pos[3], vel[3];
+      cartesian_orbits_get(&out, i * 4 + e, pos, vel);
+      ut_assert(close_to(energy(pos, vel), energy(pos0, vel0), 1e-12), "energy not conserved");
+      double h[3] = {pos[1] * vel[2] - pos[2] * vel[1], pos[2] * vel[0] - pos[0] * vel[2],
+                     pos[0] * vel[1] - pos[1] * vel[0]};
+      for (int d = 0; d < 3; d++) {
+        ut_assert(close_to(h[d], h0[d], 1e-12), "angular momentum not conserved");
+      }
+    }
+
+    // Propagating back to the starting epoch recovers the start.
+    struct CartesianOrbits one, back;
+    cartesian_orbits_new(&one, 1);
+    cartesian_orbits_new(&back, 1);
+    double pos[3], vel[3];
+    cartesian_orbits_get(&out, i * 4 + 2, pos, vel);
+    cartesian_orbits_push(&one, pos, vel, epochs[2]);
+    status = propagate_orbits(&one, &orbits.t.data[i], 1, MU, NULL, &back);
+    ut_assert(status == PROPAGATION_ERROR_NONE, "propagate_orbits failed");
+    cartesian_orbits_get(&back, 0, pos, vel);
+    for (int d = 0; d < 3; d++) {
+      ut_assert(close_to(pos[d], pos0[d], 1e-9), "round trip position differs");
+      ut_assert(close_to(vel[d], vel0[d], 1e-11), "round trip velocity differs");
+    }
+    cartesian_orbits_free(&back);
+    cartesian_orbits_free(&one);
+  }
+
+  // A used output is overwritten from row 0, and left empty on failure.
+  double *storage = inline_out.x.data;
+  status = propagate_orbits(&orbits, &epochs[3], 1, MU, &pool, &inline_out);
+  ut_assert(status == PROPAGATION_ERROR_NONE, "propagate_orbits failed");
+  ut_assert(inline_out.x.length == n_orbits && inline_out.t.length == n_orbits, "wrong length on reuse");
+  ut_assert(inline_out.x.data == storage, "reused output should keep its storage");
+  for (size_t i = 0; i < n_orbits; i++) {
+    ut_assert(inline_out.x.data[i] == out.x.data[i * 4 + 3] && inline_out.vz.data[i] == out.vz.data[i * 4 + 3] &&
+                  inline_out.t.data[i] == epochs[3],
+              "reused output differs from a fresh one");
+  }
+  status = propagate_orbits(&orbits, epochs, 4, -MU, NULL, &inline_out);
+  ut_assert(status == PROPAGATION_ERROR_INVALID_ARGUMENT, "negative mu should fail");
+  ut_assert(inline_out.x.length == 0 && inline_out.vz.length == 0, "failed output should be empty");
+
+  cartesian_orbits_free(&inline_out);
+  cartesian_orbits_free(&out);
+  thread_pool_free(&pool);
+  cartesian_orbits_free(&orbits);
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_circular_and_elliptic);
+  ut_run_test(test_conservation_and_round_trip);
+  return 0;
+}
+
+int main(void) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "shift_and_stack.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+#define N_VX 21
+#define N_VY 21
+
+static void velocity_grid(double *vx, double *vy) {
+  // -0.2 to 0.2 degrees per day in steps of 0.02, in both axes.
+  for (size_t i = 0; i < N_VX; i++) {
+    for (size_t j = 0; j < N_VY; j++) {
+      vx[i * N_VY + j] = -0.2 + 0.02 * i;
+      vy[i * N_VY + j] = -0.2 + 0.02 * j;
+    }
+  }
+}
+
+static char *test_shift_and_stack_finds_mover() {
+  struct GnomonicPointSources gnomonic;
+  gnomonic_point_sources_new(&gnomonic, 64);
+
+  // An object moving at (0.1, -0.06) degrees per day, seen on 6 nights,
+  // starting from (0.305, 0.505) at t0.
+  for (size_t night = 0; night < 6; night++) {
+    double t = 59000.0 + night;
+    gnomonic_point_sources_push(&gnomonic, 0.305 + 0.1 * night, 0.505 - 0.06 * night, t);
+  }
+  // Scattered background.
+  srand(11);
+  for (size_t i = 0; i < 50; i++) {
+    gnomonic_point_sources_push(&gnomonic, (double)rand() / RAND_MAX * 2 - 1, (double)rand() / RAND_MAX * 2 - 1,
+                                59000.0 + rand() % 6);
+  }
+
+  double vx[N_VX * N_VY], vy[N_VX * N_VY];
+  velocity_grid(vx, vy);
+  struct ShiftStackParams params = {
+      .t0 = 59000.0, .bin_size = 0.01, .x_min = -1.0, .x_max = 1.0, .y_min = -1.0, .y_max = 1.0, .min_count = 5};
+
+  struct ShiftStackHits hits = SHIFT_STACK_HITS_ZERO;
+  enum ShiftStackError status = shift_and_stack(&gnomonic, vx, vy, N_VX * N_VY, &params, NULL, &hits);
+  ut_assert(status == SHIFT_STACK_ERROR_NONE, "shift_and_stack failed");
+  ut_assert(hits.length == 1, "expected exactly one dense bin");
+  ut_assert_feq(vx[hits.velocity[0]], 0.1);
+  ut_assert_feq(vy[hits.velocity[0]], -0.06);
+  ut_assert(hits.bin_x[0] == 130, "wrong bin x");
+  ut_assert(hits.bin_y[0] == 150, "wrong bin y");
+  ut_assert(hits.count[0] == 6, "wrong count");
+
+  // Splitting velocities across threads gives the same answer.
+  struct ThreadPool pool;
+  thread_pool_new(&pool, 3);
+  struct ShiftStackHits threaded = SHIFT_STACK_HITS_ZERO;
+  params.min_count = 2;
+  shift_stack_hits_free(&hits);
+  status = shift_and_stack(&gnomonic, vx, vy, N_VX * N_VY, &params, NULL, &hits);
+  ut_assert(status == SHIFT_STACK_ERROR_NONE, "shift_and_stack failed");
+  status = shift_and_stack(&gnomonic, vx, vy, N_VX * N_VY, &params, &pool, &threaded);
+  ut_assert(status == SHIFT_STACK_ERROR_NONE, "threaded shift_and_stack failed");
+  ut_assert(hits.length > 1, "expected chance pairs at min_count=2");
+  ut_assert(threaded.length == hits.length, "threaded search found a different number of bins");
+  for (size_t i = 0; i < hits.length; i++) {
+    ut_assert(threaded.velocity[i] == hits.velocity[i], "threaded velocity differs");
+    ut_assert(threaded.bin_x[i] == hits.bin_x[i], "threaded bin_x differs");
+    ut_assert(threaded.bin_y[i] == hits.bin_y[i], "threaded bin_y differs");
+    ut_assert(threaded.count[i] == hits.count[i], "threaded count differs");
+    if (i > 0) {
+      ut_assert(hits.velocity[i] >= hits.velocity[i - 1], "hits not ordered by velocity");
+    }
+  }
+
+  thread_pool_free(&pool);
+  shift_stack_hits_free(&threaded);
+  shift_stack_hits_free(&hits);
+  gnomonic_point_sources_free(&gnomonic);
+  return 0;
+}
+
+static char *test_shift_and_stack_invalid_params() {
+  struct GnomonicPointSources gnomonic;
+  gnomonic_point_sources_new(&gnomonic, 1);
+  double vx = 0.0, vy = 0.0;
+  struct ShiftStackParams params = {
+      .t0 = 0.0, .bin_size = 0.0, .x_min = -1.0, .x_max = 1.0, .y_min = -1.0, .y_max = 1.0, .min_count = 1};
+  struct ShiftStackHits hits = SHIFT_STACK_HITS_ZERO;
+  enum ShiftStackError status = shift_and_stack(&gnomonic, &vx, &vy, 1, &params, NULL, &hits);
+  ut_assert(status == SHIFT_STACK_ERROR_INVALID_ARGUMENT, "zero bin size should be rejected");
+  gnomonic_point_sources_free(&gnomonic);
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_shift_and_stack_finds_mover);
+  ut_run_test(test_shift_and_stack_invalid_params);
+  return 0;
+}
+
+int main(void) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
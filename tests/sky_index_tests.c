@@ -0,0 +1,147 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sky_index.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+static uint64_t rng_state = 12345;
+
+static double uniform(void) {
+  rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (double)(rng_state >> 11) / 9007199254740992.0;
+}
+
+static void random_direction(double out[3]) {
+  double z = 2.0 * uniform() - 1.0;
+  double phi = 2.0 * M_PI * uniform();
+  double s = sqrt(1.0 - z * z);
+  out[0] = s * cos(phi);
+  out[1] = s * sin(phi);
+  out[2] = z;
+}
+
+static double angle_deg(const double a[3], const double b[3]) {
+  double na = sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+  double nb = sqrt(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+  double c = (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / (na * nb);
+  return acos(fmax(-1.0, fmin(1.0, c))) * 180.0 / M_PI;
+}
+
+static char *test_cells() {
+  struct CartesianPointSources empty;
+  cartesian_point_sources_new(&empty, 1);
+  struct SkyIndex index;
+  enum SkyIndexError status = sky_index_new(&index, &empty, 8);
+  ut_assert(status == SKY_INDEX_ERROR_NONE, "sky_index_new failed");
+  ut_assert(index.n_cells == 6 * 8 * 8, "wrong cell count");
+  ut_assert(index.n_epochs == 0, "empty index should have no epochs");
+
+  // Every direction lies within its cell's radius of the cell's center.
+  for (int i = 0; i < 10000; i++) {
+    double d[3];
+    random_direction(d);
+    uint32_t c = sky_index_cell(&index, d);
+    ut_assert(c < index.n_cells, "cell out of range");
+    const double *center = index.cell_centers + 3 * c;
+    double cos_angle = center[0] * d[0] + center[1] * d[1] + center[2] * d[2];
+    ut_assert(cos_angle >= index.cell_cos_radius[c] - 1e-12, "direction outside its cell");
+  }
+
+  // A zero radius cone still finds the cell of its own direction.
+  uint32_t cells[6 * 8 * 8];
+  double axis[3] = {0.3, -0.2, 0.9};
+  size_t n = sky_index_cone_cells(&index, axis, 0.0, cells);
+  ut_assert(n >= 1, "zero radius cone found no cells");
+  int found = 0;
+  for (size_t k = 0; k < n; k++) {
+    found |= cells[k] == sky_index_cell(&index, axis);
+  }
+  ut_assert(found, "zero radius cone missed its own cell");
+  ut_assert(sky_index_cone_cells(&index, axis, 180.0, cells) == index.n_cells, "full sky cone missed cells");
+  ut_assert(sky_index_cone_cells(&index, axis, -1.0, cells) == 0, "negative radius found cells");
+
+  sky_index_free(&index);
+  cartesian_point_sources_free(&empty);
+  return 0;
+}
+
+static char *test_query_matches_brute_force() {
+  size_t n = 20000;
+  double epochs[3] = {59000.0, 59000.5, 59001.0};
+  struct CartesianPointSources cartesian;
+  cartesian_point_sources_new(&cartesian, n);
+  for (size_t i = 0; i < n; i++) {
+    double d[3];
+    random_direction(d);
+    double r = 1.0 + 3.0 * uniform();
+    cartesian_point_sources_push(&cartesian, r * d[0], r * d[1], r * d[2], epochs[i % 3]);
+  }
+  // Unindexable detections are left out.
+  cartesian_point_sources_push(&cartesian, 0.0, 0.0, 0.0, epochs[0]);
+  cartesian_point_sources_push(&cartesian, NAN, 1.0, 1.0, epochs[0]);
+
+  struct SkyIndex index;
+  enum SkyIndexError status = sky_index_new(&index, &cartesian, SKY_INDEX_DEFAULT_RESOLUTION);
+  ut_assert(status == SKY_INDEX_ERROR_NONE, "sky_index_new failed");
+  ut_assert(index.n_epochs == 3, "wrong epoch count");
+  ut_assert(index.points.x.length == n, "wrong indexed point count");
+
+  int *selected = malloc(n * sizeof(int));
+  for (int trial = 0; trial < 20; trial++) {
+    double axis[3];
+    random_direction(axis);
+    double radius = 0.5 + 15.0 * uniform();
+    struct SkyIndexRuns runs = SKY_INDEX_RUNS_ZERO;
+    // Query the last two epochs only.
+    status = sky_index_query(&index, 1, 3, axis, radius, &runs);
+    ut_assert(status == SKY_INDEX_ERROR_NONE, "sky_index_query failed");
+
+    for (size_t i = 0; i < n; i++) {
+      selected[i] = 0;
+    }
+    double last_t = 0.0;
+    for (size_t r = 0; r < runs.length; r++) {
+      ut_assert(runs.start[r] < runs.end[r], "empty run");
+      for (size_t k = runs.start[r]; k < runs.end[r]; k++) {
+        uint32_t row = index.rows[k];
+        ut_assert(index.points.x.data[k] == cartesian.x.data[row], "row mapping is wrong");
+        ut_assert(index.points.t.data[k] >= last_t, "runs out of epoch order");
+        last_t = index.points.t.data[k];
+        selected[row]++;
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      double p[3] = {cartesian.x.data[i], cartesian.y.data[i], cartesian.z.data[i]};
+      int wanted = cartesian.t.data[i] != epochs[0] && angle_deg(p, axis) <= radius;
+      ut_assert(selected[i] <= 1, "detection returned twice");
+      ut_assert(!wanted || selected[i], "detection inside the cone was culled");
+      ut_assert(cartesian.t.data[i] != epochs[0] || !selected[i], "detection from an unqueried epoch");
+    }
+    sky_index_runs_free(&runs);
+  }
+
+  free(selected);
+  sky_index_free(&index);
+  cartesian_point_sources_free(&cartesian);
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_cells);
+  ut_run_test(test_query_matches_brute_force);
+  return 0;
+}
+
+int main(void) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
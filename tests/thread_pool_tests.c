@@ -0,0 +1,168 @@
+// For sched_getcpu.
+#define _GNU_SOURCE
+
+#include <sched.h>
+#include <stdio.h>
+
+#include "thread_pool.h"
+#include "unittests.h"
+
+int tests_run = 0;
+
+static void increment(void *arg) { __atomic_fetch_add((size_t *)arg, 1, __ATOMIC_RELAXED); }
+
+struct SpawnArgs {
+  struct ThreadPool *pool;
+  size_t *counter;
+};
+
+static void spawn_children(void *arg) {
+  struct SpawnArgs *spawn = arg;
+  for (size_t i = 0; i < 10; i++) {
+    thread_pool_submit(spawn->pool, increment, spawn->counter);
+  }
+}
+
+static char *test_thread_pool_runs_all_tasks() {
+  struct ThreadPool pool;
+  int status = thread_pool_new(&pool, 4);
+  ut_assert(status == 0, "thread_pool_new failed");
+  ut_assert(pool.n_threads == 4, "wrong number of threads");
+
+  size_t counter = 0;
+  // More tasks than the initial queue capacity, so the queues grow.
+  for (size_t i = 0; i < 1000; i++) {
+    status = thread_pool_submit(&pool, increment, &counter);
+    ut_assert(status == 0, "thread_pool_submit failed");
+  }
+  thread_pool_wait(&pool);
+  ut_assert(counter == 1000, "not every task ran");
+
+  // The pool is reusable after a wait.
+  for (size_t i = 0; i < 10; i++) {
+    thread_pool_submit(&pool, increment, &counter);
+  }
+  thread_pool_wait(&pool);
+  ut_assert(counter == 1010, "not every task ran on reuse");
+
+  thread_pool_free(&pool);
+  return 0;
+}
+
+static char *test_thread_pool_nested_submit() {
+  struct ThreadPool pool;
+  int status = thread_pool_new(&pool, 3);
+  ut_assert(status == 0, "thread_pool_new failed");
+
+  size_t counter = 0;
+  struct SpawnArgs spawn = {.pool = &pool, .counter = &counter};
+  for (size_t i = 0; i < 20; i++) {
+    thread_pool_submit(&pool, spawn_children, &spawn);
+  }
+  thread_pool_wait(&pool);
+  ut_assert(counter == 200, "tasks submitted from tasks did not all run");
+
+  thread_pool_free(&pool);
+  return 0;
+}
+
+static char *test_thread_pool_default_size() {
+  struct ThreadPool pool;
+  int status = thread_pool_new(&pool, 0);
+  ut_assert(status == 0, "thread_pool_new failed");
+  ut_assert(pool.n_threads >= 1, "default pool has no threads");
+  thread_pool_free(&pool);
+  return 0;
+}
+
+struct CpuRecord {
+  int cpu;
+};
+
+static void record_cpu(void *arg) { ((struct CpuRecord *)arg)->cpu = sched_getcpu(); }
+
+static char *test_thread_pool_pinned() {
+  struct NumaTopology topology;
+  int status = numa_topology_new(&topology);
+  ut_assert(status == 0, "numa_topology_new failed");
+
+  struct ThreadPool pool;
+  status = thread_pool_new_pinned(&pool, 0, NULL);
+  ut_assert(status == 0, "thread_pool_new_pinned failed");
+  ut_assert(pool.n_threads == topology.n_cpus, "default pinned pool should have one worker per CPU");
+  ut_assert(pool.n_nodes == topology.n_nodes, "pool should span the machine's nodes");
+  ut_assert(pool.node_offsets[pool.n_nodes] == pool.n_threads, "every worker should be on a node");
+
+  // Every task runs on one of the pool's CPUs.
+  struct CpuRecord records[64];
+  for (size_t i = 0; i < 64; i++) {
+    records[i].cpu = -1;
+    status = thread_pool_submit_to_node(&pool, i % pool.n_nodes, record_cpu, &records[i]);
+    ut_assert(status == 0, "thread_pool_submit_to_node failed");
+  }
+  thread_pool_wait(&pool);
+  for (size_t i = 0; i < 64; i++) {
+    int known = 0;
+    for (size_t c = 0; c < topology.n_cpus; c++) {
+      known |= records[i].cpu == topology.cpus[c];
+    }
+    ut_assert(known, "task ran off the pool's CPUs");
+  }
+  ut_assert(thread_pool_submit_to_node(&pool, pool.n_nodes, record_cpu, &records[0]) != 0,
+            "submitting to a missing node should fail");
+
+  thread_pool_free(&pool);
+  numa_topology_free(&topology);
+  return 0;
+}
+
+static char *test_thread_pool_nodes() {
+  // Two nodes sharing one CPU, which any machine has, so the
+  // multi-node paths run everywhere. The second node has twice the
+  // CPUs, and gets twice the workers.
+  int cpus[3] = {0, 0, 0};
+  size_t node_offsets[3] = {0, 1, 3};
+  struct NumaTopology topology = {.n_nodes = 2, .n_cpus = 3, .cpus = cpus, .node_offsets = node_offsets};
+
+  struct ThreadPool pool;
+  int status = thread_pool_new_pinned(&pool, 6, &topology);
+  ut_assert(status == 0, "thread_pool_new_pinned failed");
+  ut_assert(pool.n_nodes == 2, "wrong number of nodes");
+  ut_assert(pool.node_offsets[0] == 0 && pool.node_offsets[1] == 2 && pool.node_offsets[2] == 6,
+            "workers should be split in proportion to CPUs");
+
+  size_t counter = 0;
+  for (size_t i = 0; i < 1000; i++) {
+    status = thread_pool_submit_to_node(&pool, i % 2, increment, &counter);
+    ut_assert(status == 0, "thread_pool_submit_to_node failed");
+  }
+  struct SpawnArgs spawn = {.pool = &pool, .counter = &counter};
+  for (size_t i = 0; i < 20; i++) {
+    thread_pool_submit_to_node(&pool, 1, spawn_children, &spawn);
+  }
+  thread_pool_wait(&pool);
+  ut_assert(counter == 1200, "not every task ran");
+
+  thread_pool_free(&pool);
+  return 0;
+}
+
+static char *all_tests() {
+  ut_run_test(test_thread_pool_runs_all_tasks);
+  ut_run_test(test_thread_pool_nested_submit);
+  ut_run_test(test_thread_pool_default_size);
+  ut_run_test(test_thread_pool_pinned);
+  ut_run_test(test_thread_pool_nodes);
+  return 0;
+}
+
+int main(void) {
+  char *result = all_tests();
+  if (result != 0) {
+    printf("FAILURE: %s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
@@ -1,3 +1,4 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -6,21 +7,66 @@
 
 int tests_run = 0;
 
-static char *test_vector_new() {
-  struct Vec vec;
-  vector_new(&vec, 10, sizeof(double));
-  ut_assert(vec.length == 0, "wrong length");
-  ut_assert(vec.capacity == 10, "wrong capacity");
-  ut_assert(vec.item_size == sizeof(double), "wrong item size");
-  ut_assert(vec.data != NULL, "data is null");
-  vector_free(&vec);
+static char *test_vec_i64() {
+  struct VecI64 vec;
+  int status = vec_i64_new(&vec, 0);
+  ut_assert(status == -1, "invalid capacity");
+  status = vec_i64_new(&vec, 1);
+  ut_assert(status == 0, "new failed");
+  for (int64_t i = 0; i < 100; i++) {
+    vec_i64_push(&vec, i - (INT64_C(1) << 40));
+  }
+  ut_assert(vec.length == 100, "wrong length");
+  int64_t value;
+  status = vec_i64_get(&vec, 42, &value);
+  ut_assert(status == 0 && value == 42 - (INT64_C(1) << 40), "wrong value");
+  status = vec_i64_get(&vec, 100, &value);
+  ut_assert(status == -1, "get past the end should fail");
+  vec_i64_free(&vec);
   return 0;
 }
 
-static char *test_vector_new_invalid_capacity() {
-  struct Vec vec;
-  int status = vector_new(&vec, 0, sizeof(double));
-  ut_assert(status == -1, "invalid capacity");
+static char *test_vec_alignment() {
+  struct VecF64 f64 = VECF64_ZERO;
+  struct VecF32 f32 = VECF32_ZERO;
+  struct VecU16 u16 = VECU16_ZERO;
+  struct VecU32 u32 = VECU32_ZERO;
+  struct VecI64 i64 = VECI64_ZERO;
+  ut_assert(vec_f64_new(&f64, 3) == 0 && vec_u16_new(&u16, 3) == 0, "new failed");
+  ut_assert((uintptr_t)f64.data % VEC_ALIGNMENT == 0, "new f64 storage is not aligned");
+  ut_assert((uintptr_t)u16.data % VEC_ALIGNMENT == 0, "new u16 storage is not aligned");
+  // Storage stays aligned as it grows, from empty or from a first
+  // allocation.
+  for (int i = 0; i < 1000; i++) {
+    vec_f64_push(&f64, i);
+    vec_f32_push(&f32, (float)i);
+    vec_u16_push(&u16, (uint16_t)i);
+    vec_u32_push(&u32, (uint32_t)i);
+    vec_i64_push(&i64, i);
+    ut_assert((uintptr_t)f64.data % VEC_ALIGNMENT == 0, "grown f64 storage is not aligned");
+    ut_assert((uintptr_t)f32.data % VEC_ALIGNMENT == 0, "grown f32 storage is not aligned");
+    ut_assert((uintptr_t)u16.data % VEC_ALIGNMENT == 0, "grown u16 storage is not aligned");
+    ut_assert((uintptr_t)u32.data % VEC_ALIGNMENT == 0, "grown u32 storage is not aligned");
+    ut_assert((uintptr_t)i64.data % VEC_ALIGNMENT == 0, "grown i64 storage is not aligned");
+  }
+  ut_assert(f64.data[999] == 999 && f32.data[500] == 500 && u16.data[7] == 7 && u32.data[998] == 998 &&
+                i64.data[1] == 1,
+            "growth lost items");
+
+  // A view copies into aligned storage when it grows.
+  double backing[3] = {1, 2, 3};
+  struct VecF64 view;
+  vec_f64_view(&view, backing + 1, 2);
+  ut_assert(vec_f64_push(&view, 4) == 0, "push onto view failed");
+  ut_assert((uintptr_t)view.data % VEC_ALIGNMENT == 0, "grown view is not aligned");
+  ut_assert(view.data[0] == 2 && view.data[2] == 4, "wrong values after growing view");
+
+  vec_f64_free(&view);
+  vec_f64_free(&f64);
+  vec_f32_free(&f32);
+  vec_u16_free(&u16);
+  vec_u32_free(&u32);
+  vec_i64_free(&i64);
   return 0;
 }
 
@@ -104,13 +150,157 @@ static char *test_vec_f64_get() {
   return 0;
 }
 
+static char *test_vec_f64_view() {
+  double backing[3] = {1.0, 2.0, 3.0};
+  struct VecF64 vec;
+  vec_f64_view(&vec, backing, 3);
+  ut_assert(vec.length == 3, "wrong length");
+  ut_assert(vec.borrowed, "view should be borrowed");
+  ut_assert(vec.data == backing, "view should not copy");
+
+  // Growing a view copies it, leaving the backing memory untouched.
+  vec_f64_push(&vec, 4.0);
+  ut_assert(!vec.borrowed, "push should have copied the view");
+  ut_assert(vec.data != backing, "push should have moved the data");
+  ut_assert(vec.length == 4, "wrong length after push");
+  ut_assert(vec.data[0] == 1.0 && vec.data[3] == 4.0, "wrong values after push");
+  ut_assert(backing[2] == 3.0, "backing memory changed");
+  vec_f64_free(&vec);
+
+  // Freeing a view does not free the backing memory.
+  vec_f64_view(&vec, backing, 3);
+  vec_f64_free(&vec);
+  ut_assert(vec.data == NULL, "free should clear data");
+  return 0;
+}
+
+static char *test_vec_u16() {
+  struct VecU16 vec;
+  int status = vec_u16_new(&vec, 1);
+  ut_assert(status == 0, "new failed");
+  for (uint16_t i = 0; i < 100; i++) {
+    vec_u16_push(&vec, i * 7);
+  }
+  ut_assert(vec.length == 100, "wrong length");
+  uint16_t value;
+  status = vec_u16_get(&vec, 42, &value);
+  ut_assert(status == 0 && value == 42 * 7, "wrong value");
+  status = vec_u16_get(&vec, 100, &value);
+  ut_assert(status == -1, "get past the end should fail");
+  vec_u16_free(&vec);
+
+  uint16_t backing[2] = {5, 6};
+  vec_u16_view(&vec, backing, 2);
+  vec_u16_push(&vec, 7);
+  ut_assert(!vec.borrowed && vec.data[1] == 6 && vec.data[2] == 7, "push should have copied the view");
+  vec_u16_free(&vec);
+  return 0;
+}
+
+static char *test_vec_f32() {
+  struct VecF32 vec;
+  int status = vec_f32_new(&vec, 1);
+  ut_assert(status == 0, "new failed");
+  for (int i = 0; i < 100; i++) {
+    vec_f32_push(&vec, i * 0.5f);
+  }
+  ut_assert(vec.length == 100, "wrong length");
+  float value;
+  status = vec_f32_get(&vec, 42, &value);
+  ut_assert(status == 0 && value == 21.0f, "wrong value");
+  status = vec_f32_get(&vec, 100, &value);
+  ut_assert(status == -1, "get past the end should fail");
+  vec_f32_free(&vec);
+
+  float backing[2] = {5, 6};
+  vec_f32_view(&vec, backing, 2);
+  vec_f32_push(&vec, 7);
+  ut_assert(!vec.borrowed && vec.data[1] == 6 && vec.data[2] == 7, "push should have copied the view");
+  vec_f32_free(&vec);
+  return 0;
+}
+
+static char *test_vec_f64_bulk() {
+  struct VecF64 vec;
+  int status = vec_f64_new(&vec, 2);
+  ut_assert(status == 0, "new failed");
+
+  double items[5] = {1, 2, 3, 4, 5};
+  status = vec_f64_append(&vec, items, 5);
+  ut_assert(status == 0 && vec.length == 5 && vec.capacity >= 5, "append failed");
+  status = vec_f64_append(&vec, items, 2);
+  ut_assert(status == 0 && vec.length == 7, "second append failed");
+  ut_assert(vec.data[4] == 5 && vec.data[5] == 1 && vec.data[6] == 2, "wrong appended values");
+  status = vec_f64_append(&vec, NULL, 0);
+  ut_assert(status == 0 && vec.length == 7, "empty append should do nothing");
+
+  size_t capacity = vec.capacity;
+  vec_f64_clear(&vec);
+  ut_assert(vec.length == 0 && vec.capacity == capacity, "clear should keep the capacity");
+
+  status = vec_f64_resize(&vec, 100);
+  ut_assert(status == 0 && vec.length == 100 && vec.capacity >= 100, "resize failed");
+  vec.data[99] = 42;
+  status = vec_f64_resize(&vec, 3);
+  ut_assert(status == 0 && vec.length == 3 && vec.capacity >= 100, "shrinking resize should keep the capacity");
+
+  status = vec_f64_push(&vec, 7);
+  ut_assert(status == 0 && vec.length == 4 && vec.data[3] == 7, "push failed");
+
+  status = vec_f64_reserve(&vec, SIZE_MAX / 2);
+  ut_assert(status == -1 && vec.length == 4 && vec.data[3] == 7, "overflowing reserve should fail cleanly");
+  vec_f64_free(&vec);
+
+  double backing[2] = {5, 6};
+  vec_f64_view(&vec, backing, 2);
+  vec_f64_clear(&vec);
+  ut_assert(vec.borrowed && vec.data == backing, "clearing a view should not copy it");
+  status = vec_f64_append(&vec, items, 3);
+  ut_assert(status == 0 && !vec.borrowed && vec.data[2] == 3, "append should have copied the view");
+  ut_assert(backing[0] == 5, "append should not write to the view");
+  vec_f64_free(&vec);
+  return 0;
+}
+
+static char *test_vec_bulk_other_types() {
+  struct VecU16 u16 = VECU16_ZERO;
+  uint16_t u16_items[3] = {1, 2, 3};
+  ut_assert(vec_u16_append(&u16, u16_items, 3) == 0 && u16.length == 3, "u16 append failed");
+  ut_assert(vec_u16_resize(&u16, 10) == 0 && u16.length == 10, "u16 resize failed");
+  vec_u16_clear(&u16);
+  ut_assert(u16.length == 0 && u16.capacity >= 10, "u16 clear failed");
+  vec_u16_free(&u16);
+
+  struct VecU32 u32 = VECU32_ZERO;
+  uint32_t u32_items[3] = {1, 2, 3};
+  ut_assert(vec_u32_append(&u32, u32_items, 3) == 0 && u32.data[2] == 3, "u32 append failed");
+  ut_assert(vec_u32_resize(&u32, 10) == 0 && u32.length == 10, "u32 resize failed");
+  vec_u32_clear(&u32);
+  ut_assert(u32.length == 0 && u32.capacity >= 10, "u32 clear failed");
+  vec_u32_free(&u32);
+
+  struct VecF32 f32 = VECF32_ZERO;
+  float f32_items[3] = {1, 2, 3};
+  ut_assert(vec_f32_append(&f32, f32_items, 3) == 0 && f32.data[2] == 3, "f32 append failed");
+  ut_assert(vec_f32_resize(&f32, 10) == 0 && f32.length == 10, "f32 resize failed");
+  vec_f32_clear(&f32);
+  ut_assert(f32.length == 0 && f32.capacity >= 10, "f32 clear failed");
+  vec_f32_free(&f32);
+  return 0;
+}
+
 static char *all_tests() {
-  ut_run_test(test_vector_new);
-  ut_run_test(test_vector_new_invalid_capacity);
   ut_run_test(test_vec_f64_new);
   ut_run_test(test_vec_f64_new_invalid_capacity);
   ut_run_test(test_vec_f64_push);
   ut_run_test(test_vec_f64_get);
+  ut_run_test(test_vec_f64_view);
+  ut_run_test(test_vec_u16);
+  ut_run_test(test_vec_f32);
+  ut_run_test(test_vec_f64_bulk);
+  ut_run_test(test_vec_bulk_other_types);
+  ut_run_test(test_vec_i64);
+  ut_run_test(test_vec_alignment);
   return 0;
 }
 